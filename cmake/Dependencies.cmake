@@ -124,6 +124,9 @@ if (PLATFORM_EXTENSIONS AND UNIX AND NOT APPLE)
   # Automatic auto-away support. (X11 also using for capslock detection)
   search_dependency(X11               PACKAGE x11 OPTIONAL)
   search_dependency(XSS               PACKAGE xscrnsaver OPTIONAL)
+  # Screen sharing without grabbing the whole screen every frame
+  search_dependency(XDAMAGE           PACKAGE xdamage OPTIONAL)
+  search_dependency(XEXT              PACKAGE xext OPTIONAL)
 endif()
 
 if(APPLE)
@@ -207,6 +210,13 @@ if (PLATFORM_EXTENSIONS)
   endif()
 endif()
 
+if (PLATFORM_EXTENSIONS AND ${X11_EXT} AND XDAMAGE_FOUND AND XEXT_FOUND)
+  add_definitions(
+    -DQTOX_X11_SCREEN_CAPTURE
+  )
+  message(STATUS "Using X11 screen capture")
+endif()
+
 add_definitions(
   -DTIMESTAMP=${TIMESTAMP}
   -DLOG_TO_FILE=1
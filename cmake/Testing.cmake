@@ -18,10 +18,51 @@ function(auto_test subsystem module)
     COMMAND ${TEST_CROSSCOMPILING_EMULATOR} test_${module})
 endfunction()
 
+# sources only the benchmarks drive, kept out of the application
+add_library(${PROJECT_NAME}_bench_support STATIC
+  src/audio/backend/nullaudio.cpp
+  src/audio/backend/nullaudio.h
+  src/video/testpatternsource.cpp
+  src/video/testpatternsource.h)
+target_link_libraries(${PROJECT_NAME}_bench_support
+  ${PROJECT_NAME}_static)
+
+# benchmarks are built like tests, but not run by ctest since their results depend on the machine
+function(auto_bench subsystem module)
+  add_executable(bench_${module}
+    test/${subsystem}/${module}_bench.cpp)
+  target_link_libraries(bench_${module}
+    ${PROJECT_NAME}_bench_support
+    ${PROJECT_NAME}_static
+    ${CHECK_LIBRARIES}
+    Qt5::Test)
+endfunction()
+
+auto_test(audio audiolevelmeter)
+auto_test(audio audioresampler)
+auto_test(core audioratecontroller)
 auto_test(core toxpk)
 auto_test(core toxid)
+auto_test(core videoqualitycontroller)
+auto_test(chatlog layoutcache)
+auto_test(chatlog layoutworker)
+auto_test(chatlog linegeometry)
+auto_test(chatlog pixmapcache)
 auto_test(chatlog textformatter)
+auto_test(chatlog thumbnailer)
+auto_test(video screensource)
+auto_test(video videocompositor)
+auto_test(video videoframe)
+auto_test(video videoframehandoff)
+auto_test(video videoframepool)
+auto_test(video videolatency)
 auto_test(net toxmedata)
+auto_test(persistence emoticonmatcher)
 if (UNIX)
   auto_test(platform posixsignalnotifier)
 endif()
+
+auto_bench(audio audiopipeline)
+auto_bench(chatlog chatlogscroll)
+auto_bench(chatlog textformatter)
+auto_bench(video videopipeline)
@@ -27,6 +27,7 @@
 #include <QDebug>
 
 #include <cassert>
+#include <limits>
 
 /**
  * @class Audio
@@ -52,6 +53,9 @@
  * When there are input subscribers, we regularly emit captured audio frames with this signal
  * Always connect with a blocking queued connection lambda, else the behaviour is undefined
  *
+ * @var Audio::inputLevel
+ * @brief Level of the captured audio, updated by the backend with every frame.
+ *
  * @var Audio::AUDIO_SAMPLE_RATE
  * @brief The next best Opus would take is 24k
  *
@@ -207,3 +211,30 @@ Audio& Audio::getInstance()
         return instance;
     }
 }
+
+/**
+ * @brief Level of the captured audio, for widgets to poll while they're visible.
+ *
+ * Only updated while there are input subscribers.
+ */
+const AudioLevelMeter& Audio::getInputLevel() const
+{
+    return inputLevel;
+}
+
+/**
+ * @brief Amplifies audio in place, clipping to 16bit boundaries.
+ *
+ * @param[in,out] pcm interleaved 16bit PCM samples
+ * @param[in] samples number of samples over all channels
+ * @param[in] factor linear gain factor
+ */
+void Audio::applyGain(int16_t* pcm, size_t samples, qreal factor)
+{
+    for (size_t i = 0; i < samples; ++i) {
+        int ampPCM = qBound<int>(std::numeric_limits<int16_t>::min(), qRound(pcm[i] * factor),
+                                 std::numeric_limits<int16_t>::max());
+
+        pcm[i] = static_cast<int16_t>(ampPCM);
+    }
+}
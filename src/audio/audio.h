@@ -21,6 +21,8 @@
 #ifndef AUDIO_H
 #define AUDIO_H
 
+#include "src/audio/audiolevelmeter.h"
+
 #include <atomic>
 #include <cmath>
 
@@ -60,6 +62,10 @@ public:
     }
     static Audio& getInstance();
 
+    static void applyGain(int16_t* pcm, size_t samples, qreal factor);
+
+    const AudioLevelMeter& getInputLevel() const;
+
     virtual qreal outputVolume() const = 0;
     virtual void setOutputVolume(qreal volume) = 0;
 
@@ -121,10 +127,11 @@ protected:
     static constexpr uint32_t AUDIO_FRAME_SAMPLE_COUNT =
         AUDIO_FRAME_DURATION * AUDIO_SAMPLE_RATE / 1000;
 
+    AudioLevelMeter inputLevel;
+
 signals:
     void frameAvailable(const int16_t* pcm, size_t sample_count, uint8_t channels,
                         uint32_t sampling_rate);
-    void volumeAvailable(float value);
     void startActive(int msec);
 };
 
@@ -0,0 +1,124 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "audiolevelmeter.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+/**
+ * @class AudioLevelMeter
+ * @brief Keeps the level of the captured audio for widgets to poll.
+ *
+ * The audio thread updates the meter with every captured frame, widgets read it with a timer at
+ * display rate while they're visible. All values are atomics, so neither side blocks the other
+ * and nothing is signalled across threads.
+ *
+ * Values are relative to the maximum amplitude. Peak falls off slowly and RMS is smoothed over
+ * a few frames, so a reader polling less often than frames are captured doesn't miss short
+ * peaks and doesn't see the display flicker.
+ */
+
+namespace {
+/// Fraction of the peak kept per frame, falls to a tenth in about 300ms of 20ms frames
+const float PEAK_DECAY = 0.86f;
+/// Weight of the newest frame in the smoothed RMS
+const float RMS_SMOOTHING = 0.3f;
+}
+
+AudioLevelMeter::AudioLevelMeter()
+    : levelValue{0.0f}
+    , peakValue{0.0f}
+    , rmsValue{0.0f}
+{
+}
+
+/**
+ * @brief Measures a captured frame.
+ *
+ * @param pcm Interleaved 16bit PCM samples.
+ * @param samples Number of samples over all channels.
+ * @return Mean absolute amplitude of the frame, which voice activation compares to its threshold.
+ */
+float AudioLevelMeter::update(const int16_t* pcm, size_t samples)
+{
+    if (!samples) {
+        return 0.0f;
+    }
+
+    int maxAbs = 0;
+    float sumAbs = 0.0f;
+    float sumSquares = 0.0f;
+    for (size_t i = 0; i < samples; ++i) {
+        const int value = std::abs(static_cast<int>(pcm[i]));
+        maxAbs = value > maxAbs ? value : maxAbs;
+        sumAbs += value;
+        sumSquares += static_cast<float>(value) * value;
+    }
+
+    const float scale = std::numeric_limits<int16_t>::max();
+    const float frameLevel = sumAbs / samples / scale;
+    // -32768 would be slightly above full scale
+    const float framePeak = maxAbs < scale ? maxAbs / scale : 1.0f;
+    const float frameRms = std::sqrt(sumSquares / samples) / scale;
+
+    const float decayedPeak = peakValue.load(std::memory_order_relaxed) * PEAK_DECAY;
+    const float oldRms = rmsValue.load(std::memory_order_relaxed);
+
+    levelValue.store(frameLevel, std::memory_order_relaxed);
+    peakValue.store(framePeak > decayedPeak ? framePeak : decayedPeak, std::memory_order_relaxed);
+    rmsValue.store(oldRms + (frameRms - oldRms) * RMS_SMOOTHING, std::memory_order_relaxed);
+
+    return frameLevel;
+}
+
+/**
+ * @brief Drops to silence, e.g. when the input device is closed.
+ */
+void AudioLevelMeter::reset()
+{
+    levelValue.store(0.0f, std::memory_order_relaxed);
+    peakValue.store(0.0f, std::memory_order_relaxed);
+    rmsValue.store(0.0f, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Mean absolute amplitude of the last frame, on the scale of the voice activation threshold.
+ */
+float AudioLevelMeter::level() const
+{
+    return levelValue.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Peak amplitude, falling off over a few hundred milliseconds.
+ */
+float AudioLevelMeter::peak() const
+{
+    return peakValue.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief RMS amplitude, smoothed over a few frames.
+ */
+float AudioLevelMeter::rms() const
+{
+    return rmsValue.load(std::memory_order_relaxed);
+}
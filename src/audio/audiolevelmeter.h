@@ -0,0 +1,45 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AUDIOLEVELMETER_H
+#define AUDIOLEVELMETER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+class AudioLevelMeter
+{
+public:
+    AudioLevelMeter();
+
+    float update(const int16_t* pcm, size_t samples);
+    void reset();
+
+    float level() const;
+    float peak() const;
+    float rms() const;
+
+private:
+    std::atomic<float> levelValue;
+    std::atomic<float> peakValue;
+    std::atomic<float> rmsValue;
+};
+
+#endif // AUDIOLEVELMETER_H
@@ -0,0 +1,353 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "audioresampler.h"
+
+#include <QtGlobal>
+#include <QtMath>
+
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+/**
+ * @class AudioResampler
+ * @brief Converts 16bit PCM between sample rates and channel layouts.
+ *
+ * One instance converts one continuous stream: the fractional read position and the last input
+ * frames needed by the interpolation kernel are carried over between calls, so consecutive
+ * frames are resampled without clicks at their boundaries. All buffers are kept between calls
+ * and only grow, so a stream with a steady frame size does not allocate after its first frame.
+ *
+ * Channels are converted before resampling, so downmixing stereo to mono halves the work of the
+ * interpolation stage.
+ *
+ * @enum AudioResampler::Quality
+ * @brief Interpolation kernel used for sample rate conversion.
+ *
+ * @value Fast Linear interpolation, cheapest but with audible aliasing.
+ * @value Medium Catmull-Rom cubic interpolation, good enough for speech.
+ * @value Best Blackman windowed sinc, low-pass filtered when downsampling.
+ *
+ * @var AudioResampler::position
+ * @brief Read position in input frames, relative to the start of history.
+ *
+ * @var AudioResampler::history
+ * @brief Interleaved input frames, converted to the output channel layout, that are still needed.
+ */
+
+namespace {
+/// Zero crossings of the sinc kernel on each side for Quality::Best
+const int SINC_ZERO_CROSSINGS = 8;
+/// Sinc table entries per zero crossing, values in between are linearly interpolated
+const int SINC_RESOLUTION = 64;
+
+inline int16_t toSample(float value)
+{
+    return static_cast<int16_t>(qBound<float>(std::numeric_limits<int16_t>::min(),
+                                              std::round(value),
+                                              std::numeric_limits<int16_t>::max()));
+}
+}
+
+AudioResampler::AudioResampler(Quality quality)
+    : quality{quality}
+    , inChannels{0}
+    , outChannels{0}
+    , inRate{0}
+    , outRate{0}
+    , leftTaps{0}
+    , rightTaps{0}
+    , cutoff{1.0f}
+    , position{0.0}
+{
+}
+
+AudioResampler::Quality AudioResampler::getQuality() const
+{
+    return quality;
+}
+
+/**
+ * @brief Changes the interpolation kernel.
+ * @note Resets the stream state, the next frame starts a new stream.
+ */
+void AudioResampler::setQuality(Quality newQuality)
+{
+    if (newQuality == quality) {
+        return;
+    }
+
+    quality = newQuality;
+    reset();
+}
+
+/**
+ * @brief Forgets the stream state, keeping the allocated buffers.
+ */
+void AudioResampler::reset()
+{
+    inChannels = 0;
+    outChannels = 0;
+    inRate = 0;
+    outRate = 0;
+    history.clear();
+    position = 0.0;
+}
+
+/**
+ * @brief Checks if a conversion between the given formats is a no-op.
+ */
+bool AudioResampler::isPassthrough(unsigned inChannels, uint32_t inRate, unsigned outChannels,
+                                   uint32_t outRate)
+{
+    return inChannels == outChannels && inRate == outRate;
+}
+
+/**
+ * @brief Converts a frame of audio to the requested format.
+ *
+ * @param in Interleaved input samples.
+ * @param inSamples Number of samples per channel in the input.
+ * @param inChannels Number of channels of the input.
+ * @param inRate Sample rate of the input in Hertz.
+ * @param outChannels Number of channels to produce.
+ * @param outRate Sample rate to produce in Hertz.
+ * @param outSamples Set to the number of produced samples per channel.
+ * @return Interleaved output samples. Points to @p in when no conversion is needed, otherwise to
+ * an internal buffer that stays valid until the next call.
+ */
+const int16_t* AudioResampler::process(const int16_t* in, size_t inSamples, unsigned inChannels,
+                                       uint32_t inRate, unsigned outChannels, uint32_t outRate,
+                                       size_t& outSamples)
+{
+    assert(inChannels > 0 && outChannels > 0 && inRate > 0 && outRate > 0);
+
+    if (isPassthrough(inChannels, inRate, outChannels, outRate)) {
+        if (this->inRate) {
+            reset();
+        }
+
+        outSamples = inSamples;
+        return in;
+    }
+
+    if (inChannels != this->inChannels || inRate != this->inRate
+        || outChannels != this->outChannels || outRate != this->outRate) {
+        configure(inChannels, inRate, outChannels, outRate);
+    }
+
+    remix(in, inSamples, inChannels);
+
+    const int frames = history.size() / static_cast<int>(outChannels);
+    const float* src = history.constData();
+
+    if (inRate == outRate) {
+        // channel conversion only, history holds exactly this frame
+        outBuffer.reserve(history.size());
+        outBuffer.resize(history.size());
+        for (int i = 0; i < history.size(); ++i) {
+            outBuffer[i] = toSample(src[i]);
+        }
+
+        history.clear();
+        outSamples = static_cast<size_t>(frames);
+        return outBuffer.constData();
+    }
+
+    const double step = static_cast<double>(inRate) / outRate;
+    const int maxOut = qMax(0, static_cast<int>(std::ceil((frames - position) / step)) + 1);
+    outBuffer.reserve(maxOut * static_cast<int>(outChannels));
+    outBuffer.resize(maxOut * static_cast<int>(outChannels));
+
+    int16_t* out = outBuffer.data();
+    int produced = 0;
+
+    forever
+    {
+        const int index = static_cast<int>(position);
+        if (index + rightTaps >= frames || produced >= maxOut) {
+            break;
+        }
+
+        const float* frame = src + index * static_cast<int>(outChannels);
+        const double frac = position - index;
+        for (unsigned ch = 0; ch < outChannels; ++ch) {
+            *out++ = toSample(interpolate(frame, frac, ch));
+        }
+
+        ++produced;
+        position += step;
+    }
+
+    // keep the frames the kernel still needs to look back at
+    const int consumed = qMax(0, static_cast<int>(position) - leftTaps);
+    history.remove(0, consumed * static_cast<int>(outChannels));
+    position -= consumed;
+
+    outSamples = static_cast<size_t>(produced);
+    return outBuffer.constData();
+}
+
+/**
+ * @brief Starts a new stream with the given format.
+ */
+void AudioResampler::configure(unsigned inChannels, uint32_t inRate, unsigned outChannels,
+                               uint32_t outRate)
+{
+    this->inChannels = inChannels;
+    this->inRate = inRate;
+    this->outChannels = outChannels;
+    this->outRate = outRate;
+
+    // only low-pass when there's less bandwidth on the output side
+    cutoff = outRate < inRate ? static_cast<float>(outRate) / inRate : 1.0f;
+
+    switch (quality) {
+    case Quality::Fast:
+        leftTaps = 0;
+        rightTaps = 1;
+        break;
+    case Quality::Medium:
+        leftTaps = 1;
+        rightTaps = 2;
+        break;
+    case Quality::Best:
+        leftTaps = static_cast<int>(std::ceil(SINC_ZERO_CROSSINGS / cutoff));
+        rightTaps = leftTaps;
+        buildSincTable();
+        break;
+    }
+
+    if (inRate == outRate) {
+        leftTaps = 0;
+        rightTaps = 0;
+    }
+
+    // silence before the first frame, so the first sample can be centered on the kernel
+    history.fill(0.0f, leftTaps * static_cast<int>(outChannels));
+    position = leftTaps;
+}
+
+/**
+ * @brief Appends the input to history, converted to the output channel layout.
+ */
+void AudioResampler::remix(const int16_t* in, size_t inSamples, unsigned inChannels)
+{
+    const int oldSize = history.size();
+    const int samples = static_cast<int>(inSamples);
+    history.resize(oldSize + samples * static_cast<int>(outChannels));
+    float* dst = history.data() + oldSize;
+
+    if (inChannels == outChannels) {
+        for (int i = 0; i < samples * static_cast<int>(inChannels); ++i) {
+            dst[i] = in[i];
+        }
+    } else if (outChannels == 1) {
+        for (int i = 0; i < samples; ++i) {
+            int sum = 0;
+            for (unsigned ch = 0; ch < inChannels; ++ch) {
+                sum += in[i * inChannels + ch];
+            }
+
+            dst[i] = static_cast<float>(sum) / inChannels;
+        }
+    } else {
+        for (int i = 0; i < samples; ++i) {
+            for (unsigned ch = 0; ch < outChannels; ++ch) {
+                dst[i * outChannels + ch] = in[i * inChannels + ch % inChannels];
+            }
+        }
+    }
+}
+
+/**
+ * @brief Computes one output sample for a channel.
+ *
+ * @param frame Input frame just before the output sample position.
+ * @param frac Distance of the output sample from @p frame in input frames, in [0, 1).
+ * @param channel Channel to interpolate.
+ */
+float AudioResampler::interpolate(const float* frame, double frac, unsigned channel) const
+{
+    const int stride = static_cast<int>(outChannels);
+    const float* s = frame + channel;
+    const float t = static_cast<float>(frac);
+
+    switch (quality) {
+    case Quality::Fast:
+        return s[0] + (s[stride] - s[0]) * t;
+
+    case Quality::Medium: {
+        const float p0 = s[-stride];
+        const float p1 = s[0];
+        const float p2 = s[stride];
+        const float p3 = s[2 * stride];
+        return p1
+               + 0.5f * t
+                     * (p2 - p0
+                        + t * (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3
+                               + t * (3.0f * (p1 - p2) + p3 - p0)));
+    }
+
+    case Quality::Best: {
+        float sum = 0.0f;
+        float weights = 0.0f;
+        for (int k = 1 - leftTaps; k <= rightTaps; ++k) {
+            const float x = std::abs((k - t) * cutoff) * SINC_RESOLUTION;
+            const int i = static_cast<int>(x);
+            if (i + 1 >= sincTable.size()) {
+                continue;
+            }
+
+            const float w = sincTable[i] + (sincTable[i + 1] - sincTable[i]) * (x - i);
+            sum += s[k * stride] * w;
+            weights += w;
+        }
+
+        // normalizing keeps DC gain at exactly one whatever the fractional position
+        return weights != 0.0f ? sum / weights : s[0];
+    }
+    }
+
+    assert(false);
+    return s[0];
+}
+
+/**
+ * @brief Tabulates the Blackman windowed sinc kernel for Quality::Best.
+ */
+void AudioResampler::buildSincTable()
+{
+    const int size = SINC_ZERO_CROSSINGS * SINC_RESOLUTION + 2;
+    sincTable.resize(size);
+
+    for (int i = 0; i < size; ++i) {
+        const double u = static_cast<double>(i) / SINC_RESOLUTION;
+        if (u >= SINC_ZERO_CROSSINGS) {
+            sincTable[i] = 0.0f;
+            continue;
+        }
+
+        const double sinc = i == 0 ? 1.0 : std::sin(M_PI * u) / (M_PI * u);
+        const double w = 0.42 + 0.5 * std::cos(M_PI * u / SINC_ZERO_CROSSINGS)
+                         + 0.08 * std::cos(2.0 * M_PI * u / SINC_ZERO_CROSSINGS);
+        sincTable[i] = static_cast<float>(sinc * w);
+    }
+}
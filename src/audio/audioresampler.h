@@ -0,0 +1,76 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AUDIORESAMPLER_H
+#define AUDIORESAMPLER_H
+
+#include <QVector>
+
+#include <cstddef>
+#include <cstdint>
+
+class AudioResampler
+{
+public:
+    enum class Quality
+    {
+        Fast = 0,
+        Medium = 1,
+        Best = 2
+    };
+
+    explicit AudioResampler(Quality quality = Quality::Medium);
+
+    Quality getQuality() const;
+    void setQuality(Quality newQuality);
+
+    void reset();
+
+    static bool isPassthrough(unsigned inChannels, uint32_t inRate, unsigned outChannels,
+                              uint32_t outRate);
+
+    const int16_t* process(const int16_t* in, size_t inSamples, unsigned inChannels,
+                           uint32_t inRate, unsigned outChannels, uint32_t outRate,
+                           size_t& outSamples);
+
+private:
+    void configure(unsigned inChannels, uint32_t inRate, unsigned outChannels, uint32_t outRate);
+    void remix(const int16_t* in, size_t inSamples, unsigned inChannels);
+    float interpolate(const float* frame, double frac, unsigned channel) const;
+    void buildSincTable();
+
+private:
+    Quality quality;
+
+    unsigned inChannels;
+    unsigned outChannels;
+    uint32_t inRate;
+    uint32_t outRate;
+
+    int leftTaps;
+    int rightTaps;
+    float cutoff;
+    double position;
+
+    QVector<float> history;
+    QVector<float> sincTable;
+    QVector<int16_t> outBuffer;
+};
+
+#endif // AUDIORESAMPLER_H
@@ -0,0 +1,750 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "nullaudio.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <QtEndian>
+#include <QtMath>
+
+#include <cassert>
+#include <cstring>
+#include <limits>
+
+/**
+ * @class NullAudio
+ * @brief Audio backend without a soundcard, reading WAV input and writing WAV output.
+ *
+ * Nothing is driven by timers: every call to process() captures and mixes one 20ms frame
+ * immediately, so the pipeline runs as fast as the CPU allows. This makes the backend useful to
+ * benchmark and test the audio processing on machines without audio devices.
+ *
+ * reinitInput() and reinitOutput() take paths to WAV files instead of device names. Without an
+ * input file silence is captured, without an output file the mixed audio is discarded. The input
+ * file is looped and may be 16bit PCM of any sample rate with one or two channels; the output
+ * file is written at Audio::AUDIO_SAMPLE_RATE.
+ *
+ * Processing mirrors the OpenAL backends: with echo cancellation enabled the mix is mono and fed
+ * to filter_audio as far end signal like in OpenAL2, otherwise it's stereo like in OpenAL.
+ * Voice hold is counted in frames rather than wall clock time.
+ *
+ * The backend is not returned by Audio::getInstance(), it's instantiated directly.
+ *
+ * @var NullAudio::peerStreams
+ * @brief Queued audio of each subscribed output source, converted to the mixer format.
+ *
+ * @var NullAudio::soundStream
+ * @brief Queued audio of the sound played by playMono16Sound().
+ *
+ * @var NullAudio::inBuffer
+ * @brief Captured audio, converted to the capture format, that wasn't emitted yet.
+ *
+ * @var NullAudio::activeFrames
+ * @brief Remaining frames to emit before voice hold ends.
+ */
+
+namespace {
+/// Channels of captured frames, like the echo canceling backend
+const uint32_t CAPTURE_CHANNELS = 1;
+/// Channels of the mix without echo cancellation
+const uint32_t MIX_CHANNELS = 2;
+/// Maximum frames queued per peer, further audio is dropped
+const int MAX_PENDING_FRAMES = 16;
+/// Sample rate of sounds played with playMono16Sound()
+const int SOUND_SAMPLE_RATE = 44100;
+/// Size of the canonical WAV header we write
+const int WAV_HEADER_SIZE = 44;
+
+QByteArray wavHeader(uint32_t channels, uint32_t sampleRate, quint32 dataBytes)
+{
+    QByteArray header(WAV_HEADER_SIZE, '\0');
+    uchar* h = reinterpret_cast<uchar*>(header.data());
+
+    memcpy(h, "RIFF", 4);
+    qToLittleEndian<quint32>(36 + dataBytes, h + 4);
+    memcpy(h + 8, "WAVE", 4);
+    memcpy(h + 12, "fmt ", 4);
+    qToLittleEndian<quint32>(16, h + 16);
+    qToLittleEndian<quint16>(1, h + 20);
+    qToLittleEndian<quint16>(static_cast<quint16>(channels), h + 22);
+    qToLittleEndian<quint32>(sampleRate, h + 24);
+    qToLittleEndian<quint32>(sampleRate * channels * 2, h + 28);
+    qToLittleEndian<quint16>(static_cast<quint16>(channels * 2), h + 32);
+    qToLittleEndian<quint16>(16, h + 34);
+    memcpy(h + 36, "data", 4);
+    qToLittleEndian<quint32>(dataBytes, h + 40);
+
+    return header;
+}
+
+/**
+ * @brief Parses a WAV header, leaving the file at the start of the samples.
+ * @return False if the file isn't a 16bit PCM WAV file with one or two channels.
+ */
+bool readWavHeader(QFile& file, uint32_t& channels, uint32_t& sampleRate)
+{
+    const QByteArray riff = file.read(12);
+    if (riff.size() < 12 || !riff.startsWith("RIFF") || riff.mid(8, 4) != "WAVE") {
+        return false;
+    }
+
+    bool haveFormat = false;
+    forever
+    {
+        const QByteArray chunk = file.read(8);
+        if (chunk.size() < 8) {
+            return false;
+        }
+
+        const quint32 size =
+            qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(chunk.constData()) + 4);
+
+        if (chunk.startsWith("data")) {
+            return haveFormat;
+        }
+
+        if (chunk.startsWith("fmt ")) {
+            const QByteArray format = file.read(size);
+            if (format.size() < 16) {
+                return false;
+            }
+
+            const uchar* f = reinterpret_cast<const uchar*>(format.constData());
+            const quint16 type = qFromLittleEndian<quint16>(f);
+            channels = qFromLittleEndian<quint16>(f + 2);
+            sampleRate = qFromLittleEndian<quint32>(f + 4);
+            const quint16 bits = qFromLittleEndian<quint16>(f + 14);
+            if (type != 1 || bits != 16 || channels < 1 || channels > 2 || !sampleRate) {
+                return false;
+            }
+
+            haveFormat = true;
+        } else if (!file.seek(file.pos() + size)) {
+            return false;
+        }
+
+        // chunks are word aligned
+        if (size & 1) {
+            file.seek(file.pos() + 1);
+        }
+    }
+}
+}
+
+NullAudio::NullAudio()
+    : inDataOffset{0}
+    , inChannels{CAPTURE_CHANNELS}
+    , inSampleRate{AUDIO_SAMPLE_RATE}
+    , inSubscriptions{0}
+    , outDataBytes{0}
+    , outputChannels{MIX_CHANNELS}
+    , nextSourceId{1}
+    , soundLoop{false}
+    , quality{AudioResampler::Quality::Medium}
+    , volume{1.0}
+    , gain{0.0}
+    , gainFactor{1.0}
+    , minInGain{-30}
+    , maxInGain{30}
+    , inputThreshold{0.0}
+    , minInThreshold{0.0}
+    , maxInThreshold{0.4}
+    , voiceHold{250}
+    , minVoiceHold{250}
+    , maxVoiceHold{1000}
+    , activeFrames{0}
+    , echoCancel{false}
+#ifdef USE_FILTERAUDIO
+    , filterer{nullptr}
+#endif
+{
+}
+
+NullAudio::~NullAudio()
+{
+    QMutexLocker locker(&audioLock);
+    closeInput();
+    closeOutput();
+#ifdef USE_FILTERAUDIO
+    if (filterer) {
+        kill_filter_audio(filterer);
+    }
+#endif
+}
+
+qreal NullAudio::outputVolume() const
+{
+    QMutexLocker locker(&audioLock);
+    return volume;
+}
+
+void NullAudio::setOutputVolume(qreal volume)
+{
+    QMutexLocker locker(&audioLock);
+    this->volume = qBound(0.0, volume, 1.0);
+}
+
+qreal NullAudio::minInputGain() const
+{
+    QMutexLocker locker(&audioLock);
+    return minInGain;
+}
+
+void NullAudio::setMinInputGain(qreal dB)
+{
+    QMutexLocker locker(&audioLock);
+    minInGain = dB;
+}
+
+qreal NullAudio::maxInputGain() const
+{
+    QMutexLocker locker(&audioLock);
+    return maxInGain;
+}
+
+void NullAudio::setMaxInputGain(qreal dB)
+{
+    QMutexLocker locker(&audioLock);
+    maxInGain = dB;
+}
+
+qreal NullAudio::inputGain() const
+{
+    QMutexLocker locker(&audioLock);
+    return gain;
+}
+
+void NullAudio::setInputGain(qreal dB)
+{
+    QMutexLocker locker(&audioLock);
+    gain = qBound(minInGain, dB, maxInGain);
+    gainFactor = qPow(10.0, (gain / 20.0));
+}
+
+qreal NullAudio::minInputThreshold() const
+{
+    QMutexLocker locker(&audioLock);
+    return minInThreshold;
+}
+
+void NullAudio::setMinInputThreshold(qreal percent)
+{
+    QMutexLocker locker(&audioLock);
+    minInThreshold = percent;
+}
+
+qreal NullAudio::maxInputThreshold() const
+{
+    QMutexLocker locker(&audioLock);
+    return maxInThreshold;
+}
+
+void NullAudio::setMaxInputThreshold(qreal percent)
+{
+    QMutexLocker locker(&audioLock);
+    maxInThreshold = percent;
+}
+
+int NullAudio::getMinVoiceHold() const
+{
+    QMutexLocker locker(&audioLock);
+    return minVoiceHold;
+}
+
+void NullAudio::setMinVoiceHold(int msec)
+{
+    QMutexLocker locker(&audioLock);
+    minVoiceHold = msec;
+}
+
+int NullAudio::getMaxVoiceHold() const
+{
+    QMutexLocker locker(&audioLock);
+    return maxVoiceHold;
+}
+
+void NullAudio::setMaxVoiceHold(int msec)
+{
+    QMutexLocker locker(&audioLock);
+    maxVoiceHold = msec;
+}
+
+qreal NullAudio::getInputThreshold() const
+{
+    QMutexLocker locker(&audioLock);
+    return inputThreshold;
+}
+
+void NullAudio::setInputThreshold(qreal percent)
+{
+    QMutexLocker locker(&audioLock);
+    inputThreshold = percent;
+}
+
+int NullAudio::getVoiceHold() const
+{
+    QMutexLocker locker(&audioLock);
+    return voiceHold;
+}
+
+void NullAudio::setVoiceHold(int msec)
+{
+    QMutexLocker locker(&audioLock);
+    voiceHold = msec;
+}
+
+/**
+ * @brief Opens a WAV file to capture from.
+ *
+ * @param inDevDesc path to the file, an empty path captures silence
+ */
+void NullAudio::reinitInput(const QString& inDevDesc)
+{
+    QMutexLocker locker(&audioLock);
+    closeInput();
+
+    if (inDevDesc.isEmpty()) {
+        return;
+    }
+
+    inFile.setFileName(inDevDesc);
+    if (!inFile.open(QIODevice::ReadOnly) || !readWavHeader(inFile, inChannels, inSampleRate)) {
+        qWarning() << "Can't read 16bit PCM WAV input from" << inDevDesc;
+        closeInput();
+        return;
+    }
+
+    inDataOffset = inFile.pos();
+    qDebug() << "Opened audio input file" << inDevDesc << inChannels << "channels" << inSampleRate
+             << "Hz";
+}
+
+/**
+ * @brief Opens a WAV file to write the mixed output to.
+ *
+ * @param outDevDesc path to the file, an empty path discards the output
+ * @return False if the file can't be opened for writing.
+ */
+bool NullAudio::reinitOutput(const QString& outDevDesc)
+{
+    QMutexLocker locker(&audioLock);
+    closeOutput();
+
+    if (outDevDesc.isEmpty()) {
+        return true;
+    }
+
+    outFile.setFileName(outDevDesc);
+    if (!outFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Can't open audio output file" << outDevDesc;
+        return false;
+    }
+
+    // sizes are filled in when the file is closed
+    outFile.write(wavHeader(outputChannels, AUDIO_SAMPLE_RATE, 0));
+    outDataBytes = 0;
+    return true;
+}
+
+/**
+ * @brief The null device can always play audio.
+ */
+bool NullAudio::isOutputReady() const
+{
+    return true;
+}
+
+QStringList NullAudio::outDeviceNames()
+{
+    return QStringList();
+}
+
+QStringList NullAudio::inDeviceNames()
+{
+    return QStringList();
+}
+
+void NullAudio::subscribeOutput(uint& sourceId)
+{
+    QMutexLocker locker(&audioLock);
+
+    sourceId = nextSourceId++;
+    peerStreams[sourceId].resampler.setQuality(quality);
+}
+
+void NullAudio::unsubscribeOutput(uint& sourceId)
+{
+    QMutexLocker locker(&audioLock);
+
+    peerStreams.erase(sourceId);
+    sourceId = 0;
+}
+
+void NullAudio::subscribeInput()
+{
+    QMutexLocker locker(&audioLock);
+    ++inSubscriptions;
+}
+
+void NullAudio::unsubscribeInput()
+{
+    QMutexLocker locker(&audioLock);
+
+    if (inSubscriptions) {
+        --inSubscriptions;
+    }
+}
+
+void NullAudio::startLoop()
+{
+    QMutexLocker locker(&audioLock);
+    soundLoop = true;
+}
+
+void NullAudio::stopLoop()
+{
+    QMutexLocker locker(&audioLock);
+    soundLoop = false;
+    soundStream.pending.clear();
+}
+
+void NullAudio::playMono16Sound(const QByteArray& data)
+{
+    QMutexLocker locker(&audioLock);
+
+    soundData = data;
+    soundStream.resampler.reset();
+    soundStream.pending.clear();
+    queue(soundStream, reinterpret_cast<const int16_t*>(soundData.constData()),
+          soundData.size() / 2, 1, SOUND_SAMPLE_RATE);
+}
+
+void NullAudio::playMono16Sound(const QString& path)
+{
+    QFile sndFile(path);
+    sndFile.open(QIODevice::ReadOnly);
+    playMono16Sound(QByteArray(sndFile.readAll()));
+}
+
+void NullAudio::stopActive()
+{
+    QMutexLocker locker(&audioLock);
+    activeFrames = 0;
+}
+
+void NullAudio::playAudioBuffer(uint sourceId, const int16_t* data, int samples,
+                                unsigned channels, int sampleRate)
+{
+    assert(channels == 1 || channels == 2);
+    QMutexLocker locker(&audioLock);
+
+    auto it = peerStreams.find(sourceId);
+    if (it == peerStreams.end()) {
+        return;
+    }
+
+    Stream& stream = it->second;
+    const int frameSize = static_cast<int>(AUDIO_FRAME_SAMPLE_COUNT * outputChannels);
+    if (stream.pending.size() >= MAX_PENDING_FRAMES * frameSize) {
+        // reached limit, drop audio
+        return;
+    }
+
+    queue(stream, data, samples, channels, sampleRate);
+}
+
+/**
+ * @brief Checks if the backend was built with filter_audio.
+ */
+bool NullAudio::isEchoCancelSupported() const
+{
+#ifdef USE_FILTERAUDIO
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Enables echo cancellation, which switches the mix to mono.
+ *
+ * Queued output is dropped. Call this before opening the output file, it keeps the channel
+ * count it was opened with.
+ */
+void NullAudio::setEchoCancel(bool enable)
+{
+    QMutexLocker locker(&audioLock);
+
+    if (!isEchoCancelSupported() || enable == echoCancel) {
+        return;
+    }
+
+    echoCancel = enable;
+    outputChannels = echoCancel ? 1 : MIX_CHANNELS;
+
+    for (auto& peer : peerStreams) {
+        peer.second.resampler.reset();
+        peer.second.pending.clear();
+    }
+
+    soundStream.resampler.reset();
+    soundStream.pending.clear();
+
+#ifdef USE_FILTERAUDIO
+    if (echoCancel) {
+        filterer = new_filter_audio(AUDIO_SAMPLE_RATE);
+        // the mix is "played" right before the next frame is captured
+        set_echo_delay_ms(filterer, AUDIO_FRAME_DURATION);
+        enable_disable_filters(filterer, 1, 1, 1, 0);
+    } else {
+        kill_filter_audio(filterer);
+        filterer = nullptr;
+    }
+#endif
+}
+
+/**
+ * @brief Sets the resampler quality of all streams, OpenAL follows the settings instead.
+ */
+void NullAudio::setResamplerQuality(AudioResampler::Quality quality)
+{
+    QMutexLocker locker(&audioLock);
+
+    this->quality = quality;
+    inputResampler.setQuality(quality);
+    soundStream.resampler.setQuality(quality);
+    for (auto& peer : peerStreams) {
+        peer.second.resampler.setQuality(quality);
+    }
+}
+
+/**
+ * @brief Mixes and captures frames without waiting, in place of the OpenAL timers.
+ *
+ * Output is mixed before input is captured, so the echo canceler sees the far end signal first.
+ *
+ * @param frames number of 20ms frames to process
+ */
+void NullAudio::process(int frames)
+{
+    for (int i = 0; i < frames; ++i) {
+        {
+            QMutexLocker locker(&audioLock);
+            mixFrame();
+        }
+
+        captureFrame();
+    }
+}
+
+void NullAudio::closeInput()
+{
+    if (inFile.isOpen()) {
+        inFile.close();
+    }
+
+    inChannels = CAPTURE_CHANNELS;
+    inSampleRate = AUDIO_SAMPLE_RATE;
+    inDataOffset = 0;
+    inBuffer.clear();
+    inputResampler.reset();
+    inputLevel.reset();
+}
+
+/**
+ * @brief Closes the output file, completing its header.
+ */
+void NullAudio::closeOutput()
+{
+    if (!outFile.isOpen()) {
+        return;
+    }
+
+    outFile.seek(0);
+    outFile.write(wavHeader(outputChannels, AUDIO_SAMPLE_RATE, static_cast<quint32>(outDataBytes)));
+    outFile.close();
+    outDataBytes = 0;
+}
+
+/**
+ * @brief Appends audio to a stream, converted to the mixer format.
+ */
+void NullAudio::queue(Stream& stream, const int16_t* data, int samples, unsigned channels,
+                      int sampleRate)
+{
+    if (samples <= 0) {
+        return;
+    }
+
+    size_t outSamples = 0;
+    const int16_t* pcm = stream.resampler.process(data, static_cast<size_t>(samples), channels,
+                                                  static_cast<uint32_t>(sampleRate),
+                                                  outputChannels, AUDIO_SAMPLE_RATE, outSamples);
+
+    const int count = static_cast<int>(outSamples * outputChannels);
+    const int oldSize = stream.pending.size();
+    stream.pending.resize(oldSize + count);
+    memcpy(stream.pending.data() + oldSize, pcm, count * sizeof(int16_t));
+}
+
+/**
+ * @brief Mixes one frame of all streams and writes it to the output file.
+ */
+void NullAudio::mixFrame()
+{
+    const int frameSize = static_cast<int>(AUDIO_FRAME_SAMPLE_COUNT * outputChannels);
+
+    if (soundLoop && !soundData.isEmpty() && soundStream.pending.size() < frameSize) {
+        queue(soundStream, reinterpret_cast<const int16_t*>(soundData.constData()),
+              soundData.size() / 2, 1, SOUND_SAMPLE_RATE);
+    }
+
+    mixBuffer.fill(0, frameSize);
+    int32_t* mix = mixBuffer.data();
+
+    auto addStream = [mix, frameSize](Stream& stream) {
+        const int count = qMin(frameSize, stream.pending.size());
+        const int16_t* src = stream.pending.constData();
+        for (int i = 0; i < count; ++i) {
+            mix[i] += src[i];
+        }
+
+        stream.pending.remove(0, count);
+    };
+
+    for (auto& peer : peerStreams) {
+        addStream(peer.second);
+    }
+
+    addStream(soundStream);
+
+    outBuffer.resize(frameSize);
+    int16_t* out = outBuffer.data();
+    for (int i = 0; i < frameSize; ++i) {
+        out[i] = static_cast<int16_t>(qBound<int>(std::numeric_limits<int16_t>::min(),
+                                                  qRound(mix[i] * volume),
+                                                  std::numeric_limits<int16_t>::max()));
+    }
+
+#ifdef USE_FILTERAUDIO
+    if (echoCancel && filterer) {
+        pass_audio_output(filterer, out, AUDIO_FRAME_SAMPLE_COUNT);
+    }
+#endif
+
+    if (outFile.isOpen()) {
+        for (int i = 0; i < frameSize; ++i) {
+            out[i] = qToLittleEndian(out[i]);
+        }
+
+        outDataBytes += outFile.write(reinterpret_cast<const char*>(out),
+                                      frameSize * static_cast<int>(sizeof(int16_t)));
+    }
+}
+
+/**
+ * @brief Captures one frame like OpenAL::doCapture and emits it if voice is active.
+ */
+void NullAudio::captureFrame()
+{
+    QMutexLocker locker(&audioLock);
+
+    if (!inSubscriptions) {
+        return;
+    }
+
+    const int frameSize = static_cast<int>(AUDIO_FRAME_SAMPLE_COUNT * CAPTURE_CHANNELS);
+    const size_t chunkSamples = qMax<size_t>(1, inSampleRate * AUDIO_FRAME_DURATION / 1000);
+    QVector<int16_t> chunk(static_cast<int>(chunkSamples * inChannels));
+
+    while (inBuffer.size() < frameSize) {
+        readInput(chunk.data(), chunkSamples);
+        size_t outSamples = 0;
+        const int16_t* pcm = inputResampler.process(chunk.constData(), chunkSamples, inChannels,
+                                                    inSampleRate, CAPTURE_CHANNELS,
+                                                    AUDIO_SAMPLE_RATE, outSamples);
+        const int count = static_cast<int>(outSamples * CAPTURE_CHANNELS);
+        const int oldSize = inBuffer.size();
+        inBuffer.resize(oldSize + count);
+        memcpy(inBuffer.data() + oldSize, pcm, count * sizeof(int16_t));
+    }
+
+    int16_t buf[AUDIO_FRAME_SAMPLE_COUNT * CAPTURE_CHANNELS];
+    memcpy(buf, inBuffer.constData(), sizeof(buf));
+    inBuffer.remove(0, frameSize);
+
+#ifdef USE_FILTERAUDIO
+    if (echoCancel && filterer) {
+        filter_audio(filterer, buf, AUDIO_FRAME_SAMPLE_COUNT);
+    }
+#endif
+
+    const float frameLevel = inputLevel.update(buf, static_cast<size_t>(frameSize));
+    if (frameLevel > inputThreshold) {
+        activeFrames = voiceHold / static_cast<int>(AUDIO_FRAME_DURATION) + 1;
+        emit startActive(voiceHold);
+    }
+
+    if (activeFrames <= 0) {
+        return;
+    }
+
+    --activeFrames;
+    applyGain(buf, static_cast<size_t>(frameSize), gainFactor);
+
+    emit Audio::frameAvailable(buf, AUDIO_FRAME_SAMPLE_COUNT, CAPTURE_CHANNELS, AUDIO_SAMPLE_RATE);
+}
+
+/**
+ * @brief Reads samples from the input file, looping at its end, or silence without one.
+ *
+ * @param buf buffer for @p samples interleaved samples of every input channel
+ */
+void NullAudio::readInput(int16_t* buf, size_t samples)
+{
+    const qint64 bytes = static_cast<qint64>(samples * inChannels * sizeof(int16_t));
+    char* dst = reinterpret_cast<char*>(buf);
+    qint64 done = 0;
+
+    if (inFile.isOpen()) {
+        bool rewound = false;
+        while (done < bytes) {
+            const qint64 read = inFile.read(dst + done, bytes - done);
+            if (read > 0) {
+                done += read;
+                rewound = false;
+                continue;
+            }
+
+            // an empty data chunk would loop forever
+            if (rewound || !inFile.seek(inDataOffset)) {
+                break;
+            }
+
+            rewound = true;
+        }
+    }
+
+    memset(dst + done, 0, static_cast<size_t>(bytes - done));
+
+    for (size_t i = 0; i < samples * inChannels; ++i) {
+        buf[i] = qFromLittleEndian(buf[i]);
+    }
+}
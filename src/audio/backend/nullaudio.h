@@ -0,0 +1,163 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NULLAUDIO_H
+#define NULLAUDIO_H
+
+#include "src/audio/audio.h"
+#include "src/audio/audioresampler.h"
+
+#include <map>
+
+#include <QFile>
+#include <QMutex>
+#include <QVector>
+
+#ifdef USE_FILTERAUDIO
+#include <filter_audio.h>
+#endif
+
+class NullAudio : public Audio
+{
+    Q_OBJECT
+
+public:
+    NullAudio();
+    ~NullAudio();
+
+    qreal outputVolume() const;
+    void setOutputVolume(qreal volume);
+
+    qreal minInputGain() const;
+    void setMinInputGain(qreal dB);
+
+    qreal maxInputGain() const;
+    void setMaxInputGain(qreal dB);
+
+    qreal inputGain() const;
+    void setInputGain(qreal dB);
+
+    qreal minInputThreshold() const;
+    void setMinInputThreshold(qreal percent);
+
+    qreal maxInputThreshold() const;
+    void setMaxInputThreshold(qreal percent);
+
+    int getMinVoiceHold() const;
+    void setMinVoiceHold(int msec);
+
+    int getMaxVoiceHold() const;
+    void setMaxVoiceHold(int msec);
+
+    qreal getInputThreshold() const;
+    void setInputThreshold(qreal percent);
+
+    int getVoiceHold() const;
+    void setVoiceHold(int msec);
+
+    void reinitInput(const QString& inDevDesc);
+    bool reinitOutput(const QString& outDevDesc);
+
+    bool isOutputReady() const;
+
+    QStringList outDeviceNames();
+    QStringList inDeviceNames();
+
+    void subscribeOutput(uint& sourceId);
+    void unsubscribeOutput(uint& sourceId);
+
+    void subscribeInput();
+    void unsubscribeInput();
+
+    void startLoop();
+    void stopLoop();
+    void playMono16Sound(const QByteArray& data);
+    void playMono16Sound(const QString& path);
+    void stopActive();
+
+    void playAudioBuffer(uint sourceId, const int16_t* data, int samples, unsigned channels,
+                         int sampleRate);
+
+    bool isEchoCancelSupported() const;
+    void setEchoCancel(bool enable);
+
+    void setResamplerQuality(AudioResampler::Quality quality);
+
+    void process(int frames = 1);
+
+private:
+    struct Stream
+    {
+        AudioResampler resampler;
+        QVector<int16_t> pending;
+    };
+
+    void closeInput();
+    void closeOutput();
+    void queue(Stream& stream, const int16_t* data, int samples, unsigned channels,
+               int sampleRate);
+    void captureFrame();
+    void mixFrame();
+    void readInput(int16_t* buf, size_t samples);
+
+private:
+    mutable QMutex audioLock;
+
+    QFile inFile;
+    qint64 inDataOffset;
+    uint32_t inChannels;
+    uint32_t inSampleRate;
+    QVector<int16_t> inBuffer;
+    AudioResampler inputResampler;
+    quint32 inSubscriptions;
+
+    QFile outFile;
+    qint64 outDataBytes;
+    uint32_t outputChannels;
+
+    std::map<uint, Stream> peerStreams;
+    uint nextSourceId;
+    Stream soundStream;
+    QByteArray soundData;
+    bool soundLoop;
+    AudioResampler::Quality quality;
+
+    QVector<int32_t> mixBuffer;
+    QVector<int16_t> outBuffer;
+
+    qreal volume;
+    qreal gain;
+    qreal gainFactor;
+    qreal minInGain;
+    qreal maxInGain;
+    qreal inputThreshold;
+    qreal minInThreshold;
+    qreal maxInThreshold;
+    int voiceHold;
+    int minVoiceHold;
+    int maxVoiceHold;
+    int activeFrames;
+
+    bool echoCancel;
+#ifdef USE_FILTERAUDIO
+    Filter_Audio* filterer;
+#endif
+};
+
+#endif // NULLAUDIO_H
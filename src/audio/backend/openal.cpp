@@ -41,6 +41,33 @@
  *
  * @var AUDIO_CHANNELS
  * @brief Ideally, we'd auto-detect, but that's a sane default
+ *
+ * @var OpenAL::outputResamplers
+ * @brief Converts each peer source to the mixer format before it is queued.
+ *
+ * OpenAL would otherwise resample every source on its own, with a quality we can't choose.
+ *
+ * @var OpenAL::outputSampleRate
+ * @brief Sample rate the output device mixes at.
+ *
+ * @var OpenAL::outputChannels
+ * @brief Number of channels peer audio is converted to before mixing.
+ *
+ * @var OpenAL::inputResampler
+ * @brief Converts captured frames to the format the encoder expects.
+ *
+ * @var OpenAL::inputChannels
+ * @brief Number of channels the capture device was opened with.
+ *
+ * @var OpenAL::soundBuffers
+ * @brief Notification sounds by path, ready to play on the output device, 0 if unreadable.
+ *
+ * Buffers belong to the device they were created on, so they're rebuilt when it's reopened.
+ *
+ * @var OpenAL::soundData
+ * @brief Samples of the notification sounds by path, empty if the file couldn't be read.
+ *
+ * Outlives the output device, which is closed after every call, so the files are read only once.
  */
 
 static const unsigned int BUFFER_COUNT = 16;
@@ -55,6 +82,9 @@ OpenAL::OpenAL()
     , alMainSource{0}
     , alMainBuffer{0}
     , outputInitialized{false}
+    , outputSampleRate{AUDIO_SAMPLE_RATE}
+    , outputChannels{AUDIO_CHANNELS}
+    , inputChannels{AUDIO_CHANNELS}
     , minInGain{-30}
     , maxInGain{30}
     , minInThreshold{0.0f}
@@ -83,6 +113,9 @@ OpenAL::OpenAL()
     connect(&playMono16Timer, &QTimer::timeout, this, &OpenAL::playMono16SoundCleanup);
     playMono16Timer.setSingleShot(true);
 
+    connect(&Settings::getInstance(), &Settings::audioResamplerQualityChanged, this,
+            &OpenAL::updateResamplerQuality);
+
     audioThread->start();
 }
 
@@ -359,7 +392,7 @@ bool OpenAL::initInput(const QString& deviceName, uint32_t channels)
     assert(!alInDev);
 
     // TODO: Try to actually detect if our audio source is stereo
-    int stereoFlag = AUDIO_CHANNELS == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+    int stereoFlag = channels == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
     const uint32_t sampleRate = AUDIO_SAMPLE_RATE;
     const uint16_t frameDuration = AUDIO_FRAME_DURATION;
     const ALCsizei bufSize = (frameDuration * sampleRate * 4) / 1000 * channels;
@@ -378,6 +411,10 @@ bool OpenAL::initInput(const QString& deviceName, uint32_t channels)
     setInputThreshold(Settings::getInstance().getAudioThreshold());
     setVoiceHold(Settings::getInstance().getVoiceHold());
 
+    inputChannels = channels;
+    inputResampler.reset();
+    inputResampler.setQuality(resamplerQuality());
+
     qDebug() << "Opened audio input" << deviceName;
     alcCaptureStart(alInDev);
 
@@ -390,6 +427,7 @@ bool OpenAL::initInput(const QString& deviceName, uint32_t channels)
 bool OpenAL::initOutput(const QString& deviceName)
 {
     peerSources.clear();
+    outputResamplers.clear();
 
     outputInitialized = false;
     if (!Settings::getInstance().getAudioOutDevEnabled())
@@ -416,6 +454,13 @@ bool OpenAL::initOutput(const QString& deviceName)
         return false;
     }
 
+    // convert peer audio to the rate the device mixes at, so OpenAL doesn't resample per source
+    ALCint frequency = 0;
+    alcGetIntegerv(alOutDev, ALC_FREQUENCY, 1, &frequency);
+    checkAlcError(alOutDev);
+    outputSampleRate = frequency > 0 ? static_cast<uint32_t>(frequency) : AUDIO_SAMPLE_RATE;
+    outputChannels = AUDIO_CHANNELS;
+
     alGenSources(1, &alMainSource);
     checkAlError();
 
@@ -429,20 +474,83 @@ bool OpenAL::initOutput(const QString& deviceName)
         core->getAv()->invalidateCallSources();
     }
 
+    preloadSounds();
+
     outputInitialized = true;
     return true;
 }
 
+/**
+ * @brief Loads all notification sounds into buffers of the current output device.
+ */
+void OpenAL::preloadSounds()
+{
+    const Sound sounds[] = {Sound::NewMessage, Sound::Test, Sound::IncomingCall,
+                            Sound::OutgoingCall};
+
+    for (Sound sound : sounds) {
+        const QString path = getSound(sound);
+        if (!soundBuffers.contains(path)) {
+            loadSound(path);
+        }
+    }
+}
+
+/**
+ * @brief Loads a 44100Hz mono 16bit PCM sound into a cached buffer.
+ *
+ * The file is read only the first time, later devices get the samples read then.
+ *
+ * @param[in] path the path to the sound file
+ * @return the buffer, 0 if the file can't be read
+ */
+ALuint OpenAL::loadSound(const QString& path)
+{
+    auto it = soundData.find(path);
+    if (it == soundData.end()) {
+        QByteArray data;
+        QFile sndFile(path);
+        if (sndFile.open(QIODevice::ReadOnly)) {
+            data = sndFile.readAll();
+        } else {
+            qWarning() << "Can't open sound file" << path;
+        }
+
+        // a missing file is remembered too, it's not looked for again on every notification
+        it = soundData.insert(path, data);
+    }
+
+    ALuint buffer = 0;
+    if (!it.value().isEmpty()) {
+        alGenBuffers(1, &buffer);
+        alBufferData(buffer, AL_FORMAT_MONO16, it.value().constData(), it.value().size(), 44100);
+        checkAlError();
+    }
+
+    soundBuffers.insert(path, buffer);
+    return buffer;
+}
+
 /**
  * @brief Play a 44100Hz mono 16bit PCM sound from a file
  *
+ * The file is only read the first time it's played.
+ *
  * @param[in] path the path to the sound file
  */
 void OpenAL::playMono16Sound(const QString& path)
 {
-    QFile sndFile(path);
-    sndFile.open(QIODevice::ReadOnly);
-    playMono16Sound(QByteArray(sndFile.readAll()));
+    QMutexLocker locker(&audioLock);
+
+    if (!autoInitOutput())
+        return;
+
+    const auto it = soundBuffers.constFind(path);
+    const ALuint buffer = it != soundBuffers.constEnd() ? it.value() : loadSound(path);
+
+    if (buffer) {
+        playOnMainSource(buffer);
+    }
 }
 
 /**
@@ -458,6 +566,19 @@ void OpenAL::playMono16Sound(const QByteArray& data)
     if (!alMainBuffer)
         alGenBuffers(1, &alMainBuffer);
 
+    // the buffer can't be refilled while it's attached
+    alSourceStop(alMainSource);
+    alSourcei(alMainSource, AL_BUFFER, AL_NONE);
+
+    alBufferData(alMainBuffer, AL_FORMAT_MONO16, data.constData(), data.size(), 44100);
+    playOnMainSource(alMainBuffer);
+}
+
+/**
+ * @brief Plays a buffer on the main source, replacing any sound that's still playing.
+ */
+void OpenAL::playOnMainSource(ALuint buffer)
+{
     ALint state;
     alGetSourcei(alMainSource, AL_SOURCE_STATE, &state);
     if (state == AL_PLAYING) {
@@ -465,11 +586,14 @@ void OpenAL::playMono16Sound(const QByteArray& data)
         alSourcei(alMainSource, AL_BUFFER, AL_NONE);
     }
 
-    alBufferData(alMainBuffer, AL_FORMAT_MONO16, data.constData(), data.size(), 44100);
-    alSourcei(alMainSource, AL_BUFFER, static_cast<ALint>(alMainBuffer));
+    alSourcei(alMainSource, AL_BUFFER, static_cast<ALint>(buffer));
     alSourcePlay(alMainSource);
 
-    int durationMs = data.size() * 1000 / 2 / 44100;
+    ALint size = 0;
+    ALint frequency = 0;
+    alGetBufferi(buffer, AL_SIZE, &size);
+    alGetBufferi(buffer, AL_FREQUENCY, &frequency);
+    int durationMs = frequency > 0 ? size * 1000 / 2 / frequency : 0;
     playMono16Timer.start(durationMs + 50);
 }
 
@@ -502,8 +626,15 @@ void OpenAL::playAudioBuffer(uint sourceId, const int16_t* data, int samples, un
         alDeleteBuffers(processed - 1, bufids + 1);
     }
 
-    alBufferData(bufids[0], (channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16, data,
-                 samples * 2 * channels, sampleRate);
+    size_t outSamples = 0;
+    AudioResampler& resampler = outputResamplers[sourceId];
+    const int16_t* pcm = resampler.process(data, static_cast<size_t>(samples), channels,
+                                           static_cast<uint32_t>(sampleRate), outputChannels,
+                                           outputSampleRate, outSamples);
+
+    alBufferData(bufids[0], (outputChannels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16, pcm,
+                 static_cast<ALsizei>(outSamples * 2 * outputChannels),
+                 static_cast<ALsizei>(outputSampleRate));
     alSourceQueueBuffers(sourceId, 1, bufids);
 
     ALint state;
@@ -522,6 +653,7 @@ void OpenAL::cleanupInput()
         return;
 
     qDebug() << "Closing audio input";
+    inputLevel.reset();
     alcCaptureStop(alInDev);
     if (alcCaptureCloseDevice(alInDev) == ALC_TRUE)
         alInDev = nullptr;
@@ -546,6 +678,15 @@ void OpenAL::cleanupOutput()
             alMainBuffer = 0;
         }
 
+        // only the buffers go with the device, the samples stay in soundData
+        for (ALuint buffer : soundBuffers) {
+            if (buffer) {
+                alDeleteBuffers(1, &buffer);
+            }
+        }
+
+        soundBuffers.clear();
+
         if (!alcMakeContextCurrent(nullptr)) {
             qWarning("Failed to clear audio context.");
         }
@@ -573,32 +714,17 @@ void OpenAL::playMono16SoundCleanup()
     alGetSourcei(alMainSource, AL_SOURCE_STATE, &state);
     if (state == AL_STOPPED) {
         alSourcei(alMainSource, AL_BUFFER, AL_NONE);
-        alDeleteBuffers(1, &alMainBuffer);
-        alMainBuffer = 0;
+        // cached sounds stay around for the next notification
+        if (alMainBuffer) {
+            alDeleteBuffers(1, &alMainBuffer);
+            alMainBuffer = 0;
+        }
     } else {
         // the audio didn't finish, try again later
         playMono16Timer.start(10);
     }
 }
 
-/**
- * @brief Called by doCapture to calculate volume of the audio buffer
- *
- * @param[in] buf   the current audio buffer
- *
- * @return volume in percent of max volume
- */
-float OpenAL::getVolume(int16_t *buf)
-{
-    quint32 samples = AUDIO_FRAME_SAMPLE_COUNT * AUDIO_CHANNELS;
-    float sum = 0.0;
-    for (quint32 i = 0; i < samples; i++) {
-        float sample = (float)buf[i] / (float)std::numeric_limits<int16_t>::max();
-        sum += abs(sample);
-    }
-    return sum/samples;
-}
-
 void OpenAL::stopActive()
 {
     isActive = false;
@@ -622,29 +748,26 @@ void OpenAL::doCapture()
     int16_t buf[AUDIO_FRAME_SAMPLE_COUNT * AUDIO_CHANNELS];
     alcCaptureSamples(alInDev, buf, AUDIO_FRAME_SAMPLE_COUNT);
 
-    float volume = getVolume(buf);
+    float volume = inputLevel.update(buf, AUDIO_FRAME_SAMPLE_COUNT * AUDIO_CHANNELS);
     if (volume > inputThreshold)
     {
         isActive = true;
         emit startActive(voiceHold);
     }
 
-    emit Audio::volumeAvailable(volume);
     if (!isActive)
     {
         return;
     }
 
-    for (quint32 i = 0; i < AUDIO_FRAME_SAMPLE_COUNT * AUDIO_CHANNELS; ++i) {
-        // gain amplification with clipping to 16-bit boundaries
-        int ampPCM =
-            qBound<int>(std::numeric_limits<int16_t>::min(), qRound(buf[i] * inputGainFactor()),
-                        std::numeric_limits<int16_t>::max());
+    applyGain(buf, AUDIO_FRAME_SAMPLE_COUNT * AUDIO_CHANNELS, inputGainFactor());
 
-        buf[i] = static_cast<int16_t>(ampPCM);
-    }
+    size_t samples = 0;
+    const int16_t* pcm = inputResampler.process(buf, AUDIO_FRAME_SAMPLE_COUNT, inputChannels,
+                                                AUDIO_SAMPLE_RATE, AUDIO_CHANNELS,
+                                                AUDIO_SAMPLE_RATE, samples);
 
-    emit Audio::frameAvailable(buf, AUDIO_FRAME_SAMPLE_COUNT, AUDIO_CHANNELS, AUDIO_SAMPLE_RATE);
+    emit Audio::frameAvailable(pcm, samples, AUDIO_CHANNELS, AUDIO_SAMPLE_RATE);
 }
 
 /**
@@ -702,6 +825,7 @@ void OpenAL::subscribeOutput(uint& sid)
     alGenSources(1, &sid);
     assert(sid);
     peerSources << sid;
+    outputResamplers[sid] = AudioResampler{resamplerQuality()};
 
     qDebug() << "Audio source" << sid << "created. Sources active:" << peerSources.size();
 }
@@ -711,6 +835,7 @@ void OpenAL::unsubscribeOutput(uint& sid)
     QMutexLocker locker(&audioLock);
 
     peerSources.removeAll(sid);
+    outputResamplers.erase(sid);
 
     if (sid) {
         if (alIsSource(sid)) {
@@ -753,8 +878,10 @@ void OpenAL::stopLoop()
     alGetSourcei(alMainSource, AL_SOURCE_STATE, &state);
     if (state == AL_STOPPED) {
         alSourcei(alMainSource, AL_BUFFER, AL_NONE);
-        alDeleteBuffers(1, &alMainBuffer);
-        alMainBuffer = 0;
+        if (alMainBuffer) {
+            alDeleteBuffers(1, &alMainBuffer);
+            alMainBuffer = 0;
+        }
     }
 }
 
@@ -778,6 +905,31 @@ qreal OpenAL::inputGainFactor() const
     return gainFactor;
 }
 
+/**
+ * @brief Returns the resampler quality selected in the settings.
+ */
+AudioResampler::Quality OpenAL::resamplerQuality() const
+{
+    const int quality = Settings::getInstance().getAudioResamplerQuality();
+    return static_cast<AudioResampler::Quality>(
+        qBound(static_cast<int>(AudioResampler::Quality::Fast), quality,
+               static_cast<int>(AudioResampler::Quality::Best)));
+}
+
+/**
+ * @brief Switches the resamplers of all streams to the quality selected in the settings.
+ */
+void OpenAL::updateResamplerQuality()
+{
+    QMutexLocker locker(&audioLock);
+
+    const AudioResampler::Quality quality = resamplerQuality();
+    inputResampler.setQuality(quality);
+    for (auto& resampler : outputResamplers) {
+        resampler.second.setQuality(quality);
+    }
+}
+
 void OpenAL::setInputGain(qreal dB)
 {
     gain = qBound(minInGain, dB, maxInGain);
@@ -22,10 +22,14 @@
 #define OPENAL_H
 
 #include "src/audio/audio.h"
+#include "src/audio/audioresampler.h"
 
 #include <atomic>
 #include <cmath>
+#include <map>
 
+#include <QByteArray>
+#include <QHash>
 #include <QMutex>
 #include <QObject>
 #include <QTimer>
@@ -106,6 +110,7 @@ protected:
     static void checkAlcError(ALCdevice* device) noexcept;
 
     qreal inputGainFactor() const;
+    AudioResampler::Quality resamplerQuality() const;
     virtual void cleanupInput();
     virtual void cleanupOutput();
 
@@ -114,12 +119,16 @@ protected:
 
     bool initInput(const QString& deviceName, uint32_t channels);
 
+    void preloadSounds();
+
 private:
     virtual bool initInput(const QString& deviceName);
     virtual bool initOutput(const QString& outDevDescr);
     void playMono16SoundCleanup();
-    float getVolume(int16_t *buf);
+    ALuint loadSound(const QString& path);
+    void playOnMainSource(ALuint buffer);
     void doCapture();
+    void updateResamplerQuality();
 
 protected:
     QThread* audioThread;
@@ -133,9 +142,16 @@ protected:
     ALCcontext* alOutContext;
     ALuint alMainSource;
     ALuint alMainBuffer;
+    QHash<QString, ALuint> soundBuffers;
+    QHash<QString, QByteArray> soundData;
     bool outputInitialized;
 
     QList<ALuint> peerSources;
+    std::map<ALuint, AudioResampler> outputResamplers;
+    uint32_t outputSampleRate;
+    uint32_t outputChannels;
+    AudioResampler inputResampler;
+    uint32_t inputChannels;
     qreal gain;
     qreal gainFactor;
     qreal minInGain = -30;
@@ -210,6 +210,7 @@ bool OpenAL2::initOutputEchoCancel()
 bool OpenAL2::initOutput(const QString& deviceName)
 {
     peerSources.clear();
+    outputResamplers.clear();
 
     outputInitialized = false;
     if (!Settings::getInstance().getAudioOutDevEnabled()) {
@@ -240,11 +241,21 @@ bool OpenAL2::initOutput(const QString& deviceName)
     // try to init echo cancellation
     echoCancelSupported = initOutputEchoCancel();
 
-    if (!echoCancelSupported) {
+    if (echoCancelSupported) {
+        // the loopback device renders mono at our own rate, convert peer audio to that
+        outputSampleRate = AUDIO_SAMPLE_RATE;
+        outputChannels = 1;
+    } else {
         // fallback to normal, no proxy device needed
         qDebug() << "Echo cancellation disabled";
         alProxyDev = alOutDev;
         alProxyContext = alOutContext;
+
+        ALCint frequency = 0;
+        alcGetIntegerv(alOutDev, ALC_FREQUENCY, 1, &frequency);
+        checkAlcError(alOutDev);
+        outputSampleRate = frequency > 0 ? static_cast<uint32_t>(frequency) : AUDIO_SAMPLE_RATE;
+        outputChannels = 2;
     }
 
     alGenSources(1, &alMainSource);
@@ -262,6 +273,8 @@ bool OpenAL2::initOutput(const QString& deviceName)
 
     // ensure alProxyContext is active
     alcMakeContextCurrent(alProxyContext);
+    // the main source plays in the proxy context, so its sounds live on the proxy device
+    preloadSounds();
     outputInitialized = true;
     return true;
 }
@@ -369,15 +382,13 @@ void OpenAL2::doInput()
     }
 
     // gain amplification with clipping to 16-bit boundaries
-    for (quint32 i = 0; i < AUDIO_FRAME_SAMPLE_COUNT; ++i) {
-        int ampPCM = qBound<int>(std::numeric_limits<int16_t>::min(),
-                                 qRound(buf[i] * OpenAL::inputGainFactor()),
-                                 std::numeric_limits<int16_t>::max());
+    applyGain(buf, AUDIO_FRAME_SAMPLE_COUNT, OpenAL::inputGainFactor());
 
-        buf[i] = static_cast<int16_t>(ampPCM);
-    }
+    size_t samples = 0;
+    const int16_t* pcm = inputResampler.process(buf, AUDIO_FRAME_SAMPLE_COUNT, inputChannels,
+                                                AUDIO_SAMPLE_RATE, 1, AUDIO_SAMPLE_RATE, samples);
 
-    emit Audio::frameAvailable(buf, AUDIO_FRAME_SAMPLE_COUNT, 1, AUDIO_SAMPLE_RATE);
+    emit Audio::frameAvailable(pcm, samples, 1, AUDIO_SAMPLE_RATE);
 }
 
 /**
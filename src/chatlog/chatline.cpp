@@ -167,6 +167,18 @@ void ChatLine::replaceContent(int col, ChatLineContent* lineContent)
 }
 
 void ChatLine::layout(qreal w, QPointF scenePos)
+{
+    layout(w, scenePos, QVector<ContentMetrics>());
+}
+
+/**
+ * @brief Lays out the line, using the metrics measured for the columns where they still fit.
+ *
+ * @param w Width of the line.
+ * @param scenePos Top left corner of the line.
+ * @param metrics Metrics of the columns, measured at the widths from getColumnWidths().
+ */
+void ChatLine::layout(qreal w, QPointF scenePos, const QVector<ContentMetrics>& metrics)
 {
     if (!content.size())
         return;
@@ -174,35 +186,20 @@ void ChatLine::layout(qreal w, QPointF scenePos)
     width = w;
     bbox.setTopLeft(scenePos);
 
-    qreal fixedWidth = (content.size() - 1) * columnSpacing;
-    qreal varWidth = 0.0; // used for normalisation
-
-    for (int i = 0; i < format.size(); ++i) {
-        if (format[i].policy == ColumnFormat::FixedSize)
-            fixedWidth += format[i].size;
-        else
-            varWidth += format[i].size;
-    }
-
-    if (varWidth == 0.0)
-        varWidth = 1.0;
-
-    qreal leftover = qMax(0.0, width - fixedWidth);
+    const QVector<qreal> widths = getColumnWidths(w);
 
     qreal maxVOffset = 0.0;
     qreal xOffset = 0.0;
     QVector<qreal> xPos(content.size());
 
     for (int i = 0; i < content.size(); ++i) {
-        // calculate the effective width of the current column
-        qreal width;
-        if (format[i].policy == ColumnFormat::FixedSize)
-            width = format[i].size;
-        else
-            width = format[i].size / varWidth * leftover;
+        const qreal width = widths[i];
 
-        // set the width of the current column
-        content[i]->setWidth(width);
+        // set the width of the current column, the content may have been replaced since measuring
+        if (i < metrics.size() && metrics[i].content == content[i] && metrics[i].width == width)
+            content[i]->setMetrics(metrics[i]);
+        else
+            content[i]->setWidth(width);
 
         // calculate horizontal alignment
         qreal xAlign = 0.0;
@@ -237,26 +234,42 @@ void ChatLine::layout(qreal w, QPointF scenePos)
     updateBBox();
 }
 
-void ChatLine::moveBy(qreal deltaY)
+/**
+ * @brief Calculates the effective widths of the columns for a line width.
+ */
+QVector<qreal> ChatLine::getColumnWidths(qreal w) const
 {
-    // reposition only
-    for (ChatLineContent* c : content)
-        c->moveBy(0, deltaY);
+    qreal fixedWidth = (content.size() - 1) * columnSpacing;
+    qreal varWidth = 0.0; // used for normalisation
 
-    bbox.moveTop(bbox.top() + deltaY);
-}
+    for (int i = 0; i < format.size(); ++i) {
+        if (format[i].policy == ColumnFormat::FixedSize)
+            fixedWidth += format[i].size;
+        else
+            varWidth += format[i].size;
+    }
 
-bool ChatLine::lessThanBSRectTop(const ChatLine::Ptr& lhs, const qreal& rhs)
-{
-    return lhs->sceneBoundingRect().top() < rhs;
-}
+    if (varWidth == 0.0)
+        varWidth = 1.0;
 
-bool ChatLine::lessThanBSRectBottom(const ChatLine::Ptr& lhs, const qreal& rhs)
-{
-    return lhs->sceneBoundingRect().bottom() < rhs;
+    qreal leftover = qMax(0.0, w - fixedWidth);
+
+    QVector<qreal> widths(content.size());
+    for (int i = 0; i < content.size(); ++i) {
+        if (format[i].policy == ColumnFormat::FixedSize)
+            widths[i] = format[i].size;
+        else
+            widths[i] = format[i].size / varWidth * leftover;
+    }
+
+    return widths;
 }
 
-bool ChatLine::lessThanRowIndex(const ChatLine::Ptr& lhs, const ChatLine::Ptr& rhs)
+void ChatLine::moveBy(qreal deltaY)
 {
-    return lhs->getRow() < rhs->getRow();
+    // reposition only
+    for (ChatLineContent* c : content)
+        c->moveBy(0, deltaY);
+
+    bbox.moveTop(bbox.top() + deltaY);
 }
@@ -30,6 +30,7 @@ class ChatLineContent;
 class QGraphicsScene;
 class QStyleOptionGraphicsItem;
 class QFont;
+struct ContentMetrics;
 
 struct ColumnFormat
 {
@@ -75,6 +76,8 @@ public:
 
     void replaceContent(int col, ChatLineContent* lineContent);
     void layout(qreal width, QPointF scenePos);
+    void layout(qreal width, QPointF scenePos, const QVector<ContentMetrics>& metrics);
+    QVector<qreal> getColumnWidths(qreal width) const;
     void moveBy(qreal deltaY);
     void removeFromScene();
     void addToScene(QGraphicsScene* scene);
@@ -91,11 +94,6 @@ public:
 
     bool isOverSelection(QPointF scenePos);
 
-    // comparators
-    static bool lessThanBSRectTop(const ChatLine::Ptr& lhs, const qreal& rhs);
-    static bool lessThanBSRectBottom(const ChatLine::Ptr& lhs, const qreal& rhs);
-    static bool lessThanRowIndex(const ChatLine::Ptr& lhs, const ChatLine::Ptr& rhs);
-
 protected:
     friend class ChatLog;
 
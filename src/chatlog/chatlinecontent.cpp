@@ -19,6 +19,17 @@
 
 #include "chatlinecontent.h"
 
+/**
+ * @struct ContentMetrics
+ * @brief Size of a content laid out at a width, measured off the GUI thread.
+ *
+ * @var ContentMetrics::content
+ * @brief Content that was measured, only to tell whether it was replaced meanwhile.
+ *
+ * @var ContentMetrics::width
+ * @brief Width the content was measured at, negative if it wasn't measured.
+ */
+
 void ChatLineContent::setIndex(int r, int c)
 {
     row = r;
@@ -40,6 +51,25 @@ int ChatLineContent::type() const
     return GraphicsItemType::ChatLineContentType;
 }
 
+/**
+ * @brief Returns a function that measures the content at a width on any thread.
+ *
+ * The function must only work on copies of what it needs, the content may be gone when it runs.
+ * Content that is cheap to lay out returns an empty function and is laid out by setWidth().
+ */
+ChatLineContent::Measure ChatLineContent::getMeasure() const
+{
+    return Measure();
+}
+
+/**
+ * @brief Applies metrics from getMeasure(), instead of laying out with setWidth().
+ */
+void ChatLineContent::setMetrics(const ContentMetrics& metrics)
+{
+    setWidth(metrics.width);
+}
+
 void ChatLineContent::selectionMouseMove(QPointF)
 {
 }
@@ -22,7 +22,18 @@
 
 #include <QGraphicsItem>
 
+#include <functional>
+
 class ChatLine;
+class ChatLineContent;
+
+struct ContentMetrics
+{
+    const ChatLineContent* content = nullptr;
+    qreal width = -1.0;
+    QSizeF size;
+    qreal ascent = 0.0;
+};
 
 class ChatLineContent : public QObject, public QGraphicsItem
 {
@@ -30,6 +41,8 @@ class ChatLineContent : public QObject, public QGraphicsItem
     Q_INTERFACES(QGraphicsItem)
 
 public:
+    using Measure = std::function<ContentMetrics(qreal width)>;
+
     enum GraphicsItemType
     {
         ChatLineContentType = QGraphicsItem::UserType + 1,
@@ -39,6 +52,8 @@ public:
     int getRow() const;
 
     virtual void setWidth(qreal width) = 0;
+    virtual Measure getMeasure() const;
+    virtual void setMetrics(const ContentMetrics& metrics);
     virtual int type() const final;
 
     virtual void selectionMouseMove(QPointF scenePos);
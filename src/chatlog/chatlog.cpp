@@ -36,23 +36,60 @@
 /**
  * @var ChatLog::repNameAfter
  * @brief repetition interval sender name (sec)
+ *
+ * @var ChatLog::visibleFirst
+ * @brief First row in the scene.
+ *
+ * @var ChatLog::visibleLast
+ * @brief Row after the last row in the scene.
+ *
+ * The rows in [visibleFirst, visibleLast) are in the scene, those in the viewport and a viewport
+ * height above and below it. Being a contiguous range, checkVisibility() only has to diff the
+ * old and new boundaries instead of searching the lines it had shown.
+ *
+ * All other lines are left out of the scene and released, see lines. Their positions come from
+ * the heights cached in the geometry, they are created and laid out again once they come close
+ * to the viewport.
+ *
+ * @var ChatLog::lines
+ * @brief Record of every row, with its line while it's in the scene.
+ *
+ * A line out of the scene is released, only the ChatMessage::Record it can be created again from
+ * is kept. Lines that someone else still holds, like messages waiting to be sent, lines without a
+ * record, like file transfers, and the line of a precise selection are kept as they are.
+ * Selections are rows, so they don't need the lines.
+ *
+ * @var ChatLog::geometry
+ * @brief Heights and positions of all lines, see LineGeometry.
  */
 
-template <class T>
-T clamp(T x, T min, T max)
+namespace {
+/// Height assumed for lines that weren't laid out, as long as no line was
+const qreal DEFAULT_LINE_HEIGHT = 20.0;
+
+/**
+ * @brief Height of a line with the given column metrics, aligned as by ChatLine::layout().
+ */
+qreal measuredHeight(const QVector<ContentMetrics>& metrics)
 {
-    if (x > max)
-        return max;
-    if (x < min)
-        return min;
-    return x;
+    qreal ascent = 0.0;
+    for (const ContentMetrics& column : metrics)
+        ascent = qMax(ascent, column.ascent);
+
+    qreal height = 0.0;
+    for (const ContentMetrics& column : metrics) {
+        if (column.content)
+            height = qMax(height, ascent - column.ascent + column.size.height());
+    }
+
+    return height;
+}
 }
 
 ChatLog::ChatLog(QWidget* parent)
     : QGraphicsView(parent)
 {
     // Create the scene
-    busyScene = new QGraphicsScene(this);
     scene = new QGraphicsScene(this);
     scene->setItemIndexMethod(QGraphicsScene::BspTreeIndex);
     setScene(scene);
@@ -99,7 +136,8 @@ ChatLog::ChatLog(QWidget* parent)
     connect(selectionTimer, &QTimer::timeout, this, &ChatLog::onSelectionTimerTimeout);
 
     // Background worker
-    // Updates the layout of all chat-lines after a resize
+    // Applies the layouts measured on the thread pool to the chat-lines outside of the viewport
+    // after a resize, to correct their heights
     workerTimer = new QTimer(this);
     workerTimer->setSingleShot(false);
     workerTimer->setInterval(5);
@@ -126,11 +164,8 @@ ChatLog::~ChatLog()
     Translator::unregister(this);
 
     // Remove chatlines from scene
-    for (ChatLine::Ptr l : lines)
-        l->removeFromScene();
-
-    if (busyNotification)
-        busyNotification->removeFromScene();
+    for (int i = visibleFirst; i < visibleLast; ++i)
+        lines[i].line->removeFromScene();
 
     if (typingNotification)
         typingNotification->removeFromScene();
@@ -141,15 +176,23 @@ void ChatLog::clearSelection()
     if (selectionMode == None)
         return;
 
-    for (int i = selFirstRow; i <= selLastRow; ++i)
-        lines[i]->selectionCleared();
+    for (int i = selFirstRow; i <= selLastRow; ++i) {
+        if (lines[i].line)
+            lines[i].line->selectionCleared();
+    }
 
+    const int clickedRow = selClickedRow;
     selFirstRow = -1;
     selLastRow = -1;
     selClickedCol = -1;
     selClickedRow = -1;
 
     selectionMode = None;
+
+    // the line of a precise selection was kept when scrolled out of the scene
+    if (clickedRow >= 0 && (clickedRow < visibleFirst || clickedRow >= visibleLast))
+        releaseLine(clickedRow);
+
     emit selectionChanged();
 
     updateMultiSelectionRect();
@@ -165,27 +208,20 @@ void ChatLog::updateSceneRect()
     setSceneRect(calculateSceneRect());
 }
 
-void ChatLog::layout(int start, int end, qreal width)
+/**
+ * @brief Lays out a line at its position and caches its height.
+ *
+ * The lines below keep their old positions in the scene until reposition() is called.
+ *
+ * @param row Line to lay out.
+ * @param width Width to lay out at.
+ * @param metrics Columns measured by the layout worker, the others are laid out here.
+ */
+void ChatLog::layoutLine(int row, qreal width, const QVector<ContentMetrics>& metrics)
 {
-    if (lines.empty())
-        return;
-
-    qreal h = 0.0;
-
-    // Line at start-1 is considered to have the correct position. All following lines are
-    // positioned in respect to this line.
-    if (start - 1 >= 0)
-        h = lines[start - 1]->sceneBoundingRect().bottom() + lineSpacing;
-
-    start = clamp<int>(start, 0, lines.size());
-    end = clamp<int>(end + 1, 0, lines.size());
-
-    for (int i = start; i < end; ++i) {
-        ChatLine* l = lines[i].get();
-
-        l->layout(width, QPointF(0.0, h));
-        h += l->sceneBoundingRect().height() + lineSpacing;
-    }
+    ChatLine* l = lines[row].line.get();
+    l->layout(width, QPointF(0.0, geometry.getTop(row)), metrics);
+    geometry.setHeight(row, l->sceneBoundingRect().height());
 }
 
 void ChatLog::mousePressEvent(QMouseEvent* ev)
@@ -276,14 +312,16 @@ void ChatLog::mouseMoveEvent(QMouseEvent* ev)
                 } else if (col != selClickedCol) {
                     selectionMode = Multi;
 
-                    lines[selClickedRow]->selectionCleared();
+                    if (lines[selClickedRow].line)
+                        lines[selClickedRow].line->selectionCleared();
                 }
             } else if (line.get()) {
                 row = line->getRow();
 
                 if (row != selClickedRow) {
                     selectionMode = Multi;
-                    lines[selClickedRow]->selectionCleared();
+                    if (lines[selClickedRow].line)
+                        lines[selClickedRow].line->selectionCleared();
                 }
             } else {
                 return;
@@ -305,15 +343,14 @@ void ChatLog::mouseMoveEvent(QMouseEvent* ev)
 // Much faster than QGraphicsScene::itemAt()!
 ChatLineContent* ChatLog::getContentFromPos(QPointF scenePos) const
 {
-    if (lines.empty())
+    const int row = geometry.findFirstByBottom(scenePos.y());
+    if (row >= lines.size())
         return nullptr;
 
-    auto itr =
-        std::lower_bound(lines.cbegin(), lines.cend(), scenePos.y(), ChatLine::lessThanBSRectBottom);
-
-    // find content
-    if (itr != lines.cend() && (*itr)->sceneBoundingRect().contains(scenePos))
-        return (*itr)->getContent(scenePos);
+    // only lines in the scene have their content laid out at their position
+    const ChatLine::Ptr& line = lines[row].line;
+    if (line && line->isVisible && line->sceneBoundingRect().contains(scenePos))
+        return line->getContent(scenePos);
 
     return nullptr;
 }
@@ -338,21 +375,28 @@ qreal ChatLog::useableWidth() const
     return width() - verticalScrollBar()->sizeHint().width() - margins.right() - margins.left();
 }
 
-void ChatLog::reposition(int start, int end, qreal deltaY)
+/**
+ * @brief Height to assume for lines that weren't laid out yet.
+ */
+qreal ChatLog::estimatedLineHeight() const
 {
-    if (lines.isEmpty())
-        return;
-
-    start = clamp<int>(start, 0, lines.size() - 1);
-    end = clamp<int>(end + 1, 0, lines.size());
+    return geometry.size() ? geometry.getMeanHeight() : DEFAULT_LINE_HEIGHT;
+}
 
-    for (int i = start; i < end; ++i) {
-        ChatLine* l = lines[i].get();
-        l->moveBy(deltaY);
+/**
+ * @brief Moves the lines in the scene to the positions in the geometry.
+ */
+void ChatLog::reposition()
+{
+    for (int i = visibleFirst; i < visibleLast; ++i) {
+        ChatLine* line = lines[i].line.get();
+        const qreal deltaY = geometry.getTop(i) - line->sceneBoundingRect().top();
+        if (deltaY != 0.0)
+            line->moveBy(deltaY);
     }
 }
 
-void ChatLog::insertChatlineAtBottom(ChatLine::Ptr l)
+void ChatLog::insertChatlineAtBottom(ChatMessage::Ptr l)
 {
     if (!l.get())
         return;
@@ -360,12 +404,14 @@ void ChatLog::insertChatlineAtBottom(ChatLine::Ptr l)
     bool stickToBtm = stickToBottom();
 
     // insert
+    LineRecord record;
+    record.line = l;
     l->setRow(lines.size());
-    l->addToScene(scene);
-    lines.append(l);
+    lines.append(record);
+    geometry.append(estimatedLineHeight());
 
     // partial refresh
-    layout(lines.last()->getRow(), lines.size(), useableWidth());
+    layoutLine(l->getRow(), useableWidth());
     updateSceneRect();
 
     if (stickToBtm)
@@ -373,49 +419,61 @@ void ChatLog::insertChatlineAtBottom(ChatLine::Ptr l)
 
     checkVisibility();
     updateTypingNotification();
+    scheduleRelease();
 }
 
-void ChatLog::insertChatlineOnTop(ChatLine::Ptr l)
+void ChatLog::insertChatlineOnTop(ChatMessage::Ptr l)
 {
     if (!l.get())
         return;
 
-    insertChatlineOnTop(QList<ChatLine::Ptr>() << l);
+    insertChatlineOnTop(QList<ChatMessage::Ptr>() << l);
 }
 
-void ChatLog::insertChatlineOnTop(const QList<ChatLine::Ptr>& newLines)
+void ChatLog::insertChatlineOnTop(const QList<ChatMessage::Ptr>& newLines)
 {
     if (newLines.isEmpty())
         return;
 
-    QGraphicsScene::ItemIndexMethod oldIndexMeth = scene->itemIndexMethod();
-    scene->setItemIndexMethod(QGraphicsScene::NoIndex);
+    // keep showing the same lines
+    ScrollAnchor anchor = getScrollAnchor();
+    if (anchor.row >= 0)
+        anchor.row += newLines.size();
 
     // alloc space for old and new lines
-    QVector<ChatLine::Ptr> combLines;
+    QVector<LineRecord> combLines;
     combLines.reserve(newLines.size() + lines.size());
 
-    // add the new lines
+    // add the new lines, they are laid out once they come into view or by the worker
     int i = 0;
-    for (ChatLine::Ptr l : newLines) {
-        l->addToScene(scene);
-        l->visibilityChanged(false);
+    for (ChatMessage::Ptr l : newLines) {
+        LineRecord record;
+        record.line = l;
         l->setRow(i++);
-        combLines.push_back(l);
+        combLines.push_back(record);
     }
 
-    // add the old lines
-    for (ChatLine::Ptr l : lines) {
-        l->setRow(i++);
-        combLines.push_back(l);
+    // add the old lines, released ones get their row when created again
+    for (const LineRecord& record : lines) {
+        if (record.line)
+            record.line->setRow(i);
+
+        ++i;
+        combLines.push_back(record);
     }
 
     lines = combLines;
+    visibleFirst += newLines.size();
+    visibleLast += newLines.size();
+    geometry.prepend(newLines.size(), estimatedLineHeight());
 
-    scene->setItemIndexMethod(oldIndexMeth);
+    restoreScrollAnchor(anchor);
+    checkVisibility();
+    updateTypingNotification();
 
-    // redo layout
+    // correct the estimated heights, measured from the lines before they're released
     startResizeWorker();
+    scheduleRelease();
 }
 
 bool ChatLog::stickToBottom() const
@@ -429,36 +487,85 @@ void ChatLog::scrollToBottom()
     verticalScrollBar()->setValue(verticalScrollBar()->maximum());
 }
 
+/**
+ * @brief Lays out all lines again, e.g. after the width or the font changed.
+ *
+ * The lines around the viewport are laid out right away, the others by the worker.
+ */
+void ChatLog::invalidateLayout()
+{
+    geometry.invalidate();
+    checkVisibility();
+    startResizeWorker();
+}
+
+/**
+ * @brief (Re)starts laying out the lines with stale heights in the background.
+ *
+ * The lines are measured on the thread pool, the worker timer applies the results.
+ */
 void ChatLog::startResizeWorker()
 {
     if (lines.empty())
         return;
 
-    // (re)start the worker
-    if (!workerTimer->isActive()) {
-        // these values must not be reevaluated while the worker is running
-        workerStb = stickToBottom();
+    const qreal width = useableWidth();
+    QVector<LayoutWorker::Job> jobs;
 
-        if (!visibleLines.empty())
-            workerAnchorLine = visibleLines.first();
-    }
+    for (int i = 0; i < lines.size(); ++i) {
+        // creating released lines just to measure them would cost more than laying them out,
+        // they keep their height until they're shown
+        const ChatLine::Ptr& line = lines[i].line;
+        if (!geometry.isStale(i) || !line)
+            continue;
 
-    // switch to busy scene displaying the busy notification if there is a lot
-    // of text to be resized
-    int txt = 0;
-    for (ChatLine::Ptr line : lines) {
-        if (txt > 500000)
-            break;
-        for (ChatLineContent* content : line->content)
-            txt += content->getText().size();
+        LayoutWorker::Job job;
+        job.row = i;
+        job.widths = line->getColumnWidths(width);
+        for (int c = 0; c < job.widths.size(); ++c)
+            job.measures << line->getContent(c)->getMeasure();
+
+        jobs << job;
     }
-    if (txt > 500000)
-        setScene(busyScene);
 
-    workerLastIndex = 0;
+    layoutWorker.start(jobs);
     workerTimer->start();
+}
+
+/**
+ * @brief Remembers which line is at the top of the viewport.
+ */
+ChatLog::ScrollAnchor ChatLog::getScrollAnchor() const
+{
+    ScrollAnchor anchor;
+    anchor.bottom = stickToBottom();
+    anchor.row = -1;
+    anchor.offset = 0.0;
+
+    const qreal top = getVisibleRect().top();
+    const int row = geometry.findFirstByBottom(top);
+    if (row < geometry.size()) {
+        anchor.row = row;
+        anchor.offset = top - geometry.getTop(row);
+    }
 
-    verticalScrollBar()->hide();
+    return anchor;
+}
+
+/**
+ * @brief Scrolls back to the line remembered by getScrollAnchor(), after lines above it
+ * changed their height.
+ */
+void ChatLog::restoreScrollAnchor(const ScrollAnchor& anchor)
+{
+    updateSceneRect();
+
+    if (anchor.bottom) {
+        scrollToBottom();
+    } else if (anchor.row >= 0 && anchor.row < geometry.size()) {
+        const qreal top = geometry.getTop(anchor.row) + anchor.offset;
+        verticalScrollBar()->setValue(qRound(top - sceneRect().top()));
+    }
 }
 
 void ChatLog::mouseDoubleClickEvent(QMouseEvent* ev)
@@ -488,20 +595,19 @@ void ChatLog::mouseDoubleClickEvent(QMouseEvent* ev)
 QString ChatLog::getSelectedText() const
 {
     if (selectionMode == Precise) {
-        return lines[selClickedRow]->content[selClickedCol]->getSelectedText();
+        return lines[selClickedRow].line->content[selClickedCol]->getSelectedText();
     } else if (selectionMode == Multi) {
         // build a nicely formatted message
         QString out;
 
         for (int i = selFirstRow; i <= selLastRow; ++i) {
-            if (lines[i]->content[1]->getText().isEmpty())
+            if (getLineText(i, 1).isEmpty())
                 continue;
 
-            QString timestamp = lines[i]->content[2]->getText().isEmpty()
-                                    ? tr("pending")
-                                    : lines[i]->content[2]->getText();
-            QString author = lines[i]->content[0]->getText();
-            QString msg = lines[i]->content[1]->getText();
+            QString timestamp =
+                getLineText(i, 2).isEmpty() ? tr("pending") : getLineText(i, 2);
+            QString author = getLineText(i, 0);
+            QString msg = getLineText(i, 1);
 
             out +=
                 QString(out.isEmpty() ? "[%2] %1: %3" : "\n[%2] %1: %3").arg(author, timestamp, msg);
@@ -528,15 +634,23 @@ ChatLine::Ptr ChatLog::getTypingNotification() const
     return typingNotification;
 }
 
+/**
+ * @brief Returns all lines, released ones are created again for the caller.
+ */
 QVector<ChatLine::Ptr> ChatLog::getLines()
 {
-    return lines;
+    QVector<ChatLine::Ptr> result;
+    result.reserve(lines.size());
+    for (int i = 0; i < lines.size(); ++i)
+        result << getLine(i);
+
+    return result;
 }
 
 ChatLine::Ptr ChatLog::getLatestLine() const
 {
     if (!lines.empty()) {
-        return lines.last();
+        return getLine(lines.size() - 1);
     }
     return nullptr;
 }
@@ -555,18 +669,24 @@ void ChatLog::clear()
 {
     clearSelection();
 
-    QVector<ChatLine::Ptr> savedLines;
+    QVector<ChatMessage::Ptr> savedLines;
 
-    for (ChatLine::Ptr l : lines) {
-        if (isActiveFileTransfer(l))
-            savedLines.push_back(l);
-        else
-            l->removeFromScene();
+    for (const LineRecord& record : lines) {
+        if (record.line && isActiveFileTransfer(record.line))
+            savedLines.push_back(record.line);
     }
 
+    for (int i = visibleFirst; i < visibleLast; ++i) {
+        lines[i].line->visibilityChanged(false);
+        lines[i].line->removeFromScene();
+    }
+
+    layoutWorker.cancel();
     lines.clear();
-    visibleLines.clear();
-    for (ChatLine::Ptr l : savedLines)
+    visibleFirst = 0;
+    visibleLast = 0;
+    geometry.clear();
+    for (ChatMessage::Ptr l : savedLines)
         insertChatlineAtBottom(l);
 
     updateSceneRect();
@@ -581,16 +701,6 @@ void ChatLog::copySelectedText(bool toSelectionBuffer) const
         clipboard->setText(text, toSelectionBuffer ? QClipboard::Selection : QClipboard::Clipboard);
 }
 
-void ChatLog::setBusyNotification(ChatLine::Ptr notification)
-{
-    if (!notification.get())
-        return;
-
-    busyNotification = notification;
-    busyNotification->addToScene(busyScene);
-    busyNotification->visibilityChanged(true);
-}
-
 void ChatLog::setTypingNotification(ChatLine::Ptr notification)
 {
     typingNotification = notification;
@@ -613,8 +723,12 @@ void ChatLog::scrollToLine(ChatLine::Ptr line)
     if (!line.get())
         return;
 
+    const int row = line->getRow();
+    if (row < 0 || row >= lines.size() || lines[row].line != line)
+        return;
+
     updateSceneRect();
-    verticalScrollBar()->setValue(line->sceneBoundingRect().top());
+    verticalScrollBar()->setValue(qRound(geometry.getTop(row)));
 }
 
 void ChatLog::selectAll()
@@ -634,14 +748,123 @@ void ChatLog::selectAll()
 
 void ChatLog::fontChanged(const QFont& font)
 {
-    for (ChatLine::Ptr l : lines) {
-        l->fontChanged(font);
+    // released lines get the font when they're created again
+    for (const LineRecord& record : lines) {
+        if (record.line)
+            record.line->fontChanged(font);
     }
 }
 
 void ChatLog::forceRelayout()
 {
-    startResizeWorker();
+    invalidateLayout();
+}
+
+/**
+ * @brief Adds a line to the scene, creating it from its record if it was released.
+ * @return true if the line was created and its height differs from the cached one.
+ */
+bool ChatLog::showLine(int row)
+{
+    LineRecord& record = lines[row];
+    bool resized = false;
+
+    if (!record.line) {
+        record.line = getLine(row);
+
+        const qreal height = geometry.getHeight(row);
+        layoutLine(row, useableWidth());
+        resized = geometry.getHeight(row) != height;
+    }
+
+    record.line->addToScene(scene);
+    record.line->visibilityChanged(true);
+
+    return resized;
+}
+
+void ChatLog::hideLine(int row)
+{
+    lines[row].line->visibilityChanged(false);
+    lines[row].line->removeFromScene();
+    releaseLine(row);
+}
+
+/**
+ * @brief Drops the line of a row out of the scene, keeping only its record.
+ *
+ * Lines that can't be created again, or that are still needed as they are, are kept.
+ */
+void ChatLog::releaseLine(int row)
+{
+    LineRecord& record = lines[row];
+
+    // held elsewhere, e.g. by the OfflineMsgEngine to mark it as sent
+    if (!record.line || record.line.use_count() > 1)
+        return;
+
+    if (selectionMode == Precise && row == selClickedRow)
+        return;
+
+    if (record.line->getRecord().kind == ChatMessage::Record::NONE)
+        return;
+
+    record.message = record.line->getRecord();
+    record.line.reset();
+}
+
+/**
+ * @brief Releases the lines out of the scene once the event loop is reached again.
+ *
+ * The callers of the insert functions still hold the new lines until they return.
+ */
+void ChatLog::scheduleRelease()
+{
+    if (releasePending)
+        return;
+
+    releasePending = true;
+    QTimer::singleShot(0, this, SLOT(releaseHiddenLines()));
+}
+
+void ChatLog::releaseHiddenLines()
+{
+    releasePending = false;
+
+    for (int i = 0; i < visibleFirst; ++i)
+        releaseLine(i);
+
+    for (int i = visibleLast; i < lines.size(); ++i)
+        releaseLine(i);
+}
+
+/**
+ * @brief Returns the line of a row, created from its record if it was released.
+ *
+ * A created line is neither kept nor laid out.
+ */
+ChatMessage::Ptr ChatLog::getLine(int row) const
+{
+    const LineRecord& record = lines[row];
+    if (record.line)
+        return record.line;
+
+    ChatMessage::Ptr line = ChatMessage::createFromRecord(record.message);
+    line->setRow(row);
+    return line;
+}
+
+/**
+ * @brief Returns the raw text of a column of a row, without creating released lines.
+ */
+QString ChatLog::getLineText(int row, int column) const
+{
+    const LineRecord& record = lines[row];
+    if (!record.line)
+        return record.message.getText(column);
+
+    ChatLineContent* content = record.line->getContent(column);
+    return content ? content->getText() : QString();
 }
 
 void ChatLog::checkVisibility()
@@ -649,37 +872,60 @@ void ChatLog::checkVisibility()
     if (lines.empty())
         return;
 
-    // find first visible line
-    auto lowerBound = std::lower_bound(lines.cbegin(), lines.cend(), getVisibleRect().top(),
-                                       ChatLine::lessThanBSRectBottom);
+    // keep a viewport height of lines above and below in the scene, so they are ready when
+    // scrolling
+    const QRect visibleRect = getVisibleRect();
+    const qreal margin = visibleRect.height();
 
-    // find last visible line
-    auto upperBound = std::lower_bound(lowerBound, lines.cend(), getVisibleRect().bottom(),
-                                       ChatLine::lessThanBSRectTop);
+    // find first line in the scene
+    const int first = geometry.findFirstByBottom(visibleRect.top() - margin);
 
-    // set visibilty
-    QList<ChatLine::Ptr> newVisibleLines;
-    for (auto itr = lowerBound; itr != upperBound; ++itr) {
-        newVisibleLines.append(*itr);
+    // find the line after the last line in the scene
+    const int last = geometry.findFirstByTop(visibleRect.bottom() + margin);
 
-        if (!visibleLines.contains(*itr))
-            (*itr)->visibilityChanged(true);
+    const ScrollAnchor anchor = getScrollAnchor();
+    const qreal width = useableWidth();
+    bool resized = false;
 
-        visibleLines.removeOne(*itr);
+    // these lines are no longer visible, the ones above the new range and below it
+    for (int i = visibleFirst; i < qMin(visibleLast, first); ++i)
+        hideLine(i);
+
+    for (int i = qMax(visibleFirst, last); i < visibleLast; ++i)
+        hideLine(i);
+
+    // these lines came into view
+    for (int i = first; i < qMin(last, visibleFirst); ++i) {
+        if (showLine(i))
+            resized = true;
     }
 
-    // these lines are no longer visible
-    for (ChatLine::Ptr line : visibleLines)
-        line->visibilityChanged(false);
+    for (int i = qMax(first, visibleLast); i < last; ++i) {
+        if (showLine(i))
+            resized = true;
+    }
 
-    visibleLines = newVisibleLines;
+    visibleFirst = first;
+    visibleLast = last;
+
+    for (int i = first; i < last; ++i) {
+        // estimated heights become exact, content may also have been replaced meanwhile
+        if (geometry.isStale(i)) {
+            layoutLine(i, width);
+            resized = true;
+        } else if (lines[i].line->sceneBoundingRect().height() != geometry.getHeight(i)) {
+            geometry.setHeight(i, lines[i].line->sceneBoundingRect().height());
+            resized = true;
+        }
+    }
 
-    // enforce order
-    std::sort(visibleLines.begin(), visibleLines.end(), ChatLine::lessThanRowIndex);
+    reposition();
 
-    // if (!visibleLines.empty())
-    //  qDebug() << "visible from " << visibleLines.first()->getRow() << "to " <<
-    //  visibleLines.last()->getRow() << " total " << visibleLines.size();
+    if (resized) {
+        updateTypingNotification();
+        updateMultiSelectionRect();
+        restoreScrollAnchor(anchor);
+    }
 }
 
 void ChatLog::scrollContentsBy(int dx, int dy)
@@ -692,25 +938,22 @@ void ChatLog::resizeEvent(QResizeEvent* ev)
 {
     bool stb = stickToBottom();
 
-    if (ev->size().width() != ev->oldSize().width()) {
-        startResizeWorker();
-        stb = false; // let the resize worker handle it
-    }
-
     QGraphicsView::resizeEvent(ev);
 
+    if (ev->size().width() != ev->oldSize().width())
+        invalidateLayout();
+
     if (stb)
         scrollToBottom();
-
-    updateBusyNotification();
+    else
+        checkVisibility();
 }
 
 void ChatLog::updateMultiSelectionRect()
 {
     if (selectionMode == Multi && selFirstRow >= 0 && selLastRow >= 0) {
-        QRectF selBBox;
-        selBBox = selBBox.united(lines[selFirstRow]->sceneBoundingRect());
-        selBBox = selBBox.united(lines[selLastRow]->sceneBoundingRect());
+        const qreal top = geometry.getTop(selFirstRow);
+        const QRectF selBBox(0.0, top, useableWidth(), geometry.getBottom(selLastRow) - top);
 
         if (selGraphItem->rect() != selBBox)
             scene->invalidate(selGraphItem->rect());
@@ -731,33 +974,24 @@ void ChatLog::updateTypingNotification()
     qreal posY = 0.0;
 
     if (!lines.empty())
-        posY = lines.last()->sceneBoundingRect().bottom() + lineSpacing;
+        posY = geometry.getTotalHeight() + lineSpacing;
 
     notification->layout(useableWidth(), QPointF(0.0, posY));
 }
 
-void ChatLog::updateBusyNotification()
-{
-    if (busyNotification.get()) {
-        // repoisition the busy notification (centered)
-        busyNotification->layout(useableWidth(), getVisibleRect().topLeft()
-                                                     + QPointF(0, getVisibleRect().height() / 2.0));
-    }
-}
-
 ChatLine::Ptr ChatLog::findLineByPosY(qreal yPos) const
 {
-    auto itr = std::lower_bound(lines.cbegin(), lines.cend(), yPos, ChatLine::lessThanBSRectBottom);
+    const int row = geometry.findFirstByBottom(yPos);
 
-    if (itr != lines.cend())
-        return *itr;
+    if (row < lines.size())
+        return lines[row].line;
 
     return ChatLine::Ptr();
 }
 
 QRectF ChatLog::calculateSceneRect() const
 {
-    qreal bottom = (lines.empty() ? 0.0 : lines.last()->sceneBoundingRect().bottom());
+    qreal bottom = geometry.getTotalHeight();
 
     if (typingNotification.get() != nullptr)
         bottom += typingNotification->sceneBoundingRect().height() + lineSpacing;
@@ -784,38 +1018,38 @@ void ChatLog::onSelectionTimerTimeout()
 
 void ChatLog::onWorkerTimeout()
 {
-    // Fairly arbitrary but
-    // large values will make the UI unresponsive
-    const int stepSize = 50;
+    // Applying a measured line is cheap, but a tick
+    // shouldn't take long either way
+    const int stepSize = 500;
 
-    layout(workerLastIndex, workerLastIndex + stepSize, useableWidth());
-    workerLastIndex += stepSize;
+    const QVector<LayoutWorker::Result> results = layoutWorker.takeResults(stepSize);
 
-    // done?
-    if (workerLastIndex >= lines.size()) {
-        workerTimer->stop();
+    if (!results.isEmpty()) {
+        const ScrollAnchor anchor = getScrollAnchor();
+        const qreal width = useableWidth();
+
+        // lines that came into view meanwhile are already laid out
+        for (const LayoutWorker::Result& result : results) {
+            if (!geometry.isStale(result.row))
+                continue;
 
-        // switch back to the scene containing the chat messages
-        setScene(scene);
+            // released lines only need their height, they're laid out when shown
+            if (lines[result.row].line)
+                layoutLine(result.row, width, result.metrics);
+            else
+                geometry.setHeight(result.row, measuredHeight(result.metrics));
+        }
 
-        // make sure everything gets updated
-        updateSceneRect();
-        checkVisibility();
+        // make sure everything gets updated, without moving what the user is looking at
+        reposition();
         updateTypingNotification();
         updateMultiSelectionRect();
-
-        // scroll
-        if (workerStb)
-            scrollToBottom();
-        else
-            scrollToLine(workerAnchorLine);
-
-        // don't keep a Ptr to the anchor line
-        workerAnchorLine = ChatLine::Ptr();
-
-        // hidden during busy screen
-        verticalScrollBar()->show();
+        restoreScrollAnchor(anchor);
     }
+
+    // done?
+    if (!layoutWorker.isRunning())
+        workerTimer->stop();
 }
 
 void ChatLog::onMultiClickTimeout()
@@ -862,8 +1096,10 @@ void ChatLog::focusInEvent(QFocusEvent* ev)
     if (selectionMode != None) {
         selGraphItem->setBrush(QBrush(selectionRectColor));
 
-        for (int i = selFirstRow; i <= selLastRow; ++i)
-            lines[i]->selectionFocusChanged(true);
+        for (int i = selFirstRow; i <= selLastRow; ++i) {
+            if (lines[i].line)
+                lines[i].line->selectionFocusChanged(true);
+        }
     }
 }
 
@@ -874,8 +1110,10 @@ void ChatLog::focusOutEvent(QFocusEvent* ev)
     if (selectionMode != None) {
         selGraphItem->setBrush(QBrush(selectionRectColor.lighter(120)));
 
-        for (int i = selFirstRow; i <= selLastRow; ++i)
-            lines[i]->selectionFocusChanged(false);
+        for (int i = selFirstRow; i <= selLastRow; ++i) {
+            if (lines[i].line)
+                lines[i].line->selectionFocusChanged(false);
+        }
     }
 }
 
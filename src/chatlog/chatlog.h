@@ -26,6 +26,8 @@
 
 #include "chatline.h"
 #include "chatmessage.h"
+#include "layoutworker.h"
+#include "linegeometry.h"
 
 class QGraphicsScene;
 class QGraphicsRectItem;
@@ -41,13 +43,12 @@ public:
     explicit ChatLog(QWidget* parent = 0);
     virtual ~ChatLog();
 
-    void insertChatlineAtBottom(ChatLine::Ptr l);
-    void insertChatlineOnTop(ChatLine::Ptr l);
-    void insertChatlineOnTop(const QList<ChatLine::Ptr>& newLines);
+    void insertChatlineAtBottom(ChatMessage::Ptr l);
+    void insertChatlineOnTop(ChatMessage::Ptr l);
+    void insertChatlineOnTop(const QList<ChatMessage::Ptr>& newLines);
     void clearSelection();
     void clear();
     void copySelectedText(bool toSelectionBuffer = false) const;
-    void setBusyNotification(ChatLine::Ptr notification);
     void setTypingNotification(ChatLine::Ptr notification);
     void setTypingNotificationVisible(bool visible);
     void scrollToLine(ChatLine::Ptr line);
@@ -75,22 +76,32 @@ private slots:
     void onSelectionTimerTimeout();
     void onWorkerTimeout();
     void onMultiClickTimeout();
+    void releaseHiddenLines();
 
 protected:
     QRectF calculateSceneRect() const;
     QRect getVisibleRect() const;
     ChatLineContent* getContentFromPos(QPointF scenePos) const;
 
-    void layout(int start, int end, qreal width);
+    void layoutLine(int row, qreal width,
+                    const QVector<ContentMetrics>& metrics = QVector<ContentMetrics>());
     bool isOverSelection(QPointF scenePos) const;
     bool stickToBottom() const;
 
     qreal useableWidth() const;
+    qreal estimatedLineHeight() const;
 
-    void reposition(int start, int end, qreal deltaY);
+    void reposition();
     void updateSceneRect();
     void checkVisibility();
+    bool showLine(int row);
+    void hideLine(int row);
+    void releaseLine(int row);
+    void scheduleRelease();
+    ChatMessage::Ptr getLine(int row) const;
+    QString getLineText(int row, int column) const;
     void scrollToBottom();
+    void invalidateLayout();
     void startResizeWorker();
 
     virtual void mouseDoubleClickEvent(QMouseEvent* ev) final override;
@@ -105,7 +116,6 @@ protected:
 
     void updateMultiSelectionRect();
     void updateTypingNotification();
-    void updateBusyNotification();
 
     ChatLine::Ptr findLineByPosY(qreal yPos) const;
 
@@ -114,6 +124,23 @@ private:
     bool isActiveFileTransfer(ChatLine::Ptr l);
     void handleMultiClickEvent();
 
+private:
+    struct LineRecord
+    {
+        ChatMessage::Record message;
+        ChatMessage::Ptr line;
+    };
+
+    struct ScrollAnchor
+    {
+        bool bottom;
+        int row;
+        qreal offset;
+    };
+
+    ScrollAnchor getScrollAnchor() const;
+    void restoreScrollAnchor(const ScrollAnchor& anchor);
+
 private:
     enum SelectionMode
     {
@@ -132,11 +159,10 @@ private:
     QAction* copyAction = nullptr;
     QAction* selectAllAction = nullptr;
     QGraphicsScene* scene = nullptr;
-    QGraphicsScene* busyScene = nullptr;
-    QVector<ChatLine::Ptr> lines;
-    QList<ChatLine::Ptr> visibleLines;
+    QVector<LineRecord> lines;
+    int visibleFirst = 0;
+    int visibleLast = 0;
     ChatLine::Ptr typingNotification;
-    ChatLine::Ptr busyNotification;
 
     // selection
     int selClickedRow = -1; // These 4 are only valid while selectionMode != None
@@ -150,18 +176,18 @@ private:
     QTimer* selectionTimer = nullptr;
     QTimer* workerTimer = nullptr;
     QTimer* multiClickTimer = nullptr;
+    bool releasePending = false;
     AutoScrollDirection selectionScrollDir = NoDirection;
     int clickCount = 0;
     QPoint lastClickPos;
 
     // worker vars
-    int workerLastIndex = 0;
-    bool workerStb = false;
-    ChatLine::Ptr workerAnchorLine;
+    LayoutWorker layoutWorker;
 
     // layout
     QMargins margins = QMargins(10, 10, 10, 10);
     qreal lineSpacing = 5.0f;
+    LineGeometry geometry{lineSpacing};
 };
 
 #endif // CHATLOG_H
@@ -35,6 +35,21 @@
 #define NAME_COL_WIDTH 90.0
 #define TIME_COL_WIDTH 90.0
 
+/**
+ * @struct ChatMessage::Record
+ * @brief What a text or system message is created from, so it can be created again.
+ *
+ * The ChatLog keeps only the records of the lines far from the viewport, and creates their
+ * messages again when they're scrolled to. Messages of other kinds, like file transfers, have no
+ * record and are kept as they are.
+ *
+ * @var ChatMessage::Record::text
+ * @brief The raw message, before escaping and styling.
+ *
+ * @var ChatMessage::Record::date
+ * @brief When the message was sent, null while it's pending.
+ */
+
 ChatMessage::ChatMessage()
 {
 }
@@ -43,6 +58,11 @@ ChatMessage::Ptr ChatMessage::createChatMessage(const QString& sender, const QSt
                                                 MessageType type, bool isMe, const QDateTime& date)
 {
     ChatMessage::Ptr msg = ChatMessage::Ptr(new ChatMessage);
+    msg->record.kind = Record::CHAT;
+    msg->record.sender = sender;
+    msg->record.text = rawMessage;
+    msg->record.type = type;
+    msg->record.isMe = isMe;
 
     QString text = rawMessage.toHtmlEscaped();
     QString senderText = sender;
@@ -105,6 +125,11 @@ ChatMessage::Ptr ChatMessage::createChatInfoMessage(const QString& rawMessage,
                                                     SystemMessageType type, const QDateTime& date)
 {
     ChatMessage::Ptr msg = ChatMessage::Ptr(new ChatMessage);
+    msg->record.kind = Record::SYSTEM;
+    msg->record.text = rawMessage;
+    msg->record.date = date;
+    msg->record.systemType = type;
+
     QString text = rawMessage.toHtmlEscaped();
 
     QString img;
@@ -174,28 +199,37 @@ ChatMessage::Ptr ChatMessage::createTypingNotification()
 }
 
 /**
- * @brief Create message placeholder while chatform restructures text
- *
- * It can take a while for chatform to resize large amounts of text, thus
- * a message placeholder is needed to inform users about it.
- *
- * @return created message
+ * @brief Creates a message again from its record.
+ * @return The message, or nullptr if the record doesn't describe one.
  */
-ChatMessage::Ptr ChatMessage::createBusyNotification()
+ChatMessage::Ptr ChatMessage::createFromRecord(const Record& record)
 {
-    ChatMessage::Ptr msg = ChatMessage::Ptr(new ChatMessage);
-    QFont baseFont = Settings::getInstance().getChatMessageFont();
-    baseFont.setPixelSize(baseFont.pixelSize() + 2);
-    baseFont.setBold(true);
+    ChatMessage::Ptr msg;
 
-    msg->addColumn(new Text(QObject::tr("Reformatting text in progress.."), baseFont, false, ""),
-                   ColumnFormat(1.0, ColumnFormat::VariableSize, ColumnFormat::Center));
+    switch (record.kind) {
+    case Record::CHAT:
+        msg = createChatMessage(record.sender, record.text, record.type, record.isMe, record.date);
+        break;
+    case Record::SYSTEM:
+        msg = createChatInfoMessage(record.text, record.systemType, record.date);
+        break;
+    case Record::NONE:
+        return nullptr;
+    }
+
+    if (record.senderHidden)
+        msg->hideSender();
+
+    if (record.dateHidden)
+        msg->hideDate();
 
     return msg;
 }
 
 void ChatMessage::markAsSent(const QDateTime& time)
 {
+    record.date = time;
+
     QFont baseFont = Settings::getInstance().getChatMessageFont();
 
     // remove the spinner and replace it by $time
@@ -223,6 +257,8 @@ void ChatMessage::setAsAction()
 
 void ChatMessage::hideSender()
 {
+    record.senderHidden = true;
+
     ChatLineContent* c = getContent(0);
     if (c)
         c->hide();
@@ -230,11 +266,50 @@ void ChatMessage::hideSender()
 
 void ChatMessage::hideDate()
 {
+    record.dateHidden = true;
+
     ChatLineContent* c = getContent(2);
     if (c)
         c->hide();
 }
 
+/**
+ * @brief Returns the record the message can be created again from.
+ */
+const ChatMessage::Record& ChatMessage::getRecord() const
+{
+    return record;
+}
+
+/**
+ * @brief Returns the text of a column, as ChatLineContent::getText() of the message would.
+ *
+ * Lets the ChatLog copy a selection without creating the messages again.
+ */
+QString ChatMessage::Record::getText(int column) const
+{
+    if (kind != CHAT) {
+        // the columns of system messages have no raw text, apart from the timestamp
+        if (column == 2 && kind == SYSTEM)
+            return date.toString(Settings::getInstance().getTimestampFormat());
+
+        return QString();
+    }
+
+    switch (column) {
+    case 0:
+        return sender;
+    case 1:
+        return type == ACTION && isMe ? QString("%1 %2").arg(sender, text) : text;
+    case 2:
+        // pending messages show a spinner
+        return date.isNull() ? QString()
+                             : date.toString(Settings::getInstance().getTimestampFormat());
+    }
+
+    return QString();
+}
+
 QString ChatMessage::detectQuotes(const QString& str, MessageType type)
 {
     // detect text quotes
@@ -45,6 +45,28 @@ public:
         ALERT,
     };
 
+    struct Record
+    {
+        enum Kind
+        {
+            NONE,
+            CHAT,
+            SYSTEM,
+        };
+
+        Kind kind = NONE;
+        QString sender;
+        QString text;
+        QDateTime date;
+        MessageType type = NORMAL;
+        SystemMessageType systemType = INFO;
+        bool isMe = false;
+        bool senderHidden = false;
+        bool dateHidden = false;
+
+        QString getText(int column) const;
+    };
+
     ChatMessage();
 
     static ChatMessage::Ptr createChatMessage(const QString& sender, const QString& rawMessage,
@@ -55,7 +77,7 @@ public:
     static ChatMessage::Ptr createFileTransferMessage(const QString& sender, ToxFile file,
                                                       bool isMe, const QDateTime& date);
     static ChatMessage::Ptr createTypingNotification();
-    static ChatMessage::Ptr createBusyNotification();
+    static ChatMessage::Ptr createFromRecord(const Record& record);
 
     void markAsSent(const QDateTime& time);
     QString toString() const;
@@ -63,6 +85,7 @@ public:
     void setAsAction();
     void hideSender();
     void hideDate();
+    const Record& getRecord() const;
 
 protected:
     static QString detectQuotes(const QString& str, MessageType type);
@@ -70,6 +93,7 @@ protected:
 
 private:
     bool action = false;
+    Record record;
 };
 
 #endif // CHATMESSAGE_H
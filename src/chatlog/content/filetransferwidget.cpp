@@ -20,6 +20,7 @@
 #include "filetransferwidget.h"
 #include "ui_filetransferwidget.h"
 
+#include "src/chatlog/thumbnailer.h"
 #include "src/core/core.h"
 #include "src/nexus.h"
 #include "src/persistence/settings.h"
@@ -27,9 +28,7 @@
 #include "src/widget/style.h"
 #include "src/widget/widget.h"
 
-#include <libexif/exif-loader.h>
-
-#include <QBuffer>
+#include <QCursor>
 #include <QDebug>
 #include <QDesktopServices>
 #include <QDesktopWidget>
@@ -38,6 +37,7 @@
 #include <QMessageBox>
 #include <QMouseEvent>
 #include <QPainter>
+#include <QToolTip>
 #include <QVariantAnimation>
 
 #include <math.h>
@@ -530,45 +530,55 @@ void FileTransferWidget::showPreview(const QString& filename)
         // Subtract to make border visible
         const int size = qMax(ui->previewButton->width(), ui->previewButton->height()) - 4;
 
-        QFile imageFile(filename);
-        if (!imageFile.open(QIODevice::ReadOnly)) {
-            qCritical() << "Failed to open file for preview";
-            return;
-        }
-        const QByteArray imageFileData = imageFile.readAll();
-        QImage image = QImage::fromData(imageFileData);
-        const int exifOrientation = getExifOrientation(imageFileData.constData(), imageFileData.size());
-        if (exifOrientation) {
-            applyTransformation(exifOrientation, image);
-        }
+        Thumbnailer::getInstance().thumbnail(filename, size, this, [this](const QImage& thumbnail) {
+            if (thumbnail.isNull()) {
+                return;
+            }
+
+            const QPixmap iconPixmap = QPixmap::fromImage(thumbnail);
+            ui->previewButton->setIcon(QIcon(iconPixmap));
+            ui->previewButton->setIconSize(iconPixmap.size());
+            ui->previewButton->show();
+        });
+
+        // the mouseover preview is only created once it's first shown
+        previewPath = filename;
+        previewRequested = false;
+        ui->previewButton->setToolTip(QString());
+        ui->previewButton->installEventFilter(this);
+    }
+}
 
-        const QPixmap iconPixmap = scaleCropIntoSquare(QPixmap::fromImage(image), size);
+/**
+ * @brief Creates the mouseover preview when the preview button's tooltip is first requested.
+ */
+bool FileTransferWidget::eventFilter(QObject* object, QEvent* event)
+{
+    if (object != ui->previewButton || event->type() != QEvent::ToolTip
+        || !ui->previewButton->toolTip().isEmpty()) {
+        return QWidget::eventFilter(object, event);
+    }
 
-        ui->previewButton->setIcon(QIcon(iconPixmap));
-        ui->previewButton->setIconSize(iconPixmap.size());
-        ui->previewButton->show();
-        // Show mouseover preview, but make sure it's not larger than 50% of the screen width/height
+    if (!previewRequested) {
+        previewRequested = true;
+        // Make sure it's not larger than 50% of the screen width/height
         const QRect desktopSize = QApplication::desktop()->screenGeometry();
-        const int maxPreviewWidth{desktopSize.width() / 2};
-        const int maxPreviewHeight{desktopSize.height() /2};
-        const QImage previewImage = [&image, maxPreviewWidth, maxPreviewHeight]() {
-            if (image.width() > maxPreviewWidth || image.height() > maxPreviewHeight) {
-                return image.scaled(maxPreviewWidth, maxPreviewHeight,
-                                                     Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        const QSize maxSize{desktopSize.width() / 2, desktopSize.height() / 2};
+        auto showToolTip = [this](const QByteArray& png) {
+            if (png.isEmpty()) {
+                return;
             }
-            else {
-                return image;
+
+            const QString toolTip = "<img src=data:image/png;base64," + png.toBase64() + "/>";
+            ui->previewButton->setToolTip(toolTip);
+            if (ui->previewButton->underMouse()) {
+                QToolTip::showText(QCursor::pos(), toolTip, ui->previewButton);
             }
-        }();
-
-        QByteArray imageData;
-        QBuffer buffer(&imageData);
-        buffer.open(QIODevice::WriteOnly);
-        previewImage.save(&buffer, "PNG");
-        buffer.close();
-        ui->previewButton->setToolTip("<img src=data:image/png;base64," + imageData.toBase64()
-                                      + "/>");
+        };
+        Thumbnailer::getInstance().preview(previewPath, maxSize, this, showToolTip);
     }
+
+    return true;
 }
 
 void FileTransferWidget::onLeftButtonClicked()
@@ -585,79 +595,3 @@ void FileTransferWidget::onPreviewButtonClicked()
 {
     handleButton(ui->previewButton);
 }
-
-QPixmap FileTransferWidget::scaleCropIntoSquare(const QPixmap& source, const int targetSize)
-{
-    QPixmap result;
-
-    // Make sure smaller-than-icon images (at least one dimension is smaller) will not be upscaled
-    if (source.width() < targetSize || source.height() < targetSize) {
-        result = source;
-    } else {
-        result = source.scaled(targetSize, targetSize, Qt::KeepAspectRatioByExpanding,
-                               Qt::SmoothTransformation);
-    }
-
-    // Then, image has to be cropped (if needed) so it will not overflow rectangle
-    // Only one dimension will be bigger after Qt::KeepAspectRatioByExpanding
-    if (result.width() > targetSize)
-        return result.copy((result.width() - targetSize) / 2, 0, targetSize, targetSize);
-    else if (result.height() > targetSize)
-        return result.copy(0, (result.height() - targetSize) / 2, targetSize, targetSize);
-
-    // Picture was rectangle in the first place, no cropping
-    return result;
-}
-
-int FileTransferWidget::getExifOrientation(const char* data, const int size)
-{
-    ExifData* exifData = exif_data_new_from_data(reinterpret_cast<const unsigned char*>(data), size);
-
-    if (!exifData)
-        return 0;
-
-    int orientation = 0;
-    const ExifByteOrder byteOrder = exif_data_get_byte_order(exifData);
-    const ExifEntry* const exifEntry = exif_data_get_entry(exifData, EXIF_TAG_ORIENTATION);
-    if (exifEntry) {
-        orientation = exif_get_short(exifEntry->data, byteOrder);
-    }
-    exif_data_free(exifData);
-    return orientation;
-}
-
-void FileTransferWidget::applyTransformation(const int orientation, QImage& image)
-{
-    QTransform exifTransform;
-    switch(static_cast<ExifOrientation>(orientation))
-    {
-    case ExifOrientation::TopLeft:
-        break;
-    case ExifOrientation::TopRight:
-        image = image.mirrored(1,0);
-        break;
-    case ExifOrientation::BottomRight:
-        exifTransform.rotate(180);
-        break;
-    case ExifOrientation::BottomLeft:
-        image = image.mirrored(0, 1);
-        break;
-    case ExifOrientation::LeftTop:
-        exifTransform.rotate(90);
-        image = image.mirrored(0, 1);
-        break;
-    case ExifOrientation::RightTop:
-        exifTransform.rotate(-90);
-        break;
-    case ExifOrientation::RightBottom:
-        exifTransform.rotate(-90);
-        image = image.mirrored(0, 1);
-        break;
-    case ExifOrientation::LeftBottom:
-        exifTransform.rotate(90);
-        break;
-    default:
-        qWarning() << "Invalid exif orientation passed to applyTransformation!";
-    }
-    image = image.transformed(exifTransform);
-}
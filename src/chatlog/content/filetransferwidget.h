@@ -67,17 +67,13 @@ protected:
     bool drawButtonAreaNeeded() const;
 
     virtual void paintEvent(QPaintEvent*) final override;
+    bool eventFilter(QObject* object, QEvent* event) final override;
 
 private slots:
     void onLeftButtonClicked();
     void onRightButtonClicked();
     void onPreviewButtonClicked();
 
-private:
-    static QPixmap scaleCropIntoSquare(const QPixmap& source, int targetSize);
-    static int getExifOrientation(const char* data, const int size);
-    static void applyTransformation(const int oritentation, QImage& image);
-
 private:
     Ui::FileTransferWidget* ui;
     ToxFile fileInfo;
@@ -94,22 +90,8 @@ private:
     qreal meanData[TRANSFER_ROLLING_AVG_COUNT] = {0.0};
 
     bool active;
-    enum class ExifOrientation {
-        /* do not change values, this is exif spec
-         *
-         * name corresponds to where the 0 row and 0 column is in form row-column
-         * i.e. entry 5 here means that the 0'th row corresponds to the left side of the scene and the 0'th column corresponds
-         * to the top of the captured scene. This means that the image needs to be mirrored and rotated to be displayed.
-         */
-        TopLeft = 1,
-        TopRight = 2,
-        BottomRight = 3,
-        BottomLeft = 4,
-        LeftTop = 5,
-        RightTop = 6,
-        RightBottom = 7,
-        LeftBottom = 8
-    };
+    QString previewPath;
+    bool previewRequested = false;
 };
 
 #endif // FILETRANSFERWIDGET_H
@@ -25,7 +25,10 @@
 Image::Image(QSize Size, const QString& filename)
     : size(Size)
 {
-    pmap = PixmapCache::getInstance().get(filename, size);
+    pmap = PixmapCache::getInstance().get(filename, size, this, [this](const QPixmap& pixmap) {
+        pmap = pixmap;
+        update();
+    });
 }
 
 QRectF Image::boundingRect() const
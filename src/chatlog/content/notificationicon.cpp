@@ -27,7 +27,11 @@
 NotificationIcon::NotificationIcon(QSize Size)
     : size(Size)
 {
-    pmap = PixmapCache::getInstance().get(":/ui/chatArea/typing.svg", size);
+    pmap = PixmapCache::getInstance().get(":/ui/chatArea/typing.svg", size, this,
+                                          [this](const QPixmap& pixmap) {
+                                              pmap = pixmap;
+                                              update();
+                                          });
 
     updateTimer = new QTimer(this);
     updateTimer->setInterval(1000 / 30);
@@ -30,7 +30,10 @@ Spinner::Spinner(const QString& img, QSize Size, qreal speed)
     : size(Size)
     , rotSpeed(speed)
 {
-    pmap = PixmapCache::getInstance().get(img, size);
+    pmap = PixmapCache::getInstance().get(img, size, this, [this](const QPixmap& pixmap) {
+        pmap = pixmap;
+        update();
+    });
 
     timer.setInterval(1000 / 30); // 30Hz
     timer.setSingleShot(false);
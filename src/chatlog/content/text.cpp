@@ -18,7 +18,9 @@
 */
 
 #include "text.h"
+#include "../customtextdocument.h"
 #include "../documentcache.h"
+#include "../layoutcache.h"
 
 #include <QAbstractTextDocumentLayout>
 #include <QApplication>
@@ -26,19 +28,84 @@
 #include <QDesktopServices>
 #include <QFontMetrics>
 #include <QGraphicsSceneMouseEvent>
+#include <QImage>
 #include <QPainter>
 #include <QPalette>
 #include <QTextBlock>
 #include <QTextFragment>
 
+#include "src/persistence/settings.h"
 #include "src/widget/style.h"
 
+namespace {
+/// Id of the last text set, for the layout cache
+quint64 lastTextId = 0;
+
+/**
+ * @brief Document to measure text off the GUI thread.
+ *
+ * Pixmaps can only be used on the GUI thread, so emoticons are replaced by images of their size.
+ */
+class MeasureDocument : public CustomTextDocument
+{
+public:
+    explicit MeasureDocument(int emojiSize)
+        : emojiSize{emojiSize}
+    {
+    }
+
+protected:
+    QVariant loadResource(int type, const QUrl& name) final override
+    {
+        if (type == QTextDocument::ImageResource && name.scheme() == "key") {
+            QImage placeholder(emojiSize, emojiSize, QImage::Format_ARGB32_Premultiplied);
+            placeholder.fill(Qt::transparent);
+            return placeholder;
+        }
+
+        return QTextDocument::loadResource(type, name);
+    }
+
+private:
+    int emojiSize;
+};
+
+/**
+ * @brief Fills and lays out a document, the same way on the GUI thread and when measuring.
+ */
+void setupDocument(QTextDocument* doc, const QString& text, const QFont& font,
+                   const QString& styleSheet, bool elide, qreal width)
+{
+    doc->setDefaultFont(font);
+
+    if (elide) {
+        QFontMetrics metrics = QFontMetrics(font);
+        QString elidedText = metrics.elidedText(text, Qt::ElideRight, qRound(width));
+
+        doc->setPlainText(elidedText);
+    } else {
+        doc->setDefaultStyleSheet(styleSheet);
+        doc->setHtml(text);
+    }
+
+    // wrap mode
+    QTextOption opt;
+    opt.setWrapMode(elide ? QTextOption::NoWrap : QTextOption::WrapAtWordBoundaryOrAnywhere);
+    doc->setDefaultTextOption(opt);
+
+    // width
+    doc->setTextWidth(width);
+    doc->documentLayout()->update();
+}
+}
+
 Text::Text(const QString& txt, const QFont& font, bool enableElide, const QString& rwText,
            const QColor c)
     : rawText(rwText)
     , elide(enableElide)
     , defFont(font)
     , defStyleSheet(Style::getStylesheet(QStringLiteral(":/ui/chatArea/innerStyle.css"), font))
+    , styleHash(qHash(defStyleSheet))
     , color(c)
 {
     setText(txt);
@@ -50,11 +117,17 @@ Text::~Text()
 {
     if (doc)
         DocumentCache::getInstance().push(doc);
+
+    LayoutCache::getInstance().remove(id);
 }
 
 void Text::setText(const QString& txt)
 {
+    // layouts of the old text are of no use anymore
+    LayoutCache::getInstance().remove(id);
+
     text = txt;
+    id = ++lastTextId;
     dirty = true;
 }
 
@@ -66,6 +139,54 @@ void Text::setWidth(qreal w)
     regenerate();
 }
 
+/**
+ * @brief Returns a function laying out a copy of the text in a document of its own.
+ */
+ChatLineContent::Measure Text::getMeasure() const
+{
+    const ChatLineContent* content = this;
+    const QString text = this->text;
+    const QFont font = defFont;
+    const QString styleSheet = defStyleSheet;
+    const bool elide = this->elide;
+    const int emojiSize = Settings::getInstance().getEmojiFontPointSize();
+
+    return [=](qreal width) {
+        MeasureDocument doc{emojiSize};
+        setupDocument(&doc, text, font, styleSheet, elide, width);
+
+        ContentMetrics metrics;
+        metrics.content = content;
+        metrics.width = width;
+        metrics.size = doc.size();
+        if (doc.firstBlock().layout()->lineCount() > 0)
+            metrics.ascent = doc.firstBlock().layout()->lineAt(0).ascent();
+
+        return metrics;
+    };
+}
+
+/**
+ * @brief Takes the size from the metrics, the document is only built once the text is visible.
+ */
+void Text::setMetrics(const ContentMetrics& metrics)
+{
+    // the document is needed for painting anyway
+    if (keepInMemory) {
+        setWidth(metrics.width);
+        return;
+    }
+
+    width = metrics.width;
+    ascent = metrics.ascent;
+
+    if (size != metrics.size)
+        prepareGeometryChange();
+
+    size = metrics.size;
+    dirty = true;
+}
+
 void Text::selectionMouseMove(QPointF scenePos)
 {
     if (!doc)
@@ -272,43 +393,28 @@ QString Text::getLinkAt(QPointF scenePos) const
 void Text::regenerate()
 {
     if (!doc) {
-        doc = DocumentCache::getInstance().pop();
-        dirty = true;
-    }
-
-    if (dirty) {
-        doc->setDefaultFont(defFont);
+        // the layout from when the text was last visible, if it still applies
+        cacheKey = getCacheKey();
+        doc = LayoutCache::getInstance().take(cacheKey);
 
-        if (elide) {
-            QFontMetrics metrics = QFontMetrics(defFont);
-            QString elidedText = metrics.elidedText(text, Qt::ElideRight, qRound(width));
-
-            doc->setPlainText(elidedText);
+        if (doc) {
+            dirty = false;
+            updateSize();
         } else {
-            doc->setDefaultStyleSheet(defStyleSheet);
-            doc->setHtml(text);
+            doc = DocumentCache::getInstance().pop();
+            dirty = true;
         }
 
-        // wrap mode
-        QTextOption opt;
-        opt.setWrapMode(elide ? QTextOption::NoWrap : QTextOption::WrapAtWordBoundaryOrAnywhere);
-        doc->setDefaultTextOption(opt);
-
-        // width
-        doc->setTextWidth(width);
-        doc->documentLayout()->update();
-
-        // update ascent
-        if (doc->firstBlock().layout()->lineCount() > 0)
-            ascent = doc->firstBlock().layout()->lineAt(0).ascent();
-
-        // let the scene know about our change in size
-        if (size != idealSize())
-            prepareGeometryChange();
-
-        // get the new width and height
-        size = idealSize();
+        // smileys still being decoded show up once they are ready
+        const CustomTextDocument* customDoc = qobject_cast<CustomTextDocument*>(doc);
+        if (customDoc)
+            connect(customDoc, &CustomTextDocument::imageLoaded, this, [this]() { update(); });
+    }
 
+    if (dirty) {
+        cacheKey = getCacheKey();
+        setupDocument(doc, text, defFont, defStyleSheet, elide, width);
+        updateSize();
         dirty = false;
     }
 
@@ -319,10 +425,49 @@ void Text::regenerate()
 
 void Text::freeResources()
 {
-    DocumentCache::getInstance().push(doc);
+    doc->disconnect(this);
+
+    if (dirty) {
+        DocumentCache::getInstance().push(doc);
+    } else {
+        // keep the layout for when the text comes into view again
+        LayoutCache::getInstance().insert(cacheKey, doc);
+    }
+
     doc = nullptr;
 }
 
+/**
+ * @brief Takes ascent and size from the laid out document.
+ */
+void Text::updateSize()
+{
+    // update ascent
+    if (doc->firstBlock().layout()->lineCount() > 0)
+        ascent = doc->firstBlock().layout()->lineAt(0).ascent();
+
+    // let the scene know about our change in size
+    if (size != idealSize())
+        prepareGeometryChange();
+
+    // get the new width and height
+    size = idealSize();
+}
+
+/**
+ * @brief Key of the current layout in the layout cache.
+ */
+LayoutCache::Key Text::getCacheKey() const
+{
+    LayoutCache::Key key;
+    key.id = id;
+    key.width = width;
+    key.font = defFont;
+    key.style = styleHash;
+    key.emojiSize = Settings::getInstance().getEmojiFontPointSize();
+    return key;
+}
+
 QSizeF Text::idealSize()
 {
     if (doc)
@@ -21,6 +21,7 @@
 #define TEXT_H
 
 #include "../chatlinecontent.h"
+#include "../layoutcache.h"
 
 #include <QFont>
 
@@ -38,6 +39,8 @@ public:
     void setText(const QString& txt);
 
     virtual void setWidth(qreal width) final;
+    virtual Measure getMeasure() const final;
+    virtual void setMetrics(const ContentMetrics& metrics) final;
 
     virtual void selectionMouseMove(QPointF scenePos) final;
     virtual void selectionStarted(QPointF scenePos) final;
@@ -66,6 +69,8 @@ protected:
     // dynamic resource management
     void regenerate();
     void freeResources();
+    void updateSize();
+    LayoutCache::Key getCacheKey() const;
 
     QSizeF idealSize();
     int cursorFromPos(QPointF scenePos, bool fuzzy = true) const;
@@ -91,7 +96,10 @@ private:
     qreal width = 0.0;
     QFont defFont;
     QString defStyleSheet;
+    uint styleHash = 0;
     QColor color;
+    quint64 id = 0;
+    LayoutCache::Key cacheKey;
 };
 
 #endif // TEXT_H
@@ -18,14 +18,19 @@
 */
 
 #include "customtextdocument.h"
+#include "pixmapcache.h"
 #include "src/persistence/settings.h"
 #include "src/persistence/smileypack.h"
 #include "src/widget/style.h"
 
 #include <QDebug>
-#include <QIcon>
 #include <QUrl>
 
+/**
+ * @fn void CustomTextDocument::imageLoaded()
+ * @brief Emitted when a smiley shown as a placeholder is ready, the document has to be repainted.
+ */
+
 CustomTextDocument::CustomTextDocument(QObject* parent)
     : QTextDocument(parent)
 {
@@ -40,7 +45,11 @@ QVariant CustomTextDocument::loadResource(int type, const QUrl& name)
                            Settings::getInstance().getEmojiFontPointSize());
         QString fileName = QUrl::fromPercentEncoding(name.toEncoded()).mid(4).toHtmlEscaped();
 
-        return SmileyPack::getInstance().getAsIcon(fileName).pixmap(size);
+        const QString path = SmileyPack::getInstance().getIconPath(fileName);
+        return PixmapCache::getInstance().get(path, size, this, [this, name](const QPixmap& pixmap) {
+            addResource(QTextDocument::ImageResource, name, pixmap);
+            emit imageLoaded();
+        });
     }
 
     return QTextDocument::loadResource(type, name);
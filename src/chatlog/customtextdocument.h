@@ -28,6 +28,9 @@ class CustomTextDocument : public QTextDocument
 public:
     explicit CustomTextDocument(QObject* parent = 0);
 
+signals:
+    void imageLoaded();
+
 protected:
     virtual QVariant loadResource(int type, const QUrl& name);
 };
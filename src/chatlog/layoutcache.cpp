@@ -0,0 +1,222 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "layoutcache.h"
+
+#include <QTextDocument>
+
+/**
+ * @class LayoutCache
+ * @brief Keeps the laid out documents of texts that scrolled out of view.
+ *
+ * A Text gives its document back when it leaves the viewport. Putting it in here, rather than
+ * clearing it, lets the text take it again when it is scrolled back, without parsing the HTML and
+ * laying it out once more. The documents are kept in least recently used order and the oldest
+ * ones are deleted once their estimated size exceeds the budget.
+ *
+ * Only the latest layout of a text is kept. Inserting one for another width, font or style
+ * deletes the previous one, it won't be taken anymore and would only use up the budget.
+ *
+ * @struct LayoutCache::Key
+ * @brief Everything a layout depends on.
+ *
+ * @var LayoutCache::Key::id
+ * @brief Identifies the text, see Text::setText().
+ *
+ * @var LayoutCache::Key::style
+ * @brief Hash of the default style sheet.
+ *
+ * @var LayoutCache::Key::emojiSize
+ * @brief Size the emoticons were loaded at.
+ *
+ * @var LayoutCache::keys
+ * @brief Key of the layout cached for each text id, possibly evicted since.
+ *
+ * QCache doesn't tell about evictions, so keys of evicted layouts are dropped when a take() misses
+ * them, and all at once when they outnumber the cached layouts.
+ */
+
+namespace {
+/// Budget for the cached documents in bytes
+const int DEFAULT_MAX_COST = 32 * 1024 * 1024;
+/// Rough size of an empty document with its layout
+const int DOCUMENT_COST = 4096;
+/// Rough size of a character, with its formats and glyphs
+const int CHARACTER_COST = 64;
+}
+
+bool LayoutCache::Key::operator==(const Key& other) const
+{
+    return id == other.id && width == other.width && style == other.style
+           && emojiSize == other.emojiSize && font == other.font;
+}
+
+uint qHash(const LayoutCache::Key& key, uint seed)
+{
+    return qHash(key.id, seed) ^ qHash(key.width, seed) ^ qHash(key.font, seed) ^ key.style
+           ^ static_cast<uint>(key.emojiSize);
+}
+
+LayoutCache::LayoutCache()
+    : cache{DEFAULT_MAX_COST}
+{
+}
+
+/**
+ * @brief Takes a document out of the cache.
+ * @return The document laid out for the key, owned by the caller, or nullptr if there is none.
+ */
+QTextDocument* LayoutCache::take(const Key& key)
+{
+    QTextDocument* doc = cache.take(key);
+    if (doc) {
+        keys.remove(key.id);
+        ++hits;
+    } else {
+        const auto it = keys.find(key.id);
+        if (it != keys.end() && !cache.contains(it.value()))
+            keys.erase(it);
+
+        ++misses;
+    }
+
+    return doc;
+}
+
+/**
+ * @brief Puts a laid out document into the cache, which takes ownership of it.
+ *
+ * Replaces the document cached for the same text id, even if it was laid out for another key.
+ * Documents larger than the whole budget are deleted right away.
+ */
+void LayoutCache::insert(const Key& key, QTextDocument* doc)
+{
+    if (!doc)
+        return;
+
+    remove(key.id);
+    keys.insert(key.id, key);
+    cache.insert(key, doc, estimateCost(doc));
+    if (keys.size() > 2 * cache.count())
+        pruneKeys();
+}
+
+/**
+ * @brief Deletes the document of a text, whatever it was laid out for, e.g. once the text
+ * changed or is deleted.
+ */
+void LayoutCache::remove(quint64 id)
+{
+    const auto it = keys.find(id);
+    if (it == keys.end())
+        return;
+
+    cache.remove(it.value());
+    keys.erase(it);
+}
+
+/**
+ * @brief Deletes all documents and resets the statistics.
+ */
+void LayoutCache::clear()
+{
+    cache.clear();
+    keys.clear();
+    hits = 0;
+    misses = 0;
+}
+
+/**
+ * @brief Sets the budget in bytes, deleting the oldest documents until it is met.
+ */
+void LayoutCache::setMaxCost(int bytes)
+{
+    cache.setMaxCost(bytes);
+    pruneKeys();
+}
+
+int LayoutCache::getMaxCost() const
+{
+    return cache.maxCost();
+}
+
+/**
+ * @brief Estimated size of the cached documents in bytes.
+ */
+int LayoutCache::getCost() const
+{
+    return cache.totalCost();
+}
+
+/**
+ * @brief Number of cached documents.
+ */
+int LayoutCache::getCount() const
+{
+    return cache.count();
+}
+
+quint64 LayoutCache::getHits() const
+{
+    return hits;
+}
+
+quint64 LayoutCache::getMisses() const
+{
+    return misses;
+}
+
+/**
+ * @brief Share of take() calls that found a document, 0 if there were none.
+ */
+qreal LayoutCache::getHitRate() const
+{
+    const quint64 total = hits + misses;
+    return total ? static_cast<qreal>(hits) / total : 0.0;
+}
+
+/**
+ * @brief Roughly estimates the memory a laid out document takes, in bytes.
+ */
+int LayoutCache::estimateCost(const QTextDocument* doc)
+{
+    return DOCUMENT_COST + doc->characterCount() * CHARACTER_COST;
+}
+
+/**
+ * @brief Drops the keys of layouts the cache evicted.
+ */
+void LayoutCache::pruneKeys()
+{
+    for (auto it = keys.begin(); it != keys.end();) {
+        if (cache.contains(it.value()))
+            ++it;
+        else
+            it = keys.erase(it);
+    }
+}
+
+/**
+ * @brief Returns the singleton instance.
+ */
+LayoutCache& LayoutCache::getInstance()
+{
+    static LayoutCache instance;
+    return instance;
+}
@@ -0,0 +1,76 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LAYOUTCACHE_H
+#define LAYOUTCACHE_H
+
+#include <QCache>
+#include <QFont>
+#include <QHash>
+
+class QTextDocument;
+
+class LayoutCache
+{
+public:
+    struct Key
+    {
+        quint64 id = 0;
+        qreal width = 0.0;
+        QFont font;
+        uint style = 0;
+        int emojiSize = 0;
+
+        bool operator==(const Key& other) const;
+    };
+
+    static LayoutCache& getInstance();
+
+    QTextDocument* take(const Key& key);
+    void insert(const Key& key, QTextDocument* doc);
+    void remove(quint64 id);
+    void clear();
+
+    void setMaxCost(int bytes);
+    int getMaxCost() const;
+    int getCost() const;
+    int getCount() const;
+    quint64 getHits() const;
+    quint64 getMisses() const;
+    qreal getHitRate() const;
+
+    static int estimateCost(const QTextDocument* doc);
+
+private:
+    LayoutCache();
+    LayoutCache(LayoutCache&) = delete;
+    LayoutCache& operator=(const LayoutCache&) = delete;
+
+    void pruneKeys();
+
+private:
+    QCache<Key, QTextDocument> cache;
+    QHash<quint64, Key> keys;
+    quint64 hits = 0;
+    quint64 misses = 0;
+};
+
+uint qHash(const LayoutCache::Key& key, uint seed = 0);
+
+#endif // LAYOUTCACHE_H
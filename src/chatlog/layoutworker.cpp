@@ -0,0 +1,192 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "layoutworker.h"
+
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentRun>
+
+namespace {
+const int CHUNK_SIZE = 32;
+}
+
+/**
+ * @class LayoutWorker
+ * @brief Measures the lines of a ChatLog on a thread pool.
+ *
+ * Laying out text is by far the most expensive part of a relayout, e.g. after a resize or a font
+ * change. The jobs carry everything the contents need to be measured, so they run on several
+ * cores, while the GUI thread only applies the resulting sizes as they come in.
+ *
+ * The jobs are measured in chunks on a pool of their own. A relayout of a long log queues
+ * thousands of them, on the global pool they'd starve the video conversion and encoding of calls.
+ *
+ * @struct LayoutWorker::Job
+ * @brief Measurement of one line, with a measure function per column, empty where the content
+ * is laid out on the GUI thread.
+ *
+ * @struct LayoutWorker::Result
+ * @brief Metrics of the columns of a line, for ChatLine::layout().
+ *
+ * @var LayoutWorker::chunks
+ * @brief Results of the jobs, CHUNK_SIZE jobs per future.
+ *
+ * @var LayoutWorker::canceled
+ * @brief Set to stop the chunks of the current start() early.
+ *
+ * @var LayoutWorker::chunk
+ * @brief Chunk takeResults() continues with.
+ *
+ * @var LayoutWorker::taken
+ * @brief Results of the current chunk already handed out by takeResults().
+ */
+
+/**
+ * @brief Cancels the jobs, waiting for those in progress.
+ */
+LayoutWorker::~LayoutWorker()
+{
+    const QVector<QFuture<QVector<Result>>> running = chunks;
+    cancel();
+
+    for (QFuture<QVector<Result>> future : running)
+        future.waitForFinished();
+}
+
+/**
+ * @brief Starts measuring, results of jobs started earlier are dropped.
+ */
+void LayoutWorker::start(const QVector<Job>& jobs)
+{
+    cancel();
+
+    if (jobs.isEmpty())
+        return;
+
+    canceled = std::make_shared<QAtomicInt>(0);
+    chunks.reserve((jobs.size() + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    for (int i = 0; i < jobs.size(); i += CHUNK_SIZE) {
+        chunks << QtConcurrent::run(pool(), &LayoutWorker::measureChunk, jobs.mid(i, CHUNK_SIZE),
+                                    canceled);
+    }
+}
+
+/**
+ * @brief Drops all results that weren't taken yet.
+ *
+ * Jobs in progress aren't waited for, their results are discarded.
+ */
+void LayoutWorker::cancel()
+{
+    if (canceled)
+        canceled->storeRelease(1);
+
+    canceled.reset();
+    chunks.clear();
+    chunk = 0;
+    taken = 0;
+}
+
+/**
+ * @brief Whether there are results left to take.
+ */
+bool LayoutWorker::isRunning() const
+{
+    return chunk < chunks.size();
+}
+
+/**
+ * @brief Takes the results that are ready, in the order of the jobs.
+ *
+ * @param max Maximum number of results to take.
+ */
+QVector<LayoutWorker::Result> LayoutWorker::takeResults(int max)
+{
+    QVector<Result> results;
+    while (results.size() < max && chunk < chunks.size() && chunks[chunk].isFinished()) {
+        const QVector<Result> ready = chunks[chunk].result();
+        while (results.size() < max && taken < ready.size())
+            results << ready[taken++];
+
+        if (taken == ready.size()) {
+            ++chunk;
+            taken = 0;
+        }
+    }
+
+    // free the results once all are taken
+    if (chunk == chunks.size())
+        cancel();
+
+    return results;
+}
+
+/**
+ * @brief Measures the columns of a line, on any thread.
+ */
+LayoutWorker::Result LayoutWorker::measure(const Job& job)
+{
+    Result result;
+    result.row = job.row;
+    result.metrics.resize(job.measures.size());
+
+    for (int i = 0; i < job.measures.size(); ++i) {
+        if (job.measures[i])
+            result.metrics[i] = job.measures[i](job.widths[i]);
+    }
+
+    return result;
+}
+
+/**
+ * @brief Pool the chunks are measured on, shared by all ChatLogs.
+ *
+ * One core is left to the GUI thread applying the results.
+ */
+QThreadPool* LayoutWorker::pool()
+{
+    static QThreadPool pool;
+    static const bool bounded = [] {
+        pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+        return true;
+    }();
+    Q_UNUSED(bounded);
+
+    return &pool;
+}
+
+/**
+ * @brief Measures a chunk of jobs, stops early once canceled.
+ */
+QVector<LayoutWorker::Result> LayoutWorker::measureChunk(const QVector<Job>& jobs,
+                                                         std::shared_ptr<QAtomicInt> canceled)
+{
+    QVector<Result> results;
+    results.reserve(jobs.size());
+
+    for (const Job& job : jobs) {
+        if (canceled->loadAcquire())
+            break;
+
+        results << measure(job);
+    }
+
+    return results;
+}
@@ -0,0 +1,70 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LAYOUTWORKER_H
+#define LAYOUTWORKER_H
+
+#include "chatlinecontent.h"
+
+#include <QAtomicInt>
+#include <QFuture>
+#include <QVector>
+
+#include <memory>
+
+class QThreadPool;
+
+class LayoutWorker
+{
+public:
+    struct Job
+    {
+        int row;
+        QVector<qreal> widths;
+        QVector<ChatLineContent::Measure> measures;
+    };
+
+    struct Result
+    {
+        int row;
+        QVector<ContentMetrics> metrics;
+    };
+
+    ~LayoutWorker();
+
+    void start(const QVector<Job>& jobs);
+    void cancel();
+    bool isRunning() const;
+    QVector<Result> takeResults(int max);
+
+    static Result measure(const Job& job);
+
+private:
+    static QThreadPool* pool();
+    static QVector<Result> measureChunk(const QVector<Job>& jobs,
+                                        std::shared_ptr<QAtomicInt> canceled);
+
+private:
+    QVector<QFuture<QVector<Result>>> chunks;
+    std::shared_ptr<QAtomicInt> canceled;
+    int chunk = 0;
+    int taken = 0;
+};
+
+#endif // LAYOUTWORKER_H
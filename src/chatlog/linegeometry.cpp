@@ -0,0 +1,241 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "linegeometry.h"
+
+/**
+ * @class LineGeometry
+ * @brief Vertical positions of the lines of a ChatLog, derived from their cached heights.
+ *
+ * Only the lines around the viewport are laid out and in the scene, every other line is just a
+ * height here. The heights, each plus the spacing between lines, are kept in a Fenwick tree, so
+ * the top of a line, the line at a position and a change of height all cost O(log n), however
+ * long the history is.
+ *
+ * A height is stale until the line was laid out at the current width, e.g. after a resize or
+ * for lines that were never laid out and got an estimated height.
+ *
+ * @var LineGeometry::tree
+ * @brief Fenwick tree over the heights plus spacing, node k (1-based) is stored at k - 1.
+ */
+
+namespace {
+int lowestBit(int k)
+{
+    return k & -k;
+}
+}
+
+/**
+ * @param spacing Space between two lines.
+ */
+LineGeometry::LineGeometry(qreal spacing)
+    : spacing{spacing}
+{
+}
+
+void LineGeometry::clear()
+{
+    heights.clear();
+    tree.clear();
+    stale.clear();
+}
+
+/**
+ * @brief Adds a line at the bottom, its height is stale until set.
+ */
+void LineGeometry::append(qreal height)
+{
+    const int k = heights.size() + 1;
+    qreal node = height + spacing;
+
+    // the new node covers (k - lowestBit(k), k], the nodes below it cover the rest of that range
+    for (int j = k - 1; j > k - lowestBit(k); j -= lowestBit(j)) {
+        node += tree[j - 1];
+    }
+
+    heights.append(height);
+    tree.append(node);
+    stale.append(true);
+}
+
+/**
+ * @brief Adds lines on top, their heights are stale until set.
+ *
+ * @param count Number of lines to add.
+ * @param height Height to assume for them.
+ */
+void LineGeometry::prepend(int count, qreal height)
+{
+    if (count <= 0) {
+        return;
+    }
+
+    heights = QVector<qreal>(count, height) + heights;
+    stale = QVector<bool>(count, true) + stale;
+    rebuild();
+}
+
+/**
+ * @brief Sets the height of a line once it was laid out, moving all lines below it.
+ */
+void LineGeometry::setHeight(int row, qreal height)
+{
+    stale[row] = false;
+
+    const qreal delta = height - heights[row];
+    if (delta == 0.0) {
+        return;
+    }
+
+    heights[row] = height;
+    for (int k = row + 1; k <= tree.size(); k += lowestBit(k)) {
+        tree[k - 1] += delta;
+    }
+}
+
+/**
+ * @brief Marks all heights stale, the lines have to be laid out again.
+ */
+void LineGeometry::invalidate()
+{
+    stale.fill(true);
+}
+
+int LineGeometry::size() const
+{
+    return heights.size();
+}
+
+bool LineGeometry::isStale(int row) const
+{
+    return stale[row];
+}
+
+qreal LineGeometry::getHeight(int row) const
+{
+    return heights[row];
+}
+
+qreal LineGeometry::getTop(int row) const
+{
+    return prefixSum(row);
+}
+
+qreal LineGeometry::getBottom(int row) const
+{
+    return prefixSum(row) + heights[row];
+}
+
+/**
+ * @brief Bottom of the last line, 0 if there are none.
+ */
+qreal LineGeometry::getTotalHeight() const
+{
+    return heights.isEmpty() ? 0.0 : prefixSum(heights.size()) - spacing;
+}
+
+/**
+ * @brief Average height of a line, 0 if there are none.
+ */
+qreal LineGeometry::getMeanHeight() const
+{
+    return heights.isEmpty() ? 0.0 : prefixSum(heights.size()) / heights.size() - spacing;
+}
+
+/**
+ * @brief Finds the first line whose bottom is at or below a position.
+ *
+ * @return The row, or size() if all lines end above it.
+ */
+int LineGeometry::findFirstByBottom(qreal y) const
+{
+    return lowerBound(y + spacing) - 1;
+}
+
+/**
+ * @brief Finds the first line whose top is at or below a position.
+ *
+ * @return The row, or size() if all lines start above it.
+ */
+int LineGeometry::findFirstByTop(qreal y) const
+{
+    if (y <= 0.0) {
+        return 0;
+    }
+
+    return qMin(lowerBound(y), heights.size());
+}
+
+/**
+ * @brief Sum of the heights plus spacing of the first count lines.
+ */
+qreal LineGeometry::prefixSum(int count) const
+{
+    qreal sum = 0.0;
+    for (int k = count; k > 0; k -= lowestBit(k)) {
+        sum += tree[k - 1];
+    }
+
+    return sum;
+}
+
+/**
+ * @brief Finds the smallest count of lines whose prefixSum() reaches a sum.
+ *
+ * @return The count, or size() + 1 if all lines together don't reach it.
+ */
+int LineGeometry::lowerBound(qreal sum) const
+{
+    const int n = tree.size();
+    int step = 1;
+    while (step * 2 <= n) {
+        step *= 2;
+    }
+
+    // descend the tree to the largest count whose sum is still below
+    int count = 0;
+    for (; n && step > 0; step /= 2) {
+        if (count + step <= n && tree[count + step - 1] < sum) {
+            count += step;
+            sum -= tree[count - 1];
+        }
+    }
+
+    return count + 1;
+}
+
+/**
+ * @brief Builds the Fenwick tree from the heights in O(n).
+ */
+void LineGeometry::rebuild()
+{
+    const int n = heights.size();
+    tree.resize(n);
+    for (int i = 0; i < n; ++i) {
+        tree[i] = heights[i] + spacing;
+    }
+
+    for (int k = 1; k <= n; ++k) {
+        const int parent = k + lowestBit(k);
+        if (parent <= n) {
+            tree[parent - 1] += tree[k - 1];
+        }
+    }
+}
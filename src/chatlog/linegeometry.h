@@ -0,0 +1,60 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LINEGEOMETRY_H
+#define LINEGEOMETRY_H
+
+#include <QVector>
+#include <QtGlobal>
+
+class LineGeometry
+{
+public:
+    explicit LineGeometry(qreal spacing);
+
+    void clear();
+    void append(qreal height);
+    void prepend(int count, qreal height);
+    void setHeight(int row, qreal height);
+    void invalidate();
+
+    int size() const;
+    bool isStale(int row) const;
+    qreal getHeight(int row) const;
+    qreal getTop(int row) const;
+    qreal getBottom(int row) const;
+    qreal getTotalHeight() const;
+    qreal getMeanHeight() const;
+
+    int findFirstByBottom(qreal y) const;
+    int findFirstByTop(qreal y) const;
+
+private:
+    qreal prefixSum(int count) const;
+    int lowerBound(qreal sum) const;
+    void rebuild();
+
+private:
+    qreal spacing;
+    QVector<qreal> heights;
+    QVector<qreal> tree;
+    QVector<bool> stale;
+};
+
+#endif // LINEGEOMETRY_H
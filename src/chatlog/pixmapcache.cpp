@@ -1,5 +1,5 @@
 /*
-    Copyright © 2014-2015 by The qTox Project Contributors
+    Copyright © 2015 by The qTox Project Contributors
 
     This file is part of qTox, a Qt-based graphical interface for Tox.
 
@@ -19,19 +19,54 @@
 
 #include "pixmapcache.h"
 
-QPixmap PixmapCache::get(const QString& filename, QSize size)
-{
-    auto itr = cache.find(filename);
+#include <QElapsedTimer>
+#include <QImageReader>
+#include <QtConcurrent/QtConcurrentRun>
+
+/**
+ * @class PixmapCache
+ * @brief Decodes and scales images on a thread pool and keeps the results within a budget.
+ *
+ * Reading and scaling an image on the GUI thread stalls scrolling through a log full of them, so
+ * a miss returns a transparent placeholder of the requested size and queues the image for
+ * decoding. Once it's ready, the pixmap is cached and handed to everyone who asked for it in the
+ * meantime. The pixmaps are kept in least recently used order and the oldest ones are dropped
+ * once their size exceeds the budget.
+ *
+ * Only to be used from the GUI thread, the decoding threads only ever touch QImages.
+ *
+ * @struct PixmapCache::Key
+ * @brief An image file at the size it was requested.
+ *
+ * @var PixmapCache::pending
+ * @brief Images being decoded, with the callbacks waiting for them.
+ *
+ * @var PixmapCache::decodeTime
+ * @brief Total time spent decoding and scaling, in microseconds.
+ */
 
-    if (itr == cache.end()) {
-        QIcon icon;
-        icon.addFile(filename);
+namespace {
+/// Budget for the cached pixmaps in bytes
+const int DEFAULT_MAX_COST = 32 * 1024 * 1024;
+/// Threads decoding images, more would only compete with the text layout for the CPU
+const int DECODE_THREADS = 2;
+}
 
-        cache.insert(filename, icon);
-        return icon.pixmap(size);
-    }
+bool PixmapCache::Key::operator==(const Key& other) const
+{
+    return size == other.size && filename == other.filename;
+}
+
+uint qHash(const PixmapCache::Key& key, uint seed)
+{
+    return qHash(key.filename, seed) ^ qHash(key.size.width(), seed)
+           ^ qHash(key.size.height() << 16, seed);
+}
 
-    return itr.value().pixmap(size);
+PixmapCache::PixmapCache()
+    : cache{DEFAULT_MAX_COST}
+{
+    pool.setMaxThreadCount(DECODE_THREADS);
 }
 
 /**
@@ -42,3 +77,187 @@ PixmapCache& PixmapCache::getInstance()
     static PixmapCache instance;
     return instance;
 }
+
+/**
+ * @brief Gets an image scaled to fit into a size, keeping its aspect ratio.
+ *
+ * @param filename Image file, may be a resource.
+ * @param size Size to fit the image into.
+ * @param receiver Lifetime of the callback, it isn't called once the receiver is deleted.
+ * @param onReady Called with the pixmap once it's decoded, only if a placeholder was returned.
+ * @return The cached pixmap, a transparent placeholder while it's being decoded, or a null pixmap
+ * if the image can't be read.
+ */
+QPixmap PixmapCache::get(const QString& filename, QSize size, QObject* receiver, Callback onReady)
+{
+    if (filename.isEmpty()) {
+        return QPixmap();
+    }
+
+    const Key key{filename, size};
+    const QPixmap* cached = cache.object(key);
+    if (cached) {
+        ++hits;
+        return *cached;
+    }
+
+    ++misses;
+    const bool queued = pending.contains(key);
+    QVector<Waiter>& waiters = pending[key];
+    if (receiver && onReady) {
+        waiters.append({receiver, onReady});
+    }
+
+    if (!queued) {
+        QtConcurrent::run(&pool, [this, filename, size]() {
+            QElapsedTimer timer;
+            timer.start();
+            const QImage image = decode(filename, size);
+            QMetaObject::invokeMethod(this, "onDecoded", Qt::QueuedConnection,
+                                      Q_ARG(QString, filename), Q_ARG(QSize, size),
+                                      Q_ARG(QImage, image),
+                                      Q_ARG(qint64, timer.nsecsElapsed() / 1000));
+        });
+    }
+
+    QPixmap placeholder{size};
+    placeholder.fill(Qt::transparent);
+    return placeholder;
+}
+
+/**
+ * @brief Drops all pixmaps and resets the statistics, images being decoded are still delivered.
+ */
+void PixmapCache::clear()
+{
+    cache.clear();
+    hits = 0;
+    misses = 0;
+    evictions = 0;
+    decodes = 0;
+    decodeTime = 0;
+}
+
+/**
+ * @brief Sets the budget in bytes, dropping the oldest pixmaps until it is met.
+ */
+void PixmapCache::setMaxCost(int bytes)
+{
+    const int count = cache.count();
+    cache.setMaxCost(bytes);
+    evictions += static_cast<quint64>(count - cache.count());
+}
+
+int PixmapCache::getMaxCost() const
+{
+    return cache.maxCost();
+}
+
+/**
+ * @brief Estimated size of the cached pixmaps in bytes.
+ */
+int PixmapCache::getCost() const
+{
+    return cache.totalCost();
+}
+
+int PixmapCache::getCount() const
+{
+    return cache.count();
+}
+
+quint64 PixmapCache::getHits() const
+{
+    return hits;
+}
+
+quint64 PixmapCache::getMisses() const
+{
+    return misses;
+}
+
+/**
+ * @brief Number of pixmaps dropped to stay within the budget.
+ */
+quint64 PixmapCache::getEvictions() const
+{
+    return evictions;
+}
+
+/**
+ * @brief Number of images decoded.
+ */
+quint64 PixmapCache::getDecodes() const
+{
+    return decodes;
+}
+
+/**
+ * @brief Total time spent decoding and scaling images, in microseconds.
+ */
+qint64 PixmapCache::getDecodeTime() const
+{
+    return decodeTime;
+}
+
+/**
+ * @brief Reads an image and scales it to fit into a size.
+ *
+ * Vector images are rendered at the requested size, raster images are only scaled down, like
+ * QIcon does. Safe to call from any thread.
+ *
+ * @return The image, null if it can't be read.
+ */
+QImage PixmapCache::decode(const QString& filename, QSize size)
+{
+    QImageReader reader{filename};
+    const QSize original = reader.size();
+    if (original.isValid() && size.isValid()) {
+        const QSize scaled = original.scaled(size, Qt::KeepAspectRatio);
+        const bool scalable = reader.format().startsWith("svg");
+        if (scalable || scaled.width() < original.width()) {
+            // lets the plugin render at that size, QImageReader scales smoothly otherwise
+            reader.setScaledSize(scaled);
+        }
+    }
+
+    const QImage image = reader.read();
+    if (image.isNull()) {
+        return image;
+    }
+
+    // spare the GUI thread the conversion when it creates the pixmap
+    return image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied
+                                                         : QImage::Format_RGB32);
+}
+
+/**
+ * @brief Estimates the memory a pixmap uses in bytes.
+ */
+int PixmapCache::estimateCost(const QPixmap& pixmap)
+{
+    // null pixmaps are kept for images that can't be read, so they aren't tried again
+    return qMax(1, pixmap.width() * pixmap.height() * qMax(1, pixmap.depth() / 8));
+}
+
+void PixmapCache::onDecoded(const QString& filename, QSize size, const QImage& image, qint64 usecs)
+{
+    ++decodes;
+    decodeTime += usecs;
+
+    const Key key{filename, size};
+    const QPixmap pixmap = QPixmap::fromImage(image);
+
+    // pixmaps larger than the whole budget are only handed to the waiters
+    cache.remove(key);
+    const int count = cache.count();
+    cache.insert(key, new QPixmap{pixmap}, estimateCost(pixmap));
+    evictions += static_cast<quint64>(count + 1 - cache.count());
+
+    const QVector<Waiter> waiters = pending.take(key);
+    for (const Waiter& waiter : waiters) {
+        if (waiter.receiver) {
+            waiter.onReady(pixmap);
+        }
+    }
+}
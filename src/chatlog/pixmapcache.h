@@ -20,25 +20,76 @@
 #ifndef ICONCACHE_H
 #define ICONCACHE_H
 
+#include <QCache>
 #include <QHash>
-#include <QIcon>
+#include <QImage>
+#include <QObject>
 #include <QPixmap>
+#include <QPointer>
+#include <QThreadPool>
+#include <QVector>
 
-class PixmapCache
+#include <functional>
+
+class PixmapCache : public QObject
 {
+    Q_OBJECT
 public:
-    QPixmap get(const QString& filename, QSize size);
-    static PixmapCache& getInstance();
+    using Callback = std::function<void(const QPixmap&)>;
 
-protected:
-    PixmapCache()
+    struct Key
     {
-    }
+        QString filename;
+        QSize size;
+
+        bool operator==(const Key& other) const;
+    };
+
+    static PixmapCache& getInstance();
+
+    QPixmap get(const QString& filename, QSize size, QObject* receiver = nullptr,
+                Callback onReady = Callback());
+    void clear();
+
+    void setMaxCost(int bytes);
+    int getMaxCost() const;
+    int getCost() const;
+    int getCount() const;
+    quint64 getHits() const;
+    quint64 getMisses() const;
+    quint64 getEvictions() const;
+    quint64 getDecodes() const;
+    qint64 getDecodeTime() const;
+
+    static QImage decode(const QString& filename, QSize size);
+    static int estimateCost(const QPixmap& pixmap);
+
+private slots:
+    void onDecoded(const QString& filename, QSize size, const QImage& image, qint64 usecs);
+
+private:
+    PixmapCache();
     PixmapCache(PixmapCache&) = delete;
     PixmapCache& operator=(const PixmapCache&) = delete;
 
 private:
-    QHash<QString, QIcon> cache;
+    struct Waiter
+    {
+        QPointer<QObject> receiver;
+        Callback onReady;
+    };
+
+    QCache<Key, QPixmap> cache;
+    QHash<Key, QVector<Waiter>> pending;
+    quint64 hits = 0;
+    quint64 misses = 0;
+    quint64 evictions = 0;
+    quint64 decodes = 0;
+    qint64 decodeTime = 0;
+    // last, so it is destroyed first and waits for running decodes
+    QThreadPool pool;
 };
 
+uint qHash(const PixmapCache::Key& key, uint seed = 0);
+
 #endif // ICONCACHE_H
@@ -19,13 +19,11 @@
 
 #include "textformatter.h"
 
-#include <QMap>
-#include <QPair>
-#include <QRegularExpression>
 #include <QVector>
 
-#include <functional>
+#include <algorithm>
 
+namespace {
 enum TextStyle
 {
     BOLD = 0,
@@ -33,193 +31,508 @@ enum TextStyle
     UNDERLINE,
     STRIKE,
     CODE,
-    HREF
+    STYLE_COUNT
 };
 
-static const QString HTML_CHARACTER_CODE = QStringLiteral("&#%1");
+// Items associated with TextStyle values respectively. Do NOT change this order
+const char MARKDOWN_SYMBOLS[STYLE_COUNT] = {'*', '/', '_', '~', '`'};
 
-// clang-format off
-static const QVector<char> MARKDOWN_SYMBOLS {
-    '*',
-    '/',
-    '_',
-    '~',
-    '`'
+const char* const OPENING_TAGS[STYLE_COUNT] = {"<b>", "<i>", "<u>", "<s>",
+                                               "<font color=#595959><code>"};
+
+const char* const CLOSING_TAGS[STYLE_COUNT] = {"</b>", "</i>", "</u>", "</s>",
+                                               "</code></font>"};
+
+/// Upper bound of the markup added around a styled span or a URL
+const int MAX_MARKUP_LENGTH = 40;
+
+/// Length of a delimiter opening a multiline code block
+const int CODE_BLOCK_LENGTH = 3;
+
+/// Length of the identifier in a tox: URI
+const int TOX_ID_LENGTH = 76;
+
+enum class TokenType
+{
+    Text,
+    Tag,
+    Url,
+    Delimiter,
+    Newline
 };
 
-static const QString COMMON_PATTERN = QStringLiteral("(?<=^|[^%1<])"
-                                                     "[%1]{%2}"
-                                                     "(?![%1 \\n])"
-                                                     ".+?"
-                                                     "(?<![%1< \\n])"
-                                                     "[%1]{%2}"
-                                                     "(?=$|[^%1])");
-
-static const QString MULTILINE_CODE = QStringLiteral("(?<=^|[^`])"
-                                                     "```"
-                                                     "(?!`)"
-                                                     "(.|\\n)+"
-                                                     "(?<!`)"
-                                                     "```"
-                                                     "(?=$|[^`])");
-
-// Items in vector associated with TextStyle values respectively. Do NOT change this order
-static const QVector<QString> htmlPatterns{QStringLiteral("<b>%1</b>"),
-                                                QStringLiteral("<i>%1</i>"),
-                                                QStringLiteral("<u>%1</u>"),
-                                                QStringLiteral("<s>%1</s>"),
-                                                QStringLiteral(
-                                                    "<font color=#595959><code>%1</code></font>"),
-                                                QStringLiteral("<a href=\"%1%2\">%2</a>")};
-
-#define STRING_FROM_TYPE(type) QString(MARKDOWN_SYMBOLS[type])
-
-#define REGEX_MARKDOWN_PAIR(type, count) \
-{QRegularExpression(COMMON_PATTERN.arg(STRING_FROM_TYPE(type), #count)), htmlPatterns[type]}
-
-static const QVector<QPair<QRegularExpression, QString>> textPatternStyle{
-    REGEX_MARKDOWN_PAIR(BOLD, 1),
-    REGEX_MARKDOWN_PAIR(ITALIC, 1),
-    REGEX_MARKDOWN_PAIR(UNDERLINE, 1),
-    REGEX_MARKDOWN_PAIR(STRIKE, 1),
-    REGEX_MARKDOWN_PAIR(CODE, 1),
-    REGEX_MARKDOWN_PAIR(BOLD, 2),
-    REGEX_MARKDOWN_PAIR(ITALIC, 2),
-    REGEX_MARKDOWN_PAIR(UNDERLINE, 2),
-    REGEX_MARKDOWN_PAIR(STRIKE, 2),
-    {QRegularExpression(MULTILINE_CODE), htmlPatterns[CODE]}};
-
-static const QVector<QRegularExpression> urlPatterns {
-    QRegularExpression("((\\bhttp[s]?://(www\\.)?)|(\\bwww\\.))"
-                       "[^. \\n]+\\.[^ \\n]+"),
-    QRegularExpression("\\b(ftp|smb)://[^ \\n]+"),
-    QRegularExpression("\\bfile://(localhost)?/[^ \\n]+"),
-    QRegularExpression("\\btox:[a-zA-Z\\d]{76}"),
-    QRegularExpression("\\b(mailto|tox):[^ \\n]+@[^ \\n]+")
+struct Token
+{
+    TokenType type;
+    int start;
+    int length;
+    TextStyle style;
+    /// Change of the tag nesting depth, -1 for closing tags, 1 for opening ones
+    int depth;
+    bool canOpen;
+    bool canClose;
 };
 
-// clang-format on
+bool isAsciiLetterOrNumber(QChar c)
+{
+    return c.unicode() < 128 && c.isLetterOrNumber();
+}
+
+bool isWordChar(QChar c)
+{
+    return isAsciiLetterOrNumber(c) || c == '_';
+}
+
+bool isWhitespace(QChar c)
+{
+    return c == ' ' || c == '\n';
+}
+
 /**
- * @class TextFormatter
+ * @brief Checks if a run of delimiters can format text.
  *
- * @brief This class applies formatting to the text messages, e.g. font styling and URL highlighting
+ * Single and double symbols style text, except for double backticks. Triple backticks start
+ * multiline code blocks.
  */
+bool isValidRun(TextStyle style, int length)
+{
+    return length == 1 || (length == 2 && style != CODE)
+           || (length == CODE_BLOCK_LENGTH && style == CODE);
+}
 
-TextFormatter::TextFormatter(const QString& str)
-    : message(str)
+/**
+ * @brief Splits the message into tokens in a single scan.
+ *
+ * Every scan ahead of the current position is cached, so malformed tags or URLs can't make the
+ * scan quadratic.
+ */
+class Tokenizer
+{
+public:
+    explicit Tokenizer(const QString& str);
+
+    QVector<Token> tokenize();
+
+private:
+    int nextOf(QChar c, int from, int& cache) const;
+    int urlRunEnd(int from);
+    bool hasDomain(int from, int end);
+    int matchTag(int pos);
+    int matchUrl(int pos);
+    bool startsWith(int pos, const char* prefix) const;
+    void addText(int pos);
+
+private:
+    const QString& str;
+    const int size;
+    QVector<Token> tokens;
+    int nextTagEnd;
+    int nextRunEnd;
+    int nextDot;
+    int nextAt;
+};
+
+Tokenizer::Tokenizer(const QString& str)
+    : str{str}
+    , size{str.size()}
+    , nextTagEnd{-1}
+    , nextRunEnd{-1}
+    , nextDot{-1}
+    , nextAt{-1}
 {
 }
 
+QVector<Token> Tokenizer::tokenize()
+{
+    int pos = 0;
+    while (pos < size) {
+        const QChar c = str[pos];
+
+        if (c == '<') {
+            const int length = matchTag(pos);
+            if (length) {
+                const bool closing = str[pos + 1] == '/';
+                int nameEnd = pos + 1;
+                while (nameEnd < size && isAsciiLetterOrNumber(str[nameEnd])) {
+                    ++nameEnd;
+                }
+
+                const QStringRef name = str.midRef(pos + 1, nameEnd - pos - 1);
+                const QChar last = str[pos + length - 2];
+                const bool isVoid = name.compare(QLatin1String("img"), Qt::CaseInsensitive) == 0
+                                    || name.compare(QLatin1String("br"), Qt::CaseInsensitive) == 0
+                                    || name.compare(QLatin1String("hr"), Qt::CaseInsensitive) == 0
+                                    || last == '/' || last == '\\';
+                const int depth = closing ? -1 : isVoid ? 0 : 1;
+                tokens.append({TokenType::Tag, pos, length, BOLD, depth, false, false});
+                pos += length;
+                continue;
+            }
+        }
+
+        if (c == '\n') {
+            tokens.append({TokenType::Newline, pos, 1, BOLD, 0, false, false});
+            ++pos;
+            continue;
+        }
+
+        int style = 0;
+        while (style < STYLE_COUNT && c != MARKDOWN_SYMBOLS[style]) {
+            ++style;
+        }
+
+        if (style < STYLE_COUNT) {
+            int end = pos;
+            while (end < size && str[end] == c) {
+                ++end;
+            }
+
+            const int length = end - pos;
+            if (!isValidRun(static_cast<TextStyle>(style), length)) {
+                for (; pos < end; ++pos) {
+                    addText(pos);
+                }
+
+                continue;
+            }
+
+            Token token{TokenType::Delimiter, pos, length, static_cast<TextStyle>(style), 0,
+                        true, true};
+            if (length != CODE_BLOCK_LENGTH) {
+                // no whitespace inside the delimiters and no delimiters glued to a tag
+                const bool afterTag = pos > 0 && str[pos - 1] == '<';
+                token.canOpen = !afterTag && end < size && !isWhitespace(str[end]);
+                token.canClose = pos > 0 && !afterTag && !isWhitespace(str[pos - 1]);
+            }
+
+            tokens.append(token);
+            pos = end;
+            continue;
+        }
+
+        const int length = matchUrl(pos);
+        if (length) {
+            tokens.append({TokenType::Url, pos, length, BOLD, 0, false, false});
+            pos += length;
+            continue;
+        }
+
+        addText(pos);
+        ++pos;
+    }
+
+    return tokens;
+}
+
 /**
- * @brief Counts equal symbols at the beginning of the string
- * @param str Source string
- * @return Amount of equal symbols at the beginning of the string
+ * @brief Finds the next occurrence of a character, reusing the previous result while it's ahead.
+ * @return Position of the character, or the size of the string if there is none.
  */
-static int patternSignsCount(const QString& str)
+int Tokenizer::nextOf(QChar c, int from, int& cache) const
 {
-    QChar escapeSign = str.at(0);
-    int result = 0;
-    int length = str.length();
-    while (result < length && str[result] == escapeSign) {
-        ++result;
+    if (cache < from) {
+        cache = str.indexOf(c, from);
+        if (cache < 0) {
+            cache = size;
+        }
     }
-    return result;
+
+    return cache;
 }
 
 /**
- * @brief Checks HTML tags intersection while applying styles to the message text
- * @param str Checking string
- * @return True, if tag intersection detected
+ * @brief Finds the end of the URL candidate at the position, URLs end at whitespace or a tag.
  */
-static bool isTagIntersection(const QString& str)
+int Tokenizer::urlRunEnd(int from)
 {
-    const QRegularExpression TAG_PATTERN("(?<=<)/?[a-zA-Z0-9]+(?=>)");
+    if (nextRunEnd < from) {
+        nextRunEnd = from;
+        while (nextRunEnd < size && !isWhitespace(str[nextRunEnd]) && str[nextRunEnd] != '<') {
+            ++nextRunEnd;
+        }
+    }
 
-    int openingTagCount = 0;
-    int closingTagCount = 0;
+    return nextRunEnd;
+}
 
-    QRegularExpressionMatchIterator iter = TAG_PATTERN.globalMatch(str);
-    while (iter.hasNext()) {
-        iter.next().captured()[0] == '/' ? ++closingTagCount : ++openingTagCount;
+/**
+ * @brief Checks for a host name with at least one dot, e.g. after "http://".
+ */
+bool Tokenizer::hasDomain(int from, int end)
+{
+    const int dot = nextOf('.', from, nextDot);
+    return dot > from && dot + 1 < end;
+}
+
+/**
+ * @brief Matches an HTML tag, as inserted by escaping or by the smiley pack.
+ * @return Length of the tag, 0 if there is none at the position.
+ */
+int Tokenizer::matchTag(int pos)
+{
+    if (pos + 1 >= size) {
+        return 0;
     }
-    return openingTagCount != closingTagCount;
+
+    const QChar c = str[pos + 1];
+    if (c != '/' && !(c.unicode() < 128 && c.isLetter())) {
+        return 0;
+    }
+
+    const int end = nextOf('>', pos + 1, nextTagEnd);
+    return end < size ? end + 1 - pos : 0;
 }
 
 /**
- * @brief Applies a function for URL's which can be extracted from passed string
- * @param str String in which we are looking for URL's
- * @param func Function which is applied to URL
+ * @brief Matches a URL starting at a word boundary.
+ * @return Length of the URL, 0 if there is none at the position.
  */
-static void processUrl(QString& str, std::function<QString(QString&)> func)
+int Tokenizer::matchUrl(int pos)
 {
-    int startLength = str.length();
-    int offset = 0;
-    for (QRegularExpression exp : urlPatterns) {
-        QRegularExpressionMatchIterator iter = exp.globalMatch(str);
-        while (iter.hasNext()) {
-            QRegularExpressionMatch match = iter.next();
-            int startPos = match.capturedStart() + offset;
-            int length = match.capturedLength();
-            QString url = str.mid(startPos, length);
-            str.replace(startPos, length, func(url));
-            offset = str.length() - startLength;
+    if (pos > 0 && isWordChar(str[pos - 1])) {
+        return 0;
+    }
+
+    const QChar c = str[pos];
+    if (c != 'h' && c != 'w' && c != 'f' && c != 's' && c != 't' && c != 'm') {
+        return 0;
+    }
+
+    const int end = urlRunEnd(pos);
+    const int length = end - pos;
+
+    if (startsWith(pos, "http://") || startsWith(pos, "https://")) {
+        const int host = pos + (str[pos + 4] == 's' ? 8 : 7);
+        return hasDomain(host, end) ? length : 0;
+    }
+
+    if (startsWith(pos, "www.")) {
+        return hasDomain(pos + 4, end) ? length : 0;
+    }
+
+    if (startsWith(pos, "ftp://") || startsWith(pos, "smb://")) {
+        return length > 6 ? length : 0;
+    }
+
+    if (startsWith(pos, "file://")) {
+        const int path = pos + 7;
+        if (startsWith(path, "localhost/")) {
+            return end > path + 10 ? length : 0;
         }
+
+        return path < end && str[path] == '/' && end > path + 1 ? length : 0;
     }
+
+    int userStart = 0;
+    if (startsWith(pos, "tox:")) {
+        userStart = pos + 4;
+        int idEnd = userStart;
+        while (idEnd < size && idEnd - userStart < TOX_ID_LENGTH
+               && isAsciiLetterOrNumber(str[idEnd])) {
+            ++idEnd;
+        }
+
+        if (idEnd - userStart == TOX_ID_LENGTH) {
+            return idEnd - pos;
+        }
+    } else if (startsWith(pos, "mailto:")) {
+        userStart = pos + 7;
+    } else {
+        return 0;
+    }
+
+    // user@host, neither of them empty
+    const int at = nextOf('@', userStart + 1, nextAt);
+    return at + 1 < end ? length : 0;
+}
+
+bool Tokenizer::startsWith(int pos, const char* prefix) const
+{
+    for (; *prefix; ++prefix, ++pos) {
+        if (pos >= size || str[pos] != QLatin1Char(*prefix)) {
+            return false;
+        }
+    }
+
+    return true;
 }
 
 /**
- * @brief Applies styles to the font of text that was passed to the constructor
- * @param showFormattingSymbols True, if it is supposed to include formatting symbols into resulting
- * string
+ * @brief Adds a character to the text token before it, or starts a new one.
  */
-void TextFormatter::applyHtmlFontStyling(bool showFormattingSymbols)
-{
-    processUrl(message, [](QString& str) {
-        for (char c : MARKDOWN_SYMBOLS) {
-            QString charCode = QString::number(static_cast<int>(c));
-            str.replace(c, HTML_CHARACTER_CODE.arg(charCode));
-        }
-        return str;
-    });
-    for (QPair<QRegularExpression, QString> pair : textPatternStyle) {
-        QRegularExpressionMatchIterator matchesIterator = pair.first.globalMatch(message);
-        int insertedTagSymbolsCount = 0;
-
-        while (matchesIterator.hasNext()) {
-            QRegularExpressionMatch match = matchesIterator.next();
-            if (isTagIntersection(match.captured())) {
-                continue;
+void Tokenizer::addText(int pos)
+{
+    if (!tokens.isEmpty()) {
+        Token& last = tokens.last();
+        if (last.type == TokenType::Text && last.start + last.length == pos) {
+            ++last.length;
+            return;
+        }
+    }
+
+    tokens.append({TokenType::Text, pos, 1, BOLD, 0, false, false});
+}
+
+/**
+ * @brief Pairs delimiter tokens and writes the styled message as HTML.
+ *
+ * A span is closed by the first matching delimiter on the same line, code blocks by the last
+ * triple backtick, and the leftmost opening delimiter wins when spans overlap. Spans must not
+ * cross the HTML tags already in the message.
+ */
+class HtmlWriter
+{
+public:
+    HtmlWriter(const QString& str, const QVector<Token>& tokens, bool showFormattingSymbols);
+
+    QString write();
+
+private:
+    void write(int first, int last, bool inCode);
+    void append(const Token& token);
+    void appendUrl(const Token& token);
+
+private:
+    const QString& str;
+    const QVector<Token>& tokens;
+    const bool showSymbols;
+    QString result;
+    /// Tag nesting depth before each token
+    QVector<int> depth;
+    /// Index of the next newline at or after each token
+    QVector<int> nextNewline;
+    /// Index of the first delimiter after each delimiter which can close its span
+    QVector<int> nextCloser;
+    /// Index of the last code block delimiter before each token, -1 if there is none
+    QVector<int> lastCodeBlock;
+};
+
+HtmlWriter::HtmlWriter(const QString& str, const QVector<Token>& tokens,
+                       bool showFormattingSymbols)
+    : str{str}
+    , tokens{tokens}
+    , showSymbols{showFormattingSymbols}
+{
+    const int count = tokens.size();
+    depth.resize(count + 1);
+    nextNewline.resize(count + 1);
+    nextCloser.resize(count);
+    lastCodeBlock.resize(count + 1);
+
+    int markup = 0;
+    depth[0] = 0;
+    lastCodeBlock[0] = -1;
+    for (int i = 0; i < count; ++i) {
+        const Token& token = tokens[i];
+        depth[i + 1] = depth[i] + token.depth;
+        const bool isCodeBlock =
+            token.type == TokenType::Delimiter && token.length == CODE_BLOCK_LENGTH;
+        lastCodeBlock[i + 1] = isCodeBlock ? i : lastCodeBlock[i];
+        if (token.type == TokenType::Delimiter) {
+            markup += MAX_MARKUP_LENGTH / 2;
+        } else if (token.type == TokenType::Url) {
+            markup += MAX_MARKUP_LENGTH + token.length;
+        }
+    }
+
+    int closers[STYLE_COUNT][CODE_BLOCK_LENGTH];
+    std::fill(&closers[0][0], &closers[0][0] + STYLE_COUNT * CODE_BLOCK_LENGTH, count);
+    nextNewline[count] = count;
+    for (int i = count - 1; i >= 0; --i) {
+        const Token& token = tokens[i];
+        nextNewline[i] = token.type == TokenType::Newline ? i : nextNewline[i + 1];
+        if (token.type == TokenType::Delimiter) {
+            int& closer = closers[token.style][token.length - 1];
+            nextCloser[i] = closer;
+            if (token.canClose) {
+                closer = i;
             }
+        }
+    }
 
-            int capturedStart = match.capturedStart() + insertedTagSymbolsCount;
-            int capturedLength = match.capturedLength();
+    result.reserve(str.size() + markup);
+}
 
-            QString stylingText = message.mid(capturedStart, capturedLength);
-            int choppingSignsCount = showFormattingSymbols ? 0 : patternSignsCount(stylingText);
-            int textStart = capturedStart + choppingSignsCount;
-            int textLength = capturedLength - 2 * choppingSignsCount;
+QString HtmlWriter::write()
+{
+    write(0, tokens.size(), false);
+    return result;
+}
 
-            QString styledText = pair.second.arg(message.mid(textStart, textLength));
+/**
+ * @brief Writes the tokens in [first, last), styling the spans closed inside the range.
+ * @param inCode True inside a code block, those don't nest.
+ */
+void HtmlWriter::write(int first, int last, bool inCode)
+{
+    int i = first;
+    while (i < last) {
+        const Token& token = tokens[i];
+        if (token.type == TokenType::Delimiter && token.canOpen) {
+            const bool isCodeBlock = token.length == CODE_BLOCK_LENGTH;
+            const int closer = isCodeBlock ? lastCodeBlock[last] : nextCloser[i];
+            const bool closed = isCodeBlock ? closer > i && !inCode
+                                            : closer < last && closer < nextNewline[i];
+
+            if (closed && depth[i + 1] == depth[closer]) {
+                result.append(QLatin1String(OPENING_TAGS[token.style]));
+                if (showSymbols) {
+                    append(token);
+                }
+
+                write(i + 1, closer, inCode || isCodeBlock);
+
+                if (showSymbols) {
+                    append(tokens[closer]);
+                }
+
+                result.append(QLatin1String(CLOSING_TAGS[token.style]));
+                i = closer + 1;
+                continue;
+            }
+        }
 
-            message.replace(capturedStart, capturedLength, styledText);
-            // Subtracting length of "%1"
-            insertedTagSymbolsCount += pair.second.length() - 2 - 2 * choppingSignsCount;
+        if (token.type == TokenType::Url) {
+            appendUrl(token);
+        } else {
+            append(token);
         }
+
+        ++i;
     }
-    for (char c : MARKDOWN_SYMBOLS) {
-        QString charCode = QString::number(static_cast<int>(c));
-        message.replace(HTML_CHARACTER_CODE.arg(charCode), QString(c));
+}
+
+void HtmlWriter::append(const Token& token)
+{
+    result.append(str.constData() + token.start, token.length);
+}
+
+void HtmlWriter::appendUrl(const Token& token)
+{
+    result.append(QLatin1String("<a href=\""));
+    if (str[token.start] == 'w') {
+        result.append(QLatin1String("http://"));
     }
+
+    append(token);
+    result.append(QLatin1String("\">"));
+    append(token);
+    result.append(QLatin1String("</a>"));
+}
 }
 
 /**
- * @brief Wraps all found URL's in HTML hyperlink tag
+ * @class TextFormatter
+ *
+ * @brief This class applies formatting to the text messages, e.g. font styling and URL highlighting
+ *
+ * The message is split into text, tags, URLs and markdown delimiters in a single scan, then the
+ * delimiters are paired and the HTML is written into a preallocated string.
  */
-void TextFormatter::wrapUrl()
+
+TextFormatter::TextFormatter(const QString& str)
+    : message(str)
 {
-    processUrl(message, [](QString& str) {
-        return htmlPatterns[TextStyle::HREF].arg(str.startsWith("www") ? "http://" : "", str);
-    });
 }
 
 /**
@@ -230,7 +543,6 @@ void TextFormatter::wrapUrl()
  */
 QString TextFormatter::applyStyling(bool showFormattingSymbols)
 {
-    applyHtmlFontStyling(showFormattingSymbols);
-    wrapUrl();
-    return message;
+    const QVector<Token> tokens = Tokenizer{message}.tokenize();
+    return HtmlWriter{message, tokens, showFormattingSymbols}.write();
 }
@@ -27,10 +27,6 @@ class TextFormatter
 private:
     QString message;
 
-    void wrapUrl();
-
-    void applyHtmlFontStyling(bool showFormattingSymbols);
-
 public:
     explicit TextFormatter(const QString& str);
 
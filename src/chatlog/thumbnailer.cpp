@@ -0,0 +1,339 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "thumbnailer.h"
+#include "src/persistence/settings.h"
+
+#include <libexif/exif-loader.h>
+
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QImageReader>
+#include <QSaveFile>
+#include <QTransform>
+#include <QtConcurrent/QtConcurrentRun>
+
+/**
+ * @class Thumbnailer
+ * @brief Creates thumbnails and previews of image files on a thread pool.
+ *
+ * Photos are several megapixels, decoding them on the GUI thread stalls it and keeping them
+ * around takes a lot of memory. Images are decoded directly at the size they are shown at, where
+ * the format supports it, and rotated according to their EXIF orientation.
+ *
+ * Thumbnails are also written to a cache directory, named after a hash of the file content, so
+ * the images of a chat log only have to be decoded once. Previews are larger and only created
+ * on demand, they aren't cached.
+ *
+ * The callbacks are run on the GUI thread, unless the receiver was deleted in the meantime.
+ *
+ * @var Thumbnailer::cacheDir
+ * @brief Directory the thumbnails are written to.
+ */
+
+namespace {
+/// Threads decoding images, photos take long enough that they shouldn't take all cores
+const int DECODE_THREADS = 2;
+
+enum class ExifOrientation
+{
+    /* do not change values, this is exif spec
+     *
+     * name corresponds to where the 0 row and 0 column is in form row-column
+     * i.e. entry 5 here means that the 0'th row corresponds to the left side of the scene and the
+     * 0'th column corresponds to the top of the captured scene. This means that the image needs to
+     * be mirrored and rotated to be displayed.
+     */
+    TopLeft = 1,
+    TopRight = 2,
+    BottomRight = 3,
+    BottomLeft = 4,
+    LeftTop = 5,
+    RightTop = 6,
+    RightBottom = 7,
+    LeftBottom = 8
+};
+
+int getExifOrientation(const char* data, const int size)
+{
+    ExifData* exifData = exif_data_new_from_data(reinterpret_cast<const unsigned char*>(data), size);
+
+    if (!exifData)
+        return 0;
+
+    int orientation = 0;
+    const ExifByteOrder byteOrder = exif_data_get_byte_order(exifData);
+    const ExifEntry* const exifEntry = exif_data_get_entry(exifData, EXIF_TAG_ORIENTATION);
+    if (exifEntry) {
+        orientation = exif_get_short(exifEntry->data, byteOrder);
+    }
+    exif_data_free(exifData);
+    return orientation;
+}
+
+/**
+ * @brief Checks if an orientation swaps width and height of the stored image.
+ */
+bool isTransposed(const int orientation)
+{
+    return orientation >= static_cast<int>(ExifOrientation::LeftTop)
+           && orientation <= static_cast<int>(ExifOrientation::LeftBottom);
+}
+
+void applyTransformation(const int orientation, QImage& image)
+{
+    QTransform exifTransform;
+    switch (static_cast<ExifOrientation>(orientation)) {
+    case ExifOrientation::TopLeft:
+        break;
+    case ExifOrientation::TopRight:
+        image = image.mirrored(1, 0);
+        break;
+    case ExifOrientation::BottomRight:
+        exifTransform.rotate(180);
+        break;
+    case ExifOrientation::BottomLeft:
+        image = image.mirrored(0, 1);
+        break;
+    case ExifOrientation::LeftTop:
+        exifTransform.rotate(90);
+        image = image.mirrored(0, 1);
+        break;
+    case ExifOrientation::RightTop:
+        exifTransform.rotate(-90);
+        break;
+    case ExifOrientation::RightBottom:
+        exifTransform.rotate(-90);
+        image = image.mirrored(0, 1);
+        break;
+    case ExifOrientation::LeftBottom:
+        exifTransform.rotate(90);
+        break;
+    default:
+        qWarning() << "Invalid exif orientation passed to applyTransformation!";
+    }
+    image = image.transformed(exifTransform);
+}
+
+QByteArray readFile(const QString& filename)
+{
+    QFile file{filename};
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open image" << filename;
+        return QByteArray();
+    }
+
+    return file.readAll();
+}
+
+/**
+ * @brief Runs a callback with the result of a future once it's finished.
+ *
+ * The watcher is owned by the receiver, so the callback isn't run once the receiver is deleted.
+ */
+template <typename T>
+void whenFinished(const QFuture<T>& future, QObject* receiver,
+                  std::function<void(const T&)> onReady)
+{
+    QFutureWatcher<T>* watcher = new QFutureWatcher<T>(receiver);
+    QObject::connect(watcher, &QFutureWatcher<T>::finished, receiver, [watcher, onReady]() {
+        onReady(watcher->result());
+        watcher->deleteLater();
+    });
+    watcher->setFuture(future);
+}
+}
+
+Thumbnailer::Thumbnailer()
+    : cacheDir{QDir{Settings::getInstance().getAppDataDirPath()}.filePath("thumbnails")}
+{
+    pool.setMaxThreadCount(DECODE_THREADS);
+}
+
+/**
+ * @brief Returns the singleton instance.
+ */
+Thumbnailer& Thumbnailer::getInstance()
+{
+    static Thumbnailer instance;
+    return instance;
+}
+
+/**
+ * @brief Creates a square thumbnail of an image in the background.
+ * @param filename Image file.
+ * @param size Width and height of the thumbnail, smaller images aren't scaled up.
+ * @param receiver Lives in the GUI thread and owns the callback.
+ * @param onReady Called with the thumbnail, which is null if the file isn't a readable image.
+ */
+void Thumbnailer::thumbnail(const QString& filename, int size, QObject* receiver,
+                            std::function<void(const QImage&)> onReady)
+{
+    whenFinished(QtConcurrent::run(&pool, &Thumbnailer::createThumbnail, filename, size, cacheDir),
+                 receiver, onReady);
+}
+
+/**
+ * @brief Creates a preview of an image in the background.
+ * @param filename Image file.
+ * @param maxSize Size to fit the preview into, smaller images aren't scaled up.
+ * @param receiver Lives in the GUI thread and owns the callback.
+ * @param onReady Called with the preview as PNG, empty if the file isn't a readable image.
+ */
+void Thumbnailer::preview(const QString& filename, QSize maxSize, QObject* receiver,
+                          std::function<void(const QByteArray&)> onReady)
+{
+    whenFinished(QtConcurrent::run(&pool, &Thumbnailer::createPreview, filename, maxSize),
+                 receiver, onReady);
+}
+
+QString Thumbnailer::getCacheDir() const
+{
+    return cacheDir;
+}
+
+/**
+ * @brief Creates a square thumbnail of an image, or reads it from the cache directory.
+ * @param cacheDir Directory to cache the thumbnail in, empty to not cache it.
+ * @return The thumbnail, null if the file isn't a readable image.
+ */
+QImage Thumbnailer::createThumbnail(const QString& filename, int size, const QString& cacheDir)
+{
+    const QByteArray data = readFile(filename);
+    if (data.isEmpty()) {
+        return QImage();
+    }
+
+    QString cachePath;
+    QImage thumbnail;
+    if (!cacheDir.isEmpty()) {
+        const QByteArray hash = QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex();
+        cachePath = QDir{cacheDir}.filePath(
+            QStringLiteral("%1_%2.png").arg(QString::fromLatin1(hash)).arg(size));
+        if (thumbnail.load(cachePath, "PNG")) {
+            return thumbnail;
+        }
+    }
+
+    const QImage image = loadImage(data, QSize(size, size), Qt::KeepAspectRatioByExpanding);
+    thumbnail = scaleCropIntoSquare(image, size);
+    if (thumbnail.isNull() || cachePath.isEmpty() || !QDir{}.mkpath(cacheDir)) {
+        return thumbnail;
+    }
+
+    // only replaces the file once it's complete, another thread may be writing it as well
+    QSaveFile file{cachePath};
+    if (!file.open(QIODevice::WriteOnly) || !thumbnail.save(&file, "PNG") || !file.commit()) {
+        qWarning() << "Failed to cache thumbnail" << cachePath;
+    }
+
+    return thumbnail;
+}
+
+/**
+ * @brief Creates a preview of an image, scaled to fit into a size.
+ * @return The preview as PNG, empty if the file isn't a readable image.
+ */
+QByteArray Thumbnailer::createPreview(const QString& filename, QSize maxSize)
+{
+    const QImage image = loadImage(readFile(filename), maxSize, Qt::KeepAspectRatio);
+    if (image.isNull()) {
+        return QByteArray();
+    }
+
+    QByteArray png;
+    QBuffer buffer{&png};
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, "PNG");
+    return png;
+}
+
+/**
+ * @brief Decodes an image, scaling it down to the size and applying its EXIF orientation.
+ *
+ * Formats like JPEG can decode at a lower resolution, which is much faster and needs a fraction
+ * of the memory of decoding the full image.
+ *
+ * @param data Content of the image file.
+ * @param size Size to scale to.
+ * @param mode How to scale, with Qt::KeepAspectRatioByExpanding the image covers the size.
+ * @return The decoded image, null if it isn't a readable image.
+ */
+QImage Thumbnailer::loadImage(const QByteArray& data, QSize size, Qt::AspectRatioMode mode)
+{
+    if (data.isEmpty()) {
+        return QImage();
+    }
+
+    const int orientation = getExifOrientation(data.constData(), data.size());
+
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader reader{&buffer};
+
+    const QSize original = reader.size();
+    if (original.isValid() && size.isValid()) {
+        // rotated images are stored with width and height swapped
+        const QSize target = isTransposed(orientation) ? size.transposed() : size;
+        const QSize scaled = original.scaled(target, mode);
+        if (scaled.width() < original.width()) {
+            reader.setScaledSize(scaled);
+        }
+    }
+
+    QImage image = reader.read();
+    if (!image.isNull() && orientation) {
+        applyTransformation(orientation, image);
+    }
+
+    return image;
+}
+
+/**
+ * @brief Scales an image to cover a square and crops the overflow.
+ *
+ * Images smaller than the square in at least one dimension aren't scaled up.
+ */
+QImage Thumbnailer::scaleCropIntoSquare(const QImage& source, const int targetSize)
+{
+    QImage result;
+
+    // Make sure smaller-than-icon images (at least one dimension is smaller) will not be upscaled
+    if (source.width() < targetSize || source.height() < targetSize) {
+        result = source;
+    } else {
+        result = source.scaled(targetSize, targetSize, Qt::KeepAspectRatioByExpanding,
+                               Qt::SmoothTransformation);
+    }
+
+    // Then, image has to be cropped (if needed) so it will not overflow rectangle
+    // Only one dimension will be bigger after Qt::KeepAspectRatioByExpanding
+    if (result.width() > targetSize)
+        return result.copy((result.width() - targetSize) / 2, 0, targetSize, targetSize);
+    else if (result.height() > targetSize)
+        return result.copy(0, (result.height() - targetSize) / 2, targetSize, targetSize);
+
+    // Picture was rectangle in the first place, no cropping
+    return result;
+}
@@ -0,0 +1,59 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef THUMBNAILER_H
+#define THUMBNAILER_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QObject>
+#include <QSize>
+#include <QString>
+#include <QThreadPool>
+
+#include <functional>
+
+class Thumbnailer
+{
+public:
+    static Thumbnailer& getInstance();
+
+    void thumbnail(const QString& filename, int size, QObject* receiver,
+                   std::function<void(const QImage&)> onReady);
+    void preview(const QString& filename, QSize maxSize, QObject* receiver,
+                 std::function<void(const QByteArray&)> onReady);
+
+    QString getCacheDir() const;
+
+    static QImage createThumbnail(const QString& filename, int size, const QString& cacheDir);
+    static QByteArray createPreview(const QString& filename, QSize maxSize);
+    static QImage loadImage(const QByteArray& data, QSize size, Qt::AspectRatioMode mode);
+    static QImage scaleCropIntoSquare(const QImage& source, int targetSize);
+
+private:
+    Thumbnailer();
+    Thumbnailer(Thumbnailer&) = delete;
+    Thumbnailer& operator=(const Thumbnailer&) = delete;
+
+private:
+    QString cacheDir;
+    QThreadPool pool;
+};
+
+#endif // THUMBNAILER_H
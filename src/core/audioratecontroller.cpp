@@ -0,0 +1,318 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "audioratecontroller.h"
+
+#include <cmath>
+#include <cstring>
+
+/**
+ * @class AudioRateController
+ * @brief Adapts the audio bitrate and frame size of a call to the network conditions.
+ *
+ * Jitter and loss are estimated from the arrival times of the audio frames we receive, and the
+ * bitrate toxav recommends is taken as an upper limit. Our own sending path isn't observable
+ * from here, so this assumes the link behaves about the same in both directions; toxav's
+ * recommendation, which is based on the loss our peer reports, covers the rest.
+ *
+ * The statistics are evaluated once per window. When the link is congested the bitrate is cut
+ * multiplicatively, while a stable link gets it back additively, up to the configured maximum.
+ * Longer frames are used on bad links and at low bitrates, where the per packet overhead is a
+ * large part of the bandwidth. Short frames are only restored once the link has been stable for
+ * a while, so the frame size doesn't flap.
+ *
+ * The statistics are only touched from the CoreAV thread, packetize() and dropPending() from the
+ * audio thread. The frame duration is shared between both and atomic.
+ *
+ * @var AudioRateController::DEFAULT_MIN_BITRATE
+ * @brief Lowest bitrate selectable in the settings, in kbit/s.
+ *
+ * @var AudioRateController::recommendedBitrate
+ * @brief Lowest bitrate toxav recommended during the current window, 0 if none.
+ *
+ * @var AudioRateController::silenceMs
+ * @brief Gaps in the current window long enough to be silence rather than loss.
+ *
+ * @var AudioRateController::pending
+ * @brief Captured audio waiting to be sent in a longer frame.
+ */
+
+namespace {
+/// Length of a statistics window in milliseconds
+const qint64 WINDOW_MS = 2000;
+/// Minimum audio received in a window to evaluate it
+const double MIN_WINDOW_AUDIO_MS = 1000.0;
+/// Gaps longer than this are the peer not talking, with voice activation they don't send
+const double SILENCE_GAP_MS = 250.0;
+/// Weight of a new jitter sample, as in RFC 3550
+const double JITTER_GAIN = 1.0 / 16.0;
+
+/// Below this loss and jitter the link is considered stable
+const double LOSS_LOW = 0.01;
+const double JITTER_LOW_MS = 20.0;
+/// Above this loss the link is considered congested
+const double LOSS_HIGH = 0.05;
+/// Loss and jitter above which longer frames are used
+const double LOSS_40MS = 0.03;
+const double JITTER_40MS = 20.0;
+const double LOSS_60MS = 0.10;
+const double JITTER_60MS = 40.0;
+
+/// Multiplicative decrease on congestion
+const double BITRATE_DECREASE = 0.75;
+/// Additive increase per stable window, in kbit/s
+const int BITRATE_INCREASE = 4;
+/// Windows the link has to be stable before the bitrate increases or frames get shorter
+const int STABLE_WINDOWS = 2;
+/// At or below this bitrate, packet overhead outweighs the latency of 20ms frames
+const int LOW_BITRATE = 16;
+
+const int SHORT_FRAME_MS = 20;
+const int MEDIUM_FRAME_MS = 40;
+const int LONG_FRAME_MS = 60;
+}
+
+AudioRateController::AudioRateController(int minBitrate, int maxBitrate)
+    : minBitrate{minBitrate}
+    , maxBitrate{qMax(minBitrate, maxBitrate)}
+    , bitrate{this->maxBitrate}
+    , frameDuration{SHORT_FRAME_MS}
+    , jitterMs{0}
+    , lossPercent{0}
+    , recommendedBitrate{0}
+    , stableWindows{0}
+    , lastArrival{-1}
+    , lastDuration{0.0}
+    , jitter{0.0}
+    , pendingChannels{0}
+    , pendingRate{0}
+    , pendingSent{false}
+{
+    resetWindow(-1);
+}
+
+/**
+ * @brief Changes the bitrate bounds in kbit/s, the current bitrate is clamped to them.
+ */
+void AudioRateController::setBounds(int minBitrate, int maxBitrate)
+{
+    this->minBitrate = minBitrate;
+    this->maxBitrate = qMax(minBitrate, maxBitrate);
+    bitrate = qBound(this->minBitrate, bitrate, this->maxBitrate);
+}
+
+/**
+ * @brief Records the arrival of an audio frame from the peer.
+ *
+ * @param arrival Arrival time in milliseconds, from a monotonic clock.
+ * @param samples Number of samples per channel in the frame.
+ * @param rate Sample rate of the frame.
+ */
+void AudioRateController::frameReceived(qint64 arrival, size_t samples, uint32_t rate)
+{
+    if (!samples || !rate) {
+        return;
+    }
+
+    const double duration = samples * 1000.0 / rate;
+
+    if (lastArrival < 0) {
+        resetWindow(arrival);
+    } else {
+        // how much later this frame came than the end of the previous one
+        const double gap = arrival - lastArrival - lastDuration;
+        if (gap > SILENCE_GAP_MS) {
+            silenceMs += gap;
+        } else {
+            jitter += (std::abs(gap) - jitter) * JITTER_GAIN;
+        }
+    }
+
+    receivedMs += duration;
+    lastArrival = arrival;
+    lastDuration = duration;
+}
+
+/**
+ * @brief Records a bitrate recommended by toxav, in kbit/s.
+ */
+void AudioRateController::bitrateRecommended(int recommended)
+{
+    if (recommended <= 0) {
+        return;
+    }
+
+    if (!recommendedBitrate || recommended < recommendedBitrate) {
+        recommendedBitrate = recommended;
+    }
+}
+
+/**
+ * @brief Adapts bitrate and frame size once a statistics window is complete.
+ *
+ * @param now Current time in milliseconds, from the same clock as the arrival times.
+ * @return True if the bitrate or the frame duration changed.
+ */
+bool AudioRateController::update(qint64 now)
+{
+    if (windowStart < 0 || now - windowStart < WINDOW_MS || receivedMs < MIN_WINDOW_AUDIO_MS) {
+        return false;
+    }
+
+    const double span = lastArrival + lastDuration - windowStart - silenceMs;
+    const double loss = span > 0.0 ? qMax(0.0, 1.0 - receivedMs / span) : 0.0;
+    lossPercent = qRound(loss * 100);
+    jitterMs = qRound(jitter);
+
+    const int oldBitrate = bitrate;
+    const int oldDuration = frameDuration;
+
+    int target = bitrate;
+    const bool congested =
+        loss > LOSS_HIGH || (recommendedBitrate && recommendedBitrate < bitrate);
+    if (congested) {
+        stableWindows = 0;
+        target = qRound(target * BITRATE_DECREASE);
+        if (recommendedBitrate) {
+            target = qMin(target, recommendedBitrate);
+        }
+    } else if (loss < LOSS_LOW && jitter < JITTER_LOW_MS) {
+        if (++stableWindows >= STABLE_WINDOWS) {
+            target += BITRATE_INCREASE;
+        }
+    } else {
+        stableWindows = 0;
+    }
+
+    bitrate = qBound(minBitrate, target, maxBitrate);
+
+    int duration = SHORT_FRAME_MS;
+    if (loss > LOSS_60MS || jitter > JITTER_60MS) {
+        duration = LONG_FRAME_MS;
+    } else if (loss > LOSS_40MS || jitter > JITTER_40MS) {
+        duration = MEDIUM_FRAME_MS;
+    }
+
+    if (bitrate <= LOW_BITRATE) {
+        duration = qMax(duration, MEDIUM_FRAME_MS);
+    }
+
+    if (duration < oldDuration && stableWindows < STABLE_WINDOWS) {
+        duration = oldDuration;
+    }
+
+    frameDuration = duration;
+    resetWindow(static_cast<qint64>(std::ceil(lastArrival + lastDuration)));
+
+    return bitrate != oldBitrate || duration != oldDuration;
+}
+
+/**
+ * @brief Bitrate to send with, in kbit/s.
+ */
+int AudioRateController::getBitrate() const
+{
+    return bitrate;
+}
+
+/**
+ * @brief Duration of the frames to send, in milliseconds.
+ */
+int AudioRateController::getFrameDuration() const
+{
+    return frameDuration;
+}
+
+/**
+ * @brief Estimated jitter of the last window, in milliseconds.
+ */
+int AudioRateController::getJitter() const
+{
+    return jitterMs;
+}
+
+/**
+ * @brief Estimated loss of the last window, in percent.
+ */
+int AudioRateController::getLoss() const
+{
+    return lossPercent;
+}
+
+/**
+ * @brief Collects captured audio into frames of the current frame duration.
+ *
+ * @param pcm Captured audio, usually 20ms.
+ * @param samples Number of samples per channel.
+ * @param channels Number of channels.
+ * @param rate Sample rate.
+ * @param outSamples Set to the number of samples per channel to send.
+ * @return The frame to send, valid until the next call, or nullptr while more audio is needed.
+ */
+const int16_t* AudioRateController::packetize(const int16_t* pcm, size_t samples,
+                                              uint8_t channels, uint32_t rate, size_t& outSamples)
+{
+    const size_t target = rate * static_cast<size_t>(frameDuration.load()) / 1000;
+
+    if (pendingSent || channels != pendingChannels || rate != pendingRate) {
+        pending.resize(0);
+        pendingChannels = channels;
+        pendingRate = rate;
+        pendingSent = false;
+    }
+
+    if (pending.isEmpty() && samples >= target) {
+        outSamples = samples;
+        return pcm;
+    }
+
+    const int oldSize = pending.size();
+    const int count = static_cast<int>(samples * channels);
+    pending.resize(oldSize + count);
+    memcpy(pending.data() + oldSize, pcm, count * sizeof(int16_t));
+
+    if (static_cast<size_t>(pending.size()) < target * channels) {
+        outSamples = 0;
+        return nullptr;
+    }
+
+    pendingSent = true;
+    outSamples = static_cast<size_t>(pending.size()) / channels;
+    return pending.constData();
+}
+
+/**
+ * @brief Discards audio collected for the next frame, e.g. when the microphone gets muted.
+ */
+void AudioRateController::dropPending()
+{
+    pending.resize(0);
+    pendingSent = false;
+}
+
+/**
+ * @brief Starts a new statistics window, keeping the jitter estimate.
+ */
+void AudioRateController::resetWindow(qint64 start)
+{
+    windowStart = start;
+    receivedMs = 0.0;
+    silenceMs = 0.0;
+    recommendedBitrate = 0;
+}
@@ -0,0 +1,79 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AUDIORATECONTROLLER_H
+#define AUDIORATECONTROLLER_H
+
+#include <QVector>
+#include <QtGlobal>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+class AudioRateController
+{
+public:
+    AudioRateController(int minBitrate, int maxBitrate);
+
+    void setBounds(int minBitrate, int maxBitrate);
+
+    void frameReceived(qint64 arrival, size_t samples, uint32_t rate);
+    void bitrateRecommended(int recommended);
+    bool update(qint64 now);
+
+    int getBitrate() const;
+    int getFrameDuration() const;
+    int getJitter() const;
+    int getLoss() const;
+
+    const int16_t* packetize(const int16_t* pcm, size_t samples, uint8_t channels, uint32_t rate,
+                             size_t& outSamples);
+    void dropPending();
+
+public:
+    static constexpr int DEFAULT_MIN_BITRATE = 8;
+
+private:
+    void resetWindow(qint64 start);
+
+private:
+    int minBitrate;
+    int maxBitrate;
+    int bitrate;
+    std::atomic<int> frameDuration;
+    int jitterMs;
+    int lossPercent;
+    int recommendedBitrate;
+    int stableWindows;
+
+    qint64 windowStart;
+    qint64 lastArrival;
+    double lastDuration;
+    double receivedMs;
+    double silenceMs;
+    double jitter;
+
+    QVector<int16_t> pending;
+    uint8_t pendingChannels;
+    uint32_t pendingRate;
+    bool pendingSent;
+};
+
+#endif // AUDIORATECONTROLLER_H
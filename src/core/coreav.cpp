@@ -26,6 +26,8 @@
 #include "src/persistence/settings.h"
 #include "src/video/corevideosource.h"
 #include "src/video/videoframe.h"
+#include "src/video/videoframehandoff.h"
+#include "src/video/videolatency.h"
 #include <QCoreApplication>
 #include <QDebug>
 #include <QThread>
@@ -48,8 +50,44 @@
  * @brief Sent when a call was ended by the peer.
  * @param friendId Id of friend in call list.
  *
+ * @fn void CoreAV::audioRateChanged(uint32_t friendId, int bitrate, int frameDuration, int jitter,
+ * int loss)
+ * @brief Sent when the audio of a call was adapted to the network conditions.
+ * @param friendId Id of friend in call list.
+ * @param bitrate Audio bitrate we send with, in kbit/s.
+ * @param frameDuration Duration of the audio frames we send, in milliseconds.
+ * @param jitter Estimated jitter in milliseconds.
+ * @param loss Estimated loss in percent.
+ *
+ * @fn void CoreAV::videoQualityChanged(uint32_t friendId, int step, QSize size, int frameRate)
+ * @brief Sent when the video we send was adapted to the CPU load or the bitrate.
+ * @param friendId Id of friend in call list.
+ * @param step Quality step, 0 is the best, see VideoQualityController.
+ * @param size Resolution we send.
+ * @param frameRate Frames per second we send.
+ *
+ * @fn void CoreAV::videoLatencyChanged(uint32_t friendId, int interval, double median, double p95)
+ * @brief Sent periodically while we send video, with the latency of one stage of the pipeline.
+ * @param friendId Id of friend in call list.
+ * @param interval Stage that was measured, a VideoLatency::Interval.
+ * @param median Median latency of the stage since the call started, in milliseconds.
+ * @param p95 95th percentile latency of the stage, in milliseconds.
+ *
+ * @var CoreAV::audioClock
+ * @brief Monotonic clock for the arrival times of audio frames.
+ *
  * @var CoreAV::VIDEO_DEFAULT_BITRATE
  * @brief Picked at random by fair dice roll.
+ *
+ * @var CoreAV::encoderPool
+ * @brief Threads encoding the video of our calls, kept apart from the global pool so the chat
+ * log can't hold up the encoder.
+ *
+ * @var CoreAV::ENCODER_THREADS
+ * @brief At most one encode runs per call, two threads cover a call and a late one.
+ *
+ * @var CoreAV::VIDEO_LATENCY_REPORT_INTERVAL
+ * @brief Milliseconds between the latency reports of a video call, to the UI and the log.
  */
 
 /**
@@ -91,6 +129,9 @@ CoreAV::CoreAV(Tox* tox)
 
     iterateTimer->setSingleShot(true);
     connect(iterateTimer.get(), &QTimer::timeout, this, &CoreAV::process);
+    // Queued to our thread, where the rate controllers of the calls are updated
+    connect(&Settings::getInstance(), &Settings::audioBitrateChanged, this,
+            &CoreAV::updateAudioBitrate);
 
     toxav = toxav_new(tox, nullptr);
 
@@ -100,6 +141,8 @@ CoreAV::CoreAV(Tox* tox)
     toxav_callback_audio_receive_frame(toxav, CoreAV::audioFrameCallback, this);
     toxav_callback_video_receive_frame(toxav, CoreAV::videoFrameCallback, this);
 
+    encoderPool.setMaxThreadCount(ENCODER_THREADS);
+    audioClock.start();
     coreavThread->start();
 }
 
@@ -109,6 +152,7 @@ CoreAV::~CoreAV()
         cancelCall(call.first);
     }
     killTimerFromThread();
+    encoderPool.waitForDone();
     toxav_kill(toxav);
     coreavThread->exit(0);
     while (coreavThread->isRunning()) {
@@ -344,16 +388,31 @@ bool CoreAV::sendCallAudio(uint32_t callId, const int16_t* pcm, size_t samples,
 
     ToxFriendCall& call = calls[callId];
 
+    AudioRateController* rateController = call.getRateController();
     if (call.getMuteMic() || !call.isActive()
         || !(call.getState() & TOXAV_FRIEND_CALL_STATE_ACCEPTING_A)) {
+        if (rateController) {
+            rateController->dropPending();
+        }
+
         return true;
     }
 
+    // collect captured frames until there's enough audio for the adapted frame size
+    const int16_t* frame = pcm;
+    size_t frameSamples = samples;
+    if (rateController) {
+        frame = rateController->packetize(pcm, samples, chans, rate, frameSamples);
+        if (!frame) {
+            return true;
+        }
+    }
+
     // TOXAV_ERR_SEND_FRAME_SYNC means toxav failed to lock, retry 5 times in this case
     TOXAV_ERR_SEND_FRAME err;
     int retries = 0;
     do {
-        if (!toxav_audio_send_frame(toxav, callId, pcm, samples, chans, rate, &err)) {
+        if (!toxav_audio_send_frame(toxav, callId, frame, frameSamples, chans, rate, &err)) {
             if (err == TOXAV_ERR_SEND_FRAME_SYNC) {
                 ++retries;
                 QThread::usleep(500);
@@ -369,50 +428,124 @@ bool CoreAV::sendCallAudio(uint32_t callId, const int16_t* pcm, size_t samples,
     return true;
 }
 
-void CoreAV::sendCallVideo(uint32_t callId, std::shared_ptr<VideoFrame> vframe)
+/**
+ * @brief Returns the pool video frames of calls are encoded on.
+ */
+QThreadPool* CoreAV::getEncoderPool()
 {
-    // We might be running in the FFmpeg thread and holding the CameraSource lock
+    return &encoderPool;
+}
+
+/**
+ * @brief Encodes a camera frame and sends it to a friend.
+ * @param callId Id of the call, the friend number.
+ * @param state The call's send state, held by the worker since the call may end meanwhile.
+ * @param vframe Frame to send.
+ */
+void CoreAV::sendCallVideo(uint32_t callId, ToxFriendCall::VideoSendState& state,
+                           std::shared_ptr<VideoFrame> vframe)
+{
+    // We're running on a worker fed by the call's VideoFrameHandoff, one frame at a time
     // So be careful not to deadlock with anything while toxav locks in toxav_video_send_frame
-    if (calls.find(callId) == calls.end()) {
+    // The calls map belongs to the CoreAV thread, only the send state is safe to touch here
+    if (state.ended || !state.active
+        || !(state.peerState & TOXAV_FRIEND_CALL_STATE_ACCEPTING_V)) {
         return;
     }
 
-    ToxFriendCall& call = calls[callId];
+    if (state.nullBitrate.exchange(false)) {
+        qDebug() << "Restarting video stream to friend" << callId;
+        toxav_bit_rate_set(toxav, callId, -1, VIDEO_DEFAULT_BITRATE, nullptr);
+    }
 
-    if (!call.getVideoEnabled() || !call.isActive()
-        || !(call.getState() & TOXAV_FRIEND_CALL_STATE_ACCEPTING_V)) {
+    // At lower quality steps only every n-th frame is sent, and frames are scaled down
+    VideoQualityController* quality = state.quality.get();
+    if (quality && !quality->acceptFrame()) {
         return;
     }
 
-    if (call.getNullVideoBitrate()) {
-        qDebug() << "Restarting video stream to friend" << callId;
-        toxav_bit_rate_set(toxav, callId, -1, VIDEO_DEFAULT_BITRATE, nullptr);
-        call.setNullVideoBitrate(false);
+    const QSize sourceSize = vframe->getSourceDimensions().size();
+    const qint64 startTime = VideoFrame::monotonicTime();
+    QSize frameSize = quality ? quality->getFrameSize(sourceSize) : QSize{};
+    if (!frameSize.isValid()) {
+        frameSize = sourceSize;
     }
 
-    ToxYUVFrame frame = vframe->toToxYUVFrame();
+    // The frame's planes are only valid while it's read, so toxav encodes them from the reader,
+    // a camera closing meanwhile waits for it instead of freeing them
+    qint64 convertTime = 0;
+    TOXAV_ERR_SEND_FRAME err = TOXAV_ERR_SEND_FRAME_OK;
+    const bool read = vframe->readAVFrame(frameSize, AV_PIX_FMT_YUV420P, true,
+                                          [&](const AVFrame* frame) {
+        // The same camera frame goes to every call, so time this call's stages locally
+        convertTime = VideoFrame::monotonicTime();
+        vframe->markStage(VideoFrame::Stage::Convert);
+
+        // TOXAV_ERR_SEND_FRAME_SYNC means toxav failed to lock, retry 5 times in this case
+        // We don't want to be dropping iframes because of some lock held by toxav_iterate
+        int retries = 0;
+        do {
+            if (!toxav_video_send_frame(toxav, callId, frameSize.width(), frameSize.height(),
+                                        frame->data[0], frame->data[1], frame->data[2], &err)) {
+                if (err == TOXAV_ERR_SEND_FRAME_SYNC) {
+                    ++retries;
+                    QThread::usleep(500);
+                } else {
+                    qDebug() << "toxav_video_send_frame error: " << err;
+                }
+            }
+        } while (err == TOXAV_ERR_SEND_FRAME_SYNC && retries < 5);
+        if (err == TOXAV_ERR_SEND_FRAME_SYNC) {
+            qDebug() << "toxav_video_send_frame error: Lock busy, dropping frame";
+        }
+    });
 
-    if (!frame) {
+    if (!read || err != TOXAV_ERR_SEND_FRAME_OK) {
         return;
     }
 
-    // TOXAV_ERR_SEND_FRAME_SYNC means toxav failed to lock, retry 5 times in this case
-    // We don't want to be dropping iframes because of some lock held by toxav_iterate
-    TOXAV_ERR_SEND_FRAME err;
-    int retries = 0;
-    do {
-        if (!toxav_video_send_frame(toxav, callId, frame.width, frame.height, frame.y, frame.u,
-                                    frame.v, &err)) {
-            if (err == TOXAV_ERR_SEND_FRAME_SYNC) {
-                ++retries;
-                QThread::usleep(500);
-            } else {
-                qDebug() << "toxav_video_send_frame error: " << err;
+    const qint64 sendTime = VideoFrame::monotonicTime();
+    vframe->markStage(VideoFrame::Stage::Send);
+
+    const std::shared_ptr<VideoLatency>& latency = state.latency;
+    if (latency) {
+        latency->record(VideoLatency::Convert,
+                        vframe->getStageTime(VideoFrame::Stage::Capture), convertTime);
+        latency->record(VideoLatency::Encode, convertTime, sendTime);
+
+        qint64 reported = state.latencyReported;
+        if ((sendTime - reported) / 1000000 >= VIDEO_LATENCY_REPORT_INTERVAL
+            && state.latencyReported.compare_exchange_strong(reported, sendTime)) {
+            qDebug() << "Video latency of call" << callId << ":" << latency->getSummary();
+            for (int i = 0; i < VideoLatency::INTERVAL_COUNT; ++i) {
+                const VideoLatency::Histogram& histogram =
+                    latency->get(static_cast<VideoLatency::Interval>(i));
+                if (histogram.getCount()) {
+                    emit videoLatencyChanged(callId, i, histogram.getPercentile(0.5),
+                                             histogram.getPercentile(0.95));
+                }
             }
         }
-    } while (err == TOXAV_ERR_SEND_FRAME_SYNC && retries < 5);
-    if (err == TOXAV_ERR_SEND_FRAME_SYNC) {
-        qDebug() << "toxav_video_send_frame error: Lock busy, dropping frame";
+    }
+
+    if (quality) {
+        quality->frameEncoded(sendTime - startTime);
+        const std::shared_ptr<VideoFrameHandoff>& handoff = state.handoff;
+        if (handoff) {
+            quality->framesDropped(handoff->getDropped());
+        }
+
+        if (quality->update(sendTime, sourceSize)) {
+            QSize size = quality->getFrameSize(sourceSize);
+            if (!size.isValid()) {
+                size = sourceSize;
+            }
+
+            qDebug() << "Video of call" << callId << "adapted to step" << quality->getStep()
+                     << "," << size << "at" << quality->getFrameRate() << "fps, load"
+                     << quality->getLoad() << "%";
+            emit videoQualityChanged(callId, quality->getStep(), size, quality->getFrameRate());
+        }
     }
 }
 
@@ -812,8 +945,63 @@ void CoreAV::bitrateCallback(ToxAV* toxav, uint32_t friendNum, uint32_t arate, u
                                                Q_ARG(void*, vSelf));
     }
 
-    qDebug() << "Recommended bitrate with" << friendNum << " is now " << arate << "/" << vrate
-             << ", ignoring it";
+    qDebug() << "Recommended bitrate with" << friendNum << " is now " << arate << "/" << vrate;
+
+    // toxav adapts the video bitrate itself, we only pick a resolution the bitrate can carry
+    auto it = self->calls.find(friendNum);
+    if (it != self->calls.end() && it->second.getRateController()) {
+        it->second.getRateController()->bitrateRecommended(static_cast<int>(arate));
+    }
+
+    if (it != self->calls.end() && it->second.getQualityController()) {
+        it->second.getQualityController()->bitrateRecommended(static_cast<int>(vrate));
+    }
+}
+
+/**
+ * @brief Applies the audio bitrate chosen by the call's rate controller.
+ * @param friendNum Id of friend in call list.
+ */
+void CoreAV::applyAudioRate(uint32_t friendNum)
+{
+    auto it = calls.find(friendNum);
+    if (it == calls.end() || !it->second.getRateController()) {
+        return;
+    }
+
+    const AudioRateController* rateController = it->second.getRateController();
+    const int bitrate = rateController->getBitrate();
+    TOXAV_ERR_BIT_RATE_SET err;
+    if (!toxav_bit_rate_set(toxav, friendNum, bitrate, -1, &err)) {
+        qWarning() << "Failed to set audio bitrate of call" << friendNum << "with error" << err;
+        return;
+    }
+
+    qDebug() << "Audio of call" << friendNum << "adapted to" << bitrate << "kbps,"
+             << rateController->getFrameDuration() << "ms frames";
+    emit audioRateChanged(friendNum, bitrate, rateController->getFrameDuration(),
+                          rateController->getJitter(), rateController->getLoss());
+}
+
+/**
+ * @brief Adapts the calls in progress to the audio bitrate the user picked.
+ * @param bitrate Highest audio bitrate to send with, in kbit/s.
+ */
+void CoreAV::updateAudioBitrate(int bitrate)
+{
+    for (auto& call : calls) {
+        AudioRateController* rateController = call.second.getRateController();
+        if (!rateController) {
+            continue;
+        }
+
+        rateController->setBounds(AudioRateController::DEFAULT_MIN_BITRATE, bitrate);
+
+        // calls that didn't start yet are set up with the new bitrate
+        if (call.second.isActive()) {
+            applyAudioRate(call.first);
+        }
+    }
 }
 
 void CoreAV::audioFrameCallback(ToxAV*, uint32_t friendNum, const int16_t* pcm, size_t sampleCount,
@@ -826,6 +1014,17 @@ void CoreAV::audioFrameCallback(ToxAV*, uint32_t friendNum, const int16_t* pcm,
 
     ToxFriendCall& call = self->calls[friendNum];
 
+    AudioRateController* rateController = call.getRateController();
+    if (rateController) {
+        const qint64 now = self->audioClock.elapsed();
+        rateController->frameReceived(now, sampleCount, samplingRate);
+        if (rateController->update(now)) {
+            // we're inside toxav_iterate, set the bitrate once it returned
+            QMetaObject::invokeMethod(self, "applyAudioRate", Qt::QueuedConnection,
+                                      Q_ARG(uint32_t, friendNum));
+        }
+    }
+
     if (call.getMuteVol()) {
         return;
     }
@@ -22,7 +22,10 @@
 #define COREAV_H
 
 #include "src/core/toxcall.h"
+#include <QElapsedTimer>
 #include <QObject>
+#include <QSize>
+#include <QThreadPool>
 #include <atomic>
 #include <memory>
 #include <tox/toxav.h>
@@ -56,7 +59,9 @@ public:
     bool isCallVideoEnabled(const Friend* f) const;
     bool sendCallAudio(uint32_t friendNum, const int16_t* pcm, size_t samples, uint8_t chans,
                        uint32_t rate);
-    void sendCallVideo(uint32_t friendNum, std::shared_ptr<VideoFrame> frame);
+    void sendCallVideo(uint32_t friendNum, ToxFriendCall::VideoSendState& state,
+                       std::shared_ptr<VideoFrame> frame);
+    QThreadPool* getEncoderPool();
     bool sendGroupCallAudio(int groupNum, const int16_t* pcm, size_t samples, uint8_t chans,
                             uint32_t rate);
 
@@ -93,6 +98,9 @@ signals:
     void avInvite(uint32_t friendId, bool video);
     void avStart(uint32_t friendId, bool video);
     void avEnd(uint32_t friendId, bool error = false);
+    void audioRateChanged(uint32_t friendId, int bitrate, int frameDuration, int jitter, int loss);
+    void videoQualityChanged(uint32_t friendId, int step, QSize size, int frameRate);
+    void videoLatencyChanged(uint32_t friendId, int interval, double median, double p95);
 
 private slots:
     static void callCallback(ToxAV* toxAV, uint32_t friendNum, bool audio, bool video, void* self);
@@ -100,6 +108,8 @@ private slots:
     static void bitrateCallback(ToxAV* toxAV, uint32_t friendNum, uint32_t arate, uint32_t vrate,
                                 void* self);
     void killTimerFromThread();
+    void applyAudioRate(uint32_t friendNum);
+    void updateAudioBitrate(int bitrate);
 
 private:
     void process();
@@ -112,6 +122,8 @@ private:
 
 private:
     static constexpr uint32_t VIDEO_DEFAULT_BITRATE = 2500;
+    static constexpr int ENCODER_THREADS = 2;
+    static constexpr qint64 VIDEO_LATENCY_REPORT_INTERVAL = 5000;
 
 private:
     ToxAV* toxav;
@@ -120,6 +132,8 @@ private:
     static std::map<uint32_t, ToxFriendCall> calls;
     static std::map<int, ToxGroupCall> groupCalls;
     std::atomic_flag threadSwitchLock;
+    QElapsedTimer audioClock;
+    QThreadPool encoderPool;
 
     friend class Audio;
 };
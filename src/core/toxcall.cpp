@@ -4,6 +4,8 @@
 #include "src/persistence/settings.h"
 #include "src/video/camerasource.h"
 #include "src/video/corevideosource.h"
+#include "src/video/videoframehandoff.h"
+#include "src/video/videolatency.h"
 #include <QTimer>
 #include <QtConcurrent/QtConcurrent>
 
@@ -18,12 +20,37 @@
  * @var bool ToxFriendCall::videoEnabled
  * @brief True if our user asked for a video call, sending and recieving.
  *
- * @var bool ToxFriendCall::nullVideoBitrate
- * @brief True if our video bitrate is zero, i.e. if the device is closed.
- *
  * @var TOXAV_FRIEND_CALL_STATE ToxFriendCall::state
  * @brief State of the peer (not ours!)
  *
+ * @var ToxFriendCall::rateController
+ * @brief Adapts our audio bitrate and frame size to the link with the peer.
+ *
+ * @var ToxFriendCall::videoSendState
+ * @brief What the encoder workers of a video call need, they hold it instead of looking the call
+ * up, so the call can end and move while they run.
+ *
+ * @struct ToxFriendCall::VideoSendState
+ * @brief Shared by a video call and its encoder workers, the flags mirror the call's own.
+ *
+ * @var ToxFriendCall::VideoSendState::ended
+ * @brief Set when the call is destroyed, pending encodes return without sending.
+ *
+ * @var ToxFriendCall::VideoSendState::nullBitrate
+ * @brief True if our video bitrate is zero, i.e. if the device is closed.
+ *
+ * @var ToxFriendCall::VideoSendState::handoff
+ * @brief Passes camera frames to the encoder, skipping those it's too slow for.
+ *
+ * @var ToxFriendCall::VideoSendState::latency
+ * @brief Time our frames take to be converted and encoded, and received frames to be painted.
+ *
+ * @var ToxFriendCall::VideoSendState::latencyReported
+ * @brief When the latency was last reported, monotonic time in nanoseconds.
+ *
+ * @var ToxFriendCall::VideoSendState::quality
+ * @brief Adapts the resolution and frame rate of our video to the CPU and the link.
+ *
  * @var QMap ToxGroupCall::peers
  * @brief Keeps sources for users in group calls.
  */
@@ -111,6 +138,17 @@ void ToxCall::setMuteMic(bool value)
     muteMic = value;
 }
 
+/**
+ * @brief Sets whether we participate in the call, also for its encoder workers.
+ */
+void ToxFriendCall::setActive(bool value)
+{
+    ToxCall::setActive(value);
+    if (videoSendState) {
+        videoSendState->active = value;
+    }
+}
+
 void ToxFriendCall::startTimeout(uint32_t callId)
 {
     if (!timeoutTimer) {
@@ -147,12 +185,14 @@ void ToxFriendCall::setVideoEnabled(bool value)
 
 bool ToxFriendCall::getNullVideoBitrate() const
 {
-    return nullVideoBitrate;
+    return videoSendState && videoSendState->nullBitrate;
 }
 
 void ToxFriendCall::setNullVideoBitrate(bool value)
 {
-    nullVideoBitrate = value;
+    if (videoSendState) {
+        videoSendState->nullBitrate = value;
+    }
 }
 
 CoreVideoSource* ToxFriendCall::getVideoSource() const
@@ -168,6 +208,9 @@ TOXAV_FRIEND_CALL_STATE ToxFriendCall::getState() const
 void ToxFriendCall::setState(const TOXAV_FRIEND_CALL_STATE& value)
 {
     state = value;
+    if (videoSendState) {
+        videoSendState->peerState = value;
+    }
 }
 
 quint32 ToxFriendCall::getAlSource() const
@@ -180,12 +223,23 @@ void ToxFriendCall::setAlSource(const quint32& value)
     alSource = value;
 }
 
+AudioRateController* ToxFriendCall::getRateController() const
+{
+    return rateController.get();
+}
+
+VideoQualityController* ToxFriendCall::getQualityController() const
+{
+    return videoSendState ? videoSendState->quality.get() : nullptr;
+}
+
 ToxFriendCall::ToxFriendCall(uint32_t friendId, bool VideoEnabled, CoreAV& av)
     : ToxCall()
     , videoEnabled{VideoEnabled}
-    , nullVideoBitrate{false}
     , videoSource{nullptr}
     , state{static_cast<TOXAV_FRIEND_CALL_STATE>(0)}
+    , rateController{new AudioRateController{AudioRateController::DEFAULT_MIN_BITRATE,
+                                             Settings::getInstance().getAudioBitrate()}}
     , av{&av}
     , timeoutTimer{nullptr}
 {
@@ -203,16 +257,41 @@ ToxFriendCall::ToxFriendCall(uint32_t friendId, bool VideoEnabled, CoreAV& av)
     audio.subscribeOutput(alSource);
 
     if (videoEnabled) {
+        videoSendState = make_shared<VideoSendState>();
+        videoSendState->latency = make_shared<VideoLatency>();
+        videoSendState->quality.reset(new VideoQualityController);
         videoSource = new CoreVideoSource;
+        videoSource->setLatency(videoSendState->latency);
         CameraSource& source = CameraSource::getInstance();
 
         if (source.isNone())
             source.setupDefault();
         source.subscribe();
-        QObject::connect(&source, &VideoSource::frameAvailable,
-                         [friendId, &av](shared_ptr<VideoFrame> frame) {
-                             av.sendCallVideo(friendId, frame);
+
+        // Encode on a worker, so a slow encoder neither holds up the camera nor queues frames.
+        // The handoff owns the connection, a strong capture would keep the handoff alive forever.
+        // The worker gets its own reference to the send state, the call may end while it runs.
+        videoSendState->handoff = make_shared<VideoFrameHandoff>();
+        const weak_ptr<VideoSendState> weakState = videoSendState;
+        QObject::connect(videoSendState->handoff.get(), &VideoFrameHandoff::frameReady,
+                         [friendId, &av, weakState]() {
+                             const shared_ptr<VideoSendState> sendState = weakState.lock();
+                             if (!sendState || sendState->ended) {
+                                 return;
+                             }
+
+                             QtConcurrent::run(av.getEncoderPool(), [friendId, &av, sendState]() {
+                                 while (!sendState->ended) {
+                                     shared_ptr<VideoFrame> frame = sendState->handoff->take();
+                                     if (!frame) {
+                                         break;
+                                     }
+
+                                     av.sendCallVideo(friendId, *sendState, frame);
+                                 }
+                             });
                          });
+        videoInConn = VideoFrameHandoff::connectSource(&source, videoSendState->handoff);
     }
 }
 
@@ -220,14 +299,17 @@ ToxFriendCall::ToxFriendCall(ToxFriendCall&& other) noexcept
     : ToxCall(move(other))
     , alSource{other.alSource}
     , videoEnabled{other.videoEnabled}
-    , nullVideoBitrate{other.nullVideoBitrate}
     , videoSource{other.videoSource}
     , state{other.state}
+    , rateController{move(other.rateController)}
+    , videoSendState{move(other.videoSendState)}
+    , videoInConn{other.videoInConn}
     , av{other.av}
     , timeoutTimer{other.timeoutTimer}
 {
     other.videoEnabled = false;
     other.videoSource = nullptr;
+    other.videoInConn = QMetaObject::Connection();
     other.timeoutTimer = nullptr;
     // TODO: wrong, because "0" could be a valid source id
     other.alSource = 0;
@@ -239,6 +321,24 @@ ToxFriendCall::~ToxFriendCall()
         delete timeoutTimer;
 
     if (videoEnabled) {
+        QObject::disconnect(videoInConn);
+        if (videoSendState) {
+            // Workers still running keep the state alive, this only cancels what they'd send.
+            // Waiting for them here could deadlock on the toxav locks, see below.
+            videoSendState->ended = true;
+
+            const shared_ptr<VideoFrameHandoff>& handoff = videoSendState->handoff;
+            if (handoff && handoff->getDropped()) {
+                qDebug() << "Encoder skipped" << handoff->getDropped() << "of"
+                         << handoff->getDropped() + handoff->getDelivered() << "camera frames";
+            }
+
+            const shared_ptr<VideoLatency>& latency = videoSendState->latency;
+            if (latency && !latency->isEmpty()) {
+                qDebug() << "Video latency:" << latency->getSummary();
+            }
+        }
+
         // This destructor could be running in a toxav callback while holding toxav locks.
         // If the CameraSource thread calls toxav *_send_frame, we might deadlock the toxav and
         // CameraSource locks,
@@ -263,10 +363,17 @@ ToxFriendCall& ToxFriendCall::operator=(ToxFriendCall&& other) noexcept
     videoSource = other.videoSource;
     other.videoSource = nullptr;
     state = other.state;
+    rateController = move(other.rateController);
+    if (videoSendState) {
+        videoSendState->ended = true;
+    }
+    videoSendState = move(other.videoSendState);
+    QObject::disconnect(videoInConn);
+    videoInConn = other.videoInConn;
+    other.videoInConn = QMetaObject::Connection();
     timeoutTimer = other.timeoutTimer;
     other.timeoutTimer = nullptr;
     av = other.av;
-    nullVideoBitrate = other.nullVideoBitrate;
     alSource = other.alSource;
     // TODO: wrong, because "0" could be a valid source id
     other.alSource = 0;
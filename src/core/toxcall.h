@@ -1,10 +1,15 @@
 #ifndef TOXCALL_H
 #define TOXCALL_H
 
+#include "src/core/audioratecontroller.h"
+#include "src/core/videoqualitycontroller.h"
+
 #include <QMap>
 #include <QMetaObject>
 #include <QtGlobal>
+#include <atomic>
 #include <cstdint>
+#include <memory>
 
 #include <tox/toxav.h>
 
@@ -12,6 +17,8 @@ class QTimer;
 class AudioFilterer;
 class CoreVideoSource;
 class CoreAV;
+class VideoFrameHandoff;
+class VideoLatency;
 
 class ToxCall
 {
@@ -47,6 +54,18 @@ protected:
 class ToxFriendCall : public ToxCall
 {
 public:
+    struct VideoSendState
+    {
+        std::atomic<bool> ended{false};
+        std::atomic<bool> active{false};
+        std::atomic<int> peerState{0};
+        std::atomic<bool> nullBitrate{false};
+        std::atomic<qint64> latencyReported{0};
+        std::shared_ptr<VideoFrameHandoff> handoff;
+        std::shared_ptr<VideoLatency> latency;
+        std::unique_ptr<VideoQualityController> quality;
+    };
+
     ToxFriendCall() = default;
     ToxFriendCall(uint32_t friendId, bool VideoEnabled, CoreAV& av);
     ToxFriendCall(ToxFriendCall&& other) noexcept;
@@ -57,6 +76,8 @@ public:
     void startTimeout(uint32_t callId);
     void stopTimeout();
 
+    void setActive(bool value);
+
     bool getVideoEnabled() const;
     void setVideoEnabled(bool value);
 
@@ -71,12 +92,17 @@ public:
     quint32 getAlSource() const;
     void setAlSource(const quint32& value);
 
+    AudioRateController* getRateController() const;
+    VideoQualityController* getQualityController() const;
+
 private:
     quint32 alSource;
     bool videoEnabled;
-    bool nullVideoBitrate;
     CoreVideoSource* videoSource;
     TOXAV_FRIEND_CALL_STATE state;
+    std::unique_ptr<AudioRateController> rateController;
+    std::shared_ptr<VideoSendState> videoSendState;
+    QMetaObject::Connection videoInConn;
 
 protected:
     CoreAV* av;
@@ -0,0 +1,264 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "videoqualitycontroller.h"
+
+/**
+ * @class VideoQualityController
+ * @brief Steps the resolution and frame rate of the video we send down when the machine or the
+ * link can't keep up, and back up when they can.
+ *
+ * Every step trades quality for CPU time, the ladder first shrinks the picture and only then
+ * halves the frame rate, since choppy video is more disturbing than blurry video. The CPU load
+ * is the time spent converting and encoding frames during a window, relative to the length of
+ * the window. Frames the encoder had to skip, see VideoFrameHandoff, mean it's falling behind.
+ *
+ * The bitrate toxav recommends caps the pixel rate, as more pixels than the bitrate can carry
+ * only cost CPU time without looking any better.
+ *
+ * Going down happens one step per window, going up only after the load was low for a while and
+ * is expected to stay so at the next step, so the quality doesn't flap.
+ *
+ * Everything but bitrateRecommended() is called from the thread sending the call's video.
+ *
+ * @var VideoQualityController::cpuStep
+ * @brief Step chosen from the CPU load alone, before the bitrate cap.
+ *
+ * @var VideoQualityController::droppedTotal
+ * @brief Frames the encoder skipped since the call started, as last reported.
+ */
+
+namespace {
+struct Step
+{
+    int num;
+    int den;
+    int frameRateDivisor;
+};
+
+/// Scale of the picture and fraction of the frames sent at each step, best quality first
+const Step STEPS[VideoQualityController::STEP_COUNT] = {
+    {1, 1, 1}, {3, 4, 1}, {1, 2, 1}, {1, 2, 2}, {1, 3, 2}};
+
+/// Length of a statistics window in nanoseconds
+const qint64 WINDOW_NS = 2000000000;
+/// Minimum frames offered in a window to evaluate it
+const quint64 MIN_WINDOW_FRAMES = 10;
+
+/// Above this CPU load we step down
+const double LOAD_HIGH = 0.7;
+/// Load the next step up is expected to stay under before we take it
+const double LOAD_TARGET = 0.5;
+/// Above this fraction of frames skipped by the encoder we step down
+const double DROP_HIGH = 0.1;
+/// Windows without trouble before stepping up
+const int STABLE_WINDOWS = 3;
+/// Bits per pixel VP8 needs for a watchable picture
+const double BITS_PER_PIXEL = 0.05;
+
+int scaled(int value, const Step& s)
+{
+    // YUV420 needs even dimensions
+    return qMax(2, (value * s.num / s.den) & ~1);
+}
+
+double pixelRate(QSize size, double fps, const Step& s)
+{
+    return static_cast<double>(scaled(size.width(), s)) * scaled(size.height(), s) * fps
+           / s.frameRateDivisor;
+}
+}
+
+VideoQualityController::VideoQualityController()
+    : step{0}
+    , cpuStep{0}
+    , stableWindows{0}
+    , frameRate{0}
+    , loadPercent{0}
+    , recommendedBitrate{0}
+    , droppedTotal{0}
+    , frameCounter{0}
+{
+    resetWindow(-1);
+}
+
+/**
+ * @brief Decides whether to send a frame, at lower steps only a part of them are.
+ *
+ * @return True if the frame should be encoded and sent.
+ */
+bool VideoQualityController::acceptFrame()
+{
+    ++offered;
+    return frameCounter++ % STEPS[step].frameRateDivisor == 0;
+}
+
+/**
+ * @brief Records the time it took to convert and encode a frame, in nanoseconds.
+ */
+void VideoQualityController::frameEncoded(qint64 ns)
+{
+    encodeTime += ns;
+}
+
+/**
+ * @brief Records the total number of frames the encoder skipped since the call started.
+ */
+void VideoQualityController::framesDropped(quint64 total)
+{
+    if (total > droppedTotal) {
+        dropped += total - droppedTotal;
+    }
+
+    droppedTotal = total;
+}
+
+/**
+ * @brief Records a video bitrate recommended by toxav, in kbit/s.
+ */
+void VideoQualityController::bitrateRecommended(int recommended)
+{
+    if (recommended > 0) {
+        recommendedBitrate = recommended;
+    }
+}
+
+/**
+ * @brief Picks the step once a statistics window is complete.
+ *
+ * @param now Current time in nanoseconds, from VideoFrame::monotonicTime().
+ * @param sourceSize Size of the frames we get from the camera.
+ * @return True if the step changed.
+ */
+bool VideoQualityController::update(qint64 now, QSize sourceSize)
+{
+    if (windowStart < 0) {
+        resetWindow(now);
+        return false;
+    }
+
+    const qint64 elapsed = now - windowStart;
+    if (elapsed < WINDOW_NS || offered < MIN_WINDOW_FRAMES) {
+        return false;
+    }
+
+    const double seconds = elapsed / 1e9;
+    const double sourceFps = (offered + dropped) / seconds;
+    const double load = static_cast<double>(encodeTime) / elapsed;
+    const double dropRatio = static_cast<double>(dropped) / (offered + dropped);
+    loadPercent = qRound(load * 100);
+
+    if (load > LOAD_HIGH || dropRatio > DROP_HIGH) {
+        stableWindows = 0;
+        cpuStep = qMin(cpuStep + 1, STEP_COUNT - 1);
+    } else if (cpuStep > 0 && ++stableWindows >= STABLE_WINDOWS) {
+        // encoding time grows about with the pixel rate
+        const double current = pixelRate(sourceSize, sourceFps, STEPS[cpuStep]);
+        const double next = pixelRate(sourceSize, sourceFps, STEPS[cpuStep - 1]);
+        if (current > 0 && load * next / current < LOAD_TARGET) {
+            --cpuStep;
+            stableWindows = 0;
+        }
+    }
+
+    const int oldStep = step;
+    step = qMax(cpuStep, getBitrateStep(sourceSize, sourceFps));
+    frameRate = qRound(sourceFps / STEPS[step].frameRateDivisor);
+    resetWindow(now);
+
+    return step != oldStep;
+}
+
+/**
+ * @brief Current step, 0 is the best quality.
+ */
+int VideoQualityController::getStep() const
+{
+    return step;
+}
+
+/**
+ * @brief Size to scale the frames to at the current step.
+ *
+ * @param sourceSize Size of the frames we get from the camera.
+ * @return The size to send, invalid if the frames should be sent as they are.
+ */
+QSize VideoQualityController::getFrameSize(QSize sourceSize) const
+{
+    if (!step || sourceSize.isEmpty()) {
+        return {};
+    }
+
+    const Step& s = STEPS[step];
+    return {scaled(sourceSize.width(), s), scaled(sourceSize.height(), s)};
+}
+
+/**
+ * @brief Only every n-th frame is sent at the current step.
+ */
+int VideoQualityController::getFrameRateDivisor() const
+{
+    return STEPS[step].frameRateDivisor;
+}
+
+/**
+ * @brief Frames per second sent at the current step, as of the last window.
+ */
+int VideoQualityController::getFrameRate() const
+{
+    return frameRate;
+}
+
+/**
+ * @brief Share of a CPU core spent on sending video in the last window, in percent.
+ */
+int VideoQualityController::getLoad() const
+{
+    return loadPercent;
+}
+
+/**
+ * @brief Returns the best step whose pixel rate the recommended bitrate can carry.
+ */
+int VideoQualityController::getBitrateStep(QSize sourceSize, double sourceFps) const
+{
+    const int bitrate = recommendedBitrate;
+    if (!bitrate || sourceSize.isEmpty()) {
+        return 0;
+    }
+
+    int s = 0;
+    while (s < STEP_COUNT - 1
+           && pixelRate(sourceSize, sourceFps, STEPS[s]) * BITS_PER_PIXEL > bitrate * 1000.0) {
+        ++s;
+    }
+
+    return s;
+}
+
+/**
+ * @brief Starts a new statistics window.
+ */
+void VideoQualityController::resetWindow(qint64 start)
+{
+    windowStart = start;
+    encodeTime = 0;
+    offered = 0;
+    dropped = 0;
+}
@@ -0,0 +1,68 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VIDEOQUALITYCONTROLLER_H
+#define VIDEOQUALITYCONTROLLER_H
+
+#include <QSize>
+#include <QtGlobal>
+
+#include <atomic>
+
+class VideoQualityController
+{
+public:
+    VideoQualityController();
+
+    bool acceptFrame();
+    void frameEncoded(qint64 ns);
+    void framesDropped(quint64 total);
+    void bitrateRecommended(int recommended);
+    bool update(qint64 now, QSize sourceSize);
+
+    int getStep() const;
+    QSize getFrameSize(QSize sourceSize) const;
+    int getFrameRateDivisor() const;
+    int getFrameRate() const;
+    int getLoad() const;
+
+public:
+    static const int STEP_COUNT = 5;
+
+private:
+    int getBitrateStep(QSize sourceSize, double sourceFps) const;
+    void resetWindow(qint64 start);
+
+private:
+    int step;
+    int cpuStep;
+    int stableWindows;
+    int frameRate;
+    int loadPercent;
+    std::atomic<int> recommendedBitrate;
+
+    qint64 windowStart;
+    qint64 encodeTime;
+    quint64 offered;
+    quint64 dropped;
+    quint64 droppedTotal;
+    quint64 frameCounter;
+};
+
+#endif // VIDEOQUALITYCONTROLLER_H
@@ -0,0 +1,177 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "emoticonmatcher.h"
+
+#include <QMap>
+
+#include <algorithm>
+
+/**
+ * @class EmoticonMatcher
+ * @brief Immutable trie of the emoticons of a smiley pack.
+ *
+ * Emoticons are only replaced when they make up a whole whitespace separated word. Walking the
+ * trie along a word stops at the first character no emoticon continues with, which for most
+ * words is the first one, so a message is substituted in a single scan without hashing words.
+ *
+ * The trie is built once when a pack is loaded and never changes afterwards, so it can be read
+ * from any thread without locking.
+ *
+ * @var EmoticonMatcher::nodes
+ * @brief Trie nodes, the root is the first one.
+ *
+ * @var EmoticonMatcher::edges
+ * @brief Children of all nodes, each node's edges are contiguous and sorted by character.
+ */
+
+namespace {
+const QString IMG_TITLE = QStringLiteral("<img title=\"");
+const QString IMG_SRC = QStringLiteral("\" src=\"key:");
+const QString IMG_END = QStringLiteral("\"\\>");
+}
+
+/**
+ * @param emoticons Groups of emoticons showing the same smiley, e.g. {{":)", ":-)"}, {":("}}
+ */
+EmoticonMatcher::EmoticonMatcher(const QList<QStringList>& emoticons)
+{
+    // build with maps first, they keep the children sorted for the flat layout
+    QVector<QMap<ushort, int>> children(1);
+    QVector<int> groups(1, -1);
+    for (int group = 0; group < emoticons.size(); ++group) {
+        for (const QString& emoticon : emoticons[group]) {
+            if (emoticon.isEmpty()) {
+                continue;
+            }
+
+            int node = 0;
+            for (QChar c : emoticon) {
+                int child = children[node].value(c.unicode(), -1);
+                if (child < 0) {
+                    child = children.size();
+                    children[node].insert(c.unicode(), child);
+                    children.append(QMap<ushort, int>());
+                    groups.append(-1);
+                }
+
+                node = child;
+            }
+
+            // the first group listing an emoticon keeps it
+            if (groups[node] < 0) {
+                groups[node] = group;
+            }
+        }
+    }
+
+    nodes.reserve(children.size());
+    edges.reserve(children.size() - 1);
+    for (int node = 0; node < children.size(); ++node) {
+        nodes.append({edges.size(), children[node].size(), groups[node]});
+        for (auto it = children[node].constBegin(); it != children[node].constEnd(); ++it) {
+            edges.append({it.key(), it.value()});
+        }
+    }
+}
+
+/**
+ * @brief Looks up an emoticon.
+ * @return Index of the group the emoticon belongs to, -1 if it isn't part of the pack.
+ */
+int EmoticonMatcher::find(const QString& emoticon) const
+{
+    return match(emoticon.constData(), emoticon.constData() + emoticon.size());
+}
+
+/**
+ * @brief Replaces all words which are emoticons by an HTML reference to their smiley.
+ * @param msg Message where to search for emoticons
+ * @return Formatted copy of message, sharing the data of msg if nothing was replaced
+ */
+QString EmoticonMatcher::smileyfied(const QString& msg) const
+{
+    QString result;
+    const QChar* const begin = msg.constData();
+    const QChar* const end = begin + msg.size();
+    // end of the part of msg already copied to the result
+    const QChar* copied = begin;
+
+    const QChar* word = begin;
+    while (word < end) {
+        while (word < end && word->isSpace()) {
+            ++word;
+        }
+
+        const QChar* wordEnd = word;
+        while (wordEnd < end && !wordEnd->isSpace()) {
+            ++wordEnd;
+        }
+
+        if (word < wordEnd && match(word, wordEnd) >= 0) {
+            if (result.isNull()) {
+                result.reserve(msg.size() + IMG_TITLE.size() + IMG_SRC.size() + IMG_END.size());
+            }
+
+            const int length = static_cast<int>(wordEnd - word);
+            result.append(copied, static_cast<int>(word - copied));
+            result.append(IMG_TITLE);
+            result.append(word, length);
+            result.append(IMG_SRC);
+            result.append(word, length);
+            result.append(IMG_END);
+            copied = wordEnd;
+        }
+
+        word = wordEnd;
+    }
+
+    if (result.isNull()) {
+        return msg;
+    }
+
+    result.append(copied, static_cast<int>(end - copied));
+    return result;
+}
+
+/**
+ * @brief Walks the trie along the characters in [begin, end).
+ * @return Group of the emoticon spelled by all of them, -1 if there is none.
+ */
+int EmoticonMatcher::match(const QChar* begin, const QChar* end) const
+{
+    int node = 0;
+    for (const QChar* c = begin; c < end; ++c) {
+        const Node& current = nodes[node];
+        const Edge* first = edges.constData() + current.firstEdge;
+        const Edge* last = first + current.edgeCount;
+        const ushort character = c->unicode();
+        const Edge* edge = std::lower_bound(first, last, character,
+                                            [](const Edge& e, ushort ch) {
+                                                return e.character < ch;
+                                            });
+        if (edge == last || edge->character != character) {
+            return -1;
+        }
+
+        node = edge->node;
+    }
+
+    return nodes[node].group;
+}
@@ -0,0 +1,57 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EMOTICONMATCHER_H
+#define EMOTICONMATCHER_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class EmoticonMatcher
+{
+public:
+    explicit EmoticonMatcher(const QList<QStringList>& emoticons);
+
+    int find(const QString& emoticon) const;
+    QString smileyfied(const QString& msg) const;
+
+private:
+    int match(const QChar* begin, const QChar* end) const;
+
+private:
+    struct Edge
+    {
+        ushort character;
+        int node;
+    };
+
+    struct Node
+    {
+        int firstEdge;
+        int edgeCount;
+        int group;
+    };
+
+    QVector<Node> nodes;
+    QVector<Edge> edges;
+};
+
+#endif // EMOTICONMATCHER_H
@@ -272,6 +272,7 @@ void Settings::loadGlobal()
         #ifdef USE_FILTERAUDIO
         enableBackend2 = s.value("enableBackend2", false).toBool();
         #endif
+        audioResamplerQuality = s.value("audioResamplerQuality", 1).toInt();
     }
     s.endGroup();
 
@@ -282,6 +283,7 @@ void Settings::loadGlobal()
         screenRegion = s.value("screenRegion", QRect()).toRect();
         screenGrabbed = s.value("screenGrabbed", false).toBool();
         camVideoFPS = static_cast<quint16>(s.value("camVideoFPS", 0).toUInt());
+        camDecodeThreads = s.value("camDecodeThreads", 0).toInt();
     }
     s.endGroup();
 
@@ -573,6 +575,7 @@ void Settings::saveGlobal()
         s.setValue("outVolume", outVolume);
         s.setValue("audioBitrate", audioBitrate);
         s.setValue("enableBackend2", enableBackend2);
+        s.setValue("audioResamplerQuality", audioResamplerQuality);
     }
     s.endGroup();
 
@@ -581,6 +584,7 @@ void Settings::saveGlobal()
         s.setValue("videoDev", videoDev);
         s.setValue("camVideoRes", camVideoRes);
         s.setValue("camVideoFPS", camVideoFPS);
+        s.setValue("camDecodeThreads", camDecodeThreads);
         s.setValue("screenRegion", screenRegion);
         s.setValue("screenGrabbed", screenGrabbed);
     }
@@ -1952,6 +1956,26 @@ void Settings::setEnableBackend2(bool enabled)
     }
 }
 
+/**
+ * @brief Quality of the sample rate conversion in the audio pipeline.
+ * @return Value of AudioResampler::Quality, 0 is fastest and 2 is best.
+ */
+int Settings::getAudioResamplerQuality() const
+{
+    QMutexLocker locker{&bigLock};
+    return audioResamplerQuality;
+}
+
+void Settings::setAudioResamplerQuality(int quality)
+{
+    QMutexLocker locker{&bigLock};
+
+    if (quality != audioResamplerQuality) {
+        audioResamplerQuality = quality;
+        emit audioResamplerQualityChanged(quality);
+    }
+}
+
 QRect Settings::getScreenRegion() const
 {
     QMutexLocker locker(&bigLock);
@@ -2016,6 +2040,25 @@ void Settings::setCamVideoFPS(unsigned short newValue)
     }
 }
 
+/**
+ * @brief Number of threads to decode camera video with, 0 to choose by the number of cores.
+ */
+int Settings::getCamDecodeThreads() const
+{
+    QMutexLocker locker{&bigLock};
+    return camDecodeThreads;
+}
+
+void Settings::setCamDecodeThreads(int threads)
+{
+    QMutexLocker locker{&bigLock};
+
+    if (threads != camDecodeThreads) {
+        camDecodeThreads = threads;
+        emit camDecodeThreadsChanged(camDecodeThreads);
+    }
+}
+
 QString Settings::getFriendAddress(const QString& publicKey) const
 {
     QMutexLocker locker{&bigLock};
@@ -109,6 +109,8 @@ class Settings : public QObject, public ICoreSettings
     Q_PROPERTY(int audioBitrate READ getAudioBitrate WRITE setAudioBitrate NOTIFY audioBitrateChanged FINAL)
     Q_PROPERTY(bool enableBackend2 READ getEnableBackend2 WRITE setEnableBackend2 NOTIFY
                    enableBackend2Changed FINAL)
+    Q_PROPERTY(int audioResamplerQuality READ getAudioResamplerQuality WRITE
+                   setAudioResamplerQuality NOTIFY audioResamplerQualityChanged FINAL)
 
     // Video
     Q_PROPERTY(QString videoDev READ getVideoDev WRITE setVideoDev NOTIFY videoDevChanged FINAL)
@@ -116,6 +118,8 @@ class Settings : public QObject, public ICoreSettings
     Q_PROPERTY(QRect screenRegion READ getScreenRegion WRITE setScreenRegion NOTIFY screenRegionChanged FINAL)
     Q_PROPERTY(bool screenGrabbed READ getScreenGrabbed WRITE setScreenGrabbed NOTIFY screenGrabbedChanged FINAL)
     Q_PROPERTY(quint16 camVideoFPS READ getCamVideoFPS WRITE setCamVideoFPS NOTIFY camVideoFPSChanged FINAL)
+    Q_PROPERTY(int camDecodeThreads READ getCamDecodeThreads WRITE setCamDecodeThreads NOTIFY
+                   camDecodeThreadsChanged FINAL)
 
 public:
     enum class StyleType
@@ -240,6 +244,7 @@ signals:
     void audioBitrateChanged(int bitrate);
     void enableTestSoundChanged(bool enabled);
     void enableBackend2Changed(bool enabled);
+    void audioResamplerQualityChanged(int quality);
 
     // Video
     void videoDevChanged(const QString& name);
@@ -247,6 +252,7 @@ signals:
     void screenRegionChanged(const QRect& region);
     void screenGrabbedChanged(bool enabled);
     void camVideoFPSChanged(quint16 fps);
+    void camDecodeThreadsChanged(int threads);
 
 public:
     bool getMakeToxPortable() const;
@@ -389,6 +395,9 @@ public:
     bool getEnableBackend2() const;
     void setEnableBackend2(bool enabled);
 
+    int getAudioResamplerQuality() const;
+    void setAudioResamplerQuality(int quality);
+
     QString getVideoDev() const;
     void setVideoDev(const QString& deviceSpecifier);
 
@@ -404,6 +413,9 @@ public:
     unsigned short getCamVideoFPS() const;
     void setCamVideoFPS(unsigned short newValue);
 
+    int getCamDecodeThreads() const;
+    void setCamDecodeThreads(int threads);
+
     bool isAnimationEnabled() const;
     void setAnimationEnabled(bool newValue);
 
@@ -650,6 +662,7 @@ private:
     int audioBitrate;
     bool enableTestSound;
     bool enableBackend2;
+    int audioResamplerQuality;
 
     // Video
     QString videoDev;
@@ -657,6 +670,7 @@ private:
     QRect screenRegion;
     bool screenGrabbed;
     unsigned short camVideoFPS;
+    int camDecodeThreads;
 
     struct friendProp
     {
@@ -22,7 +22,6 @@
 
 #include <QDir>
 #include <QDomElement>
-#include <QRegularExpression>
 #include <QStandardPaths>
 #include <QtConcurrent/QtConcurrentRun>
 
@@ -40,6 +39,9 @@
  * @var SmileyPack::iconCache
  * @brief representation of a smiley ie. "happy.png" -> data
  *
+ * @var SmileyPack::emoticonToPath
+ * @brief Matches an emoticon to the absolute path of its smiley file
+ *
  * @var SmileyPack::emoticons
  * @brief {{ ":)", ":-)" }, {":(", ...}, ... }
  *
@@ -48,14 +50,18 @@
  *
  * @var SmileyPack::defaultPaths
  * @brief Contains all directories where smileys could be found
+ *
+ * @var SmileyPack::matcher
+ * @brief Matcher of the current pack, swapped atomically as a whole when a pack loads
+ *
+ * smileyfied() holds its own reference, so a replaced matcher is freed once the last message
+ * using it is formatted.
  */
 
 QStringList loadDefaultPaths();
 
 static const QStringList DEFAULT_PATHS = loadDefaultPaths();
 
-static const QString RICH_TEXT_PATTERN = QStringLiteral("<img title=\"%1\" src=\"key:%1\"\\>");
-
 static const QString EMOTICONS_FILE_NAME = QStringLiteral("emoticons.xml");
 
 /**
@@ -91,17 +97,6 @@ QStringList loadDefaultPaths()
     return paths;
 }
 
-/**
- * @brief Wraps passed string into smiley HTML image reference
- * @param key Describes which smiley is needed
- * @return Key that wrapped into image ref
- */
-QString getAsRichText(const QString& key)
-{
-    return RICH_TEXT_PATTERN.arg(key);
-}
-
-
 SmileyPack::SmileyPack()
 {
     loadingMutex.lock();
@@ -203,6 +198,7 @@ bool SmileyPack::load(const QString& filename)
     const int iconsCount = emoticonElements.size();
     emoticons.clear();
     emoticonToIcon.clear();
+    emoticonToPath.clear();
     icons.clear();
     icons.reserve(iconsCount);
     for (int i = 0; i < iconsCount; ++i) {
@@ -215,6 +211,7 @@ bool SmileyPack::load(const QString& filename)
         while (!stringElement.isNull()) {
             QString emoticon = stringElement.text().replace("<", "&lt;").replace(">", "&gt;");
             emoticonToIcon.insert(emoticon, &icons[i]);
+            emoticonToPath.insert(emoticon, iconPath);
             emoticonList.append(emoticon);
             stringElement = stringElement.nextSibling().toElement();
         }
@@ -222,35 +219,31 @@ bool SmileyPack::load(const QString& filename)
         emoticons.append(emoticonList);
     }
 
+    const std::shared_ptr<const EmoticonMatcher> loaded{new EmoticonMatcher(emoticons)};
+    std::atomic_store(&matcher, loaded);
     loadingMutex.unlock();
     return true;
 }
 
 /**
  * @brief Replaces all found text emoticons to HTML reference with its according icon filename
+ *
+ * Only waits for loadingMutex until the first pack has loaded, after that a reference to the
+ * current matcher is taken without waiting for packs being loaded.
+ *
  * @param msg Message where to search for emoticons
  * @return Formatted copy of message
  */
 QString SmileyPack::smileyfied(const QString& msg)
 {
-    QMutexLocker locker(&loadingMutex);
-    QString result(msg);
-    QRegularExpression exp("\\S+");
-    QRegularExpressionMatchIterator iter = exp.globalMatch(result);
-    int replaceDiff = 0;
-    while (iter.hasNext()) {
-        QRegularExpressionMatch match = iter.next();
-        QString key = match.captured();
-        int startPos = match.capturedStart();
-        int keyLength = key.length();
-        if (emoticonToIcon.contains(key)) {
-            QString imgRichText = getAsRichText(key);
-            result.replace(startPos + replaceDiff, keyLength, imgRichText);
-            replaceDiff += imgRichText.length() - keyLength;
-        }
+    std::shared_ptr<const EmoticonMatcher> current = std::atomic_load(&matcher);
+    if (!current) {
+        // the first pack is still loading
+        QMutexLocker locker(&loadingMutex);
+        current = std::atomic_load(&matcher);
     }
 
-    return result;
+    return current ? current->smileyfied(msg) : msg;
 }
 
 /**
@@ -273,6 +266,17 @@ QIcon SmileyPack::getAsIcon(const QString& emoticon)
     return emoticonToIcon.contains(emoticon) ? *(emoticonToIcon[emoticon]) : QIcon();
 }
 
+/**
+ * @brief Gets the file of the smiley for an emoticon
+ * @param emoticon Passed emoticon
+ * @return Path of the smiley file, empty if no smiley is mapped to this emoticon
+ */
+QString SmileyPack::getIconPath(const QString& emoticon)
+{
+    QMutexLocker locker(&loadingMutex);
+    return emoticonToPath.value(emoticon);
+}
+
 void SmileyPack::onSmileyPackChanged()
 {
     loadingMutex.lock();
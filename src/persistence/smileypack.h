@@ -20,10 +20,14 @@
 #ifndef SMILEYPACK_H
 #define SMILEYPACK_H
 
+#include "src/persistence/emoticonmatcher.h"
+
 #include <QIcon>
 #include <QMap>
 #include <QMutex>
 
+#include <memory>
+
 class SmileyPack : public QObject
 {
     Q_OBJECT
@@ -36,6 +40,7 @@ public:
     QString smileyfied(const QString& msg);
     QList<QStringList> getEmoticons() const;
     QIcon getAsIcon(const QString& key);
+    QString getIconPath(const QString& key);
 
 private slots:
     void onSmileyPackChanged();
@@ -49,9 +54,11 @@ private:
 
     QVector<QIcon> icons;
     QMap<QString, const QIcon*> emoticonToIcon;
+    QMap<QString, QString> emoticonToPath;
     QList<QStringList> emoticons;
     QString path;
     mutable QMutex loadingMutex;
+    std::shared_ptr<const EmoticonMatcher> matcher;
 };
 
 #endif // SMILEYPACK_H
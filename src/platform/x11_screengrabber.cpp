@@ -0,0 +1,263 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef QTOX_X11_SCREEN_CAPTURE
+#include "src/platform/x11_screengrabber.h"
+#include "src/platform/x11_display.h"
+#include <QDebug>
+#include <QVector>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/Xdamage.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+/**
+ * @class Platform::X11ScreenGrabber
+ * @brief Captures an area of the X11 screen, fetching only what changed since the last capture.
+ *
+ * XDamage reports which parts of the screen were drawn to. Small changes are fetched rectangle
+ * by rectangle, larger ones with a single XShmGetImage of the whole area, which doesn't copy the
+ * pixels through the X connection. The captured pixels are kept in one shared memory image that
+ * always holds the whole area, 32 bits per pixel in the byte order of AV_PIX_FMT_BGR0.
+ *
+ * Uses the shared display connection of Platform::X11Display, nothing else reads events from it.
+ */
+
+namespace {
+/// Fetch the whole area once the damaged part is larger than this fraction of it
+const int FULL_GRAB_FRACTION = 4;
+/// Fetch the whole area if the damage is split into more rectangles than this
+const int MAX_DAMAGE_RECTS = 16;
+}
+
+namespace Platform {
+
+struct X11ScreenGrabberPrivate
+{
+    XImage* image = nullptr;
+    XShmSegmentInfo shmInfo;
+    Damage damage = 0;
+    int damageEventBase = 0;
+    bool firstGrab = true;
+};
+
+/**
+ * @brief Prepares capturing an area of the screen, check isValid() before use.
+ * @param region Area to capture, in root window coordinates.
+ */
+X11ScreenGrabber::X11ScreenGrabber(const QRect& region)
+    : region{region}
+    , d{new X11ScreenGrabberPrivate}
+{
+    d->shmInfo.shmid = -1;
+    d->shmInfo.shmaddr = nullptr;
+
+    Display* display = X11Display::lock();
+    if (!display) {
+        X11Display::unlock();
+        return;
+    }
+
+    int damageErrorBase;
+    if (!XShmQueryExtension(display)
+        || !XDamageQueryExtension(display, &d->damageEventBase, &damageErrorBase)) {
+        qWarning() << "XShm or XDamage not available, can't capture the screen";
+        X11Display::unlock();
+        return;
+    }
+
+    const int screen = DefaultScreen(display);
+    XImage* image = XShmCreateImage(display, DefaultVisual(display, screen),
+                                    DefaultDepth(display, screen), ZPixmap, nullptr,
+                                    &d->shmInfo, region.width(), region.height());
+    if (!image || image->bits_per_pixel != 32) {
+        qWarning() << "Unsupported screen format for capturing";
+        if (image) {
+            XDestroyImage(image);
+        }
+
+        X11Display::unlock();
+        return;
+    }
+
+    d->shmInfo.shmid =
+        shmget(IPC_PRIVATE, static_cast<size_t>(image->bytes_per_line * image->height),
+               IPC_CREAT | 0600);
+    if (d->shmInfo.shmid < 0) {
+        XDestroyImage(image);
+        X11Display::unlock();
+        return;
+    }
+
+    d->shmInfo.shmaddr = image->data = static_cast<char*>(shmat(d->shmInfo.shmid, nullptr, 0));
+    d->shmInfo.readOnly = False;
+
+    // Marked for removal right away, it goes away with the last detach even if we crash
+    shmctl(d->shmInfo.shmid, IPC_RMID, nullptr);
+
+    if (d->shmInfo.shmaddr == reinterpret_cast<char*>(-1) || !XShmAttach(display, &d->shmInfo)) {
+        d->shmInfo.shmaddr = nullptr;
+        image->data = nullptr;
+        XDestroyImage(image);
+        X11Display::unlock();
+        return;
+    }
+
+    d->image = image;
+    d->damage = XDamageCreate(display, DefaultRootWindow(display), XDamageReportRawRectangles);
+    X11Display::unlock();
+}
+
+X11ScreenGrabber::~X11ScreenGrabber()
+{
+    Display* display = X11Display::lock();
+
+    if (display && d->damage) {
+        XDamageDestroy(display, d->damage);
+    }
+
+    if (d->image) {
+        if (display) {
+            XShmDetach(display, &d->shmInfo);
+            XSync(display, False);
+        }
+
+        // The data belongs to the shared memory segment, not to Xlib
+        d->image->data = nullptr;
+        XDestroyImage(d->image);
+    }
+
+    if (d->shmInfo.shmaddr) {
+        shmdt(d->shmInfo.shmaddr);
+    }
+
+    X11Display::unlock();
+}
+
+/**
+ * @brief Checks whether the X server has the extensions needed for capturing.
+ */
+bool X11ScreenGrabber::isSupported()
+{
+    Display* display = X11Display::lock();
+    int eventBase, errorBase;
+    const bool supported =
+        display && XShmQueryExtension(display)
+        && XDamageQueryExtension(display, &eventBase, &errorBase);
+    X11Display::unlock();
+
+    return supported;
+}
+
+bool X11ScreenGrabber::isValid() const
+{
+    return d->image && d->damage;
+}
+
+/**
+ * @brief Updates the captured image with what changed on the screen.
+ * @return The changed parts, relative to the captured area. Empty if nothing changed.
+ */
+QRegion X11ScreenGrabber::grab()
+{
+    if (!isValid()) {
+        return {};
+    }
+
+    Display* display = X11Display::lock();
+    if (!display) {
+        X11Display::unlock();
+        return {};
+    }
+
+    QRegion damaged;
+    while (XPending(display)) {
+        XEvent event;
+        XNextEvent(display, &event);
+
+        if (event.type == d->damageEventBase + XDamageNotify) {
+            const XDamageNotifyEvent* notify = reinterpret_cast<XDamageNotifyEvent*>(&event);
+            damaged += QRect{notify->area.x, notify->area.y, notify->area.width,
+                             notify->area.height};
+        }
+    }
+
+    const QRect area{QPoint{0, 0}, region.size()};
+    if (d->firstGrab) {
+        d->firstGrab = false;
+        damaged = area;
+    } else {
+        damaged = damaged.intersected(region).translated(-region.topLeft());
+    }
+
+    if (damaged.isEmpty()) {
+        X11Display::unlock();
+        return {};
+    }
+
+    const QVector<QRect> rects = damaged.rects();
+    qint64 damagedPixels = 0;
+    for (const QRect& rect : rects) {
+        damagedPixels += static_cast<qint64>(rect.width()) * rect.height();
+    }
+
+    const qint64 areaPixels = static_cast<qint64>(area.width()) * area.height();
+    const Window root = DefaultRootWindow(display);
+
+    if (rects.size() > MAX_DAMAGE_RECTS
+        || damagedPixels > areaPixels / FULL_GRAB_FRACTION) {
+        XShmGetImage(display, root, d->image, region.x(), region.y(), AllPlanes);
+        damaged = area;
+    } else {
+        for (const QRect& rect : rects) {
+            XGetSubImage(display, root, region.x() + rect.x(), region.y() + rect.y(),
+                         static_cast<unsigned>(rect.width()), static_cast<unsigned>(rect.height()),
+                         AllPlanes, ZPixmap, d->image, rect.x(), rect.y());
+        }
+    }
+
+    X11Display::unlock();
+    return damaged;
+}
+
+/**
+ * @brief Area of the screen that is captured.
+ */
+QRect X11ScreenGrabber::getRegion() const
+{
+    return region;
+}
+
+/**
+ * @brief Pixels of the captured area, valid as long as the grabber.
+ */
+const uint8_t* X11ScreenGrabber::getData() const
+{
+    return d->image ? reinterpret_cast<const uint8_t*>(d->image->data) : nullptr;
+}
+
+int X11ScreenGrabber::getStride() const
+{
+    return d->image ? d->image->bytes_per_line : 0;
+}
+}
+
+#endif // QTOX_X11_SCREEN_CAPTURE
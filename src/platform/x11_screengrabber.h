@@ -0,0 +1,61 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef QTOX_X11_SCREEN_CAPTURE
+
+#ifndef PLATFORM_X11_SCREENGRABBER_H
+#define PLATFORM_X11_SCREENGRABBER_H
+
+#include <QRect>
+#include <QRegion>
+
+#include <cstdint>
+#include <memory>
+
+namespace Platform {
+
+struct X11ScreenGrabberPrivate;
+
+class X11ScreenGrabber
+{
+public:
+    explicit X11ScreenGrabber(const QRect& region);
+    ~X11ScreenGrabber();
+
+    X11ScreenGrabber(const X11ScreenGrabber&) = delete;
+    X11ScreenGrabber& operator=(const X11ScreenGrabber&) = delete;
+
+    static bool isSupported();
+
+    bool isValid() const;
+    QRegion grab();
+
+    QRect getRegion() const;
+    const uint8_t* getData() const;
+    int getStride() const;
+
+private:
+    const QRect region;
+    std::unique_ptr<X11ScreenGrabberPrivate> d;
+};
+}
+
+#endif // PLATFORM_X11_SCREENGRABBER_H
+
+#endif // QTOX_X11_SCREEN_CAPTURE
@@ -25,9 +25,11 @@ extern "C" {
 }
 #include "cameradevice.h"
 #include "camerasource.h"
+#include "screensource.h"
 #include "videoframe.h"
 #include "src/persistence/settings.h"
 #include <QDebug>
+#include <QMutexLocker>
 #include <QReadLocker>
 #include <QWriteLocker>
 #include <QtConcurrent/QtConcurrentRun>
@@ -45,14 +47,16 @@ extern "C" {
  * The source is lazy in the sense that it will only keep the video
  * device open as long as there are subscribers, the source can be
  * open but the device closed if there are zero subscribers.
+ *
+ * While the device is open, two threads run. The stream thread reads packets from the device
+ * and queues them, the decode thread decodes them and emits the frames. Reading never waits for
+ * a slow decoder. The queue holds at most MAX_QUEUED_PACKETS packets, beyond that packets are
+ * dropped, see queuePacket(). Closing the device clears the queue and stops both threads.
  */
 
 /**
- * @var QVector<std::weak_ptr<VideoFrame>> CameraSource::freelist
- * @brief Frames that need freeing before we can safely close the device
- *
  * @var QFuture<void> CameraSource::streamFuture
- * @brief Future of the streaming thread
+ * @brief Future of the stream thread, reading packets from the device into the packetQueue
  *
  * @var QString CameraSource::deviceName
  * @brief Short name of the device for CameraDevice's open(QString)
@@ -61,6 +65,10 @@ extern "C" {
  * @brief Non-owning pointer to an open CameraDevice, or nullptr. Not atomic, synced with memfences
  * when becomes null.
  *
+ * @var CameraSource::screenSource
+ * @brief Captures the screen instead of the device, if the device is a screen and the platform
+ * supports capturing it directly. Its frames are emitted as ours.
+ *
  * @var VideoMode CameraSource::mode
  * @brief What mode we tried to open the device in, all zeros means default mode
  *
@@ -74,25 +82,80 @@ extern "C" {
  * @var int CameraSource::videoStreamIndex
  * @brief A camera can have multiple streams, this is the one we're decoding
  *
- * @var QMutex CameraSource::biglock
- * @brief True when locked. Faster than mutexes for video decoding.
+ * @var CameraSource::frameGeneration
+ * @brief Tracks the frames we emitted, so they can be invalidated before the decoder is freed
+ *
+ * @var CameraSource::frameInterval
+ * @brief Minimum time between emitted frames in nanoseconds, 0 to emit every frame
+ *
+ * @var CameraSource::nextFrameDue
+ * @brief When the next frame should be emitted, on the frameClock
+ *
+ * @var CameraSource::framesCaptured
+ * @brief Frames decoded since the device was opened
+ *
+ * @var CameraSource::framesDropped
+ * @brief Decoded frames that weren't emitted because they came faster than the selected mode
+ *
+ * @var CameraSource::decodeFuture
+ * @brief Future of the decode thread, decoding the queued packets and emitting the frames
+ *
+ * @var CameraSource::queueMutex
+ * @brief Guards the packetQueue and waitForKeyframe, shared by the stream and decode threads.
+ *
+ * @var CameraSource::packetQueued
+ * @brief Wakes the decode thread when a packet was queued.
  *
- * @var QMutex CameraSource::freelistLock
- * @brief True when locked. Faster than mutexes for video decoding.
+ * @var CameraSource::packetQueue
+ * @brief Packets read from the device, waiting for the decode thread. Bounded by
+ * MAX_QUEUED_PACKETS, guarded by queueMutex.
  *
- * @var std::atomic_bool CameraSource::streamBlocker
- * @brief Holds the streaming thread still when true
+ * @var CameraSource::intraOnly
+ * @brief True if every packet of the codec is a keyframe, e.g. MJPEG
+ *
+ * @var CameraSource::waitForKeyframe
+ * @brief True after packets were dropped, until a keyframe arrives. Guarded by queueMutex.
+ *
+ * @var CameraSource::queueGeneration
+ * @brief Advanced whenever the queue is cleared, packets read before are dropped instead of
+ * queued. Only advanced with queueMutex locked.
+ *
+ * @var CameraSource::packetsDropped
+ * @brief Packets that weren't decoded because the decoder fell behind
+ *
+ * @var CameraSource::readTime
+ * @brief Time spent reading packets since stageTimesStart, in nanoseconds. Likewise for
+ * queueTime, decodeTime and deliverTime.
+ *
+ * @var CameraSource::deviceMutex
+ * @brief Serializes subscribing, changing the device and opening or closing it.
+ *
+ * @var CameraSource::streamMutex
+ * @brief Held for reading by the stream and decode threads while they use the device and the
+ * decoder, closeDevice() takes it for writing to free them.
  *
  * @var std::atomic_int CameraSource::subscriptions
  * @brief Remember how many times we subscribed for RAII
  */
 
+namespace {
+/// Packets waiting for the decoder, a few frames are enough to absorb hiccups
+const int MAX_QUEUED_PACKETS = 4;
+/// How long the decode thread waits for a packet before checking the device again, in ms
+const unsigned long DEQUEUE_TIMEOUT = 10;
+/// How often the stage times are logged, in ns
+const qint64 STAGE_TIMES_INTERVAL = 30 * 1000000000LL;
+/// Decode threads used if the setting is automatic, more frame threads mean more latency
+const int MAX_AUTO_DECODE_THREADS = 4;
+}
+
 CameraSource* CameraSource::instance{nullptr};
 
 CameraSource::CameraSource()
     : deviceThread{new QThread}
     , deviceName{"none"}
     , device{nullptr}
+    , screenSource{nullptr}
     , mode(VideoMode())
     // clang-format off
     , cctx{nullptr}
@@ -100,6 +163,21 @@ CameraSource::CameraSource()
     , cctxOrig{nullptr}
 #endif
     , videoStreamIndex{-1}
+    , frameGeneration{std::make_shared<VideoFrame::SourceGeneration>()}
+    , frameInterval{0}
+    , nextFrameDue{0}
+    , framesCaptured{0}
+    , framesDropped{0}
+    , intraOnly{false}
+    , waitForKeyframe{false}
+    , queueGeneration{0}
+    , packetsDropped{0}
+    , readTime{0}
+    , queueTime{0}
+    , decodeTime{0}
+    , deliverTime{0}
+    , packetsDecoded{0}
+    , stageTimesStart{0}
     , _isNone{true}
     , subscriptions{0}
 {
@@ -200,12 +278,14 @@ CameraSource::~CameraSource()
     deviceThread->wait();
     delete deviceThread;
 
+    delete screenSource;
+
     if (_isNone) {
         return;
     }
 
-    // Free all remaining VideoFrame
-    VideoFrame::untrackFrames(id, true);
+    // Invalidate all remaining VideoFrame before their decoder goes away
+    frameGeneration->advance();
 
     if (cctx) {
         avcodec_free_context(&cctx);
@@ -225,9 +305,29 @@ CameraSource::~CameraSource()
 
     locker.unlock();
 
-    // Synchronize with our stream thread
-    while (streamFuture.isRunning())
+    // Synchronize with our stream and decode threads
+    while (streamFuture.isRunning() || decodeFuture.isRunning())
         QThread::yieldCurrentThread();
+
+    clearPacketQueue();
+}
+
+/**
+ * @brief Number of frames decoded since the device was last opened.
+ */
+quint64 CameraSource::getFramesCaptured() const
+{
+    return framesCaptured;
+}
+
+/**
+ * @brief Number of decoded frames dropped to keep to the frame rate of the selected mode.
+ *
+ * Frames consumers skip because they couldn't keep up aren't counted here, see VideoFrameHandoff.
+ */
+quint64 CameraSource::getFramesDropped() const
+{
+    return framesDropped;
 }
 
 void CameraSource::subscribe()
@@ -250,7 +350,7 @@ void CameraSource::unsubscribe()
 
 /**
  * @brief Opens the video device and starts streaming.
- * @note Callers must own the biglock.
+ * @note Runs on the device thread, calls from other threads are queued to it.
  */
 void CameraSource::openDevice()
 {
@@ -266,6 +366,19 @@ void CameraSource::openDevice()
 
     qDebug() << "Opening device " << deviceName;
 
+    // Only fetches what changed on the screen, instead of grabbing and decoding it all every frame
+    if (CameraDevice::isScreen(deviceName) && ScreenSource::isSupported()) {
+        if (!screenSource) {
+            screenSource = new ScreenSource(mode.toRect());
+            connect(screenSource, &VideoSource::frameAvailable, this,
+                    &VideoSource::frameAvailable, Qt::DirectConnection);
+            screenSource->subscribe();
+        }
+
+        emit deviceOpened();
+        return;
+    }
+
     if (device) {
         device->open();
         emit openFailed();
@@ -344,6 +457,24 @@ void CameraSource::openDevice()
     }
 #endif
 
+    // High resolution MJPEG is too much for one core. Slice threads don't add latency, but few
+    // decoders support them, frame threads delay each frame by a frame per thread
+    int threads = Settings::getInstance().getCamDecodeThreads();
+    if (threads <= 0) {
+        threads = qBound(1, QThread::idealThreadCount(), MAX_AUTO_DECODE_THREADS);
+    }
+
+    cctx->thread_count = threads;
+#ifdef AV_CODEC_CAP_SLICE_THREADS
+    const bool sliceThreads = codec->capabilities & AV_CODEC_CAP_SLICE_THREADS;
+#else
+    const bool sliceThreads = codec->capabilities & CODEC_CAP_SLICE_THREADS;
+#endif
+    cctx->thread_type = sliceThreads ? FF_THREAD_SLICE : FF_THREAD_FRAME;
+
+    const AVCodecDescriptor* descriptor = avcodec_descriptor_get(codecId);
+    intraOnly = descriptor && (descriptor->props & AV_CODEC_PROP_INTRA_ONLY);
+
     // Open codec
     if (avcodec_open2(cctx, codec, nullptr) < 0) {
         qWarning() << "Can't open codec";
@@ -352,13 +483,28 @@ void CameraSource::openDevice()
         return;
     }
 
+    // Cameras often deliver more than the mode asked for, e.g. when they ignore the setting
+    frameInterval = mode.FPS > 0 ? static_cast<qint64>(1000000000.0 / mode.FPS) : 0;
+    nextFrameDue = 0;
+    framesCaptured = 0;
+    framesDropped = 0;
+    packetsDropped = 0;
+    frameClock.start();
+    stageTimesStart = 0;
+
+    qDebug() << "Decoding with" << cctx->thread_count
+             << (sliceThreads ? "slice threads" : "frame threads");
+
     if (streamFuture.isRunning())
         qDebug() << "The stream thread is already running! Keeping the current one open.";
     else
         streamFuture = QtConcurrent::run(std::bind(&CameraSource::stream, this));
 
-    // Synchronize with our stream thread
-    while (!streamFuture.isRunning())
+    if (!decodeFuture.isRunning())
+        decodeFuture = QtConcurrent::run(std::bind(&CameraSource::decode, this));
+
+    // Synchronize with our stream and decode threads
+    while (!streamFuture.isRunning() || !decodeFuture.isRunning())
         QThread::yieldCurrentThread();
 
     emit deviceOpened();
@@ -366,7 +512,7 @@ void CameraSource::openDevice()
 
 /**
  * @brief Closes the video device and stops streaming.
- * @note Callers must own the biglock.
+ * @note Runs on the device thread, calls from other threads are queued to it.
  */
 void CameraSource::closeDevice()
 {
@@ -380,10 +526,22 @@ void CameraSource::closeDevice()
         return;
     }
 
-    qDebug() << "Closing device " << deviceName;
+    if (screenSource) {
+        qDebug() << "Closing screen capture after" << screenSource->getFramesCaptured()
+                 << "frames";
+        delete screenSource;
+        screenSource = nullptr;
+        return;
+    }
+
+    qDebug() << "Closing device " << deviceName << "after" << framesCaptured << "frames,"
+             << framesDropped << "dropped for pacing," << packetsDropped
+             << "packets dropped before decoding";
 
-    // Free all remaining VideoFrame
-    VideoFrame::untrackFrames(id, true);
+    // Invalidate all remaining VideoFrame before their decoder goes away
+    frameGeneration->advance();
+    clearPacketQueue();
+    logStageTimes();
 
     // Free our resources and close the device
     videoStreamIndex = -1;
@@ -398,64 +556,298 @@ void CameraSource::closeDevice()
 }
 
 /**
- * @brief Blocking. Decodes video stream and emits new frames.
+ * @brief Blocking. Reads packets from the device and queues them for decoding.
  * @note Designed to run in its own thread.
  */
 void CameraSource::stream()
 {
-    auto streamLoop = [=]() {
-        AVPacket packet;
-        if (av_read_frame(device->context, &packet) != 0) {
-            return;
-        }
+    forever
+    {
+        AVPacket* packet = new AVPacket;
+        av_init_packet(packet);
+        packet->data = nullptr;
+        packet->size = 0;
+        quint64 generation = 0;
+
+        {
+            QReadLocker locker{&streamMutex};
+
+            // Exit if device is no longer valid
+            if (!device) {
+                delete packet;
+                break;
+            }
 
-#if LIBAVCODEC_VERSION_INT < 3747941
-        AVFrame* frame = av_frame_alloc();
-        if (!frame) {
-            return;
-        }
+            const qint64 start = frameClock.nsecsElapsed();
+            if (av_read_frame(device->context, packet) != 0) {
+                delete packet;
 
-        // Only keep packets from the right stream;
-        if (packet.stream_index == videoStreamIndex) {
-            // Decode video frame
-            int frameFinished;
-            avcodec_decode_video2(cctx, frame, &frameFinished, &packet);
-            if (!frameFinished) {
-                return;
+                // Nothing to read right now, don't spin on the device
+                locker.unlock();
+                QThread::msleep(1);
+                continue;
             }
 
-            VideoFrame* vframe = new VideoFrame(id, frame);
-            emit frameAvailable(vframe->trackFrame());
+            readTime += frameClock.nsecsElapsed() - start;
+
+            // closeDevice() clears the queue holding this lock for writing, a packet read
+            // before is dropped by queuePacket() instead of reaching the next device's decoder
+            generation = queueGeneration;
+
+            // Only keep packets from the right stream
+            if (packet->stream_index != videoStreamIndex) {
+                av_packet_unref(packet);
+                delete packet;
+                continue;
+            }
         }
-#else
 
-        // Forward packets to the decoder and grab the decoded frame
-        bool isVideo = packet.stream_index == videoStreamIndex;
-        bool readyToRecive = isVideo && !avcodec_send_packet(cctx, &packet);
-
-        if (readyToRecive) {
-            AVFrame* frame = av_frame_alloc();
-            if (frame && !avcodec_receive_frame(cctx, frame)) {
-                VideoFrame* vframe = new VideoFrame(id, frame);
-                emit frameAvailable(vframe->trackFrame());
-            } else {
-                av_frame_free(&frame);
+        // Unreferenced packets are only valid until the next read
+        if (!packet->buf) {
+            AVPacket* copy = new AVPacket;
+            av_init_packet(copy);
+            const bool copied = av_packet_ref(copy, packet) == 0;
+            av_packet_unref(packet);
+            delete packet;
+
+            if (!copied) {
+                delete copy;
+                continue;
             }
+
+            packet = copy;
         }
-#endif
 
-        av_packet_unref(&packet);
-    };
+        queuePacket(packet, generation);
+    }
+}
 
+/**
+ * @brief Blocking. Decodes queued packets and emits new frames.
+ * @note Designed to run in its own thread.
+ */
+void CameraSource::decode()
+{
     forever
     {
+        AVPacket* packet = dequeuePacket();
+
         QReadLocker locker{&streamMutex};
 
         // Exit if device is no longer valid
         if (!device) {
+            if (packet) {
+                av_packet_unref(packet);
+                delete packet;
+            }
+
+            break;
+        }
+
+        if (!packet) {
+            continue;
+        }
+
+        decodePacket(packet);
+        av_packet_unref(packet);
+        delete packet;
+
+        if (frameClock.nsecsElapsed() - stageTimesStart > STAGE_TIMES_INTERVAL) {
+            logStageTimes();
+        }
+    }
+}
+
+/**
+ * @brief Decodes a packet and delivers the frames it completes.
+ * @note Called by the decode thread, with the streamMutex locked for reading.
+ */
+void CameraSource::decodePacket(AVPacket* packet)
+{
+    qint64 start = frameClock.nsecsElapsed();
+    qint64 delivering = 0;
+
+#if LIBAVCODEC_VERSION_INT < 3747941
+    AVFrame* frame = av_frame_alloc();
+    if (!frame) {
+        return;
+    }
+
+    int frameFinished;
+    avcodec_decode_video2(cctx, frame, &frameFinished, packet);
+    if (frameFinished) {
+        const qint64 decoded = frameClock.nsecsElapsed();
+        deliverFrame(frame);
+        delivering += frameClock.nsecsElapsed() - decoded;
+    } else {
+        av_frame_free(&frame);
+    }
+#else
+    // Forward packets to the decoder and grab the decoded frames, with frame threading a packet
+    // can complete none or several of them
+    if (avcodec_send_packet(cctx, packet)) {
+        return;
+    }
+
+    forever
+    {
+        AVFrame* frame = av_frame_alloc();
+        if (!frame || avcodec_receive_frame(cctx, frame)) {
+            av_frame_free(&frame);
             break;
         }
 
-        streamLoop();
+        const qint64 decoded = frameClock.nsecsElapsed();
+        deliverFrame(frame);
+        delivering += frameClock.nsecsElapsed() - decoded;
+    }
+#endif
+
+    ++packetsDecoded;
+    decodeTime += frameClock.nsecsElapsed() - start - delivering;
+    deliverTime += delivering;
+}
+
+/**
+ * @brief Queues a packet for the decode thread, dropping packets if the decoder falls behind.
+ *
+ * When the queue is full, codecs that only have keyframes lose the oldest packet. For other
+ * codecs the whole queue is dropped, and decoding resumes with the next keyframe.
+ *
+ * @param packet Packet to queue, ownership is taken.
+ * @param generation Queue generation the packet was read in, it's dropped if the queue was
+ * cleared since.
+ */
+void CameraSource::queuePacket(AVPacket* packet, quint64 generation)
+{
+    QMutexLocker locker{&queueMutex};
+
+    // Read from a device that was closed in the meantime
+    if (generation != queueGeneration) {
+        av_packet_unref(packet);
+        delete packet;
+        return;
+    }
+
+    if (waitForKeyframe) {
+        if (!(packet->flags & AV_PKT_FLAG_KEY)) {
+            ++packetsDropped;
+            av_packet_unref(packet);
+            delete packet;
+            return;
+        }
+
+        waitForKeyframe = false;
+    }
+
+    if (packetQueue.size() >= MAX_QUEUED_PACKETS) {
+        const int drop = intraOnly ? 1 : packetQueue.size();
+        for (int i = 0; i < drop; ++i) {
+            QueuedPacket queued = packetQueue.dequeue();
+            av_packet_unref(queued.packet);
+            delete queued.packet;
+            ++packetsDropped;
+        }
+
+        if (!intraOnly && !(packet->flags & AV_PKT_FLAG_KEY)) {
+            waitForKeyframe = true;
+            ++packetsDropped;
+            av_packet_unref(packet);
+            delete packet;
+            return;
+        }
+    }
+
+    packetQueue.enqueue({packet, frameClock.nsecsElapsed()});
+    packetQueued.wakeOne();
+}
+
+/**
+ * @brief Takes the next packet to decode, waiting a short while for one.
+ * @return The packet, or nullptr if none was queued in time. Ownership is passed to the caller.
+ */
+AVPacket* CameraSource::dequeuePacket()
+{
+    QMutexLocker locker{&queueMutex};
+
+    if (packetQueue.isEmpty()) {
+        // Not indefinitely, the decode thread has to notice when the device is closed
+        packetQueued.wait(&queueMutex, DEQUEUE_TIMEOUT);
+    }
+
+    if (packetQueue.isEmpty()) {
+        return nullptr;
+    }
+
+    QueuedPacket queued = packetQueue.dequeue();
+    queueTime += frameClock.nsecsElapsed() - queued.queuedAt;
+    return queued.packet;
+}
+
+/**
+ * @brief Drops all queued packets, and those read before but not queued yet.
+ */
+void CameraSource::clearPacketQueue()
+{
+    QMutexLocker locker{&queueMutex};
+
+    ++queueGeneration;
+
+    while (!packetQueue.isEmpty()) {
+        QueuedPacket queued = packetQueue.dequeue();
+        av_packet_unref(queued.packet);
+        delete queued.packet;
     }
+
+    waitForKeyframe = false;
+}
+
+/**
+ * @brief Logs the average time a packet spent in each stage, and restarts measuring.
+ *
+ * Reading includes waiting for the device, so it is about the frame interval when the
+ * decoder keeps up. Delivering includes everything consumers do on the decode thread.
+ */
+void CameraSource::logStageTimes()
+{
+    const quint64 packets = packetsDecoded.exchange(0);
+    const qint64 read = readTime.exchange(0);
+    const qint64 queued = queueTime.exchange(0);
+    const qint64 decoding = decodeTime.exchange(0);
+    const qint64 delivering = deliverTime.exchange(0);
+    stageTimesStart = frameClock.nsecsElapsed();
+
+    if (!packets) {
+        return;
+    }
+
+    const double toMs = 1e-6 / packets;
+    qDebug().nospace() << "Camera stage times per packet: read " << read * toMs << "ms, queued "
+                       << queued * toMs << "ms, decode " << decoding * toMs << "ms, deliver "
+                       << delivering * toMs << "ms; " << packetsDropped << " packets and "
+                       << framesDropped << " frames dropped so far";
+}
+
+/**
+ * @brief Emits a decoded frame, unless it came too early for the selected frame rate.
+ * @param frame Decoded frame, ownership is taken.
+ * @note Called by the decode thread, with the streamMutex locked for reading.
+ */
+void CameraSource::deliverFrame(AVFrame* frame)
+{
+    ++framesCaptured;
+
+    const qint64 now = frameClock.nsecsElapsed();
+    // A quarter interval of tolerance, so a jittery camera at the right rate isn't paced
+    if (frameInterval && now < nextFrameDue - frameInterval / 4) {
+        ++framesDropped;
+        av_frame_free(&frame);
+        return;
+    }
+
+    // Don't let frames that were held up be followed by a burst
+    nextFrameDue = qMax(nextFrameDue + frameInterval, now + frameInterval / 2);
+
+    VideoFrame* vframe = new VideoFrame(id, frame);
+    emit frameAvailable(vframe->trackFrame(frameGeneration));
 }
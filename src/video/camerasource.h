@@ -20,17 +20,25 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include "src/video/videoframe.h"
 #include "src/video/videomode.h"
 #include "src/video/videosource.h"
+#include <QElapsedTimer>
 #include <QFuture>
 #include <QHash>
+#include <QMutex>
+#include <QQueue>
 #include <QReadWriteLock>
 #include <QString>
 #include <QVector>
+#include <QWaitCondition>
 #include <atomic>
 
 class CameraDevice;
+class ScreenSource;
 struct AVCodecContext;
+struct AVFrame;
+struct AVPacket;
 
 class CameraSource : public VideoSource
 {
@@ -46,6 +54,9 @@ public:
     virtual void subscribe() override;
     virtual void unsubscribe() override;
 
+    quint64 getFramesCaptured() const;
+    quint64 getFramesDropped() const;
+
 public slots:
     void setupDevice(const QString& deviceName, const VideoMode& mode);
 
@@ -57,22 +68,61 @@ private:
     CameraSource();
     ~CameraSource();
     void stream();
+    void decode();
+    void decodePacket(AVPacket* packet);
+    void deliverFrame(AVFrame* frame);
+
+    void queuePacket(AVPacket* packet, quint64 generation);
+    AVPacket* dequeuePacket();
+    void clearPacketQueue();
+    void logStageTimes();
 
 private slots:
     void openDevice();
     void closeDevice();
 
+private:
+    struct QueuedPacket
+    {
+        AVPacket* packet;
+        qint64 queuedAt;
+    };
+
 private:
     QFuture<void> streamFuture;
+    QFuture<void> decodeFuture;
     QThread* deviceThread;
 
     QString deviceName;
     CameraDevice* device;
+    ScreenSource* screenSource;
     VideoMode mode;
     AVCodecContext* cctx;
     // TODO: Remove when ffmpeg version will be bumped to the 3.1.0
     AVCodecContext* cctxOrig;
     int videoStreamIndex;
+    std::shared_ptr<VideoFrame::SourceGeneration> frameGeneration;
+
+    QElapsedTimer frameClock;
+    qint64 frameInterval;
+    qint64 nextFrameDue;
+    std::atomic<quint64> framesCaptured;
+    std::atomic<quint64> framesDropped;
+
+    QMutex queueMutex;
+    QWaitCondition packetQueued;
+    QQueue<QueuedPacket> packetQueue;
+    bool intraOnly;
+    bool waitForKeyframe;
+    std::atomic<quint64> queueGeneration;
+    std::atomic<quint64> packetsDropped;
+
+    std::atomic<qint64> readTime;
+    std::atomic<qint64> queueTime;
+    std::atomic<qint64> decodeTime;
+    std::atomic<qint64> deliverTime;
+    std::atomic<quint64> packetsDecoded;
+    qint64 stageTimesStart;
 
     QReadWriteLock deviceMutex;
     QReadWriteLock streamMutex;
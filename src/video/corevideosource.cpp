@@ -36,6 +36,9 @@ extern "C" {
  *
  * @var std::atomic_bool deleteOnClose
  * @brief If true, self-delete after the last suscriber is gone
+ *
+ * @var CoreVideoSource::latency
+ * @brief Collects the render latency of our frames, shared with the call.
  */
 
 /**
@@ -99,6 +102,8 @@ void CoreVideoSource::pushFrame(const vpx_image_t* vpxframe)
     }
 
     vframe = std::make_shared<VideoFrame>(id, avframe, true);
+    vframe->markStage(VideoFrame::Stage::Receive);
+    vframe->setLatency(latency);
     emit frameAvailable(vframe);
 }
 
@@ -132,6 +137,15 @@ void CoreVideoSource::setDeleteOnClose(bool newstate)
     deleteOnClose = newstate;
 }
 
+/**
+ * @brief Sets where the frames we emit record how long they took to be painted.
+ */
+void CoreVideoSource::setLatency(const std::shared_ptr<VideoLatency>& newLatency)
+{
+    QMutexLocker locker(&biglock);
+    latency = newLatency;
+}
+
 /**
  * @brief Stopping the source.
  * @see The callers in CoreAV for the rationale
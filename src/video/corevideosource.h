@@ -24,8 +24,11 @@
 #include "videosource.h"
 #include <QMutex>
 #include <atomic>
+#include <memory>
 #include <vpx/vpx_image.h>
 
+class VideoLatency;
+
 class CoreVideoSource : public VideoSource
 {
     Q_OBJECT
@@ -39,6 +42,7 @@ private:
 
     void pushFrame(const vpx_image_t* frame);
     void setDeleteOnClose(bool newstate);
+    void setLatency(const std::shared_ptr<VideoLatency>& newLatency);
 
     void stopSource();
     void restartSource();
@@ -48,6 +52,7 @@ private:
     std::atomic_bool deleteOnClose;
     QMutex biglock;
     std::atomic_bool stopped;
+    std::shared_ptr<VideoLatency> latency;
 
     friend class CoreAV;
     friend struct ToxFriendCall;
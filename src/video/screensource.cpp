@@ -0,0 +1,322 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "screensource.h"
+#include "videoframe.h"
+#include "src/platform/x11_screengrabber.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+#include <QDebug>
+#include <QGuiApplication>
+#include <QMutexLocker>
+#include <QScreen>
+#include <QThread>
+#include <QTimer>
+
+/**
+ * @class ScreenSource
+ * @brief A VideoSource sharing an area of the screen.
+ *
+ * Unlike grabbing the screen through libavdevice, only the parts of the screen that changed are
+ * fetched, and nothing is scaled or emitted while nothing changes. Captures are scaled straight
+ * into YUV420P frames of at most the given size, which toxav takes without further conversion.
+ *
+ * The capture rate adapts to the screen: it goes up to 30 fps while things move, and backs off
+ * to 2 fps while the screen is still. It never spends more than about a quarter of a core on
+ * capturing. While the screen is still, the last frame is repeated every second so peers that
+ * lost a frame catch up.
+ *
+ * Capturing runs on its own thread while subscribed. Only X11 is supported for now, see
+ * isSupported().
+ *
+ * @var ScreenSource::DEFAULT_MAX_SIZE
+ * @brief Frames are scaled down to fit into this size, about what calls can send
+ *
+ * @var ScreenSource::frameSize
+ * @brief Size of the emitted frames, the region scaled down to fit the maximum size
+ *
+ * @var ScreenSource::captureMutex
+ * @brief Guards the grabber, scaler and last frame
+ *
+ * @var ScreenSource::interval
+ * @brief Current time between two captures in milliseconds
+ */
+
+namespace {
+/// Fastest capture rate, while the screen changes
+const int MIN_INTERVAL_MS = 1000 / 30;
+/// Slowest capture rate, while the screen is still
+const int MAX_INTERVAL_MS = 500;
+/// The last frame is sent again after this long without a change
+const qint64 KEEPALIVE_MS = 1000;
+/// The interval is kept at least this many times the cost of a capture
+const int COST_FACTOR = 4;
+}
+
+const QSize ScreenSource::DEFAULT_MAX_SIZE{1280, 720};
+
+/**
+ * @brief Returns the region to capture, the primary screen if none was given.
+ */
+static QRect captureRegion(const QRect& region)
+{
+    if (!region.isEmpty()) {
+        return region;
+    }
+
+    const QScreen* screen = QGuiApplication::primaryScreen();
+    if (!screen) {
+        return {};
+    }
+
+    const qreal pixRatio = screen->devicePixelRatio();
+    const QRect geometry = screen->geometry();
+    return QRect(geometry.x() * pixRatio, geometry.y() * pixRatio, geometry.width() * pixRatio,
+                 geometry.height() * pixRatio);
+}
+
+/**
+ * @brief Returns the size of the frames, toxav needs even dimensions.
+ */
+static QSize scaledFrameSize(const QSize& regionSize, const QSize& maxSize)
+{
+    QSize size = regionSize;
+    if (size.width() > maxSize.width() || size.height() > maxSize.height()) {
+        size.scale(maxSize, Qt::KeepAspectRatio);
+    }
+
+    return {size.width() / 2 * 2, size.height() / 2 * 2};
+}
+
+/**
+ * @brief Creates a source for an area of the screen, capturing starts on the first subscriber.
+ *
+ * @param region Area to share in screen coordinates, the primary screen if empty.
+ * @param maxSize Frames are scaled down to fit into this size.
+ */
+ScreenSource::ScreenSource(const QRect& region, const QSize& maxSize)
+    : region{captureRegion(region)}
+    , frameSize{scaledFrameSize(this->region.size(), maxSize)}
+    , captureThread{new QThread}
+    , captureTimer{new QTimer(this)}
+    , scaler{nullptr}
+    , interval{MIN_INTERVAL_MS}
+    , framesCaptured{0}
+    , subscriptions{0}
+{
+    captureTimer->setTimerType(Qt::PreciseTimer);
+    connect(captureTimer, &QTimer::timeout, this, &ScreenSource::onCaptureTimeout);
+
+    captureThread->setObjectName("Screen capture thread");
+    captureThread->start();
+    moveToThread(captureThread);
+}
+
+ScreenSource::~ScreenSource()
+{
+    // The timer lives in the capture thread, it has to be stopped there
+    if (QThread::currentThread() == captureThread) {
+        stop();
+    } else {
+        QMetaObject::invokeMethod(this, "stop", Qt::BlockingQueuedConnection);
+    }
+
+    captureThread->exit(0);
+    captureThread->wait();
+    delete captureThread;
+
+    sws_freeContext(scaler);
+}
+
+/**
+ * @brief Checks whether the screen can be captured on this platform.
+ */
+bool ScreenSource::isSupported()
+{
+#ifdef QTOX_X11_SCREEN_CAPTURE
+    return Platform::X11ScreenGrabber::isSupported();
+#else
+    return false;
+#endif
+}
+
+void ScreenSource::subscribe()
+{
+    if (subscriptions++ == 0) {
+        QMetaObject::invokeMethod(this, "start");
+    }
+}
+
+void ScreenSource::unsubscribe()
+{
+    if (--subscriptions == 0) {
+        QMetaObject::invokeMethod(this, "stop");
+    }
+}
+
+QRect ScreenSource::getRegion() const
+{
+    return region;
+}
+
+QSize ScreenSource::getFrameSize() const
+{
+    return frameSize;
+}
+
+/**
+ * @brief Current time between two captures in milliseconds.
+ */
+int ScreenSource::getInterval() const
+{
+    return interval;
+}
+
+/**
+ * @brief Number of frames captured, without repeated frames.
+ */
+quint64 ScreenSource::getFramesCaptured() const
+{
+    return framesCaptured;
+}
+
+/**
+ * @brief Captures the screen and emits a frame if it changed since the last capture.
+ *
+ * Called periodically while subscribed, tests can call it directly instead.
+ *
+ * @return true if a frame was emitted, false if nothing changed or capturing failed.
+ */
+bool ScreenSource::captureFrame()
+{
+#ifdef QTOX_X11_SCREEN_CAPTURE
+    QMutexLocker locker{&captureMutex};
+
+    if (!grabber) {
+        grabber.reset(new Platform::X11ScreenGrabber(region));
+        if (!grabber->isValid()) {
+            qWarning() << "Can't capture screen region" << region;
+            grabber.reset();
+            return false;
+        }
+    }
+
+    if (grabber->grab().isEmpty()) {
+        return false;
+    }
+
+    scaler = sws_getCachedContext(scaler, region.width(), region.height(), AV_PIX_FMT_BGR0,
+                                  frameSize.width(), frameSize.height(), AV_PIX_FMT_YUV420P,
+                                  SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (!scaler) {
+        return false;
+    }
+
+    AVFrame* frame = av_frame_alloc();
+    if (!frame) {
+        return false;
+    }
+
+    frame->width = frameSize.width();
+    frame->height = frameSize.height();
+    frame->format = AV_PIX_FMT_YUV420P;
+
+    // No padding, so toxav can take the planes as they are
+    if (av_image_alloc(frame->data, frame->linesize, frameSize.width(), frameSize.height(),
+                       AV_PIX_FMT_YUV420P, 1)
+        < 0) {
+        av_frame_free(&frame);
+        return false;
+    }
+
+    const uint8_t* source[4] = {grabber->getData(), nullptr, nullptr, nullptr};
+    const int sourceStride[4] = {grabber->getStride(), 0, 0, 0};
+    sws_scale(scaler, source, sourceStride, 0, region.height(), frame->data, frame->linesize);
+
+    lastFrame = std::make_shared<VideoFrame>(id, frame, true);
+    lastFrameTime.start();
+    ++framesCaptured;
+
+    const std::shared_ptr<VideoFrame> emitted = lastFrame;
+    locker.unlock();
+
+    emit frameAvailable(emitted);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ScreenSource::start()
+{
+    interval = MIN_INTERVAL_MS;
+    captureTimer->start(interval);
+}
+
+void ScreenSource::stop()
+{
+    captureTimer->stop();
+
+    // Nobody is watching, don't keep the shared memory and damage tracking around
+    QMutexLocker locker{&captureMutex};
+    lastFrame.reset();
+#ifdef QTOX_X11_SCREEN_CAPTURE
+    grabber.reset();
+#endif
+}
+
+void ScreenSource::onCaptureTimeout()
+{
+    QElapsedTimer cost;
+    cost.start();
+
+    const bool changed = captureFrame();
+
+    if (!changed) {
+        QMutexLocker locker{&captureMutex};
+        if (lastFrame && lastFrameTime.elapsed() >= KEEPALIVE_MS) {
+            lastFrameTime.start();
+            const std::shared_ptr<VideoFrame> repeated = lastFrame;
+            locker.unlock();
+
+            emit frameAvailable(repeated);
+        }
+    }
+
+    adaptInterval(changed, cost.elapsed());
+    captureTimer->setInterval(interval);
+}
+
+/**
+ * @brief Captures faster while the screen changes and slower while it's still.
+ *
+ * @param changed Whether the last capture found a change.
+ * @param cost Time the last capture took in milliseconds.
+ */
+void ScreenSource::adaptInterval(bool changed, qint64 cost)
+{
+    int next = changed ? interval / 2 : interval * 3 / 2;
+    next = qBound(MIN_INTERVAL_MS, next, MAX_INTERVAL_MS);
+    next = qMax(next, static_cast<int>(qMin<qint64>(cost * COST_FACTOR, MAX_INTERVAL_MS)));
+    interval = next;
+}
@@ -0,0 +1,92 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCREENSOURCE_H
+#define SCREENSOURCE_H
+
+#include "videosource.h"
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QRect>
+#include <QSize>
+
+#include <atomic>
+#include <memory>
+
+namespace Platform {
+class X11ScreenGrabber;
+}
+
+class QThread;
+class QTimer;
+struct SwsContext;
+
+class ScreenSource : public VideoSource
+{
+    Q_OBJECT
+
+public:
+    explicit ScreenSource(const QRect& region, const QSize& maxSize = DEFAULT_MAX_SIZE);
+    ~ScreenSource();
+
+    static bool isSupported();
+
+    // VideoSource interface
+    virtual void subscribe() override;
+    virtual void unsubscribe() override;
+
+    QRect getRegion() const;
+    QSize getFrameSize() const;
+    int getInterval() const;
+    quint64 getFramesCaptured() const;
+
+    bool captureFrame();
+
+public:
+    static const QSize DEFAULT_MAX_SIZE;
+
+private slots:
+    void start();
+    void stop();
+    void onCaptureTimeout();
+
+private:
+    void adaptInterval(bool changed, qint64 cost);
+
+private:
+    const QRect region;
+    const QSize frameSize;
+    QThread* captureThread;
+    QTimer* captureTimer;
+
+    QMutex captureMutex;
+#ifdef QTOX_X11_SCREEN_CAPTURE
+    std::unique_ptr<Platform::X11ScreenGrabber> grabber;
+#endif
+    SwsContext* scaler;
+    std::shared_ptr<VideoFrame> lastFrame;
+    QElapsedTimer lastFrameTime;
+
+    std::atomic_int interval;
+    std::atomic<quint64> framesCaptured;
+    std::atomic_int subscriptions;
+};
+
+#endif // SCREENSOURCE_H
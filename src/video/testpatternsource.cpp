@@ -0,0 +1,217 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "testpatternsource.h"
+#include "videoframe.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+#include <QDebug>
+#include <QMutexLocker>
+
+/**
+ * @class TestPatternSource
+ * @brief A VideoSource that emits a moving test pattern, for testing without a camera.
+ *
+ * While subscribed, frames are emitted at the given rate from the thread the source lives in,
+ * which needs an event loop. Benchmarks can call generateFrame() directly instead, it emits a
+ * frame synchronously whether subscribed or not.
+ *
+ * The pattern is rendered once for a cycle of frames in the requested pixel format, afterwards
+ * each frame only costs a copy into a new buffer, like a camera delivers it.
+ *
+ * @var TestPatternSource::patterns
+ * @brief The rendered frames of one cycle, copied into every emitted frame
+ *
+ * @var TestPatternSource::framesGenerated
+ * @brief Number of frames emitted so far
+ */
+
+namespace {
+/// Frames until the pattern repeats
+const int PATTERN_FRAMES = 30;
+/// Colors of the vertical bars, in RGB
+const uint8_t BAR_COLORS[][3] = {{192, 192, 192}, {192, 192, 0}, {0, 192, 192}, {0, 192, 0},
+                                 {192, 0, 192},   {192, 0, 0},   {0, 0, 192},   {16, 16, 16}};
+const int BAR_COUNT = sizeof(BAR_COLORS) / sizeof(BAR_COLORS[0]);
+}
+
+/**
+ * @brief Creates a source of the given format, the pattern is rendered right away.
+ *
+ * @param size Size of the frames.
+ * @param fps Frames per second to emit while subscribed.
+ * @param pixFmt Pixel format of the frames, any format swscale can convert to.
+ */
+TestPatternSource::TestPatternSource(QSize size, int fps, int pixFmt)
+    : size{size}
+    , fps{qMax(1, fps)}
+    , pixFmt{pixFmt}
+    , nextPattern{0}
+    , framesGenerated{0}
+    , subscribers{0}
+{
+    renderPatterns();
+
+    frameTimer.setTimerType(Qt::PreciseTimer);
+    frameTimer.setInterval(1000 / this->fps);
+    connect(&frameTimer, &QTimer::timeout, this, &TestPatternSource::generateFrame);
+}
+
+TestPatternSource::~TestPatternSource()
+{
+    for (AVFrame* pattern : patterns) {
+        av_freep(&pattern->data[0]);
+        av_frame_free(&pattern);
+    }
+}
+
+/**
+ * @brief Starts emitting frames on the first subscription.
+ * @note Must be called from the thread the source lives in, like unsubscribe().
+ */
+void TestPatternSource::subscribe()
+{
+    QMutexLocker locker{&biglock};
+    if (subscribers++ == 0) {
+        frameTimer.start();
+    }
+}
+
+void TestPatternSource::unsubscribe()
+{
+    QMutexLocker locker{&biglock};
+    if (--subscribers == 0) {
+        frameTimer.stop();
+        emit sourceStopped();
+    }
+}
+
+QSize TestPatternSource::getSize() const
+{
+    return size;
+}
+
+int TestPatternSource::getFps() const
+{
+    return fps;
+}
+
+int TestPatternSource::getPixelFormat() const
+{
+    return pixFmt;
+}
+
+quint64 TestPatternSource::getFramesGenerated() const
+{
+    return framesGenerated;
+}
+
+/**
+ * @brief Emits the next frame of the pattern in a newly allocated buffer.
+ */
+void TestPatternSource::generateFrame()
+{
+    if (patterns.isEmpty()) {
+        return;
+    }
+
+    const AVFrame* pattern = patterns[nextPattern];
+    nextPattern = (nextPattern + 1) % patterns.size();
+
+    AVFrame* frame = av_frame_alloc();
+    if (!frame) {
+        return;
+    }
+
+    frame->width = size.width();
+    frame->height = size.height();
+    frame->format = pixFmt;
+
+    if (av_image_alloc(frame->data, frame->linesize, size.width(), size.height(),
+                       static_cast<AVPixelFormat>(pixFmt), VideoFrame::dataAlignment)
+        < 0) {
+        av_frame_free(&frame);
+        return;
+    }
+
+    av_image_copy(frame->data, frame->linesize, const_cast<const uint8_t**>(pattern->data),
+                  pattern->linesize, static_cast<AVPixelFormat>(pixFmt), size.width(),
+                  size.height());
+
+    ++framesGenerated;
+    emit frameAvailable(std::make_shared<VideoFrame>(id, frame, true));
+}
+
+/**
+ * @brief Renders color bars moving to the right, with a bright line moving down.
+ */
+void TestPatternSource::renderPatterns()
+{
+    const int width = size.width();
+    const int height = size.height();
+
+    SwsContext* swsCtx =
+        sws_getContext(width, height, AV_PIX_FMT_RGB24, width, height,
+                       static_cast<AVPixelFormat>(pixFmt), SWS_POINT, nullptr, nullptr, nullptr);
+    if (!swsCtx) {
+        qWarning() << "Can't render test pattern of size" << size << "and format" << pixFmt;
+        return;
+    }
+
+    QVector<uint8_t> rgb(width * height * 3);
+    const int rgbStride = width * 3;
+
+    for (int i = 0; i < PATTERN_FRAMES; ++i) {
+        const int shift = i * width / PATTERN_FRAMES;
+        const int line = i * height / PATTERN_FRAMES;
+
+        for (int y = 0; y < height; ++y) {
+            uint8_t* row = rgb.data() + y * rgbStride;
+            for (int x = 0; x < width; ++x) {
+                const uint8_t* color = BAR_COLORS[(x + shift) % width * BAR_COUNT / width];
+                const uint8_t boost = y == line ? 63 : 0;
+                row[x * 3] = color[0] + boost;
+                row[x * 3 + 1] = color[1] + boost;
+                row[x * 3 + 2] = color[2] + boost;
+            }
+        }
+
+        AVFrame* pattern = av_frame_alloc();
+        if (!pattern) {
+            break;
+        }
+
+        if (av_image_alloc(pattern->data, pattern->linesize, width, height,
+                           static_cast<AVPixelFormat>(pixFmt), VideoFrame::dataAlignment)
+            < 0) {
+            av_frame_free(&pattern);
+            break;
+        }
+
+        const uint8_t* src[] = {rgb.constData()};
+        sws_scale(swsCtx, src, &rgbStride, 0, height, pattern->data, pattern->linesize);
+        patterns << pattern;
+    }
+
+    sws_freeContext(swsCtx);
+}
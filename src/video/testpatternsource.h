@@ -0,0 +1,71 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TESTPATTERNSOURCE_H
+#define TESTPATTERNSOURCE_H
+
+#include "videosource.h"
+
+#include <QMutex>
+#include <QSize>
+#include <QTimer>
+#include <QVector>
+
+#include <atomic>
+
+struct AVFrame;
+
+class TestPatternSource : public VideoSource
+{
+    Q_OBJECT
+
+public:
+    TestPatternSource(QSize size, int fps, int pixFmt);
+    ~TestPatternSource();
+
+    // VideoSource interface
+    virtual void subscribe() override;
+    virtual void unsubscribe() override;
+
+    QSize getSize() const;
+    int getFps() const;
+    int getPixelFormat() const;
+    quint64 getFramesGenerated() const;
+
+public slots:
+    void generateFrame();
+
+private:
+    void renderPatterns();
+
+private:
+    const QSize size;
+    const int fps;
+    const int pixFmt;
+
+    QVector<AVFrame*> patterns;
+    int nextPattern;
+    std::atomic<quint64> framesGenerated;
+
+    QMutex biglock;
+    int subscribers;
+    QTimer frameTimer;
+};
+
+#endif // TESTPATTERNSOURCE_H
@@ -0,0 +1,232 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "videocompositor.h"
+#include "videoframe.h"
+
+extern "C" {
+#include <libswscale/swscale.h>
+}
+
+#include <QPainter>
+
+/**
+ * @class VideoCompositor
+ * @brief Renders the latest frames of several video tiles into one image.
+ *
+ * Views showing many videos at once, like a conference, can draw all tiles in one pass instead
+ * of having one widget per video scale and paint on its own. Every frame is scaled straight from
+ * its source planes into the backing image, without an intermediate image per tile. Tiles of the
+ * same size showing sources of the same format share a scaling context.
+ *
+ * Frames are letterboxed in their tile. Tiles without a frame, or whose frame was invalidated by
+ * its source, show their placeholder, e.g. the avatar of the peer.
+ *
+ * Not thread safe, use it from the thread that paints.
+ *
+ * @var VideoCompositor::scalers
+ * @brief Scaling contexts, most recently used last
+ *
+ * @var VideoCompositor::backing
+ * @brief The composited image, reused between calls of the same size
+ */
+
+namespace {
+/// Scaling contexts kept around, one per distinct tile size and source format is enough
+const int MAX_SCALERS = 8;
+/// Tiles start at a multiple of this many pixels, so the scaler writes aligned rows
+const int TILE_ALIGNMENT = 4;
+}
+
+VideoCompositor::VideoCompositor()
+{
+}
+
+VideoCompositor::~VideoCompositor()
+{
+    for (const Scaler& scaler : scalers) {
+        sws_freeContext(scaler.context);
+    }
+}
+
+/**
+ * @brief Adds a tile or moves an existing one.
+ *
+ * @param id Identifies the tile, e.g. the peer it shows.
+ * @param rect Area of the tile in the composited image.
+ */
+void VideoCompositor::setTile(int id, const QRect& rect)
+{
+    tiles[id].rect = rect;
+}
+
+void VideoCompositor::removeTile(int id)
+{
+    tiles.remove(id);
+}
+
+void VideoCompositor::clear()
+{
+    tiles.clear();
+}
+
+/**
+ * @brief Sets the frame a tile shows from now on, nullptr to show its placeholder.
+ */
+void VideoCompositor::setFrame(int id, std::shared_ptr<VideoFrame> frame)
+{
+    auto tile = tiles.find(id);
+    if (tile != tiles.end()) {
+        tile->frame = std::move(frame);
+    }
+}
+
+/**
+ * @brief Sets the image shown by a tile while it has no frame.
+ */
+void VideoCompositor::setPlaceholder(int id, const QImage& image)
+{
+    auto tile = tiles.find(id);
+    if (tile != tiles.end()) {
+        tile->placeholder = image;
+    }
+}
+
+/**
+ * @brief Renders all tiles.
+ *
+ * @param size Size of the image, usually the size of the view.
+ * @return The composited image, valid until the next call.
+ */
+const QImage& VideoCompositor::compose(const QSize& size)
+{
+    if (backing.size() != size) {
+        backing = QImage{size, QImage::Format_RGB32};
+    }
+
+    backing.fill(Qt::black);
+
+    // Placeholders are drawn afterwards with a single painter
+    QVector<const Tile*> placeholders;
+
+    for (auto it = tiles.begin(); it != tiles.end(); ++it) {
+        Tile& tile = it.value();
+
+        if (tile.frame && !drawFrame(tile.frame, tile.rect)) {
+            // The source invalidated the frame
+            tile.frame.reset();
+        }
+
+        if (!tile.frame && !tile.placeholder.isNull()) {
+            placeholders << &tile;
+        }
+    }
+
+    if (!placeholders.isEmpty()) {
+        QPainter painter{&backing};
+        painter.setRenderHint(QPainter::SmoothPixmapTransform);
+        for (const Tile* tile : placeholders) {
+            painter.drawImage(tile->rect, tile->placeholder);
+        }
+    }
+
+    return backing;
+}
+
+/**
+ * @brief Number of scaling contexts currently kept.
+ */
+int VideoCompositor::getScalerCount() const
+{
+    return scalers.size();
+}
+
+/**
+ * @brief Scales a frame into its tile of the backing image, keeping its aspect ratio.
+ *
+ * @return false if the frame is no longer valid, true otherwise.
+ */
+bool VideoCompositor::drawFrame(const std::shared_ptr<VideoFrame>& frame, const QRect& rect)
+{
+    const QSize sourceSize = frame->getSourceDimensions().size();
+    const int pixelFormat = frame->getSourcePixelFormat();
+
+    const QRect area = rect & backing.rect();
+    const QSize targetSize = sourceSize.scaled(area.size(), Qt::KeepAspectRatio);
+    if (targetSize.isEmpty()) {
+        return frame->isValid();
+    }
+
+    int x = area.x() + (area.width() - targetSize.width()) / 2;
+    x -= x % TILE_ALIGNMENT;
+    const int y = area.y() + (area.height() - targetSize.height()) / 2;
+
+    SwsContext* scaler = getScaler(sourceSize, pixelFormat, targetSize);
+    if (!scaler) {
+        return frame->isValid();
+    }
+
+    // QImage::Format_RGB32 has the byte order of AV_PIX_FMT_RGB32 on every platform
+    uint8_t* target[4] = {backing.bits() + y * backing.bytesPerLine() + x * 4, nullptr, nullptr,
+                          nullptr};
+    int targetLinesize[4] = {backing.bytesPerLine(), 0, 0, 0};
+
+    // The source frame itself, no conversion happens here. It's scaled while the frame holds it,
+    // the source may free it as soon as the reader returns.
+    return frame->readAVFrame(sourceSize, pixelFormat, false, [&](const AVFrame* source) {
+        sws_scale(scaler, source->data, source->linesize, 0, sourceSize.height(), target,
+                  targetLinesize);
+    });
+}
+
+/**
+ * @brief Finds or creates a scaling context to the backing image's format.
+ */
+SwsContext* VideoCompositor::getScaler(const QSize& sourceSize, int pixelFormat,
+                                       const QSize& targetSize)
+{
+    for (int i = 0; i < scalers.size(); ++i) {
+        const Scaler& scaler = scalers[i];
+        if (scaler.sourceSize == sourceSize && scaler.pixelFormat == pixelFormat
+            && scaler.targetSize == targetSize) {
+            // Keep the order of use, so the least recently used context is evicted first
+            scalers.append(scalers.takeAt(i));
+            return scalers.last().context;
+        }
+    }
+
+    // Bilinear is better for shrinking, bicubic better for upscaling
+    const int resizeAlgo = sourceSize.width() > targetSize.width() ? SWS_BILINEAR : SWS_BICUBIC;
+
+    SwsContext* context =
+        sws_getContext(sourceSize.width(), sourceSize.height(),
+                       static_cast<AVPixelFormat>(pixelFormat), targetSize.width(),
+                       targetSize.height(), AV_PIX_FMT_RGB32, resizeAlgo, nullptr, nullptr, nullptr);
+
+    if (!context) {
+        return nullptr;
+    }
+
+    if (scalers.size() >= MAX_SCALERS) {
+        sws_freeContext(scalers.takeFirst().context);
+    }
+
+    scalers.append(Scaler{sourceSize, pixelFormat, targetSize, context});
+    return context;
+}
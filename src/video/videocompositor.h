@@ -0,0 +1,79 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VIDEOCOMPOSITOR_H
+#define VIDEOCOMPOSITOR_H
+
+#include <QImage>
+#include <QMap>
+#include <QRect>
+#include <QSize>
+#include <QVector>
+
+#include <memory>
+
+struct SwsContext;
+class VideoFrame;
+
+class VideoCompositor
+{
+public:
+    VideoCompositor();
+    ~VideoCompositor();
+
+    VideoCompositor(const VideoCompositor&) = delete;
+    VideoCompositor& operator=(const VideoCompositor&) = delete;
+
+    void setTile(int id, const QRect& rect);
+    void removeTile(int id);
+    void clear();
+
+    void setFrame(int id, std::shared_ptr<VideoFrame> frame);
+    void setPlaceholder(int id, const QImage& image);
+
+    const QImage& compose(const QSize& size);
+
+    int getScalerCount() const;
+
+private:
+    struct Tile
+    {
+        QRect rect;
+        std::shared_ptr<VideoFrame> frame;
+        QImage placeholder;
+    };
+
+    struct Scaler
+    {
+        QSize sourceSize;
+        int pixelFormat;
+        QSize targetSize;
+        SwsContext* context;
+    };
+
+    bool drawFrame(const std::shared_ptr<VideoFrame>& frame, const QRect& rect);
+    SwsContext* getScaler(const QSize& sourceSize, int pixelFormat, const QSize& targetSize);
+
+private:
+    QMap<int, Tile> tiles;
+    QVector<Scaler> scalers;
+    QImage backing;
+};
+
+#endif // VIDEOCOMPOSITOR_H
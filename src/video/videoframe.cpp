@@ -18,6 +18,11 @@
 */
 
 #include "videoframe.h"
+#include "videoframepool.h"
+
+#include <QThread>
+
+#include <chrono>
 
 extern "C" {
 #include <libavutil/imgutils.h>
@@ -46,9 +51,17 @@ extern "C" {
  * references to the frame data become invalid when the VideoFrame is deleted. We try to avoid
  * pixel format conversions as much as possible, at the cost of some memory.
  *
+ * Converted frames are taken from and given back to the VideoFramePool, so their buffers are
+ * reused for the following frames of the same size and format.
+ *
  * Every function in this class is thread safe apart from concurrent construction and deletion of
  * the object.
  *
+ * A source that has to invalidate its frames before freeing the memory they point to, like the
+ * decoder of a camera, tracks them with a SourceGeneration. Generations are per source and the
+ * VideoFramePool locks per frame geometry, so sources don't contend with each other while their
+ * frames are created, converted or deleted.
+ *
  * This class uses the phrase "frame alignment" to specify the property that each frame's width is
  * equal to it's maximum linesize. Note: this is NOT "data alignment" which specifies how allocated
  * buffers are aligned in memory. Though internally the two are related, unless otherwise specified
@@ -67,6 +80,22 @@ extern "C" {
  * It's currently set to 32-byte alignment for AVX2 support.
  *
  *
+ * @class VideoFrame::SourceGeneration
+ * @brief Invalidates all frames of a source at once.
+ *
+ * Frames remember the generation of their source when they're tracked. Advancing the generation
+ * makes all earlier frames invalid without visiting them, they release their buffers on their
+ * next use or when deleted. Conversions register themselves while they read the source frame,
+ * so advance() can wait for those that started before it.
+ *
+ * @enum VideoFrame::Stage
+ * @brief Points in the life of a frame that are timestamped, see markStage().
+ *
+ * Capture is when the frame was created by its source. Convert and Send are when it was
+ * converted for and handed to toxav, Receive is when a frame of a peer was received, and Paint
+ * when it was first painted.
+ *
+ *
  * @class FrameBufferKey
  * @brief A class representing a structure that stores frame properties to be used as the key
  * value for a std::unordered_map.
@@ -75,11 +104,30 @@ extern "C" {
 // Initialize static fields
 VideoFrame::AtomicIDType VideoFrame::frameIDs{0};
 
-std::unordered_map<VideoFrame::IDType, QMutex> VideoFrame::mutexMap{};
-std::unordered_map<VideoFrame::IDType, std::unordered_map<VideoFrame::IDType, std::weak_ptr<VideoFrame>>>
-    VideoFrame::refsMap{};
+/**
+ * @brief Constructs the generation tracker of a source, starting at the first generation.
+ */
+VideoFrame::SourceGeneration::SourceGeneration()
+    : generation{0}
+    , activeConversions{0}
+{
+}
 
-QReadWriteLock VideoFrame::refsLock{};
+/**
+ * @brief Invalidates all frames tracked so far.
+ *
+ * Blocks until conversions of those frames that are in progress are done, afterwards none of them
+ * accesses its source frame anymore. Frames tracked from now on belong to the new generation.
+ */
+void VideoFrame::SourceGeneration::advance()
+{
+    ++generation;
+
+    // Conversions that missed the new generation have registered before we read this
+    while (activeConversions.load() > 0) {
+        QThread::yieldCurrentThread();
+    }
+}
 
 /**
  * @brief Constructs a new instance of a VideoFrame, sourced by a given AVFrame pointer.
@@ -95,47 +143,25 @@ VideoFrame::VideoFrame(IDType sourceID, AVFrame* sourceFrame, QRect dimensions,
     : frameID(frameIDs++)
     , sourceID(sourceID)
     , sourceDimensions(dimensions)
-    , sourceFrameKey(getFrameKey(dimensions.size(), pixFmt, sourceFrame->linesize[0]))
+    , sourcePixelFormat(getCanonicalPixelFormat(pixFmt))
+    , sourceFrameKey(getFrameKey(dimensions.size(), sourcePixelFormat,
+                                 isFrameAligned(sourceFrame, dimensions.size(), sourcePixelFormat)))
     , freeSourceFrame(freeSourceFrame)
+    , generation(0)
 {
-
-    // We override the pixel format in the case a deprecated one is used
-    switch (pixFmt) {
-    case AV_PIX_FMT_YUVJ420P: {
-        sourcePixelFormat = AV_PIX_FMT_YUV420P;
-        sourceFrame->color_range = AVCOL_RANGE_MPEG;
-        break;
-    }
-
-    case AV_PIX_FMT_YUVJ411P: {
-        sourcePixelFormat = AV_PIX_FMT_YUV411P;
-        sourceFrame->color_range = AVCOL_RANGE_MPEG;
-        break;
+    for (std::atomic<qint64>& stageTime : stageTimes) {
+        stageTime = 0;
     }
 
-    case AV_PIX_FMT_YUVJ422P: {
-        sourcePixelFormat = AV_PIX_FMT_YUV422P;
-        sourceFrame->color_range = AVCOL_RANGE_MPEG;
-        break;
-    }
+    stageTimes[static_cast<int>(Stage::Capture)] = monotonicTime();
 
-    case AV_PIX_FMT_YUVJ444P: {
-        sourcePixelFormat = AV_PIX_FMT_YUV444P;
+    // The source frame is stored under its canonical format, so a camera delivering YUVJ420P at
+    // the right size is handed to toxav without conversion
+    if (sourcePixelFormat != pixFmt) {
         sourceFrame->color_range = AVCOL_RANGE_MPEG;
-        break;
-    }
-
-    case AV_PIX_FMT_YUVJ440P: {
-        sourcePixelFormat = AV_PIX_FMT_YUV440P;
-        sourceFrame->color_range = AVCOL_RANGE_MPEG;
-        break;
-    }
-
-    default: {
-        sourcePixelFormat = pixFmt;
+    } else {
         sourceFrame->color_range = AVCOL_RANGE_UNSPECIFIED;
     }
-    }
 
     frameBuffer[sourceFrameKey] = sourceFrame;
 }
@@ -157,115 +183,40 @@ VideoFrame::~VideoFrame()
     deleteFrameBuffer();
 
     frameLock.unlock();
-
-    // Delete tracked reference
-    refsLock.lockForRead();
-
-    if (refsMap.count(sourceID) > 0) {
-        QMutex& sourceMutex = mutexMap[sourceID];
-
-        sourceMutex.lock();
-        refsMap[sourceID].erase(frameID);
-        sourceMutex.unlock();
-    }
-
-    refsLock.unlock();
 }
 
 /**
  * @brief Returns the validity of this VideoFrame.
  *
  * A VideoFrame is valid if it manages at least one AVFrame. A VideoFrame can be invalidated
- * by calling releaseFrame() on it.
+ * by calling releaseFrame() on it, or by advancing the generation of its source.
  *
  * @return true if the VideoFrame is valid, false otherwise.
  */
 bool VideoFrame::isValid()
 {
     frameLock.lockForRead();
-    bool retValue = frameBuffer.size() > 0;
+    bool retValue = frameBuffer.size() > 0 && isCurrentGeneration();
     frameLock.unlock();
 
     return retValue;
 }
 
 /**
- * @brief Causes the VideoFrame class to maintain an internal reference for the frame.
- *
- * The internal reference is managed via a std::weak_ptr such that it doesn't inhibit
- * destruction of the object once all external references are no longer reachable.
- *
- * @return a std::shared_ptr holding a reference to this frame.
- */
-std::shared_ptr<VideoFrame> VideoFrame::trackFrame()
-{
-    // Add frame to tracked reference list
-    refsLock.lockForRead();
-
-    if (refsMap.count(sourceID) == 0) {
-        // We need to add a new source to our reference map, obtain write lock
-        refsLock.unlock();
-        refsLock.lockForWrite();
-    }
-
-    QMutex& sourceMutex = mutexMap[sourceID];
-
-    sourceMutex.lock();
-
-    std::shared_ptr<VideoFrame> ret{this};
-
-    refsMap[sourceID][frameID] = ret;
-
-    sourceMutex.unlock();
-    refsLock.unlock();
-
-    return ret;
-}
-
-/**
- * @brief Untracks all the frames for the given VideoSource, releasing them if specified.
+ * @brief Ties the frame to the current generation of its source and hands it out.
  *
- * This function causes all internally tracked frames for the given VideoSource to be dropped.
- * If the releaseFrames option is set to true, the frames are sequentially released on the
- * caller's thread in an unspecified order.
+ * Must be called right after construction, before the frame is shared with other threads.
  *
- * @param sourceID the ID of the VideoSource to untrack frames from.
- * @param releaseFrames true to release the frames as necessary, false otherwise. Defaults to
- * false.
+ * @param sourceGeneration the generation tracker of the source that created this frame.
+ * @return a std::shared_ptr owning this frame.
  */
-void VideoFrame::untrackFrames(const VideoFrame::IDType& sourceID, bool releaseFrames)
+std::shared_ptr<VideoFrame>
+VideoFrame::trackFrame(const std::shared_ptr<SourceGeneration>& sourceGeneration)
 {
-    refsLock.lockForWrite();
-
-    if (refsMap.count(sourceID) == 0) {
-        // No tracking reference exists for source, simply return
-        refsLock.unlock();
-
-        return;
-    }
-
-    if (releaseFrames) {
-        QMutex& sourceMutex = mutexMap[sourceID];
-
-        sourceMutex.lock();
-
-        for (auto& frameIterator : refsMap[sourceID]) {
-            std::shared_ptr<VideoFrame> frame = frameIterator.second.lock();
+    this->sourceGeneration = sourceGeneration;
+    generation = sourceGeneration->generation.load();
 
-            if (frame) {
-                frame->releaseFrame();
-            }
-        }
-
-        sourceMutex.unlock();
-    }
-
-    refsMap[sourceID].clear();
-
-    mutexMap.erase(sourceID);
-    refsMap.erase(sourceID);
-
-    refsLock.unlock();
+    return std::shared_ptr<VideoFrame>{this};
 }
 
 /**
@@ -292,6 +243,9 @@ void VideoFrame::releaseFrame()
  * @param requireAligned true if the returned frame must be frame aligned, false if not.
  * @return a pointer to a AVFrame with the given parameters or nullptr if the VideoFrame is no
  * longer valid.
+ *
+ * @note The returned frame is freed as soon as the source invalidates this VideoFrame, use
+ * readAVFrame() to access its planes while the source may do so.
  */
 const AVFrame* VideoFrame::getAVFrame(QSize frameSize, const int pixelFormat, const bool requireAligned)
 {
@@ -311,6 +265,35 @@ const AVFrame* VideoFrame::getAVFrame(QSize frameSize, const int pixelFormat, co
     return toGenericObject(frameSize, pixelFormat, requireAligned, converter, nullPointer);
 }
 
+/**
+ * @brief Passes an AVFrame derived from the source based on the given parameters to a reader.
+ *
+ * Unlike the frame returned by getAVFrame(), the frame stays valid until the reader returns,
+ * invalidating this VideoFrame through its source waits for the reader to finish.
+ *
+ * @param frameSize the dimensions of the frame to read. Defaults to source frame size if
+ * frameSize is invalid.
+ * @param pixelFormat the desired pixel format of the frame.
+ * @param requireAligned true if the frame must be frame aligned, false if not.
+ * @param reader called with the frame, must not keep pointers into its planes.
+ * @return true if the reader was called, false if the VideoFrame is no longer valid.
+ */
+bool VideoFrame::readAVFrame(QSize frameSize, const int pixelFormat, const bool requireAligned,
+                             const std::function<void(const AVFrame*)>& reader)
+{
+    if (!frameSize.isValid()) {
+        frameSize = sourceDimensions.size();
+    }
+
+    // Runs under the frame lock and within the conversion, like the other converters
+    const std::function<bool(AVFrame * const)> converter = [&](AVFrame* const frame) {
+        reader(frame);
+        return true;
+    };
+
+    return toGenericObject(frameSize, pixelFormat, requireAligned, converter, false);
+}
+
 /**
  * @brief Converts this VideoFrame to a QImage that shares this VideoFrame's buffer.
  *
@@ -344,10 +327,17 @@ QImage VideoFrame::toQImage(QSize frameSize)
  * The given ToxAVFrame will be frame aligned under a pixel format of planar YUV with a chroma
  * subsampling format of 4:2:0 (i.e. AV_PIX_FMT_YUV420P).
  *
+ * A source frame that already is YUV420P of the requested size is passed through as is when
+ * its planes have no padding, and only copied otherwise.
+ *
  * @param frameSize the given frame size of ToxAVFrame to generate. Defaults to source frame size
  * if frameSize is invalid.
  * @return a ToxAVFrame structure that represents this VideoFrame, sharing it's buffers or an
  * empty structure if this VideoFrame is no longer valid.
+ *
+ * @note Like the frame returned by getAVFrame(), the planes are only valid while the source
+ * can't invalidate this VideoFrame, e.g. if it owns its frames. Frames tracked by a
+ * SourceGeneration must be read with readAVFrame() instead.
  */
 ToxYUVFrame VideoFrame::toToxYUVFrame(QSize frameSize)
 {
@@ -411,6 +401,56 @@ int VideoFrame::getSourcePixelFormat() const
 }
 
 
+/**
+ * @brief Records that the frame reached a stage, only the first time counts.
+ *
+ * @param stage the stage reached.
+ * @return true if the stage wasn't reached before, false otherwise.
+ */
+bool VideoFrame::markStage(Stage stage)
+{
+    qint64 unset = 0;
+    return stageTimes[static_cast<int>(stage)].compare_exchange_strong(unset, monotonicTime());
+}
+
+/**
+ * @brief Returns when the frame reached a stage.
+ *
+ * @param stage the stage to look up.
+ * @return the time from monotonicTime(), or 0 if the stage wasn't reached yet.
+ */
+qint64 VideoFrame::getStageTime(Stage stage) const
+{
+    return stageTimes[static_cast<int>(stage)];
+}
+
+/**
+ * @brief Sets the latency statistics of the call the frame belongs to.
+ *
+ * Must be called right after construction, before the frame is shared with other threads.
+ */
+void VideoFrame::setLatency(const std::shared_ptr<VideoLatency>& latency)
+{
+    this->latency = latency;
+}
+
+/**
+ * @brief Returns the latency statistics of the call the frame belongs to, if any.
+ */
+std::shared_ptr<VideoLatency> VideoFrame::getLatency() const
+{
+    return latency;
+}
+
+/**
+ * @brief Returns a monotonic timestamp in nanoseconds, for stage times.
+ */
+qint64 VideoFrame::monotonicTime()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
 /**
  * @brief Constructs a new FrameBufferKey with the given attributes.
  *
@@ -482,27 +522,65 @@ size_t VideoFrame::FrameBufferKey::hash(const FrameBufferKey& key)
  *
  * @param frameSize the given size of the frame.
  * @param pixFmt the pixel format of the frame.
- * @param linesize the maximum linesize of the frame, may be larger than the width.
+ * @param frameAligned true if the frame is aligned, false otherwise.
  * @return a FrameBufferKey object representing the key for the frameBuffer map.
  */
 VideoFrame::FrameBufferKey VideoFrame::getFrameKey(const QSize& frameSize, const int pixFmt,
-                                                   const int linesize)
+                                                   const bool frameAligned)
 {
-    return getFrameKey(frameSize, pixFmt, frameSize.width() == linesize);
+    return {frameSize.width(), frameSize.height(), pixFmt, frameAligned};
 }
 
 /**
- * @brief Generates a key object based on given parameters.
+ * @brief Maps the deprecated full range YUVJ formats to the YUV format with the same layout.
  *
- * @param frameSize the given size of the frame.
+ * @param pixFmt the pixel format to map.
+ * @return the pixel format the frame is handled as.
+ */
+int VideoFrame::getCanonicalPixelFormat(const int pixFmt)
+{
+    switch (pixFmt) {
+    case AV_PIX_FMT_YUVJ420P:
+        return AV_PIX_FMT_YUV420P;
+    case AV_PIX_FMT_YUVJ411P:
+        return AV_PIX_FMT_YUV411P;
+    case AV_PIX_FMT_YUVJ422P:
+        return AV_PIX_FMT_YUV422P;
+    case AV_PIX_FMT_YUVJ444P:
+        return AV_PIX_FMT_YUV444P;
+    case AV_PIX_FMT_YUVJ440P:
+        return AV_PIX_FMT_YUV440P;
+    default:
+        return pixFmt;
+    }
+}
+
+/**
+ * @brief Checks whether every plane of a frame is frame aligned.
+ *
+ * Checking only the first plane isn't enough, decoders may pad the chroma planes of a frame whose
+ * luma plane has no padding.
+ *
+ * @param frame the frame to check.
+ * @param frameSize the size of the frame.
  * @param pixFmt the pixel format of the frame.
- * @param frameAligned true if the frame is aligned, false otherwise.
- * @return a FrameBufferKey object representing the key for the frameBuffer map.
+ * @return true if the linesize of each plane matches its width, false otherwise.
  */
-VideoFrame::FrameBufferKey VideoFrame::getFrameKey(const QSize& frameSize, const int pixFmt,
-                                                   const bool frameAligned)
+bool VideoFrame::isFrameAligned(const AVFrame* frame, const QSize& frameSize, const int pixFmt)
 {
-    return {frameSize.width(), frameSize.height(), pixFmt, frameAligned};
+    int linesizes[4];
+    if (av_image_fill_linesizes(linesizes, static_cast<AVPixelFormat>(pixFmt), frameSize.width())
+        < 0) {
+        return false;
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        if (linesizes[i] && frame->linesize[i] != linesizes[i]) {
+            return false;
+        }
+    }
+
+    return true;
 }
 
 /**
@@ -557,37 +635,43 @@ AVFrame* VideoFrame::retrieveAVFrame(const QSize& dimensions, const int pixelFor
 AVFrame* VideoFrame::generateAVFrame(const QSize& dimensions, const int pixelFormat,
                                      const bool requireAligned)
 {
-    AVFrame* ret = av_frame_alloc();
-
-    if (!ret) {
-        return nullptr;
-    }
-
-    // Populate AVFrame fields
-    ret->width = dimensions.width();
-    ret->height = dimensions.height();
-    ret->format = pixelFormat;
-
     /*
      * We generate a frame under data alignment only if the dimensions allow us to be frame aligned
      * or if the caller doesn't require frame alignment
      */
 
-    int bufSize;
+    int alignment = dataAlignment;
 
-    if (!requireAligned || (dimensions.width() % 8 == 0 && dimensions.height() % 8 == 0)) {
-        bufSize = av_image_alloc(ret->data, ret->linesize, dimensions.width(), dimensions.height(),
-                                 static_cast<AVPixelFormat>(pixelFormat), dataAlignment);
-    } else {
-        bufSize = av_image_alloc(ret->data, ret->linesize, dimensions.width(), dimensions.height(),
-                                 static_cast<AVPixelFormat>(pixelFormat), 1);
+    if (requireAligned) {
+        int linesizes[4];
+        av_image_fill_linesizes(linesizes, static_cast<AVPixelFormat>(pixelFormat),
+                                dimensions.width());
+
+        for (int i = 0; i < 4; ++i) {
+            if (linesizes[i] % dataAlignment != 0) {
+                alignment = 1;
+            }
+        }
     }
 
-    if (bufSize < 0) {
-        av_frame_free(&ret);
+    VideoFramePool& pool = VideoFramePool::getInstance();
+    AVFrame* ret = pool.acquire(dimensions.width(), dimensions.height(), pixelFormat, alignment);
+
+    if (!ret) {
         return nullptr;
     }
 
+    AVFrame* source = frameBuffer[sourceFrameKey];
+
+    // Only the layout differs, e.g. a padded source for toxav, copying is enough
+    if (dimensions == sourceDimensions.size() && pixelFormat == sourcePixelFormat) {
+        av_image_copy(ret->data, ret->linesize, const_cast<const uint8_t**>(source->data),
+                      source->linesize, static_cast<AVPixelFormat>(pixelFormat),
+                      dimensions.width(), dimensions.height());
+
+        return ret;
+    }
+
     // Bilinear is better for shrinking, bicubic better for upscaling
     int resizeAlgo = sourceDimensions.width() > dimensions.width() ? SWS_BILINEAR : SWS_BICUBIC;
 
@@ -598,16 +682,10 @@ AVFrame* VideoFrame::generateAVFrame(const QSize& dimensions, const int pixelFor
                        nullptr, nullptr, nullptr);
 
     if (!swsCtx) {
-        av_freep(&ret->data[0]);
-#if LIBAVCODEC_VERSION_INT < 3747941
-        av_frame_unref(ret);
-#endif
-        av_frame_free(&ret);
+        pool.release(ret);
         return nullptr;
     }
 
-    AVFrame* source = frameBuffer[sourceFrameKey];
-
     sws_scale(swsCtx, source->data, source->linesize, 0, sourceDimensions.height(), ret->data,
               ret->linesize);
     sws_freeContext(swsCtx);
@@ -620,7 +698,7 @@ AVFrame* VideoFrame::generateAVFrame(const QSize& dimensions, const int pixelFor
  *
  * As protection against duplicate frames, the storage mechanism will only allow one frame of a
  * given type to exist in the frame buffer. Should the given frame type already exist in the frame
- * buffer, the given frame will be freed and have it's buffers invalidated. In order to ensure
+ * buffer, the given frame will be released to the VideoFramePool. In order to ensure
  * correct operation, always replace the frame pointer with the one returned by this function.
  *
  * As an example:
@@ -639,18 +717,15 @@ AVFrame* VideoFrame::generateAVFrame(const QSize& dimensions, const int pixelFor
  */
 AVFrame* VideoFrame::storeAVFrame(AVFrame* frame, const QSize& dimensions, const int pixelFormat)
 {
-    FrameBufferKey frameKey = getFrameKey(dimensions, pixelFormat, frame->linesize[0]);
+    FrameBufferKey frameKey =
+        getFrameKey(dimensions, pixelFormat, isFrameAligned(frame, dimensions, pixelFormat));
 
     // We check the prescence of the frame in case of double-computation
     if (frameBuffer.count(frameKey) > 0) {
         AVFrame* old_ret = frameBuffer[frameKey];
 
-        // Free new frame
-        av_freep(&frame->data[0]);
-#if LIBAVCODEC_VERSION_INT < 3747941
-        av_frame_unref(frame);
-#endif
-        av_frame_free(&frame);
+        // Give new frame back
+        VideoFramePool::getInstance().release(frame);
 
         return old_ret;
     } else {
@@ -685,17 +760,57 @@ void VideoFrame::deleteFrameBuffer()
 #endif
             av_frame_free(&frame);
         } else {
-            av_freep(&frame->data[0]);
-#if LIBAVCODEC_VERSION_INT < 3747941
-            av_frame_unref(frame);
-#endif
-            av_frame_free(&frame);
+            VideoFramePool::getInstance().release(frame);
         }
     }
 
     frameBuffer.clear();
 }
 
+/**
+ * @brief Checks whether the source of this frame didn't invalidate it yet.
+ *
+ * @return true if the frame is untracked or belongs to the current generation of its source.
+ */
+bool VideoFrame::isCurrentGeneration() const
+{
+    return !sourceGeneration || sourceGeneration->generation.load() == generation;
+}
+
+/**
+ * @brief Registers a conversion with the source's generation before accessing the frame buffers.
+ *
+ * The conversion count is raised before the generation is checked, while
+ * SourceGeneration::advance() does the opposite, so one of both always sees the other.
+ *
+ * @return true if the frame may be accessed until endConversion(), false if it was invalidated.
+ */
+bool VideoFrame::beginConversion()
+{
+    if (!sourceGeneration) {
+        return true;
+    }
+
+    ++sourceGeneration->activeConversions;
+
+    if (isCurrentGeneration()) {
+        return true;
+    }
+
+    --sourceGeneration->activeConversions;
+    return false;
+}
+
+/**
+ * @brief Ends a conversion started with a successful beginConversion().
+ */
+void VideoFrame::endConversion()
+{
+    if (sourceGeneration) {
+        --sourceGeneration->activeConversions;
+    }
+}
+
 /**
  * @brief Converts this VideoFrame to a generic type T based on the given parameters and
  * supplied converter functions.
@@ -721,11 +836,18 @@ T VideoFrame::toGenericObject(const QSize& dimensions, const int pixelFormat, co
                               const std::function<T(AVFrame* const)>& objectConstructor,
                               const T& nullObject)
 {
+    // The source invalidated this frame, its buffers may be gone already
+    if (!beginConversion()) {
+        releaseFrame();
+        return nullObject;
+    }
+
     frameLock.lockForRead();
 
     // We return nullObject if the VideoFrame is no longer valid
     if (frameBuffer.size() == 0) {
         frameLock.unlock();
+        endConversion();
         return nullObject;
     }
 
@@ -735,12 +857,19 @@ T VideoFrame::toGenericObject(const QSize& dimensions, const int pixelFormat, co
         T ret = objectConstructor(frame);
 
         frameLock.unlock();
+        endConversion();
         return ret;
     }
 
     // VideoFrame does not contain an AVFrame to spec, generate one here
     frame = generateAVFrame(dimensions, static_cast<int>(pixelFormat), requireAligned);
 
+    if (!frame) {
+        frameLock.unlock();
+        endConversion();
+        return nullObject;
+    }
+
     /*
      * We need to "upgrade" the lock to a write lock so we can update our frameBuffer map.
      *
@@ -756,6 +885,7 @@ T VideoFrame::toGenericObject(const QSize& dimensions, const int pixelFormat, co
     T ret = objectConstructor(frame);
 
     frameLock.unlock();
+    endConversion();
     return ret;
 }
 
@@ -21,7 +21,6 @@
 #define VIDEOFRAME_H
 
 #include <QImage>
-#include <QMutex>
 #include <QReadWriteLock>
 #include <QRect>
 #include <QSize>
@@ -36,6 +35,8 @@ extern "C" {
 #include <memory>
 #include <unordered_map>
 
+class VideoLatency;
+
 struct ToxYUVFrame
 {
 public:
@@ -57,6 +58,29 @@ public:
     using IDType = std::uint_fast64_t;
     using AtomicIDType = std::atomic_uint_fast64_t;
 
+    class SourceGeneration
+    {
+    public:
+        SourceGeneration();
+
+        void advance();
+
+    private:
+        friend class VideoFrame;
+
+        AtomicIDType generation;
+        std::atomic_int activeConversions;
+    };
+
+    enum class Stage
+    {
+        Capture,
+        Convert,
+        Send,
+        Receive,
+        Paint
+    };
+
 public:
     VideoFrame(IDType sourceID, AVFrame* sourceFrame, QRect dimensions, int pixFmt,
                bool freeSourceFrame = false);
@@ -75,12 +99,13 @@ public:
 
     bool isValid();
 
-    std::shared_ptr<VideoFrame> trackFrame();
-    static void untrackFrames(const IDType& sourceID, bool releaseFrames = false);
+    std::shared_ptr<VideoFrame> trackFrame(const std::shared_ptr<SourceGeneration>& sourceGeneration);
 
     void releaseFrame();
 
     const AVFrame* getAVFrame(QSize frameSize, const int pixelFormat, const bool requireAligned);
+    bool readAVFrame(QSize frameSize, const int pixelFormat, const bool requireAligned,
+                     const std::function<void(const AVFrame*)>& reader);
     QImage toQImage(QSize frameSize = {});
     ToxYUVFrame toToxYUVFrame(QSize frameSize = {});
 
@@ -89,6 +114,13 @@ public:
     QRect getSourceDimensions() const;
     int getSourcePixelFormat() const;
 
+    bool markStage(Stage stage);
+    qint64 getStageTime(Stage stage) const;
+    void setLatency(const std::shared_ptr<VideoLatency>& latency);
+    std::shared_ptr<VideoLatency> getLatency() const;
+
+    static qint64 monotonicTime();
+
     static constexpr int dataAlignment = 32;
 
 private:
@@ -121,9 +153,10 @@ private:
     };
 
 private:
-    static FrameBufferKey getFrameKey(const QSize& frameSize, const int pixFmt, const int linesize);
     static FrameBufferKey getFrameKey(const QSize& frameSize, const int pixFmt,
                                       const bool frameAligned);
+    static int getCanonicalPixelFormat(const int pixFmt);
+    static bool isFrameAligned(const AVFrame* frame, const QSize& frameSize, const int pixFmt);
 
     AVFrame* retrieveAVFrame(const QSize& dimensions, const int pixelFormat, const bool requireAligned);
     AVFrame* generateAVFrame(const QSize& dimensions, const int pixelFormat, const bool requireAligned);
@@ -131,6 +164,10 @@ private:
 
     void deleteFrameBuffer();
 
+    bool isCurrentGeneration() const;
+    bool beginConversion();
+    void endConversion();
+
     template <typename T>
     T toGenericObject(const QSize& dimensions, const int pixelFormat, const bool requireAligned,
                       const std::function<T(AVFrame* const)>& objectConstructor, const T& nullObject);
@@ -146,19 +183,23 @@ private:
 
     // Source frame
     const QRect sourceDimensions;
-    int sourcePixelFormat;
+    const int sourcePixelFormat;
     const FrameBufferKey sourceFrameKey;
     const bool freeSourceFrame;
 
-    // Reference store
+    // Lifetime tracking
     static AtomicIDType frameIDs;
 
-    static std::unordered_map<IDType, QMutex> mutexMap;
-    static std::unordered_map<IDType, std::unordered_map<IDType, std::weak_ptr<VideoFrame>>> refsMap;
+    std::shared_ptr<SourceGeneration> sourceGeneration;
+    IDType generation;
+
+    // Instrumentation
+    static constexpr int stageCount = static_cast<int>(Stage::Paint) + 1;
+    std::atomic<qint64> stageTimes[stageCount];
+    std::shared_ptr<VideoLatency> latency;
 
     // Concurrency
     QReadWriteLock frameLock{};
-    static QReadWriteLock refsLock;
 };
 
 #endif // VIDEOFRAME_H
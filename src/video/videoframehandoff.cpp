@@ -0,0 +1,125 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "videoframehandoff.h"
+#include "src/video/videoframe.h"
+#include "src/video/videosource.h"
+
+/**
+ * @class VideoFrameHandoff
+ * @brief Passes frames from a VideoSource to a consumer, the latest frame wins.
+ *
+ * Only one frame waits for the consumer at a time. A frame arriving before the consumer took the
+ * previous one replaces it, so a consumer that can't keep up skips stale frames instead of
+ * falling further and further behind.
+ *
+ * The consumer is notified with frameReady() when a frame arrives, and then calls take() until it
+ * returns nullptr. No further notifications are sent until it did, so connecting frameReady() to
+ * a slow consumer doesn't pile up events either.
+ *
+ * All functions are thread safe.
+ */
+
+VideoFrameHandoff::VideoFrameHandoff()
+    : notified{false}
+    , delivered{0}
+    , dropped{0}
+{
+}
+
+/**
+ * @brief Feeds the frames of a source into a handoff.
+ *
+ * The connection keeps the handoff alive, disconnect it when the consumer goes away.
+ *
+ * @param source the source to take frames from.
+ * @param handoff the handoff to put the frames into.
+ * @return the connection to the source.
+ */
+QMetaObject::Connection
+VideoFrameHandoff::connectSource(VideoSource* source,
+                                 const std::shared_ptr<VideoFrameHandoff>& handoff)
+{
+    // Direct, the frames are put on the source's thread
+    return QObject::connect(source, &VideoSource::frameAvailable,
+                            [handoff](std::shared_ptr<VideoFrame> frame) {
+                                handoff->put(std::move(frame));
+                            });
+}
+
+/**
+ * @brief Offers a new frame to the consumer, replacing the frame it didn't take yet.
+ */
+void VideoFrameHandoff::put(std::shared_ptr<VideoFrame> frame)
+{
+    QMutexLocker locker{&handoffLock};
+
+    if (pending) {
+        ++dropped;
+    }
+
+    pending = std::move(frame);
+
+    if (notified) {
+        return;
+    }
+
+    notified = true;
+    locker.unlock();
+
+    emit frameReady();
+}
+
+/**
+ * @brief Takes the waiting frame.
+ *
+ * @return the newest frame, or nullptr if there's none. Returning nullptr re-arms frameReady().
+ */
+std::shared_ptr<VideoFrame> VideoFrameHandoff::take()
+{
+    QMutexLocker locker{&handoffLock};
+
+    if (!pending) {
+        notified = false;
+        return nullptr;
+    }
+
+    ++delivered;
+    std::shared_ptr<VideoFrame> frame;
+    frame.swap(pending);
+    return frame;
+}
+
+/**
+ * @brief Number of frames the consumer took.
+ */
+quint64 VideoFrameHandoff::getDelivered() const
+{
+    QMutexLocker locker{&handoffLock};
+    return delivered;
+}
+
+/**
+ * @brief Number of frames replaced by a newer one before the consumer took them.
+ */
+quint64 VideoFrameHandoff::getDropped() const
+{
+    QMutexLocker locker{&handoffLock};
+    return dropped;
+}
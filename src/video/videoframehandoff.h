@@ -0,0 +1,59 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VIDEOFRAMEHANDOFF_H
+#define VIDEOFRAMEHANDOFF_H
+
+#include <QMetaObject>
+#include <QMutex>
+#include <QObject>
+
+#include <memory>
+
+class VideoFrame;
+class VideoSource;
+
+class VideoFrameHandoff : public QObject
+{
+    Q_OBJECT
+
+public:
+    VideoFrameHandoff();
+
+    static QMetaObject::Connection connectSource(VideoSource* source,
+                                                 const std::shared_ptr<VideoFrameHandoff>& handoff);
+
+    void put(std::shared_ptr<VideoFrame> frame);
+    std::shared_ptr<VideoFrame> take();
+
+    quint64 getDelivered() const;
+    quint64 getDropped() const;
+
+signals:
+    void frameReady();
+
+private:
+    mutable QMutex handoffLock;
+    std::shared_ptr<VideoFrame> pending;
+    bool notified;
+    quint64 delivered;
+    quint64 dropped;
+};
+
+#endif // VIDEOFRAMEHANDOFF_H
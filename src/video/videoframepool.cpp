@@ -0,0 +1,304 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "videoframepool.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+}
+
+#include <QDebug>
+
+#include <functional>
+
+/**
+ * @class VideoFramePool
+ * @brief Recycles the AVFrames and image buffers used for video frame conversions.
+ *
+ * Every captured or received frame is converted at least once, to RGB24 for display and to
+ * YUV420P for toxav, and the converted frames are freed again when the VideoFrame is released.
+ * Allocating and freeing those buffers for every frame is a lot of churn at higher resolutions,
+ * so released frames are kept and handed out again for the next frame of the same geometry.
+ *
+ * Frames are pooled by width, height, pixel format and data alignment. Idle frames are bounded
+ * both per key and in total, anything beyond that is freed on release.
+ *
+ * Each key has its own bucket with its own lock, so streams of different geometries never
+ * contend, and a frame finds its bucket through its opaque pointer when it's released. Only
+ * frames of the same geometry, in practice the conversions of one stream, share a lock, which is
+ * held for a few pointer operations. Looking up the bucket takes a read lock, only the first
+ * frame of a new geometry takes it for writing.
+ *
+ * All functions are thread safe.
+ *
+ * @struct VideoFramePool::Stats
+ * @brief Counters to judge the effectiveness of the pool.
+ *
+ * @var VideoFramePool::Stats::hits
+ * @brief Number of frames handed out from the pool.
+ *
+ * @var VideoFramePool::Stats::misses
+ * @brief Number of frames that had to be allocated.
+ *
+ * @var VideoFramePool::Stats::bytesHeld
+ * @brief Image buffer bytes of the idle frames in the pool.
+ *
+ * @var VideoFramePool::Stats::bytesInUse
+ * @brief Image buffer bytes of the frames handed out and not yet released.
+ *
+ * @struct VideoFramePool::Bucket
+ * @brief The idle frames of one key, buckets live as long as the pool.
+ *
+ * @struct VideoFramePool::Entry
+ * @brief Pool bookkeeping of a frame, stored in its AVFrame::opaque.
+ */
+
+namespace {
+/// Idle frames kept per geometry, enough for a few frames in flight per stream
+const size_t MAX_IDLE_PER_KEY = 8;
+/// Upper limit for the image buffers of all idle frames together
+const qint64 MAX_BYTES_HELD = 64 * 1024 * 1024;
+}
+
+/**
+ * @brief Returns the process wide pool.
+ */
+VideoFramePool& VideoFramePool::getInstance()
+{
+    static VideoFramePool instance;
+    return instance;
+}
+
+VideoFramePool::VideoFramePool()
+    : hits{0}
+    , misses{0}
+    , bytesHeld{0}
+    , bytesInUse{0}
+{
+}
+
+VideoFramePool::~VideoFramePool()
+{
+    clear();
+
+    if (bytesInUse > 0) {
+        qWarning() << bytesInUse.load() << "bytes of video frames weren't returned to the pool";
+    }
+}
+
+/**
+ * @brief Hands out a frame with allocated image buffers.
+ *
+ * The image buffers are uninitialized, recycled frames contain the picture of their last use.
+ *
+ * @param width the width of the frame.
+ * @param height the height of the frame.
+ * @param pixFmt the pixel format of the frame.
+ * @param alignment the data alignment of the image buffers, as for av_image_alloc().
+ * @return the frame, or nullptr if the allocation failed. Must be given back with release().
+ */
+AVFrame* VideoFramePool::acquire(int width, int height, int pixFmt, int alignment)
+{
+    Bucket& bucket = getBucket(Key{width, height, pixFmt, alignment});
+
+    {
+        QMutexLocker locker{&bucket.lock};
+
+        if (!bucket.idle.empty()) {
+            AVFrame* frame = bucket.idle.back();
+            bucket.idle.pop_back();
+
+            Entry* entry = static_cast<Entry*>(frame->opaque);
+            entry->inUse = true;
+            bytesHeld -= entry->bytes;
+            bytesInUse += entry->bytes;
+            ++hits;
+
+            return frame;
+        }
+    }
+
+    ++misses;
+
+    // allocate outside of the lock, other threads may still hit the pool meanwhile
+    AVFrame* frame = av_frame_alloc();
+    if (!frame) {
+        return nullptr;
+    }
+
+    frame->width = width;
+    frame->height = height;
+    frame->format = pixFmt;
+
+    const int bufSize = av_image_alloc(frame->data, frame->linesize, width, height,
+                                       static_cast<AVPixelFormat>(pixFmt), alignment);
+
+    if (bufSize < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    frame->opaque = new Entry{&bucket, bufSize, true};
+    bytesInUse += bufSize;
+
+    return frame;
+}
+
+/**
+ * @brief Gives a frame back to the pool.
+ *
+ * The frame is kept for reuse if the pool has room for it, otherwise it is freed. Frames that
+ * didn't come from the pool are freed as well, they must not have an opaque pointer.
+ *
+ * @param frame the frame obtained from acquire(), may be nullptr.
+ */
+void VideoFramePool::release(AVFrame* frame)
+{
+    if (!frame) {
+        return;
+    }
+
+    Entry* entry = static_cast<Entry*>(frame->opaque);
+    if (!entry) {
+        freeFrame(frame);
+        return;
+    }
+
+    Bucket& bucket = *entry->bucket;
+    QMutexLocker locker{&bucket.lock};
+
+    if (!entry->inUse) {
+        qWarning() << "Video frame released to the pool twice";
+        return;
+    }
+
+    entry->inUse = false;
+    bytesInUse -= entry->bytes;
+
+    // the total is only reserved if the bucket has room, so it can't be exceeded by a race
+    if (bucket.idle.size() >= MAX_IDLE_PER_KEY
+        || bytesHeld.fetch_add(entry->bytes) + entry->bytes > MAX_BYTES_HELD) {
+        if (bucket.idle.size() < MAX_IDLE_PER_KEY) {
+            bytesHeld -= entry->bytes;
+        }
+
+        locker.unlock();
+        freeFrame(frame);
+        return;
+    }
+
+    bucket.idle.push_back(frame);
+}
+
+/**
+ * @brief Frees all idle frames, frames in use are unaffected.
+ */
+void VideoFramePool::clear()
+{
+    std::vector<AVFrame*> unused;
+
+    {
+        QReadLocker bucketsLocker{&bucketsLock};
+
+        for (auto& bucket : buckets) {
+            QMutexLocker locker{&bucket.second->lock};
+            std::vector<AVFrame*>& idle = bucket.second->idle;
+
+            for (AVFrame* frame : idle) {
+                bytesHeld -= static_cast<Entry*>(frame->opaque)->bytes;
+                unused.push_back(frame);
+            }
+
+            idle.clear();
+        }
+    }
+
+    for (AVFrame* frame : unused) {
+        freeFrame(frame);
+    }
+}
+
+/**
+ * @brief Returns a snapshot of the pool's counters.
+ *
+ * The counters are read one after another, while frames are acquired and released concurrently
+ * they may not add up exactly.
+ */
+VideoFramePool::Stats VideoFramePool::getStats() const
+{
+    return Stats{hits.load(), misses.load(), bytesHeld.load(), bytesInUse.load()};
+}
+
+/**
+ * @brief Returns the bucket for a key, creating it on first use.
+ */
+VideoFramePool::Bucket& VideoFramePool::getBucket(const Key& key)
+{
+    {
+        QReadLocker locker{&bucketsLock};
+        auto it = buckets.find(key);
+        if (it != buckets.end()) {
+            return *it->second;
+        }
+    }
+
+    QWriteLocker locker{&bucketsLock};
+    std::unique_ptr<Bucket>& bucket = buckets[key];
+    if (!bucket) {
+        bucket.reset(new Bucket);
+    }
+
+    return *bucket;
+}
+
+/**
+ * @brief Frees a frame, its image buffers and its pool bookkeeping.
+ */
+void VideoFramePool::freeFrame(AVFrame* frame)
+{
+    delete static_cast<Entry*>(frame->opaque);
+    frame->opaque = nullptr;
+    av_freep(&frame->data[0]);
+#if LIBAVCODEC_VERSION_INT < 3747941
+    av_frame_unref(frame);
+#endif
+    av_frame_free(&frame);
+}
+
+bool VideoFramePool::Key::operator==(const Key& other) const
+{
+    return width == other.width && height == other.height && pixelFormat == other.pixelFormat
+           && alignment == other.alignment;
+}
+
+size_t VideoFramePool::KeyHash::operator()(const Key& key) const
+{
+    std::hash<int> intHasher;
+
+    // same java-style combination as VideoFrame::FrameBufferKey::hash()
+    size_t ret = 47;
+
+    ret = 37 * ret + intHasher(key.width);
+    ret = 37 * ret + intHasher(key.height);
+    ret = 37 * ret + intHasher(key.pixelFormat);
+    ret = 37 * ret + intHasher(key.alignment);
+
+    return ret;
+}
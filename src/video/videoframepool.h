@@ -0,0 +1,104 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VIDEOFRAMEPOOL_H
+#define VIDEOFRAMEPOOL_H
+
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QtGlobal>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class VideoFramePool
+{
+public:
+    struct Stats
+    {
+        quint64 hits;
+        quint64 misses;
+        qint64 bytesHeld;
+        qint64 bytesInUse;
+    };
+
+public:
+    static VideoFramePool& getInstance();
+
+    VideoFramePool();
+    ~VideoFramePool();
+
+    VideoFramePool(const VideoFramePool&) = delete;
+    VideoFramePool& operator=(const VideoFramePool&) = delete;
+
+    AVFrame* acquire(int width, int height, int pixFmt, int alignment);
+    void release(AVFrame* frame);
+    void clear();
+
+    Stats getStats() const;
+
+private:
+    struct Key
+    {
+        int width;
+        int height;
+        int pixelFormat;
+        int alignment;
+
+        bool operator==(const Key& other) const;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Bucket
+    {
+        QMutex lock;
+        std::vector<AVFrame*> idle;
+    };
+
+    struct Entry
+    {
+        Bucket* bucket;
+        qint64 bytes;
+        bool inUse;
+    };
+
+    Bucket& getBucket(const Key& key);
+    static void freeFrame(AVFrame* frame);
+
+private:
+    QReadWriteLock bucketsLock;
+    std::unordered_map<Key, std::unique_ptr<Bucket>, KeyHash> buckets;
+    std::atomic<quint64> hits;
+    std::atomic<quint64> misses;
+    std::atomic<qint64> bytesHeld;
+    std::atomic<qint64> bytesInUse;
+};
+
+#endif // VIDEOFRAMEPOOL_H
@@ -0,0 +1,191 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "videolatency.h"
+
+#include <QStringList>
+
+/**
+ * @class VideoLatency
+ * @brief Collects how long video frames of a call spend in each stage of the pipeline.
+ *
+ * Intervals are measured between the monotonic timestamps VideoFrame records at its stages:
+ * Convert is from capture until the frame is converted for toxav, Encode until toxav took it,
+ * and Render from receiving a frame until it's painted. Network latency isn't visible to us,
+ * toxav doesn't pass on when a frame was sent.
+ *
+ * Recording is thread safe and lock free, the stages happen on different threads.
+ *
+ * @class VideoLatency::Histogram
+ * @brief Counts latencies in buckets with fixed bounds, from 1ms up to a second.
+ *
+ * Percentiles are reported as the upper bound of the bucket they fall into, which is precise
+ * enough to tell where a call spends its time.
+ */
+
+namespace {
+/// Upper bounds of the buckets in milliseconds, the last bucket takes everything above
+const double BUCKET_BOUNDS[VideoLatency::Histogram::BUCKET_COUNT - 1] = {
+    1, 2, 5, 10, 20, 35, 50, 75, 100, 150, 250, 500, 1000};
+const char* const INTERVAL_NAMES[VideoLatency::INTERVAL_COUNT] = {"convert", "encode", "render"};
+}
+
+VideoLatency::Histogram::Histogram()
+{
+    reset();
+}
+
+/**
+ * @brief Adds a latency in nanoseconds.
+ */
+void VideoLatency::Histogram::record(qint64 ns)
+{
+    const double ms = ns / 1e6;
+    int bucket = 0;
+    while (bucket < BUCKET_COUNT - 1 && ms > BUCKET_BOUNDS[bucket]) {
+        ++bucket;
+    }
+
+    ++buckets[bucket];
+    ++count;
+    sum += ns;
+
+    qint64 previous = max;
+    while (ns > previous && !max.compare_exchange_weak(previous, ns)) {
+    }
+}
+
+void VideoLatency::Histogram::reset()
+{
+    for (std::atomic<quint64>& bucket : buckets) {
+        bucket = 0;
+    }
+
+    count = 0;
+    sum = 0;
+    max = 0;
+}
+
+quint64 VideoLatency::Histogram::getCount() const
+{
+    return count;
+}
+
+/**
+ * @brief Average latency in milliseconds, 0 if nothing was recorded.
+ */
+double VideoLatency::Histogram::getMean() const
+{
+    const quint64 n = count;
+    return n ? sum / 1e6 / n : 0.0;
+}
+
+/**
+ * @brief Highest latency in milliseconds.
+ */
+double VideoLatency::Histogram::getMax() const
+{
+    return max / 1e6;
+}
+
+/**
+ * @brief Latency in milliseconds that the given fraction of the frames didn't exceed.
+ *
+ * @param percentile Fraction between 0 and 1, e.g. 0.95.
+ * @return Upper bound of the bucket the percentile falls into, at most the maximum.
+ */
+double VideoLatency::Histogram::getPercentile(double percentile) const
+{
+    const quint64 n = count;
+    if (!n) {
+        return 0.0;
+    }
+
+    const quint64 rank = qMax<quint64>(1, static_cast<quint64>(percentile * n + 0.5));
+    quint64 seen = 0;
+    for (int i = 0; i < BUCKET_COUNT - 1; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return qMin(BUCKET_BOUNDS[i], getMax());
+        }
+    }
+
+    return getMax();
+}
+
+/**
+ * @brief Records an interval between two timestamps in nanoseconds.
+ *
+ * Ignored if either stage wasn't reached, i.e. its timestamp is 0.
+ */
+void VideoLatency::record(Interval interval, qint64 start, qint64 end)
+{
+    if (!start || !end || end < start) {
+        return;
+    }
+
+    histograms[interval].record(end - start);
+}
+
+void VideoLatency::reset()
+{
+    for (Histogram& histogram : histograms) {
+        histogram.reset();
+    }
+}
+
+const VideoLatency::Histogram& VideoLatency::get(Interval interval) const
+{
+    return histograms[interval];
+}
+
+bool VideoLatency::isEmpty() const
+{
+    for (const Histogram& histogram : histograms) {
+        if (histogram.getCount()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Describes the recorded intervals in one line, for the log.
+ */
+QString VideoLatency::getSummary() const
+{
+    QStringList parts;
+    for (int i = 0; i < INTERVAL_COUNT; ++i) {
+        const Histogram& histogram = histograms[i];
+        if (!histogram.getCount()) {
+            continue;
+        }
+
+        parts << QString("%1 %2 frames, mean %3ms, p50 %4ms, p95 %5ms, max %6ms")
+                     .arg(INTERVAL_NAMES[i])
+                     .arg(histogram.getCount())
+                     .arg(histogram.getMean(), 0, 'f', 1)
+                     .arg(histogram.getPercentile(0.5))
+                     .arg(histogram.getPercentile(0.95))
+                     .arg(histogram.getMax(), 0, 'f', 1);
+    }
+
+    return parts.join("; ");
+}
@@ -0,0 +1,74 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VIDEOLATENCY_H
+#define VIDEOLATENCY_H
+
+#include <QString>
+#include <QtGlobal>
+
+#include <atomic>
+
+class VideoLatency
+{
+public:
+    enum Interval
+    {
+        Convert,
+        Encode,
+        Render,
+        INTERVAL_COUNT
+    };
+
+    class Histogram
+    {
+    public:
+        Histogram();
+
+        void record(qint64 ns);
+        void reset();
+
+        quint64 getCount() const;
+        double getMean() const;
+        double getMax() const;
+        double getPercentile(double percentile) const;
+
+    public:
+        static const int BUCKET_COUNT = 14;
+
+    private:
+        std::atomic<quint64> buckets[BUCKET_COUNT];
+        std::atomic<quint64> count;
+        std::atomic<qint64> sum;
+        std::atomic<qint64> max;
+    };
+
+public:
+    void record(Interval interval, qint64 start, qint64 end);
+    void reset();
+
+    const Histogram& get(Interval interval) const;
+    bool isEmpty() const;
+    QString getSummary() const;
+
+private:
+    Histogram histograms[INTERVAL_COUNT];
+};
+
+#endif // VIDEOLATENCY_H
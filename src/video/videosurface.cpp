@@ -23,16 +23,44 @@
 #include "src/friendlist.h"
 #include "src/persistence/settings.h"
 #include "src/video/videoframe.h"
+#include "src/video/videoframehandoff.h"
+#include "src/video/videolatency.h"
 #include "src/widget/friendwidget.h"
 #include "src/widget/style.h"
 
 #include <QDebug>
 #include <QLabel>
 #include <QPainter>
+#include <QWindow>
+#include <QtConcurrent/QtConcurrentRun>
 
 /**
+ * @class VideoSurface
+ *
+ * Frames are converted to the size they're displayed at on a worker thread, once per frame and
+ * size. Painting only draws the last converted image, so repaints without a new frame are cheap.
+ *
+ * While the surface can't be seen, e.g. its window is minimized or its tab is hidden, frames are
+ * still taken from the source but not converted, the source keeps running for the call. The first
+ * paint once the surface is shown again converts the latest frame.
+ *
  * @var std::atomic_bool VideoSurface::frameLock
  * @brief Fast lock for lastFrame.
+ *
+ * @var VideoSurface::frameHandoff
+ * @brief Passes frames from the source, skipping those we're too slow to show.
+ *
+ * @var VideoSurface::convertingFrame
+ * @brief Frame being converted by the worker, nullptr if none is.
+ *
+ * @var VideoSurface::convertedFrame
+ * @brief Last frame converted for display.
+ *
+ * @var VideoSurface::convertedSource
+ * @brief The frame convertedFrame was converted from.
+ *
+ * @var VideoSurface::conversionPending
+ * @brief The frame or size changed while a conversion was running, convert again once it's done.
  */
 
 float getSizeRatio(const QSize size)
@@ -44,11 +72,15 @@ VideoSurface::VideoSurface(const QPixmap& avatar, QWidget* parent, bool expandin
     : QWidget{parent}
     , source{nullptr}
     , frameLock{false}
+    , conversionPending{false}
     , hasSubscribed{0}
     , avatar{avatar}
     , ratio{1.0f}
     , expanding{expanding}
 {
+    connect(&conversionWatcher, &QFutureWatcher<QImage>::finished, this,
+            &VideoSurface::onFrameConverted);
+
     recalulateBounds();
 }
 
@@ -112,7 +144,10 @@ void VideoSurface::subscribe()
 {
     if (source && hasSubscribed++ == 0) {
         source->subscribe();
-        connect(source, &VideoSource::frameAvailable, this, &VideoSurface::onNewFrameAvailable);
+        frameHandoff = std::make_shared<VideoFrameHandoff>();
+        connect(frameHandoff.get(), &VideoFrameHandoff::frameReady, this,
+                &VideoSurface::onNewFrameAvailable);
+        frameConn = VideoFrameHandoff::connectSource(source, frameHandoff);
         connect(source, &VideoSource::sourceStopped, this, &VideoSurface::onSourceStopped);
     }
 }
@@ -125,22 +160,37 @@ void VideoSurface::unsubscribe()
     if (--hasSubscribed != 0)
         return;
 
-    lock();
-    lastFrame.reset();
-    unlock();
+    resetFrame();
 
     ratio = 1.0f;
     recalulateBounds();
     emit ratioChanged();
     emit boundaryChanged();
 
-    disconnect(source, &VideoSource::frameAvailable, this, &VideoSurface::onNewFrameAvailable);
+    disconnect(frameConn);
+    disconnect(frameHandoff.get(), &VideoFrameHandoff::frameReady, this,
+               &VideoSurface::onNewFrameAvailable);
+    frameHandoff.reset();
     disconnect(source, &VideoSource::sourceStopped, this, &VideoSurface::onSourceStopped);
     source->unsubscribe();
 }
 
-void VideoSurface::onNewFrameAvailable(const std::shared_ptr<VideoFrame>& newFrame)
+void VideoSurface::onNewFrameAvailable()
 {
+    if (!frameHandoff) {
+        return;
+    }
+
+    // Only the newest frame is worth showing
+    std::shared_ptr<VideoFrame> newFrame;
+    while (std::shared_ptr<VideoFrame> frame = frameHandoff->take()) {
+        newFrame = frame;
+    }
+
+    if (!newFrame) {
+        return;
+    }
+
     QSize newSize;
 
     lock();
@@ -157,27 +207,142 @@ void VideoSurface::onNewFrameAvailable(const std::shared_ptr<VideoFrame>& newFra
         emit boundaryChanged();
     }
 
-    update();
+    convertFrame();
 }
 
 void VideoSurface::onSourceStopped()
 {
     // If the source's stream is on hold, just revert back to the avatar view
-    lastFrame.reset();
+    resetFrame();
     update();
 }
 
+/**
+ * @brief Converts the last frame to the display size on a worker thread.
+ *
+ * Only one conversion runs at a time. Frames arriving meanwhile aren't queued, the newest one is
+ * converted once the running conversion is done.
+ */
+void VideoSurface::convertFrame()
+{
+    lock();
+    std::shared_ptr<VideoFrame> frame = lastFrame;
+    unlock();
+
+    const QSize size = boundingRect.size();
+    if (!frame || size.isEmpty() || !isDisplayed()) {
+        return;
+    }
+
+    if (convertingFrame) {
+        conversionPending =
+            conversionPending || frame != convertingFrame || size != convertingSize;
+        return;
+    }
+
+    if (frame == convertedSource.lock() && size == convertedFrame.size()) {
+        return;
+    }
+
+    convertingFrame = frame;
+    convertingSize = size;
+    conversionPending = false;
+
+    conversionWatcher.setFuture(QtConcurrent::run([frame, size]() {
+        // RGB32 is drawn without any further conversion, and the copy outlives the frame
+        return frame->toQImage(size).convertToFormat(QImage::Format_RGB32);
+    }));
+}
+
+void VideoSurface::onFrameConverted()
+{
+    const std::shared_ptr<VideoFrame> frame = convertingFrame;
+    convertingFrame.reset();
+
+    // The surface was reset while converting
+    if (!frame) {
+        return;
+    }
+
+    const QImage image = conversionWatcher.result();
+
+    lock();
+    const bool current = frame == lastFrame;
+    if (image.isNull() && current) {
+        // The frame was invalidated by its source
+        lastFrame.reset();
+    }
+    unlock();
+
+    if (!image.isNull() || current) {
+        convertedFrame = image;
+        convertedSource = frame;
+        update();
+    }
+
+    if (conversionPending) {
+        conversionPending = false;
+        convertFrame();
+    }
+}
+
+/**
+ * @brief Drops the last frame, the avatar is shown until a new one arrives.
+ */
+void VideoSurface::resetFrame()
+{
+    lock();
+    lastFrame.reset();
+    unlock();
+
+    // A running conversion is left to finish, its result is discarded
+    convertingFrame.reset();
+    conversionPending = false;
+    convertedFrame = QImage{};
+    convertedSource.reset();
+}
+
+/**
+ * @brief Checks whether the surface can currently be seen.
+ *
+ * Windows covered by other windows count as visible unless the platform reports them as not
+ * exposed, which some do.
+ */
+bool VideoSurface::isDisplayed() const
+{
+    if (!isVisible() || visibleRegion().isEmpty()) {
+        return false;
+    }
+
+    const QWidget* top = window();
+    if (top->isMinimized()) {
+        return false;
+    }
+
+    const QWindow* handle = top->windowHandle();
+    return !handle || handle->isExposed();
+}
+
 void VideoSurface::paintEvent(QPaintEvent*)
 {
     lock();
 
     QPainter painter(this);
     painter.fillRect(painter.viewport(), Qt::black);
-    if (lastFrame) {
-        QImage frame = lastFrame->toQImage(rect().size());
-        if (frame.isNull())
-            lastFrame.reset();
-        painter.drawImage(boundingRect, frame, frame.rect(), Qt::NoFormatConversion);
+    if (lastFrame && !convertedFrame.isNull()) {
+        painter.drawImage(boundingRect, convertedFrame, convertedFrame.rect(),
+                          Qt::NoFormatConversion);
+
+        // Only the first paint of a frame counts, repaints of the same frame aren't latency
+        const std::shared_ptr<VideoFrame> painted = convertedSource.lock();
+        if (painted && painted->markStage(VideoFrame::Stage::Paint)) {
+            const std::shared_ptr<VideoLatency> latency = painted->getLatency();
+            if (latency) {
+                latency->record(VideoLatency::Render,
+                                painted->getStageTime(VideoFrame::Stage::Receive),
+                                painted->getStageTime(VideoFrame::Stage::Paint));
+            }
+        }
     } else {
         painter.fillRect(boundingRect, Qt::white);
         QPixmap drawnAvatar = avatar;
@@ -190,6 +355,9 @@ void VideoSurface::paintEvent(QPaintEvent*)
     }
 
     unlock();
+
+    // Catch up on the frames that came while we weren't displayed, no-op if we're up to date
+    convertFrame();
 }
 
 void VideoSurface::resizeEvent(QResizeEvent* event)
@@ -225,6 +393,7 @@ void VideoSurface::recalulateBounds()
         boundingRect.setRect(pos.x(), pos.y(), size.width(), size.height());
     }
 
+    convertFrame();
     update();
 }
 
@@ -21,10 +21,14 @@
 #define SELFCAMVIEW_H
 
 #include "src/video/videosource.h"
+#include <QFutureWatcher>
+#include <QImage>
 #include <QWidget>
 #include <atomic>
 #include <memory>
 
+class VideoFrameHandoff;
+
 class VideoSurface : public QWidget
 {
     Q_OBJECT
@@ -54,18 +58,30 @@ protected:
     virtual void showEvent(QShowEvent* event) final override;
 
 private slots:
-    void onNewFrameAvailable(const std::shared_ptr<VideoFrame>& newFrame);
+    void onNewFrameAvailable();
     void onSourceStopped();
+    void onFrameConverted();
 
 private:
+    void convertFrame();
+    void resetFrame();
+    bool isDisplayed() const;
     void recalulateBounds();
     void lock();
     void unlock();
 
     QRect boundingRect;
     VideoSource* source;
+    std::shared_ptr<VideoFrameHandoff> frameHandoff;
+    QMetaObject::Connection frameConn;
     std::shared_ptr<VideoFrame> lastFrame;
     std::atomic_bool frameLock;
+    QFutureWatcher<QImage> conversionWatcher;
+    std::shared_ptr<VideoFrame> convertingFrame;
+    QSize convertingSize;
+    QImage convertedFrame;
+    std::weak_ptr<VideoFrame> convertedSource;
+    bool conversionPending;
     uint8_t hasSubscribed;
     QPixmap avatar;
     float ratio;
@@ -27,12 +27,14 @@
 #include "src/chatlog/content/text.h"
 #include "src/core/core.h"
 #include "src/core/coreav.h"
+#include "src/core/videoqualitycontroller.h"
 #include "src/model/friend.h"
 #include "src/nexus.h"
 #include "src/persistence/offlinemsgengine.h"
 #include "src/persistence/profile.h"
 #include "src/persistence/settings.h"
 #include "src/video/netcamview.h"
+#include "src/video/videolatency.h"
 #include "src/widget/form/loadhistorydialog.h"
 #include "src/widget/maskablepixmapwidget.h"
 #include "src/widget/style.h"
@@ -45,11 +47,13 @@
 #include <QClipboard>
 #include <QFileDialog>
 #include <QFileInfo>
+#include <QFutureWatcher>
 #include <QMessageBox>
 #include <QMimeData>
 #include <QPushButton>
 #include <QScrollBar>
 #include <QStringBuilder>
+#include <QtConcurrent/QtConcurrentRun>
 
 #include <cassert>
 
@@ -167,6 +171,9 @@ ChatForm::ChatForm(Friend* chatFriend)
     connect(av, &CoreAV::avInvite, this, &ChatForm::onAvInvite);
     connect(av, &CoreAV::avStart, this, &ChatForm::onAvStart);
     connect(av, &CoreAV::avEnd, this, &ChatForm::onAvEnd);
+    connect(av, &CoreAV::audioRateChanged, this, &ChatForm::onAudioRateChanged);
+    connect(av, &CoreAV::videoQualityChanged, this, &ChatForm::onVideoQualityChanged);
+    connect(av, &CoreAV::videoLatencyChanged, this, &ChatForm::onVideoLatencyChanged);
 
     connect(sendButton, &QPushButton::clicked, this, &ChatForm::onSendTriggered);
     connect(fileButton, &QPushButton::clicked, this, &ChatForm::onAttachClicked);
@@ -397,6 +404,89 @@ void ChatForm::onAvEnd(uint32_t friendId, bool error)
     hideNetcam();
 }
 
+/**
+ * @brief Shows how the call's audio was adapted to the network in the call duration tooltip.
+ */
+void ChatForm::onAudioRateChanged(uint32_t friendId, int bitrate, int frameDuration, int jitter,
+                                  int loss)
+{
+    if (friendId != f->getId()) {
+        return;
+    }
+
+    audioRateInfo = tr("Audio: %1 kbps, %2 ms frames\nJitter: %3 ms, loss: %4%")
+                        .arg(bitrate)
+                        .arg(frameDuration)
+                        .arg(jitter)
+                        .arg(loss);
+    updateCallInfo();
+}
+
+/**
+ * @brief Shows the quality step our video was adapted to in the call duration tooltip.
+ */
+void ChatForm::onVideoQualityChanged(uint32_t friendId, int step, QSize size, int frameRate)
+{
+    if (friendId != f->getId()) {
+        return;
+    }
+
+    videoQualityInfo = tr("Video: %1x%2 at %3 fps, quality step %4 of %5")
+                           .arg(size.width())
+                           .arg(size.height())
+                           .arg(frameRate)
+                           .arg(VideoQualityController::STEP_COUNT - step)
+                           .arg(VideoQualityController::STEP_COUNT);
+    updateCallInfo();
+}
+
+/**
+ * @brief Shows how long a stage of our video pipeline takes in the call duration tooltip.
+ */
+void ChatForm::onVideoLatencyChanged(uint32_t friendId, int interval, double median, double p95)
+{
+    if (friendId != f->getId()) {
+        return;
+    }
+
+    QString stage;
+    switch (interval) {
+    case VideoLatency::Convert:
+        stage = tr("conversion");
+        break;
+    case VideoLatency::Encode:
+        stage = tr("encoding");
+        break;
+    case VideoLatency::Render:
+        stage = tr("rendering");
+        break;
+    default:
+        return;
+    }
+
+    videoLatencyInfo[interval] = tr("Video %1: median %2 ms, 95th percentile %3 ms")
+                                     .arg(stage)
+                                     .arg(median, 0, 'f', 1)
+                                     .arg(p95, 0, 'f', 1);
+    updateCallInfo();
+}
+
+void ChatForm::updateCallInfo()
+{
+    QStringList info;
+    if (!audioRateInfo.isEmpty()) {
+        info << audioRateInfo;
+    }
+
+    if (!videoQualityInfo.isEmpty()) {
+        info << videoQualityInfo;
+    }
+
+    info << videoLatencyInfo.values();
+
+    callDuration->setToolTip(info.join('\n'));
+}
+
 void ChatForm::showOutgoingCall(bool video)
 {
     QPushButton* btn = video ? videoButton : callButton;
@@ -716,7 +806,7 @@ void ChatForm::loadHistory(const QDateTime& since, bool processUndelivered)
     ToxPk prevIdBackup = previousId;
     previousId = ToxPk{};
 
-    QList<ChatLine::Ptr> historyMessages;
+    QList<ChatMessage::Ptr> historyMessages;
 
     QDate lastDate(1, 0, 0);
     for (const auto& it : msgs) {
@@ -800,19 +890,28 @@ void ChatForm::sendImage(const QPixmap& pixmap)
                            .arg(Settings::getInstance().getAppDataDirPath())
                            .arg(QDir::separator())
                            .arg(QDateTime::currentDateTime().toString("yyyy-MM-dd HH-mm-ss.zzz"));
-    QFile file(filepath);
 
-    if (file.open(QFile::ReadWrite)) {
-        pixmap.save(&file, "PNG");
-        qint64 filesize = file.size();
-        file.close();
-        QFileInfo fi(file);
-        Core::getInstance()->sendFile(f->getId(), fi.fileName(), fi.filePath(), filesize);
-    } else {
-        QMessageBox::warning(this,
-                             tr("Failed to open temporary file", "Temporary file for screenshot"),
-                             tr("qTox wasn't able to save the screenshot"));
-    }
+    // encoding a screenshot as PNG takes long enough to stall the GUI
+    const QImage image = pixmap.toImage();
+    QFutureWatcher<bool>* watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcher<bool>::finished, this, [this, watcher, filepath]() {
+        watcher->deleteLater();
+        if (!watcher->result()) {
+            QMessageBox::warning(this,
+                                 tr("Failed to open temporary file",
+                                    "Temporary file for screenshot"),
+                                 tr("qTox wasn't able to save the screenshot"));
+            return;
+        }
+
+        QFileInfo fi(filepath);
+        Core::getInstance()->sendFile(f->getId(), fi.fileName(), fi.filePath(), fi.size());
+    });
+
+    watcher->setFuture(QtConcurrent::run([image, filepath]() {
+        QFile file(filepath);
+        return file.open(QFile::ReadWrite) && image.save(&file, "PNG");
+    }));
 }
 
 void ChatForm::onLoadHistory()
@@ -906,6 +1005,10 @@ void ChatForm::stopCounter(bool error)
                          QDateTime::currentDateTime());
     callDurationTimer->stop();
     callDuration->setText("");
+    audioRateInfo.clear();
+    videoQualityInfo.clear();
+    videoLatencyInfo.clear();
+    callDuration->setToolTip(QString());
     callDuration->hide();
 
     delete callDurationTimer;
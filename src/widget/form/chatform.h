@@ -22,6 +22,7 @@
 
 #include <QElapsedTimer>
 #include <QLabel>
+#include <QMap>
 #include <QSet>
 #include <QTimer>
 
@@ -69,6 +70,10 @@ public slots:
     void onAvInvite(uint32_t friendId, bool video);
     void onAvStart(uint32_t friendId, bool video);
     void onAvEnd(uint32_t friendId, bool error);
+    void onAudioRateChanged(uint32_t friendId, int bitrate, int frameDuration, int jitter,
+                            int loss);
+    void onVideoQualityChanged(uint32_t friendId, int step, QSize size, int frameRate);
+    void onVideoLatencyChanged(uint32_t friendId, int interval, double median, double p95);
     void onAvatarChange(uint32_t friendId, const QPixmap& pic);
     void onAvatarRemoved(uint32_t friendId);
 
@@ -109,6 +114,7 @@ private:
     void showOutgoingCall(bool video);
     void startCounter();
     void stopCounter(bool error = false);
+    void updateCallInfo();
     void updateCallButtons();
     void SendMessageStr(QString msg);
 
@@ -126,6 +132,9 @@ private:
     QMenu statusMessageMenu;
     QLabel* callDuration;
     QTimer* callDurationTimer;
+    QString audioRateInfo;
+    QString videoQualityInfo;
+    QMap<int, QString> videoLatencyInfo;
     QTimer typingTimer;
     QElapsedTimer timeElapsed;
     OfflineMsgEngine* offlineEngine;
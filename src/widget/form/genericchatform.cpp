@@ -133,7 +133,6 @@ GenericChatForm::GenericChatForm(QWidget* parent)
     QGridLayout* buttonsLayout = new QGridLayout();
 
     chatWidget = new ChatLog(this);
-    chatWidget->setBusyNotification(ChatMessage::createBusyNotification());
 
     // settings
     const Settings& s = Settings::getInstance();
@@ -597,7 +596,7 @@ void GenericChatForm::onSelectAllClicked()
 
 void GenericChatForm::insertChatMessage(ChatMessage::Ptr msg)
 {
-    chatWidget->insertChatlineAtBottom(std::static_pointer_cast<ChatLine>(msg));
+    chatWidget->insertChatlineAtBottom(msg);
     emit messageInserted();
 }
 
@@ -42,6 +42,11 @@
 #define ALC_ALL_DEVICES_SPECIFIER ALC_DEVICE_SPECIFIER
 #endif
 
+namespace {
+/// How often the input level is polled while the form is visible, about the display rate
+const int VOLUME_POLL_INTERVAL_MS = 33;
+}
+
 AVForm::AVForm()
     : GenericForm(QPixmap(":/img/settings/av.png"))
     , subscribedToAudioIn(false)
@@ -104,7 +109,8 @@ AVForm::AVForm()
     audioThresholdSlider->setTracking(false);
     audioThresholdSlider->installEventFilter(this);
 
-    connect(&audio, &Audio::volumeAvailable, this, &AVForm::setVolume);
+    volumeTimer.setInterval(VOLUME_POLL_INTERVAL_MS);
+    connect(&volumeTimer, &QTimer::timeout, this, &AVForm::updateVolumeDisplay);
     volumeDisplay->setMinimum(audio.minInputThreshold() * 1000);
     volumeDisplay->setMaximum(audio.maxInputThreshold() * 1000);
 
@@ -133,6 +139,8 @@ void AVForm::hideEvent(QHideEvent* event)
         subscribedToAudioIn = false;
     }
 
+    volumeTimer.stop();
+
     if (camVideoSurface) {
         camVideoSurface->setSource(nullptr);
         killVideoSurface();
@@ -155,6 +163,8 @@ void AVForm::showEvent(QShowEvent* event)
         subscribedToAudioIn = true;
     }
 
+    volumeTimer.start();
+
     GenericForm::showEvent(event);
 }
 
@@ -173,9 +183,11 @@ void AVForm::rescanDevices()
     getVideoDevices();
 }
 
-void AVForm::setVolume(float value)
+void AVForm::updateVolumeDisplay()
 {
-    volumeDisplay->setValue(value * 1000);
+    const float level = Audio::getInstance().getInputLevel().level();
+    // QProgressBar doesn't repaint if the value didn't change, e.g. while the input is silent
+    volumeDisplay->setValue(qRound(level * 1000));
 }
 
 void AVForm::on_cbEnableBackend2_stateChanged()
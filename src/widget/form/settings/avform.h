@@ -23,6 +23,7 @@
 #include <QList>
 #include <QObject>
 #include <QString>
+#include <QTimer>
 
 #include "genericsettings.h"
 #include "ui_avform.h"
@@ -76,7 +77,7 @@ private slots:
     void on_videoModescomboBox_currentIndexChanged(int index);
 
     void rescanDevices();
-    void setVolume(float value);
+    void updateVolumeDisplay();
 
     void on_cbEnableBackend2_stateChanged();
 
@@ -90,6 +91,7 @@ private:
 
 private:
     bool subscribedToAudioIn;
+    QTimer volumeTimer;
     VideoSurface* camVideoSurface;
     CameraSource& camera;
     QVector<QPair<QString, QString>> videoDeviceList;
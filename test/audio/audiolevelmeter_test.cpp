@@ -0,0 +1,118 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/audio/audiolevelmeter.h"
+
+#include <QtTest/QtTest>
+#include <QVector>
+
+#include <limits>
+
+static const int FRAME_SAMPLES = 960;
+
+static QVector<int16_t> squareFrame(int16_t amplitude)
+{
+    QVector<int16_t> frame(FRAME_SAMPLES);
+    for (int i = 0; i < FRAME_SAMPLES; ++i) {
+        frame[i] = i % 2 ? amplitude : static_cast<int16_t>(-amplitude);
+    }
+
+    return frame;
+}
+
+class TestAudioLevelMeter : public QObject
+{
+    Q_OBJECT
+private slots:
+    void silenceTest();
+    void levelTest();
+    void peakDecayTest();
+    void resetTest();
+};
+
+void TestAudioLevelMeter::silenceTest()
+{
+    AudioLevelMeter meter;
+    const QVector<int16_t> frame(FRAME_SAMPLES, 0);
+
+    QVERIFY(meter.update(frame.constData(), FRAME_SAMPLES) == 0.0f);
+    QVERIFY(meter.update(frame.constData(), 0) == 0.0f);
+    QVERIFY(meter.level() == 0.0f);
+    QVERIFY(meter.peak() == 0.0f);
+    QVERIFY(meter.rms() == 0.0f);
+}
+
+void TestAudioLevelMeter::levelTest()
+{
+    AudioLevelMeter meter;
+    const QVector<int16_t> frame = squareFrame(16384);
+
+    float level = 0.0f;
+    for (int i = 0; i < 50; ++i) {
+        level = meter.update(frame.constData(), FRAME_SAMPLES);
+    }
+
+    // a square wave has the same mean absolute, peak and RMS amplitude
+    QVERIFY(qAbs(level - 0.5f) < 0.001f);
+    QVERIFY(meter.level() == level);
+    QVERIFY(qAbs(meter.peak() - 0.5f) < 0.001f);
+    QVERIFY(qAbs(meter.rms() - 0.5f) < 0.001f);
+
+    const QVector<int16_t> full = squareFrame(std::numeric_limits<int16_t>::min());
+    meter.update(full.constData(), FRAME_SAMPLES);
+    QVERIFY(meter.peak() == 1.0f);
+}
+
+void TestAudioLevelMeter::peakDecayTest()
+{
+    AudioLevelMeter meter;
+    const QVector<int16_t> loud = squareFrame(32000);
+    const QVector<int16_t> silence(FRAME_SAMPLES, 0);
+
+    meter.update(loud.constData(), FRAME_SAMPLES);
+    const float peak = meter.peak();
+
+    // a reader polling every other frame still sees the peak
+    meter.update(silence.constData(), FRAME_SAMPLES);
+    QVERIFY(meter.level() == 0.0f);
+    QVERIFY(meter.peak() > peak / 2);
+    QVERIFY(meter.peak() < peak);
+
+    for (int i = 0; i < 50; ++i) {
+        meter.update(silence.constData(), FRAME_SAMPLES);
+    }
+
+    QVERIFY(meter.peak() < 0.01f);
+    QVERIFY(meter.rms() < 0.01f);
+}
+
+void TestAudioLevelMeter::resetTest()
+{
+    AudioLevelMeter meter;
+    const QVector<int16_t> frame = squareFrame(16384);
+
+    meter.update(frame.constData(), FRAME_SAMPLES);
+    meter.reset();
+    QVERIFY(meter.level() == 0.0f);
+    QVERIFY(meter.peak() == 0.0f);
+    QVERIFY(meter.rms() == 0.0f);
+}
+
+QTEST_GUILESS_MAIN(TestAudioLevelMeter)
+#include "audiolevelmeter_test.moc"
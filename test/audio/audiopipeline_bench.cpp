@@ -0,0 +1,344 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/audio/audiolevelmeter.h"
+#include "src/audio/audioresampler.h"
+#include "src/audio/backend/nullaudio.h"
+
+#include <QtTest/QtTest>
+#include <QTemporaryFile>
+#include <QVector>
+
+#include <cmath>
+
+#ifdef USE_FILTERAUDIO
+#include <filter_audio.h>
+#endif
+
+/*
+ * Every benchmark iteration processes one 20ms frame for each of the concurrent streams, so the
+ * per-frame cost of a stage is the reported time divided by the number of streams.
+ */
+
+static const uint32_t SAMPLE_RATE = 48000;
+static const size_t FRAME_SAMPLES = 960;
+
+/**
+ * @brief Generates a frame of a sine, with a different pitch for every stream.
+ */
+static QVector<int16_t> sineFrame(int stream, unsigned channels, uint32_t rate)
+{
+    const size_t samples = rate / 50;
+    QVector<int16_t> frame(static_cast<int>(samples * channels));
+    for (size_t i = 0; i < samples; ++i) {
+        const double t = static_cast<double>(i) / rate;
+        const int16_t v = static_cast<int16_t>(8000 * std::sin(2 * M_PI * (220 + 20 * stream) * t));
+        for (unsigned ch = 0; ch < channels; ++ch) {
+            frame[static_cast<int>(i * channels + ch)] = v;
+        }
+    }
+
+    return frame;
+}
+
+static QVector<QVector<int16_t>> sineFrames(int streams, unsigned channels, uint32_t rate)
+{
+    QVector<QVector<int16_t>> frames;
+    for (int s = 0; s < streams; ++s) {
+        frames << sineFrame(s, channels, rate);
+    }
+
+    return frames;
+}
+
+/**
+ * @brief Writes a one second mono 48kHz WAV file to use as capture input.
+ */
+static bool writeInputWav(QTemporaryFile& file)
+{
+    if (!file.open()) {
+        return false;
+    }
+
+    QVector<int16_t> pcm;
+    for (int f = 0; f < 50; ++f) {
+        pcm << sineFrame(0, 1, SAMPLE_RATE);
+    }
+
+    const quint32 bytes = static_cast<quint32>(pcm.size() * 2);
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData("RIFF", 4);
+    out << static_cast<quint32>(36 + bytes);
+    out.writeRawData("WAVEfmt ", 8);
+    out << quint32{16} << quint16{1} << quint16{1} << SAMPLE_RATE << quint32{SAMPLE_RATE * 2}
+        << quint16{2} << quint16{16};
+    out.writeRawData("data", 4);
+    out << bytes;
+    for (int16_t sample : pcm) {
+        out << sample;
+    }
+
+    file.close();
+    return out.status() == QDataStream::Ok;
+}
+
+class BenchAudioPipeline : public QObject
+{
+    Q_OBJECT
+private slots:
+    void gain_data();
+    void gain();
+    void inputLevel_data();
+    void inputLevel();
+    void echoCancel_data();
+    void echoCancel();
+    void mixing_data();
+    void mixing();
+    void resampling_data();
+    void resampling();
+    void pipeline_data();
+    void pipeline();
+
+private:
+    void addStreamRows();
+};
+
+void BenchAudioPipeline::addStreamRows()
+{
+    QTest::addColumn<int>("streams");
+    QTest::newRow("1 stream") << 1;
+    QTest::newRow("10 streams") << 10;
+    QTest::newRow("50 streams") << 50;
+}
+
+void BenchAudioPipeline::gain_data()
+{
+    addStreamRows();
+}
+
+void BenchAudioPipeline::gain()
+{
+    QFETCH(int, streams);
+    const QVector<QVector<int16_t>> frames = sineFrames(streams, 1, SAMPLE_RATE);
+    QVector<int16_t> buf(static_cast<int>(FRAME_SAMPLES));
+    const qreal factor = std::pow(10.0, 6.0 / 20.0);
+
+    QBENCHMARK
+    {
+        for (const QVector<int16_t>& frame : frames) {
+            // amplifying the same buffer over and over would only measure clipping
+            memcpy(buf.data(), frame.constData(), FRAME_SAMPLES * sizeof(int16_t));
+            Audio::applyGain(buf.data(), FRAME_SAMPLES, factor);
+        }
+    }
+}
+
+void BenchAudioPipeline::inputLevel_data()
+{
+    addStreamRows();
+}
+
+/**
+ * @brief Updates the level meter, the only per frame work left for voice activity detection.
+ */
+void BenchAudioPipeline::inputLevel()
+{
+    QFETCH(int, streams);
+    const QVector<QVector<int16_t>> frames = sineFrames(streams, 1, SAMPLE_RATE);
+    AudioLevelMeter meter;
+    float volume = 0.0f;
+
+    QBENCHMARK
+    {
+        for (const QVector<int16_t>& frame : frames) {
+            volume += meter.update(frame.constData(), FRAME_SAMPLES);
+        }
+    }
+
+    QVERIFY(volume > 0.0f);
+    QVERIFY(meter.peak() > 0.0f);
+}
+
+void BenchAudioPipeline::echoCancel_data()
+{
+    addStreamRows();
+}
+
+void BenchAudioPipeline::echoCancel()
+{
+#ifdef USE_FILTERAUDIO
+    QFETCH(int, streams);
+    const QVector<QVector<int16_t>> farEnd = sineFrames(streams, 1, SAMPLE_RATE);
+    const QVector<int16_t> nearEnd = sineFrame(streams, 1, SAMPLE_RATE);
+    QVector<int16_t> buf(static_cast<int>(FRAME_SAMPLES));
+
+    QVector<Filter_Audio*> filters;
+    for (int s = 0; s < streams; ++s) {
+        Filter_Audio* filter = new_filter_audio(SAMPLE_RATE);
+        set_echo_delay_ms(filter, 20);
+        enable_disable_filters(filter, 1, 1, 1, 0);
+        filters << filter;
+    }
+
+    QBENCHMARK
+    {
+        for (int s = 0; s < streams; ++s) {
+            QVector<int16_t> played = farEnd[s];
+            pass_audio_output(filters[s], played.data(), FRAME_SAMPLES);
+            memcpy(buf.data(), nearEnd.constData(), FRAME_SAMPLES * sizeof(int16_t));
+            filter_audio(filters[s], buf.data(), FRAME_SAMPLES);
+        }
+    }
+
+    for (Filter_Audio* filter : filters) {
+        kill_filter_audio(filter);
+    }
+#else
+    QSKIP("Built without filter_audio");
+#endif
+}
+
+void BenchAudioPipeline::mixing_data()
+{
+    addStreamRows();
+}
+
+void BenchAudioPipeline::mixing()
+{
+    QFETCH(int, streams);
+    const QVector<QVector<int16_t>> frames = sineFrames(streams, 2, SAMPLE_RATE);
+
+    NullAudio audio;
+    QVector<uint> sources(streams);
+    for (uint& source : sources) {
+        audio.subscribeOutput(source);
+    }
+
+    QBENCHMARK
+    {
+        // peers already play at the mixer format, so nothing is resampled
+        for (int s = 0; s < streams; ++s) {
+            audio.playAudioBuffer(sources[s], frames[s].constData(), FRAME_SAMPLES, 2,
+                                  SAMPLE_RATE);
+        }
+
+        audio.process();
+    }
+
+    for (uint& source : sources) {
+        audio.unsubscribeOutput(source);
+    }
+}
+
+void BenchAudioPipeline::resampling_data()
+{
+    QTest::addColumn<int>("streams");
+    QTest::addColumn<int>("quality");
+
+    const char* names[] = {"fast", "medium", "best"};
+    for (int quality = 0; quality < 3; ++quality) {
+        for (int streams : {1, 10, 50}) {
+            const QByteArray name = QByteArray::number(streams) + " streams, " + names[quality];
+            QTest::newRow(name.constData()) << streams << quality;
+        }
+    }
+}
+
+void BenchAudioPipeline::resampling()
+{
+    QFETCH(int, streams);
+    QFETCH(int, quality);
+    const QVector<QVector<int16_t>> frames = sineFrames(streams, 2, SAMPLE_RATE);
+
+    // a 44.1kHz soundcard is the common case where OpenAL has to resample peer audio
+    QVector<AudioResampler> resamplers(streams);
+    for (AudioResampler& resampler : resamplers) {
+        resampler.setQuality(static_cast<AudioResampler::Quality>(quality));
+    }
+
+    size_t outSamples = 0;
+    QBENCHMARK
+    {
+        for (int s = 0; s < streams; ++s) {
+            resamplers[s].process(frames[s].constData(), FRAME_SAMPLES, 2, SAMPLE_RATE, 2, 44100,
+                                  outSamples);
+        }
+    }
+
+    QVERIFY(outSamples > 0);
+}
+
+void BenchAudioPipeline::pipeline_data()
+{
+    addStreamRows();
+}
+
+/**
+ * @brief Runs capture and playback through the null backend, from and to WAV files.
+ */
+void BenchAudioPipeline::pipeline()
+{
+    QFETCH(int, streams);
+    const QVector<QVector<int16_t>> frames = sineFrames(streams, 1, SAMPLE_RATE);
+
+    QTemporaryFile input;
+    QTemporaryFile output;
+    QVERIFY(writeInputWav(input));
+    QVERIFY(output.open());
+    output.close();
+
+    NullAudio audio;
+    audio.setEchoCancel(true);
+    audio.reinitInput(input.fileName());
+    QVERIFY(audio.reinitOutput(output.fileName()));
+    audio.setInputGain(6.0);
+    audio.subscribeInput();
+
+    int captured = 0;
+    connect(&audio, &Audio::frameAvailable, [&captured](const int16_t*, size_t, uint8_t, uint32_t) {
+        ++captured;
+    });
+
+    QVector<uint> sources(streams);
+    for (uint& source : sources) {
+        audio.subscribeOutput(source);
+    }
+
+    QBENCHMARK
+    {
+        for (int s = 0; s < streams; ++s) {
+            audio.playAudioBuffer(sources[s], frames[s].constData(), FRAME_SAMPLES, 1,
+                                  SAMPLE_RATE);
+        }
+
+        audio.process();
+    }
+
+    QVERIFY(captured > 0);
+
+    for (uint& source : sources) {
+        audio.unsubscribeOutput(source);
+    }
+
+    audio.unsubscribeInput();
+}
+
+QTEST_GUILESS_MAIN(BenchAudioPipeline)
+#include "audiopipeline_bench.moc"
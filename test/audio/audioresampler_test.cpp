@@ -0,0 +1,149 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/audio/audioresampler.h"
+
+#include <QtTest/QtTest>
+#include <QVector>
+
+#include <cmath>
+
+static const uint32_t SAMPLE_RATE = 48000;
+static const size_t FRAME_SAMPLES = 960;
+
+/**
+ * @brief Generates a stereo frame of a 440Hz sine, continuing at the given sample offset.
+ */
+static QVector<int16_t> sineFrame(size_t offset, size_t samples, uint32_t rate)
+{
+    QVector<int16_t> frame(static_cast<int>(samples * 2));
+    for (size_t i = 0; i < samples; ++i) {
+        const double t = static_cast<double>(offset + i) / rate;
+        const int16_t v = static_cast<int16_t>(10000 * std::sin(2 * M_PI * 440 * t));
+        frame[static_cast<int>(2 * i)] = v;
+        frame[static_cast<int>(2 * i + 1)] = v;
+    }
+
+    return frame;
+}
+
+/**
+ * @brief Resamples 50 frames of a sine and returns the mean error after the first few frames.
+ */
+static double sineError(AudioResampler::Quality quality, uint32_t inRate, size_t& produced)
+{
+    AudioResampler resampler{quality};
+    const size_t inSamples = inRate / 50;
+    double error = 0.0;
+    int count = 0;
+    produced = 0;
+
+    for (size_t f = 0; f < 50; ++f) {
+        QVector<int16_t> in = sineFrame(f * inSamples, inSamples, inRate);
+        size_t outSamples = 0;
+        const int16_t* out = resampler.process(in.constData(), inSamples, 2, inRate, 1,
+                                               SAMPLE_RATE, outSamples);
+        for (size_t i = 0; i < outSamples; ++i) {
+            const double t = static_cast<double>(produced + i) / SAMPLE_RATE;
+            const double expected = 10000 * std::sin(2 * M_PI * 440 * t);
+            if (f > 2) {
+                error += std::abs(out[i] - expected);
+                ++count;
+            }
+        }
+
+        produced += outSamples;
+    }
+
+    return error / count;
+}
+
+class TestAudioResampler : public QObject
+{
+    Q_OBJECT
+private slots:
+    void passthroughTest();
+    void downmixTest();
+    void upmixTest();
+    void upsampleTest();
+    void downsampleTest();
+};
+
+void TestAudioResampler::passthroughTest()
+{
+    AudioResampler resampler;
+    QVector<int16_t> in = sineFrame(0, FRAME_SAMPLES, SAMPLE_RATE);
+    size_t outSamples = 0;
+    const int16_t* out = resampler.process(in.constData(), FRAME_SAMPLES, 2, SAMPLE_RATE, 2,
+                                           SAMPLE_RATE, outSamples);
+    QVERIFY(out == in.constData());
+    QVERIFY(outSamples == FRAME_SAMPLES);
+}
+
+void TestAudioResampler::downmixTest()
+{
+    AudioResampler resampler;
+    const int16_t in[] = {100, 300, -200, 0, 32767, 32767};
+    size_t outSamples = 0;
+    const int16_t* out = resampler.process(in, 3, 2, SAMPLE_RATE, 1, SAMPLE_RATE, outSamples);
+    QVERIFY(outSamples == 3);
+    QVERIFY(out[0] == 200);
+    QVERIFY(out[1] == -100);
+    QVERIFY(out[2] == 32767);
+}
+
+void TestAudioResampler::upmixTest()
+{
+    AudioResampler resampler;
+    const int16_t in[] = {1, -2, 3};
+    size_t outSamples = 0;
+    const int16_t* out = resampler.process(in, 3, 1, SAMPLE_RATE, 2, SAMPLE_RATE, outSamples);
+    QVERIFY(outSamples == 3);
+    for (int i = 0; i < 3; ++i) {
+        QVERIFY(out[2 * i] == in[i]);
+        QVERIFY(out[2 * i + 1] == in[i]);
+    }
+}
+
+void TestAudioResampler::upsampleTest()
+{
+    const AudioResampler::Quality qualities[] = {AudioResampler::Quality::Fast,
+                                                 AudioResampler::Quality::Medium,
+                                                 AudioResampler::Quality::Best};
+    for (AudioResampler::Quality quality : qualities) {
+        size_t produced = 0;
+        const double error = sineError(quality, 24000, produced);
+        // one second of input, the kernel's lookahead is still pending
+        QVERIFY(produced <= SAMPLE_RATE);
+        QVERIFY(produced > SAMPLE_RATE - 64);
+        QVERIFY(error < 20.0);
+    }
+}
+
+void TestAudioResampler::downsampleTest()
+{
+    size_t produced = 0;
+    const double error = sineError(AudioResampler::Quality::Best, 96000, produced);
+    QVERIFY(produced <= SAMPLE_RATE);
+    QVERIFY(produced > SAMPLE_RATE - 64);
+    QVERIFY(error < 20.0);
+}
+
+QTEST_GUILESS_MAIN(TestAudioResampler)
+#include "audioresampler_test.moc"
@@ -0,0 +1,189 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/chatlog/chatline.h"
+#include "src/chatlog/chatlinecontent.h"
+#include "src/chatlog/chatlog.h"
+
+#include <QScrollBar>
+#include <QtTest/QtTest>
+
+/*
+ * The log is filled with placeholder content of fixed line heights, so the benchmarks measure
+ * the bookkeeping of the ChatLog rather than text layout. Every iteration scrolls by the given
+ * steps, the way the scroll bar does, which runs checkVisibility() once per step.
+ */
+
+/// Lines in the log, a long history
+static const int LOG_LINES = 100000;
+/// Steps scrolled per benchmark iteration
+static const int SCROLL_STEPS = 100;
+
+/**
+ * @brief Placeholder for a column of a message, wrapping a text of the given length.
+ */
+class Block : public ChatLineContent
+{
+public:
+    Block(int length, qreal lineHeight)
+        : length{length}
+        , lineHeight{lineHeight}
+    {
+    }
+
+    void setWidth(qreal width) override
+    {
+        // wrap at about the width of a character per line height
+        const int perLine = qMax(1, static_cast<int>(width / (lineHeight / 2)));
+        prepareGeometryChange();
+        size = QSizeF(width, lineHeight * ((length + perLine - 1) / perLine));
+    }
+
+    QRectF boundingRect() const override
+    {
+        return QRectF(QPointF(), size);
+    }
+
+    void paint(QPainter*, const QStyleOptionGraphicsItem*, QWidget*) override
+    {
+    }
+
+private:
+    int length;
+    qreal lineHeight;
+    QSizeF size;
+};
+
+/**
+ * @brief Line laid out like a chat message, with sender, text and timestamp columns.
+ */
+class Message : public ChatLine
+{
+public:
+    Message(int length, qreal lineHeight)
+    {
+        addColumn(new Block(8, lineHeight), ColumnFormat(75.0, ColumnFormat::FixedSize));
+        addColumn(new Block(length, lineHeight), ColumnFormat(1.0, ColumnFormat::VariableSize));
+        addColumn(new Block(5, lineHeight), ColumnFormat(50.0, ColumnFormat::FixedSize));
+    }
+};
+
+class BenchChatLogScroll : public QObject
+{
+    Q_OBJECT
+private slots:
+    void scroll_data();
+    void scroll();
+    void jump_data();
+    void jump();
+
+private:
+    void addScreenRows();
+    void fill(ChatLog& log, qreal lineHeight, int viewportHeight);
+};
+
+void BenchChatLogScroll::addScreenRows()
+{
+    QTest::addColumn<qreal>("lineHeight");
+    QTest::addColumn<int>("viewportHeight");
+    QTest::newRow("default font, 720p") << 20.0 << 600;
+    QTest::newRow("small font, 4k") << 10.0 << 2000;
+}
+
+/**
+ * @brief Loads the history into the log at once, the way a chat form does.
+ */
+void BenchChatLogScroll::fill(ChatLog& log, qreal lineHeight, int viewportHeight)
+{
+    log.resize(800, viewportHeight);
+    log.show();
+
+    QList<ChatLine::Ptr> lines;
+    lines.reserve(LOG_LINES);
+    for (int i = 0; i < LOG_LINES; ++i) {
+        // a mix of short and multi-line messages
+        lines << ChatLine::Ptr(new Message(20 + (i * 37) % 400, lineHeight));
+    }
+
+    log.insertChatlineOnTop(lines);
+}
+
+void BenchChatLogScroll::scroll_data()
+{
+    addScreenRows();
+}
+
+/**
+ * @brief Scrolls pixel by pixel through the middle of the log, back and forth.
+ */
+void BenchChatLogScroll::scroll()
+{
+    QFETCH(qreal, lineHeight);
+    QFETCH(int, viewportHeight);
+
+    ChatLog log;
+    fill(log, lineHeight, viewportHeight);
+
+    QScrollBar* bar = log.verticalScrollBar();
+    int step = 1;
+    bar->setValue(bar->maximum() / 2);
+
+    QBENCHMARK
+    {
+        for (int i = 0; i < SCROLL_STEPS; ++i) {
+            bar->setValue(bar->value() + step);
+        }
+
+        step = -step;
+    }
+}
+
+void BenchChatLogScroll::jump_data()
+{
+    addScreenRows();
+}
+
+/**
+ * @brief Jumps across the whole log, like dragging the scroll bar, replacing all lines in the
+ * scene on every step.
+ */
+void BenchChatLogScroll::jump()
+{
+    QFETCH(qreal, lineHeight);
+    QFETCH(int, viewportHeight);
+
+    ChatLog log;
+    fill(log, lineHeight, viewportHeight);
+
+    QScrollBar* bar = log.verticalScrollBar();
+    const int stride = bar->maximum() / SCROLL_STEPS + viewportHeight;
+    QVERIFY(bar->maximum() > stride);
+    int pos = 0;
+
+    QBENCHMARK
+    {
+        for (int i = 0; i < SCROLL_STEPS; ++i) {
+            pos = (pos + stride) % bar->maximum();
+            bar->setValue(pos);
+        }
+    }
+}
+
+QTEST_MAIN(BenchChatLogScroll)
+#include "chatlogscroll_bench.moc"
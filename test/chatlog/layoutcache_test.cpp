@@ -0,0 +1,221 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/chatlog/layoutcache.h"
+
+#include <QPointer>
+#include <QTextDocument>
+#include <QtTest/QtTest>
+
+static LayoutCache::Key makeKey(quint64 id, qreal width = 400.0)
+{
+    LayoutCache::Key key;
+    key.id = id;
+    key.width = width;
+    key.style = 42;
+    key.emojiSize = 16;
+    return key;
+}
+
+static QTextDocument* makeDocument(int length = 100)
+{
+    QTextDocument* doc = new QTextDocument;
+    doc->setPlainText(QString(length, QChar('a')));
+    return doc;
+}
+
+class TestLayoutCache : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void cleanup();
+    void hitTest();
+    void keyTest();
+    void evictionTest();
+    void oversizeTest();
+    void removeTest();
+    void replaceTest();
+
+private:
+    int defaultMaxCost = 0;
+};
+
+void TestLayoutCache::initTestCase()
+{
+    defaultMaxCost = LayoutCache::getInstance().getMaxCost();
+}
+
+void TestLayoutCache::cleanup()
+{
+    LayoutCache::getInstance().clear();
+    LayoutCache::getInstance().setMaxCost(defaultMaxCost);
+}
+
+void TestLayoutCache::hitTest()
+{
+    LayoutCache& cache = LayoutCache::getInstance();
+    QTextDocument* doc = makeDocument();
+    cache.insert(makeKey(1), doc);
+    QVERIFY(cache.getCount() == 1);
+    QVERIFY(cache.getCost() == LayoutCache::estimateCost(doc));
+
+    QTextDocument* taken = cache.take(makeKey(1));
+    QVERIFY(taken == doc);
+    QVERIFY(cache.getCount() == 0);
+    QVERIFY(cache.getCost() == 0);
+
+    // taken documents are owned by the caller
+    QVERIFY(!cache.take(makeKey(1)));
+    delete taken;
+
+    QVERIFY(cache.getHits() == 1);
+    QVERIFY(cache.getMisses() == 1);
+    QCOMPARE(cache.getHitRate(), 0.5);
+
+    cache.clear();
+    QVERIFY(cache.getHits() == 0);
+    QCOMPARE(cache.getHitRate(), 0.0);
+}
+
+void TestLayoutCache::keyTest()
+{
+    LayoutCache& cache = LayoutCache::getInstance();
+    const LayoutCache::Key key = makeKey(1);
+    cache.insert(key, makeDocument());
+
+    LayoutCache::Key other = key;
+    other.id = 2;
+    QVERIFY(!cache.take(other));
+
+    other = key;
+    other.width = 401.0;
+    QVERIFY(!cache.take(other));
+
+    other = key;
+    other.font.setPointSize(key.font.pointSize() + 2);
+    QVERIFY(!cache.take(other));
+
+    other = key;
+    other.style = 43;
+    QVERIFY(!cache.take(other));
+
+    other = key;
+    other.emojiSize = 24;
+    QVERIFY(!cache.take(other));
+
+    QTextDocument* doc = cache.take(key);
+    QVERIFY(doc);
+    delete doc;
+}
+
+void TestLayoutCache::evictionTest()
+{
+    LayoutCache& cache = LayoutCache::getInstance();
+    QTextDocument* docs[4];
+    for (QTextDocument*& doc : docs) {
+        doc = makeDocument();
+    }
+
+    cache.setMaxCost(3 * LayoutCache::estimateCost(docs[0]));
+    QPointer<QTextDocument> oldest = docs[1];
+
+    for (int i = 0; i < 3; ++i) {
+        cache.insert(makeKey(i), docs[i]);
+    }
+
+    // the first document becomes visible again and is the most recently used afterwards
+    cache.insert(makeKey(0), cache.take(makeKey(0)));
+    cache.insert(makeKey(3), docs[3]);
+
+    QVERIFY(cache.getCount() == 3);
+    QVERIFY(cache.getCost() <= cache.getMaxCost());
+    QVERIFY(!oldest);
+    QVERIFY(!cache.take(makeKey(1)));
+
+    for (int i : {0, 2, 3}) {
+        QTextDocument* doc = cache.take(makeKey(i));
+        QVERIFY(doc == docs[i]);
+        delete doc;
+    }
+
+    // shrinking the budget evicts right away
+    for (int i = 0; i < 3; ++i) {
+        cache.insert(makeKey(i), makeDocument());
+    }
+
+    cache.setMaxCost(cache.getCost() - 1);
+    QVERIFY(cache.getCount() == 2);
+    QVERIFY(!cache.take(makeKey(0)));
+}
+
+void TestLayoutCache::oversizeTest()
+{
+    LayoutCache& cache = LayoutCache::getInstance();
+    QPointer<QTextDocument> doc = makeDocument(10000);
+    cache.setMaxCost(LayoutCache::estimateCost(doc) - 1);
+
+    cache.insert(makeKey(1), doc);
+    QVERIFY(!doc);
+    QVERIFY(cache.getCount() == 0);
+}
+
+void TestLayoutCache::removeTest()
+{
+    LayoutCache& cache = LayoutCache::getInstance();
+    QPointer<QTextDocument> doc = makeDocument();
+    cache.insert(makeKey(1), doc);
+
+    cache.remove(1);
+    QVERIFY(!doc);
+    QVERIFY(cache.getCount() == 0);
+
+    // nothing to remove
+    cache.remove(2);
+}
+
+void TestLayoutCache::replaceTest()
+{
+    LayoutCache& cache = LayoutCache::getInstance();
+    QPointer<QTextDocument> narrow = makeDocument();
+    QPointer<QTextDocument> wide = makeDocument();
+    QPointer<QTextDocument> other = makeDocument();
+    cache.insert(makeKey(1, 300.0), narrow);
+    cache.insert(makeKey(2, 300.0), other);
+
+    // laid out again after a resize, the old layout is of no use anymore
+    cache.insert(makeKey(1, 500.0), wide);
+    QVERIFY(!narrow);
+    QVERIFY(wide);
+    QVERIFY(other);
+    QVERIFY(cache.getCount() == 2);
+    QVERIFY(cache.getCost() == 2 * LayoutCache::estimateCost(other));
+
+    // all layouts of a text are removed, whatever their width
+    cache.remove(1);
+    QVERIFY(!wide);
+    QVERIFY(cache.getCount() == 1);
+
+    QTextDocument* doc = cache.take(makeKey(2, 300.0));
+    QVERIFY(doc == other);
+    delete doc;
+}
+
+QTEST_GUILESS_MAIN(TestLayoutCache)
+#include "layoutcache_test.moc"
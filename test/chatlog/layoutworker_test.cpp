@@ -0,0 +1,154 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/chatlog/layoutworker.h"
+
+#include <QThread>
+#include <QThreadPool>
+#include <QtTest/QtTest>
+#include <QVector>
+
+/**
+ * @brief Measures as if the content wrapped at 10 pixels per line.
+ */
+static ContentMetrics wrap(qreal width, int length)
+{
+    ContentMetrics metrics;
+    metrics.width = width;
+    metrics.size = QSizeF(width, 10.0 * (length / qMax(1, static_cast<int>(width / 10.0)) + 1));
+    metrics.ascent = 8.0;
+    return metrics;
+}
+
+/**
+ * @brief Jobs for lines with a measured text column and a column laid out on the GUI thread.
+ */
+static QVector<LayoutWorker::Job> makeJobs(int count, qreal width)
+{
+    QVector<LayoutWorker::Job> jobs;
+    for (int i = 0; i < count; ++i) {
+        LayoutWorker::Job job;
+        job.row = i;
+        job.widths << width << 50.0;
+        job.measures << [i](qreal width) { return wrap(width, i); } << ChatLineContent::Measure();
+        jobs << job;
+    }
+
+    return jobs;
+}
+
+/**
+ * @brief Takes all results of the worker.
+ */
+static QVector<LayoutWorker::Result> takeAll(LayoutWorker& worker)
+{
+    QVector<LayoutWorker::Result> results;
+    while (worker.isRunning()) {
+        results << worker.takeResults(64);
+        QThread::yieldCurrentThread();
+    }
+
+    return results;
+}
+
+class TestLayoutWorker : public QObject
+{
+    Q_OBJECT
+private slots:
+    void measureTest();
+    void orderTest();
+    void cancelTest();
+    void restartTest();
+    void poolTest();
+};
+
+void TestLayoutWorker::measureTest()
+{
+    const LayoutWorker::Job job = makeJobs(40, 100.0).last();
+    const LayoutWorker::Result result = LayoutWorker::measure(job);
+
+    QVERIFY(result.row == 39);
+    QVERIFY(result.metrics.size() == 2);
+    QCOMPARE(result.metrics[0].width, 100.0);
+    QCOMPARE(result.metrics[0].size, QSizeF(100.0, 40.0));
+    QCOMPARE(result.metrics[0].ascent, 8.0);
+    // not measured
+    QVERIFY(result.metrics[1].width < 0.0);
+}
+
+void TestLayoutWorker::orderTest()
+{
+    LayoutWorker worker;
+    QVERIFY(!worker.isRunning());
+
+    worker.start(makeJobs(5000, 200.0));
+    const QVector<LayoutWorker::Result> results = takeAll(worker);
+
+    QVERIFY(results.size() == 5000);
+    for (int i = 0; i < results.size(); ++i) {
+        QVERIFY(results[i].row == i);
+        QCOMPARE(results[i].metrics[0].size, wrap(200.0, i).size);
+    }
+
+    QVERIFY(worker.takeResults(64).isEmpty());
+}
+
+void TestLayoutWorker::cancelTest()
+{
+    LayoutWorker worker;
+    worker.start(makeJobs(5000, 200.0));
+    worker.takeResults(1);
+    worker.cancel();
+
+    QVERIFY(!worker.isRunning());
+    QVERIFY(worker.takeResults(64).isEmpty());
+
+    // nothing to measure
+    worker.start(QVector<LayoutWorker::Job>());
+    QVERIFY(!worker.isRunning());
+}
+
+void TestLayoutWorker::restartTest()
+{
+    LayoutWorker worker;
+    worker.start(makeJobs(5000, 200.0));
+    worker.takeResults(10);
+
+    // e.g. resized again, the results for the old width are dropped
+    worker.start(makeJobs(100, 300.0));
+    const QVector<LayoutWorker::Result> results = takeAll(worker);
+
+    QVERIFY(results.size() == 100);
+    for (const LayoutWorker::Result& result : results) {
+        QCOMPARE(result.metrics[0].width, 300.0);
+    }
+}
+
+void TestLayoutWorker::poolTest()
+{
+    LayoutWorker worker;
+    worker.start(makeJobs(5000, 200.0));
+
+    // a relayout must leave the global pool to the video pipeline
+    QCOMPARE(QThreadPool::globalInstance()->activeThreadCount(), 0);
+    QVERIFY(takeAll(worker).size() == 5000);
+}
+
+QTEST_GUILESS_MAIN(TestLayoutWorker)
+#include "layoutworker_test.moc"
@@ -0,0 +1,160 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/chatlog/linegeometry.h"
+
+#include <QtTest/QtTest>
+#include <QVector>
+
+static const qreal SPACING = 5.0;
+
+/**
+ * @brief Top of a line, computed the slow way.
+ */
+static qreal naiveTop(const QVector<qreal>& heights, int row)
+{
+    qreal top = 0.0;
+    for (int i = 0; i < row; ++i) {
+        top += heights[i] + SPACING;
+    }
+
+    return top;
+}
+
+class TestLineGeometry : public QObject
+{
+    Q_OBJECT
+private slots:
+    void emptyTest();
+    void positionTest();
+    void setHeightTest();
+    void findTest();
+    void prependTest();
+    void staleTest();
+};
+
+void TestLineGeometry::emptyTest()
+{
+    LineGeometry geometry{SPACING};
+    QVERIFY(geometry.size() == 0);
+    QVERIFY(geometry.getTotalHeight() == 0.0);
+    QVERIFY(geometry.getMeanHeight() == 0.0);
+    QVERIFY(geometry.findFirstByBottom(100.0) == 0);
+    QVERIFY(geometry.findFirstByTop(100.0) == 0);
+}
+
+void TestLineGeometry::positionTest()
+{
+    LineGeometry geometry{SPACING};
+    QVector<qreal> heights;
+    for (int i = 0; i < 100; ++i) {
+        heights << 10.0 + i % 7;
+        geometry.append(heights.last());
+    }
+
+    for (int i = 0; i < heights.size(); ++i) {
+        QCOMPARE(geometry.getTop(i), naiveTop(heights, i));
+        QCOMPARE(geometry.getBottom(i), naiveTop(heights, i) + heights[i]);
+    }
+
+    QCOMPARE(geometry.getTotalHeight(), naiveTop(heights, heights.size()) - SPACING);
+}
+
+void TestLineGeometry::setHeightTest()
+{
+    LineGeometry geometry{SPACING};
+    QVector<qreal> heights(37, 20.0);
+    for (qreal height : heights) {
+        geometry.append(height);
+    }
+
+    for (int row : {0, 5, 16, 36}) {
+        heights[row] = 50.0 + row;
+        geometry.setHeight(row, heights[row]);
+    }
+
+    for (int i = 0; i < heights.size(); ++i) {
+        QCOMPARE(geometry.getTop(i), naiveTop(heights, i));
+        QCOMPARE(geometry.getHeight(i), heights[i]);
+    }
+}
+
+void TestLineGeometry::findTest()
+{
+    LineGeometry geometry{SPACING};
+    for (int i = 0; i < 10; ++i) {
+        geometry.append(10.0);
+    }
+
+    // lines at 0-10, 15-25, 30-40, ...
+    QVERIFY(geometry.findFirstByBottom(-20.0) == 0);
+    QVERIFY(geometry.findFirstByBottom(5.0) == 0);
+    QVERIFY(geometry.findFirstByBottom(10.0) == 0);
+    QVERIFY(geometry.findFirstByBottom(12.0) == 1);
+    QVERIFY(geometry.findFirstByBottom(26.0) == 2);
+    QVERIFY(geometry.findFirstByBottom(145.0) == 9);
+    QVERIFY(geometry.findFirstByBottom(146.0) == 10);
+
+    QVERIFY(geometry.findFirstByTop(-20.0) == 0);
+    QVERIFY(geometry.findFirstByTop(0.0) == 0);
+    QVERIFY(geometry.findFirstByTop(1.0) == 1);
+    QVERIFY(geometry.findFirstByTop(15.0) == 1);
+    QVERIFY(geometry.findFirstByTop(16.0) == 2);
+    QVERIFY(geometry.findFirstByTop(135.0) == 9);
+    QVERIFY(geometry.findFirstByTop(500.0) == 10);
+}
+
+void TestLineGeometry::prependTest()
+{
+    LineGeometry geometry{SPACING};
+    geometry.append(30.0);
+    geometry.setHeight(0, 30.0);
+    geometry.prepend(3, 10.0);
+
+    QVERIFY(geometry.size() == 4);
+    QCOMPARE(geometry.getTop(3), 45.0);
+    QCOMPARE(geometry.getTotalHeight(), 75.0);
+    QCOMPARE(geometry.getMeanHeight(), 15.0);
+    QVERIFY(geometry.isStale(0));
+    QVERIFY(!geometry.isStale(3));
+
+    geometry.append(20.0);
+    QCOMPARE(geometry.getTop(4), 80.0);
+    QVERIFY(geometry.findFirstByTop(80.0) == 4);
+}
+
+void TestLineGeometry::staleTest()
+{
+    LineGeometry geometry{SPACING};
+    geometry.append(10.0);
+    QVERIFY(geometry.isStale(0));
+
+    geometry.setHeight(0, 10.0);
+    QVERIFY(!geometry.isStale(0));
+
+    geometry.invalidate();
+    QVERIFY(geometry.isStale(0));
+    QCOMPARE(geometry.getHeight(0), 10.0);
+
+    geometry.clear();
+    QVERIFY(geometry.size() == 0);
+}
+
+QTEST_GUILESS_MAIN(TestLineGeometry)
+#include "linegeometry_test.moc"
@@ -0,0 +1,120 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/chatlog/pixmapcache.h"
+
+#include <QImage>
+#include <QTemporaryDir>
+#include <QtTest/QtTest>
+
+/*
+ * Pixmaps need a GUI application, so only the decoding, which runs on plain QImages, is tested.
+ */
+
+class TestPixmapCache : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void scaleDownTest();
+    void noUpscaleTest();
+    void formatTest();
+    void missingTest();
+    void keyTest();
+
+private:
+    QString writeImage(const QString& name, QSize size, bool alpha);
+
+private:
+    QTemporaryDir dir;
+};
+
+/**
+ * @brief Writes a PNG of the given size into the temporary directory.
+ * @return Path of the image.
+ */
+QString TestPixmapCache::writeImage(const QString& name, QSize size, bool alpha)
+{
+    QImage image{size, alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32};
+    image.fill(alpha ? QColor(255, 0, 0, 128) : QColor(Qt::red));
+    const QString path = dir.path() + "/" + name + ".png";
+    return image.save(path) ? path : QString();
+}
+
+void TestPixmapCache::initTestCase()
+{
+    QVERIFY(dir.isValid());
+}
+
+void TestPixmapCache::scaleDownTest()
+{
+    const QString path = writeImage("wide", QSize(64, 32), false);
+    QVERIFY(!path.isEmpty());
+
+    // the aspect ratio is kept
+    QImage image = PixmapCache::decode(path, QSize(16, 16));
+    QVERIFY(image.size() == QSize(16, 8));
+
+    image = PixmapCache::decode(path, QSize(64, 32));
+    QVERIFY(image.size() == QSize(64, 32));
+}
+
+void TestPixmapCache::noUpscaleTest()
+{
+    const QString path = writeImage("small", QSize(8, 8), false);
+    QVERIFY(!path.isEmpty());
+
+    const QImage image = PixmapCache::decode(path, QSize(32, 32));
+    QVERIFY(image.size() == QSize(8, 8));
+}
+
+void TestPixmapCache::formatTest()
+{
+    const QString opaque = writeImage("opaque", QSize(4, 4), false);
+    const QString transparent = writeImage("transparent", QSize(4, 4), true);
+
+    QVERIFY(PixmapCache::decode(opaque, QSize(4, 4)).format() == QImage::Format_RGB32);
+    QVERIFY(PixmapCache::decode(transparent, QSize(4, 4)).format()
+            == QImage::Format_ARGB32_Premultiplied);
+}
+
+void TestPixmapCache::missingTest()
+{
+    QVERIFY(PixmapCache::decode(dir.path() + "/missing.png", QSize(16, 16)).isNull());
+    QVERIFY(PixmapCache::decode(QString(), QSize(16, 16)).isNull());
+}
+
+void TestPixmapCache::keyTest()
+{
+    const PixmapCache::Key key{"a.png", QSize(16, 16)};
+    const PixmapCache::Key same{"a.png", QSize(16, 16)};
+    const PixmapCache::Key otherSize{"a.png", QSize(16, 32)};
+    const PixmapCache::Key otherFile{"b.png", QSize(16, 16)};
+
+    QVERIFY(key == same);
+    QVERIFY(qHash(key) == qHash(same));
+    QVERIFY(!(key == otherSize));
+    QVERIFY(!(key == otherFile));
+    // width and height don't cancel each other out
+    QVERIFY(qHash(PixmapCache::Key{"a.png", QSize(16, 32)})
+            != qHash(PixmapCache::Key{"a.png", QSize(32, 16)}));
+}
+
+QTEST_GUILESS_MAIN(TestPixmapCache)
+#include "pixmapcache_test.moc"
@@ -0,0 +1,96 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/chatlog/textformatter.h"
+
+#include <QtTest/QtTest>
+#include <QString>
+
+/*
+ * Every iteration styles one large paste, as it reaches the formatter: HTML escaped, with
+ * smileys and quotes already replaced by tags. The throughput is the paste size divided by the
+ * reported time.
+ */
+
+/// Size of a paste, in characters
+static const int PASTE_SIZE = 256 * 1024;
+
+/**
+ * @brief Repeats the lines until the paste has the given size.
+ */
+static QString makePaste(const QString& lines, int size)
+{
+    QString paste;
+    paste.reserve(size + lines.size());
+    while (paste.size() < size) {
+        paste += lines;
+    }
+
+    return paste;
+}
+
+class BenchTextFormatter : public QObject
+{
+    Q_OBJECT
+private slots:
+    void applyStyling_data();
+    void applyStyling();
+};
+
+void BenchTextFormatter::applyStyling_data()
+{
+    QTest::addColumn<QString>("lines");
+    QTest::addColumn<bool>("showSymbols");
+
+    const QString plain = QStringLiteral("Lorem ipsum dolor sit amet, consectetur adipiscing "
+                                         "elit, sed do eiusmod tempor incididunt ut labore.\n");
+    const QString markdown = QStringLiteral("Some *bold*, /italic/ and _underlined_ words, "
+                                            "**more** of ~them~ and `a = b * c / d;`\n");
+    const QString urls = QStringLiteral("see https://github.com/qTox/qTox/issues/4233 and "
+                                        "www.example.com/a_b or mailto:user@example.com\n");
+    // code blocks are greedy, the whole paste ends up as one block
+    const QString code = QStringLiteral("```int main()\n{\n    return a * b / c;\n}```\n");
+    const QString quotes = QStringLiteral("<span class=quote>&gt; quoted &amp; escaped</span> "
+                                          "<img title=\":)\" src=\"key::)\"\\> *reply*\n");
+
+    QTest::newRow("plain text") << plain << false;
+    QTest::newRow("markdown") << markdown << false;
+    QTest::newRow("markdown, with symbols") << markdown << true;
+    QTest::newRow("urls") << urls << false;
+    QTest::newRow("code block") << code << false;
+    QTest::newRow("quotes and smileys") << quotes << false;
+}
+
+void BenchTextFormatter::applyStyling()
+{
+    QFETCH(QString, lines);
+    QFETCH(bool, showSymbols);
+    const QString paste = makePaste(lines, PASTE_SIZE);
+
+    QString styled;
+    QBENCHMARK
+    {
+        styled = TextFormatter(paste).applyStyling(showSymbols);
+    }
+
+    QVERIFY(styled.size() >= paste.size());
+}
+
+QTEST_GUILESS_MAIN(BenchTextFormatter)
+#include "textformatter_bench.moc"
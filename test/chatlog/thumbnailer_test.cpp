@@ -0,0 +1,166 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/chatlog/thumbnailer.h"
+
+#include <QBuffer>
+#include <QDir>
+#include <QImage>
+#include <QTemporaryDir>
+#include <QtTest/QtTest>
+
+static QByteArray encodePng(const QImage& image)
+{
+    QByteArray png;
+    QBuffer buffer{&png};
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, "PNG");
+    return png;
+}
+
+static QImage makeImage(QSize size, QColor color = Qt::red)
+{
+    QImage image{size, QImage::Format_RGB32};
+    image.fill(color);
+    return image;
+}
+
+class TestThumbnailer : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void scaleCropTest();
+    void loadImageTest();
+    void thumbnailTest();
+    void cacheTest();
+    void invalidTest();
+    void previewTest();
+
+private:
+    QString writeImage(const QString& name, const QImage& image);
+
+private:
+    QTemporaryDir dir;
+};
+
+QString TestThumbnailer::writeImage(const QString& name, const QImage& image)
+{
+    const QString path = dir.path() + "/" + name + ".png";
+    return image.save(path, "PNG") ? path : QString();
+}
+
+void TestThumbnailer::initTestCase()
+{
+    QVERIFY(dir.isValid());
+}
+
+void TestThumbnailer::scaleCropTest()
+{
+    QImage thumbnail = Thumbnailer::scaleCropIntoSquare(makeImage(QSize(100, 50)), 32);
+    QVERIFY(thumbnail.size() == QSize(32, 32));
+
+    thumbnail = Thumbnailer::scaleCropIntoSquare(makeImage(QSize(40, 80)), 32);
+    QVERIFY(thumbnail.size() == QSize(32, 32));
+
+    // smaller images aren't scaled up
+    thumbnail = Thumbnailer::scaleCropIntoSquare(makeImage(QSize(16, 16)), 32);
+    QVERIFY(thumbnail.size() == QSize(16, 16));
+}
+
+void TestThumbnailer::loadImageTest()
+{
+    const QByteArray png = encodePng(makeImage(QSize(200, 100)));
+
+    QImage image = Thumbnailer::loadImage(png, QSize(50, 50), Qt::KeepAspectRatio);
+    QVERIFY(image.size() == QSize(50, 25));
+
+    image = Thumbnailer::loadImage(png, QSize(50, 50), Qt::KeepAspectRatioByExpanding);
+    QVERIFY(image.size() == QSize(100, 50));
+
+    image = Thumbnailer::loadImage(png, QSize(400, 400), Qt::KeepAspectRatio);
+    QVERIFY(image.size() == QSize(200, 100));
+}
+
+void TestThumbnailer::thumbnailTest()
+{
+    const QString path = writeImage("thumbnail", makeImage(QSize(300, 200)));
+    QVERIFY(!path.isEmpty());
+
+    const QImage thumbnail = Thumbnailer::createThumbnail(path, 60, QString());
+    QVERIFY(thumbnail.size() == QSize(60, 60));
+    QVERIFY(thumbnail.pixel(30, 30) == QColor(Qt::red).rgb());
+}
+
+void TestThumbnailer::cacheTest()
+{
+    const QString cacheDir = dir.path() + "/cache";
+    const QImage image = makeImage(QSize(120, 120), Qt::blue);
+    const QString path = writeImage("cached", image);
+    const QString copy = writeImage("copy", image);
+    QVERIFY(!path.isEmpty() && !copy.isEmpty());
+
+    QVERIFY(Thumbnailer::createThumbnail(path, 40, cacheDir).size() == QSize(40, 40));
+    const QStringList cached = QDir{cacheDir}.entryList(QDir::Files);
+    QVERIFY(cached.size() == 1);
+    QVERIFY(cached.first().endsWith("_40.png"));
+
+    // replace the cached thumbnail, to see whether it's used
+    QVERIFY(makeImage(QSize(40, 40), Qt::green).save(QDir{cacheDir}.filePath(cached.first())));
+
+    // the cache is keyed by content, not by file name
+    QImage thumbnail = Thumbnailer::createThumbnail(copy, 40, cacheDir);
+    QVERIFY(thumbnail.pixel(20, 20) == QColor(Qt::green).rgb());
+
+    // other sizes are cached separately
+    thumbnail = Thumbnailer::createThumbnail(path, 20, cacheDir);
+    QVERIFY(thumbnail.size() == QSize(20, 20));
+    QVERIFY(thumbnail.pixel(10, 10) == QColor(Qt::blue).rgb());
+    QVERIFY(QDir{cacheDir}.entryList(QDir::Files).size() == 2);
+}
+
+void TestThumbnailer::invalidTest()
+{
+    const QString cacheDir = dir.path() + "/invalid";
+    QVERIFY(Thumbnailer::createThumbnail(dir.path() + "/missing.png", 40, cacheDir).isNull());
+
+    const QString path = dir.path() + "/text.png";
+    QFile file{path};
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("not an image");
+    file.close();
+
+    QVERIFY(Thumbnailer::createThumbnail(path, 40, cacheDir).isNull());
+    QVERIFY(Thumbnailer::createPreview(path, QSize(100, 100)).isEmpty());
+    QVERIFY(QDir{cacheDir}.entryList(QDir::Files).isEmpty());
+}
+
+void TestThumbnailer::previewTest()
+{
+    const QString path = writeImage("preview", makeImage(QSize(400, 100)));
+    QVERIFY(!path.isEmpty());
+
+    const QByteArray png = Thumbnailer::createPreview(path, QSize(200, 200));
+    QImage preview;
+    QVERIFY(preview.loadFromData(png, "PNG"));
+    QVERIFY(preview.size() == QSize(200, 50));
+}
+
+QTEST_GUILESS_MAIN(TestThumbnailer)
+#include "thumbnailer_test.moc"
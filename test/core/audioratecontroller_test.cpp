@@ -0,0 +1,211 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/core/audioratecontroller.h"
+
+#include <QtTest/QtTest>
+#include <QVector>
+
+static const int MIN_BITRATE = 8;
+static const int MAX_BITRATE = 64;
+static const uint32_t SAMPLE_RATE = 48000;
+static const size_t FRAME_SAMPLES = 960;
+
+/**
+ * @brief Feeds the controller 20ms frames for the given time, updating it after every frame.
+ *
+ * @param time Start time in milliseconds, advanced by the simulated duration.
+ * @param seconds Duration to simulate.
+ * @param dropEvery Drop every n-th frame, 0 to drop none.
+ * @param jitter Alternately delay frames by this many milliseconds.
+ * @return True if the controller changed its settings at any point.
+ */
+static bool simulate(AudioRateController& controller, qint64& time, int seconds, int dropEvery = 0,
+                     int jitter = 0)
+{
+    bool changed = false;
+    const int frames = seconds * 50;
+    for (int i = 0; i < frames; ++i) {
+        time += 20;
+        if (dropEvery && i % dropEvery == 0) {
+            continue;
+        }
+
+        const qint64 arrival = time + (i % 2 ? jitter : 0);
+        controller.frameReceived(arrival, FRAME_SAMPLES, SAMPLE_RATE);
+        changed |= controller.update(arrival);
+    }
+
+    return changed;
+}
+
+class TestAudioRateController : public QObject
+{
+    Q_OBJECT
+private slots:
+    void stableLinkTest();
+    void lossyLinkTest();
+    void jitteryLinkTest();
+    void recommendationTest();
+    void recoveryTest();
+    void silenceTest();
+    void packetizeTest();
+    void boundsTest();
+};
+
+void TestAudioRateController::stableLinkTest()
+{
+    AudioRateController controller{MIN_BITRATE, MAX_BITRATE};
+    qint64 time = 0;
+
+    QVERIFY(!simulate(controller, time, 20));
+    QVERIFY(controller.getBitrate() == MAX_BITRATE);
+    QVERIFY(controller.getFrameDuration() == 20);
+    QVERIFY(controller.getLoss() == 0);
+    QVERIFY(controller.getJitter() == 0);
+}
+
+void TestAudioRateController::lossyLinkTest()
+{
+    AudioRateController controller{MIN_BITRATE, MAX_BITRATE};
+    qint64 time = 0;
+
+    QVERIFY(simulate(controller, time, 20, 7));
+    QVERIFY(controller.getLoss() >= 10);
+    QVERIFY(controller.getBitrate() == MIN_BITRATE);
+    QVERIFY(controller.getFrameDuration() == 60);
+}
+
+void TestAudioRateController::jitteryLinkTest()
+{
+    AudioRateController controller{MIN_BITRATE, MAX_BITRATE};
+    qint64 time = 0;
+
+    simulate(controller, time, 10, 0, 40);
+    QVERIFY(controller.getJitter() > 20);
+    QVERIFY(controller.getJitter() <= 40);
+    QVERIFY(controller.getFrameDuration() == 40);
+    // jitter alone isn't congestion
+    QVERIFY(controller.getBitrate() == MAX_BITRATE);
+}
+
+void TestAudioRateController::recommendationTest()
+{
+    AudioRateController controller{MIN_BITRATE, MAX_BITRATE};
+    qint64 time = 0;
+
+    simulate(controller, time, 1);
+    controller.bitrateRecommended(24);
+    QVERIFY(simulate(controller, time, 2));
+    QVERIFY(controller.getBitrate() <= 24);
+    QVERIFY(controller.getBitrate() >= MIN_BITRATE);
+
+    controller.bitrateRecommended(2);
+    simulate(controller, time, 2);
+    QVERIFY(controller.getBitrate() == MIN_BITRATE);
+}
+
+void TestAudioRateController::recoveryTest()
+{
+    AudioRateController controller{MIN_BITRATE, MAX_BITRATE};
+    qint64 time = 0;
+
+    simulate(controller, time, 20, 7);
+    QVERIFY(controller.getBitrate() == MIN_BITRATE);
+
+    simulate(controller, time, 60);
+    QVERIFY(controller.getBitrate() == MAX_BITRATE);
+    QVERIFY(controller.getFrameDuration() == 20);
+    QVERIFY(controller.getLoss() == 0);
+}
+
+void TestAudioRateController::silenceTest()
+{
+    AudioRateController controller{MIN_BITRATE, MAX_BITRATE};
+    qint64 time = 0;
+
+    for (int i = 0; i < 10; ++i) {
+        simulate(controller, time, 1);
+        // the peer stops talking for a second
+        time += 1000;
+    }
+
+    QVERIFY(controller.getLoss() == 0);
+    QVERIFY(controller.getBitrate() == MAX_BITRATE);
+}
+
+void TestAudioRateController::packetizeTest()
+{
+    AudioRateController controller{MIN_BITRATE, MAX_BITRATE};
+    QVector<int16_t> frame(static_cast<int>(FRAME_SAMPLES * 2));
+    for (int i = 0; i < frame.size(); ++i) {
+        frame[i] = static_cast<int16_t>(i);
+    }
+
+    size_t samples = 0;
+    const int16_t* out =
+        controller.packetize(frame.constData(), FRAME_SAMPLES, 2, SAMPLE_RATE, samples);
+    QVERIFY(out == frame.constData());
+    QVERIFY(samples == FRAME_SAMPLES);
+
+    qint64 time = 0;
+    simulate(controller, time, 20, 7);
+    QVERIFY(controller.getFrameDuration() == 60);
+
+    for (int i = 0; i < 2; ++i) {
+        out = controller.packetize(frame.constData(), FRAME_SAMPLES, 2, SAMPLE_RATE, samples);
+        QVERIFY(!out);
+        QVERIFY(samples == 0);
+    }
+
+    out = controller.packetize(frame.constData(), FRAME_SAMPLES, 2, SAMPLE_RATE, samples);
+    QVERIFY(out);
+    QVERIFY(samples == 3 * FRAME_SAMPLES);
+    QVERIFY(out[FRAME_SAMPLES * 2] == 0);
+    QVERIFY(out[FRAME_SAMPLES * 6 - 1] == frame.last());
+
+    controller.packetize(frame.constData(), FRAME_SAMPLES, 2, SAMPLE_RATE, samples);
+    controller.dropPending();
+    controller.packetize(frame.constData(), FRAME_SAMPLES, 2, SAMPLE_RATE, samples);
+    controller.packetize(frame.constData(), FRAME_SAMPLES, 2, SAMPLE_RATE, samples);
+    QVERIFY(samples == 0);
+}
+
+void TestAudioRateController::boundsTest()
+{
+    AudioRateController controller{MIN_BITRATE, MAX_BITRATE};
+    qint64 time = 0;
+
+    simulate(controller, time, 5);
+    QVERIFY(controller.getBitrate() == MAX_BITRATE);
+
+    // the user lowers the bitrate during the call
+    controller.setBounds(MIN_BITRATE, 32);
+    QVERIFY(controller.getBitrate() == 32);
+    simulate(controller, time, 20);
+    QVERIFY(controller.getBitrate() == 32);
+
+    // and raises it again, the bitrate climbs back up
+    controller.setBounds(MIN_BITRATE, MAX_BITRATE);
+    simulate(controller, time, 60);
+    QVERIFY(controller.getBitrate() == MAX_BITRATE);
+}
+
+QTEST_GUILESS_MAIN(TestAudioRateController)
+#include "audioratecontroller_test.moc"
@@ -0,0 +1,170 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/core/videoqualitycontroller.h"
+
+#include <QtTest/QtTest>
+
+static const qint64 FRAME_NS = 1000000000 / 30;
+
+/**
+ * @brief A simulated 30fps camera.
+ */
+struct Camera
+{
+    explicit Camera(QSize size)
+        : size{size}
+        , time{0}
+        , dropped{0}
+    {
+    }
+
+    QSize size;
+    qint64 time;
+    quint64 dropped;
+};
+
+/**
+ * @brief Feeds the controller frames from the camera, updating it after every frame.
+ *
+ * @param seconds Duration to simulate, the camera's time is advanced by it.
+ * @param encodeMs Time it takes to encode a frame of the camera size, smaller frames take
+ * proportionally less.
+ * @param dropEvery Let the encoder skip every n-th frame, 0 to skip none.
+ * @return True if the controller changed the step at any point.
+ */
+static bool simulate(VideoQualityController& controller, Camera& camera, int seconds,
+                     double encodeMs, int dropEvery = 0)
+{
+    bool changed = false;
+    const int frames = seconds * 30;
+    for (int i = 0; i < frames; ++i) {
+        camera.time += FRAME_NS;
+        if (dropEvery && i % dropEvery == 0) {
+            ++camera.dropped;
+            continue;
+        }
+
+        if (!controller.acceptFrame()) {
+            continue;
+        }
+
+        QSize size = controller.getFrameSize(camera.size);
+        if (!size.isValid()) {
+            size = camera.size;
+        }
+
+        const double pixels = static_cast<double>(size.width()) * size.height()
+                              / (camera.size.width() * camera.size.height());
+        controller.frameEncoded(static_cast<qint64>(encodeMs * pixels * 1000000));
+        controller.framesDropped(camera.dropped);
+        changed |= controller.update(camera.time, camera.size);
+    }
+
+    return changed;
+}
+
+class TestVideoQualityController : public QObject
+{
+    Q_OBJECT
+private slots:
+    void fastMachineTest();
+    void slowMachineTest();
+    void verySlowMachineTest();
+    void droppedFramesTest();
+    void recoveryTest();
+    void bitrateTest();
+};
+
+void TestVideoQualityController::fastMachineTest()
+{
+    VideoQualityController controller;
+    Camera camera{{640, 480}};
+
+    QVERIFY(!simulate(controller, camera, 20, 2));
+    QVERIFY(controller.getStep() == 0);
+    QVERIFY(!controller.getFrameSize(camera.size).isValid());
+    QVERIFY(controller.getFrameRateDivisor() == 1);
+    QVERIFY(controller.getFrameRate() == 30);
+}
+
+void TestVideoQualityController::slowMachineTest()
+{
+    VideoQualityController controller;
+    Camera camera{{640, 480}};
+
+    QVERIFY(simulate(controller, camera, 30, 30));
+    QVERIFY(controller.getStep() == 1);
+    QVERIFY(controller.getFrameSize(camera.size) == QSize(480, 360));
+    QVERIFY(controller.getFrameRateDivisor() == 1);
+    QVERIFY(controller.getLoad() <= 70);
+}
+
+void TestVideoQualityController::verySlowMachineTest()
+{
+    VideoQualityController controller;
+    Camera camera{{640, 480}};
+
+    simulate(controller, camera, 30, 100);
+    QVERIFY(controller.getStep() == 3);
+    QVERIFY(controller.getFrameSize(camera.size) == QSize(320, 240));
+    QVERIFY(controller.getFrameRateDivisor() == 2);
+    QVERIFY(controller.getFrameRate() == 15);
+}
+
+void TestVideoQualityController::droppedFramesTest()
+{
+    VideoQualityController controller;
+    Camera camera{{640, 480}};
+
+    QVERIFY(simulate(controller, camera, 4, 2, 5));
+    QVERIFY(controller.getStep() > 0);
+}
+
+void TestVideoQualityController::recoveryTest()
+{
+    VideoQualityController controller;
+    Camera camera{{640, 480}};
+
+    simulate(controller, camera, 30, 100);
+    QVERIFY(controller.getStep() == 3);
+
+    // e.g. a build finished in the background
+    simulate(controller, camera, 60, 5);
+    QVERIFY(controller.getStep() == 0);
+    QVERIFY(controller.getFrameRate() == 30);
+}
+
+void TestVideoQualityController::bitrateTest()
+{
+    VideoQualityController controller;
+    Camera camera{{1280, 720}};
+
+    controller.bitrateRecommended(500);
+    QVERIFY(simulate(controller, camera, 4, 2));
+    QVERIFY(controller.getStep() == 2);
+    QVERIFY(controller.getFrameSize(camera.size) == QSize(640, 360));
+
+    controller.bitrateRecommended(5000);
+    QVERIFY(simulate(controller, camera, 4, 2));
+    QVERIFY(controller.getStep() == 0);
+}
+
+QTEST_GUILESS_MAIN(TestVideoQualityController)
+#include "videoqualitycontroller_test.moc"
@@ -0,0 +1,108 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/persistence/emoticonmatcher.h"
+
+#include <QtTest/QtTest>
+#include <QString>
+
+static const QList<QStringList> EMOTICONS{{":)", ":-)"}, {":(", ":-("}, {"&lt;3"}, {":-)", ":D"}};
+
+static QString richText(const QString& key)
+{
+    return QStringLiteral("<img title=\"%1\" src=\"key:%1\"\\>").arg(key);
+}
+
+class TestEmoticonMatcher : public QObject
+{
+    Q_OBJECT
+private slots:
+    void findTest();
+    void wordTest();
+    void whitespaceTest();
+    void unchangedTest();
+    void emptyTest();
+};
+
+void TestEmoticonMatcher::findTest()
+{
+    EmoticonMatcher matcher{EMOTICONS};
+
+    QVERIFY(matcher.find(":)") == 0);
+    QVERIFY(matcher.find(":-(") == 1);
+    QVERIFY(matcher.find("&lt;3") == 2);
+    QVERIFY(matcher.find(":D") == 3);
+    // the first group listing an emoticon keeps it
+    QVERIFY(matcher.find(":-)") == 0);
+
+    // prefixes and extensions of emoticons aren't emoticons
+    QVERIFY(matcher.find(":") == -1);
+    QVERIFY(matcher.find(":-") == -1);
+    QVERIFY(matcher.find(":))") == -1);
+    QVERIFY(matcher.find("") == -1);
+}
+
+void TestEmoticonMatcher::wordTest()
+{
+    EmoticonMatcher matcher{EMOTICONS};
+
+    QVERIFY(matcher.smileyfied(":)") == richText(":)"));
+    QVERIFY(matcher.smileyfied("hi :) there") == "hi " + richText(":)") + " there");
+    QVERIFY(matcher.smileyfied("I &lt;3 you :D")
+            == "I " + richText("&lt;3") + " you " + richText(":D"));
+
+    // only whole words are replaced
+    QVERIFY(matcher.smileyfied(":):)") == ":):)");
+    QVERIFY(matcher.smileyfied("hi:)") == "hi:)");
+    QVERIFY(matcher.smileyfied(":),") == ":),");
+}
+
+void TestEmoticonMatcher::whitespaceTest()
+{
+    EmoticonMatcher matcher{EMOTICONS};
+
+    QVERIFY(matcher.smileyfied("  :(\n:-)\t") == "  " + richText(":(") + "\n" + richText(":-)")
+                                                     + "\t");
+    QVERIFY(matcher.smileyfied(":) :) :)")
+            == richText(":)") + " " + richText(":)") + " " + richText(":)"));
+}
+
+void TestEmoticonMatcher::unchangedTest()
+{
+    EmoticonMatcher matcher{EMOTICONS};
+    const QString msg = QStringLiteral("no smileys: here (really)");
+
+    const QString result = matcher.smileyfied(msg);
+    QVERIFY(result == msg);
+    // nothing is copied if nothing is replaced
+    QVERIFY(result.constData() == msg.constData());
+}
+
+void TestEmoticonMatcher::emptyTest()
+{
+    EmoticonMatcher empty{QList<QStringList>()};
+    QVERIFY(empty.find(":)") == -1);
+    QVERIFY(empty.smileyfied("hi :)") == "hi :)");
+
+    EmoticonMatcher matcher{EMOTICONS};
+    QVERIFY(matcher.smileyfied("").isEmpty());
+}
+
+QTEST_GUILESS_MAIN(TestEmoticonMatcher)
+#include "emoticonmatcher_test.moc"
@@ -0,0 +1,93 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/video/screensource.h"
+#include "src/video/videoframe.h"
+
+#include <QtTest/QtTest>
+
+#include <memory>
+
+#ifdef QTOX_X11_SCREEN_CAPTURE
+#include "src/platform/x11_display.h"
+#include <X11/Xlib.h>
+#endif
+
+/*
+ * Capturing needs an X server with the XShm and XDamage extensions, e.g. Xvfb. The capture tests
+ * are skipped without one.
+ */
+
+class TestScreenSource : public QObject
+{
+    Q_OBJECT
+private slots:
+    void frameSizeTest();
+    void captureTest();
+};
+
+void TestScreenSource::frameSizeTest()
+{
+    QVERIFY(ScreenSource{QRect(0, 0, 1920, 1080)}.getFrameSize() == QSize(1280, 720));
+    QVERIFY(ScreenSource{QRect(0, 0, 2560, 1600)}.getFrameSize() == QSize(1152, 720));
+    QVERIFY(ScreenSource{QRect(100, 100, 801, 601)}.getFrameSize() == QSize(800, 600));
+    QVERIFY(ScreenSource(QRect(0, 0, 1920, 1080), {640, 480}).getFrameSize() == QSize(640, 360));
+}
+
+void TestScreenSource::captureTest()
+{
+#ifdef QTOX_X11_SCREEN_CAPTURE
+    if (!ScreenSource::isSupported()) {
+        QSKIP("No X server with XShm and XDamage");
+    }
+
+    ScreenSource source{QRect(0, 0, 64, 48)};
+    std::shared_ptr<VideoFrame> frame;
+    connect(&source, &VideoSource::frameAvailable,
+            [&frame](std::shared_ptr<VideoFrame> f) { frame = std::move(f); });
+
+    // The first capture always delivers a frame
+    QVERIFY(source.captureFrame());
+    QVERIFY(frame);
+    QVERIFY(frame->getSourceDimensions().size() == QSize(64, 48));
+    QVERIFY(frame->toToxYUVFrame());
+
+    frame.reset();
+    QVERIFY(!source.captureFrame());
+    QVERIFY(!frame);
+
+    Display* display = Platform::X11Display::lock();
+    const Window root = DefaultRootWindow(display);
+    GC gc = XCreateGC(display, root, 0, nullptr);
+    XSetForeground(display, gc, WhitePixel(display, DefaultScreen(display)));
+    XFillRectangle(display, root, gc, 8, 8, 16, 16);
+    XFreeGC(display, gc);
+    XSync(display, False);
+    Platform::X11Display::unlock();
+
+    QVERIFY(source.captureFrame());
+    QVERIFY(frame);
+    QVERIFY(source.getFramesCaptured() == 2);
+#else
+    QSKIP("Built without X11 screen capture");
+#endif
+}
+
+QTEST_GUILESS_MAIN(TestScreenSource)
+#include "screensource_test.moc"
@@ -0,0 +1,195 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/video/videocompositor.h"
+#include "src/video/videoframe.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixfmt.h>
+}
+
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtTest/QtTest>
+
+#include <cstring>
+#include <memory>
+
+/**
+ * @brief Allocates an AVFrame of a single gray level, its planes share one buffer at data[0].
+ */
+static AVFrame* grayAVFrame(int width, int height, uint8_t luma)
+{
+    AVFrame* frame = av_frame_alloc();
+    frame->width = width;
+    frame->height = height;
+    frame->format = AV_PIX_FMT_YUV420P;
+
+    if (av_image_alloc(frame->data, frame->linesize, width, height, AV_PIX_FMT_YUV420P,
+                       VideoFrame::dataAlignment)
+        < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    memset(frame->data[0], luma, frame->linesize[0] * height);
+    memset(frame->data[1], 128, frame->linesize[1] * (height / 2));
+    memset(frame->data[2], 128, frame->linesize[2] * (height / 2));
+
+    return frame;
+}
+
+/**
+ * @brief Creates a frame of a single gray level.
+ */
+static std::shared_ptr<VideoFrame> grayFrame(int width, int height, uint8_t luma)
+{
+    AVFrame* frame = grayAVFrame(width, height, luma);
+    if (!frame) {
+        return nullptr;
+    }
+
+    return std::make_shared<VideoFrame>(0, frame, true);
+}
+
+class TestVideoCompositor : public QObject
+{
+    Q_OBJECT
+private slots:
+    void tileTest();
+    void letterboxTest();
+    void sharedScalerTest();
+    void placeholderTest();
+    void invalidFrameTest();
+    void advanceGenerationTest();
+};
+
+void TestVideoCompositor::tileTest()
+{
+    VideoCompositor compositor;
+    compositor.setTile(1, {0, 0, 64, 48});
+    compositor.setTile(2, {64, 0, 64, 48});
+    compositor.setFrame(1, grayFrame(64, 48, 235));
+
+    const QImage& image = compositor.compose({128, 48});
+    QVERIFY(image.size() == QSize(128, 48));
+    QVERIFY(qGray(image.pixel(32, 24)) > 200);
+    QVERIFY(image.pixel(96, 24) == qRgb(0, 0, 0));
+}
+
+void TestVideoCompositor::letterboxTest()
+{
+    VideoCompositor compositor;
+    compositor.setTile(1, {0, 0, 128, 128});
+    compositor.setFrame(1, grayFrame(128, 64, 235));
+
+    const QImage& image = compositor.compose({128, 128});
+    QVERIFY(image.pixel(64, 8) == qRgb(0, 0, 0));
+    QVERIFY(qGray(image.pixel(64, 64)) > 200);
+    QVERIFY(image.pixel(64, 120) == qRgb(0, 0, 0));
+}
+
+void TestVideoCompositor::sharedScalerTest()
+{
+    VideoCompositor compositor;
+    for (int i = 0; i < 4; ++i) {
+        compositor.setTile(i, {i * 64, 0, 64, 48});
+        compositor.setFrame(i, grayFrame(320, 240, 128));
+    }
+
+    compositor.compose({256, 48});
+    QVERIFY(compositor.getScalerCount() == 1);
+
+    compositor.removeTile(3);
+    compositor.setTile(0, {0, 0, 32, 24});
+    compositor.compose({256, 48});
+    QVERIFY(compositor.getScalerCount() == 2);
+}
+
+void TestVideoCompositor::placeholderTest()
+{
+    QImage avatar{16, 16, QImage::Format_RGB32};
+    avatar.fill(Qt::red);
+
+    VideoCompositor compositor;
+    compositor.setTile(1, {0, 0, 32, 32});
+    compositor.setPlaceholder(1, avatar);
+
+    QVERIFY(compositor.compose({32, 32}).pixel(16, 16) == qRgb(255, 0, 0));
+
+    compositor.setFrame(1, grayFrame(32, 32, 235));
+    QVERIFY(qGray(compositor.compose({32, 32}).pixel(16, 16)) > 200);
+
+    compositor.setFrame(1, nullptr);
+    QVERIFY(compositor.compose({32, 32}).pixel(16, 16) == qRgb(255, 0, 0));
+}
+
+void TestVideoCompositor::invalidFrameTest()
+{
+    QImage avatar{16, 16, QImage::Format_RGB32};
+    avatar.fill(Qt::red);
+
+    VideoCompositor compositor;
+    compositor.setTile(1, {0, 0, 32, 32});
+    compositor.setPlaceholder(1, avatar);
+
+    std::shared_ptr<VideoFrame> frame = grayFrame(32, 32, 235);
+    compositor.setFrame(1, frame);
+    frame->releaseFrame();
+
+    QVERIFY(compositor.compose({32, 32}).pixel(16, 16) == qRgb(255, 0, 0));
+}
+
+void TestVideoCompositor::advanceGenerationTest()
+{
+    QImage avatar{16, 16, QImage::Format_RGB32};
+    avatar.fill(Qt::red);
+
+    VideoCompositor compositor;
+    compositor.setTile(1, {0, 0, 320, 240});
+    compositor.setPlaceholder(1, avatar);
+
+    for (int i = 0; i < 50; ++i) {
+        const std::shared_ptr<VideoFrame::SourceGeneration> generation =
+            std::make_shared<VideoFrame::SourceGeneration>();
+        AVFrame* source = grayAVFrame(1280, 720, 235);
+        QVERIFY(source);
+        uint8_t* planes = source->data[0];
+
+        // The source owns the planes, like a decoder does
+        VideoFrame* frame = new VideoFrame(0, source, false);
+        compositor.setFrame(1, frame->trackFrame(generation));
+
+        // Like CameraSource closing the device while the frame is scaled, the planes must not be
+        // freed before the scale is done
+        QFuture<void> closed = QtConcurrent::run([generation, planes]() {
+            generation->advance();
+            uint8_t* buffer = planes;
+            av_freep(&buffer);
+        });
+
+        compositor.compose({320, 240});
+        closed.waitForFinished();
+
+        QVERIFY(compositor.compose({320, 240}).pixel(160, 120) == qRgb(255, 0, 0));
+    }
+}
+
+QTEST_GUILESS_MAIN(TestVideoCompositor)
+#include "videocompositor_test.moc"
@@ -0,0 +1,180 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/video/videoframe.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixfmt.h>
+}
+
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtTest/QtTest>
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+/**
+ * @brief Allocates a frame filled with a pattern, owned by the VideoFrame it's passed to.
+ */
+static AVFrame* createFrame(int width, int height, AVPixelFormat pixFmt, int alignment)
+{
+    AVFrame* frame = av_frame_alloc();
+    frame->width = width;
+    frame->height = height;
+    frame->format = pixFmt;
+
+    if (av_image_alloc(frame->data, frame->linesize, width, height, pixFmt, alignment) < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < frame->linesize[0]; ++x) {
+            frame->data[0][y * frame->linesize[0] + x] = static_cast<uint8_t>(x + y);
+        }
+    }
+
+    return frame;
+}
+
+class TestVideoFrame : public QObject
+{
+    Q_OBJECT
+private slots:
+    void passthroughTest();
+    void fullRangePassthroughTest();
+    void paddedCopyTest();
+    void conversionTest();
+    void readDuringAdvanceTest();
+};
+
+void TestVideoFrame::passthroughTest()
+{
+    AVFrame* source = createFrame(64, 48, AV_PIX_FMT_YUV420P, 1);
+    QVERIFY(source);
+    VideoFrame frame{0, source, true};
+
+    ToxYUVFrame yuv = frame.toToxYUVFrame();
+    QVERIFY(yuv);
+    QVERIFY(yuv.width == 64);
+    QVERIFY(yuv.height == 48);
+    QVERIFY(yuv.y == source->data[0]);
+    QVERIFY(yuv.u == source->data[1]);
+    QVERIFY(yuv.v == source->data[2]);
+}
+
+void TestVideoFrame::fullRangePassthroughTest()
+{
+    AVFrame* source = createFrame(64, 48, AV_PIX_FMT_YUVJ420P, 1);
+    QVERIFY(source);
+    VideoFrame frame{0, source, true};
+
+    QVERIFY(frame.getSourcePixelFormat() == AV_PIX_FMT_YUV420P);
+
+    ToxYUVFrame yuv = frame.toToxYUVFrame();
+    QVERIFY(yuv);
+    QVERIFY(yuv.y == source->data[0]);
+}
+
+void TestVideoFrame::paddedCopyTest()
+{
+    // chroma planes of 24 pixels are padded to 32 bytes
+    AVFrame* source = createFrame(48, 32, AV_PIX_FMT_YUV420P, 32);
+    QVERIFY(source);
+    QVERIFY(source->linesize[1] != 24);
+    VideoFrame frame{0, source, true};
+
+    ToxYUVFrame yuv = frame.toToxYUVFrame();
+    QVERIFY(yuv);
+    QVERIFY(yuv.y != source->data[0]);
+
+    for (int y = 0; y < 32; ++y) {
+        QVERIFY(memcmp(yuv.y + y * 48, source->data[0] + y * source->linesize[0], 48) == 0);
+    }
+
+    // the copy is kept for the next call
+    QVERIFY(frame.toToxYUVFrame().y == yuv.y);
+}
+
+void TestVideoFrame::conversionTest()
+{
+    AVFrame* source = createFrame(64, 48, AV_PIX_FMT_RGB24, 1);
+    QVERIFY(source);
+    VideoFrame frame{0, source, true};
+
+    ToxYUVFrame yuv = frame.toToxYUVFrame();
+    QVERIFY(yuv);
+    QVERIFY(yuv.y != source->data[0]);
+
+    ToxYUVFrame scaled = frame.toToxYUVFrame({32, 24});
+    QVERIFY(scaled);
+    QVERIFY(scaled.width == 32);
+    QVERIFY(scaled.y != yuv.y);
+}
+
+void TestVideoFrame::readDuringAdvanceTest()
+{
+    const std::shared_ptr<VideoFrame::SourceGeneration> generation =
+        std::make_shared<VideoFrame::SourceGeneration>();
+    AVFrame* source = createFrame(64, 48, AV_PIX_FMT_YUV420P, 1);
+    QVERIFY(source);
+    uint8_t* planes = source->data[0];
+
+    // The source owns the planes, like a decoder does
+    VideoFrame* frame = new VideoFrame(0, source, false);
+    const std::shared_ptr<VideoFrame> tracked = frame->trackFrame(generation);
+
+    std::atomic<bool> freed{false};
+    QFuture<void> closed;
+    bool valid = true;
+    const bool read = tracked->readAVFrame({}, AV_PIX_FMT_YUV420P, true,
+                                           [&](const AVFrame* yuv) {
+        QVERIFY(yuv->data[0] == planes);
+
+        // Like CameraSource closing the device while the frame is encoded
+        closed = QtConcurrent::run([generation, planes, &freed]() {
+            generation->advance();
+            uint8_t* buffer = planes;
+            av_freep(&buffer);
+            freed = true;
+        });
+
+        QThread::msleep(50);
+        valid = !freed;
+        for (int y = 0; y < 48; ++y) {
+            for (int x = 0; x < 64; ++x) {
+                const uint8_t luma = yuv->data[0][y * yuv->linesize[0] + x];
+                valid = valid && luma == static_cast<uint8_t>(x + y);
+            }
+        }
+    });
+
+    QVERIFY(read);
+    closed.waitForFinished();
+    QVERIFY(valid);
+    QVERIFY(freed);
+
+    // The frame belongs to an old generation now
+    QVERIFY(!tracked->readAVFrame({}, AV_PIX_FMT_YUV420P, true, [](const AVFrame*) {}));
+}
+
+QTEST_GUILESS_MAIN(TestVideoFrame)
+#include "videoframe_test.moc"
@@ -0,0 +1,86 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/video/videoframe.h"
+#include "src/video/videoframehandoff.h"
+
+#include <QtTest/QtTest>
+
+#include <memory>
+
+/**
+ * @brief Creates an empty frame, its content doesn't matter for the handoff.
+ */
+static std::shared_ptr<VideoFrame> makeFrame()
+{
+    AVFrame* frame = av_frame_alloc();
+    frame->width = 16;
+    frame->height = 16;
+    frame->format = AV_PIX_FMT_YUV420P;
+    return std::make_shared<VideoFrame>(0, frame);
+}
+
+class TestVideoFrameHandoff : public QObject
+{
+    Q_OBJECT
+private slots:
+    void latestFrameTest();
+    void notifyTest();
+};
+
+void TestVideoFrameHandoff::latestFrameTest()
+{
+    VideoFrameHandoff handoff;
+    const std::shared_ptr<VideoFrame> first = makeFrame();
+    const std::shared_ptr<VideoFrame> second = makeFrame();
+
+    QVERIFY(!handoff.take());
+
+    handoff.put(first);
+    handoff.put(second);
+    QVERIFY(handoff.take() == second);
+    QVERIFY(!handoff.take());
+
+    QVERIFY(handoff.getDelivered() == 1);
+    QVERIFY(handoff.getDropped() == 1);
+}
+
+void TestVideoFrameHandoff::notifyTest()
+{
+    VideoFrameHandoff handoff;
+    int notifications = 0;
+    connect(&handoff, &VideoFrameHandoff::frameReady, [&notifications]() { ++notifications; });
+
+    // no further notifications until the consumer caught up
+    handoff.put(makeFrame());
+    handoff.put(makeFrame());
+    QVERIFY(notifications == 1);
+
+    QVERIFY(handoff.take());
+    handoff.put(makeFrame());
+    QVERIFY(notifications == 1);
+
+    QVERIFY(handoff.take());
+    QVERIFY(!handoff.take());
+    handoff.put(makeFrame());
+    QVERIFY(notifications == 2);
+}
+
+QTEST_GUILESS_MAIN(TestVideoFrameHandoff)
+#include "videoframehandoff_test.moc"
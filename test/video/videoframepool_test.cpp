@@ -0,0 +1,181 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/video/videoframepool.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixfmt.h>
+}
+
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtTest/QtTest>
+
+#include <vector>
+
+class TestVideoFramePool : public QObject
+{
+    Q_OBJECT
+private slots:
+    void recycleTest();
+    void keyTest();
+    void limitTest();
+    void foreignFrameTest();
+    void clearTest();
+    void concurrentTest();
+};
+
+void TestVideoFramePool::recycleTest()
+{
+    VideoFramePool pool;
+
+    AVFrame* frame = pool.acquire(640, 480, AV_PIX_FMT_YUV420P, 32);
+    QVERIFY(frame);
+    QVERIFY(frame->width == 640);
+    QVERIFY(frame->height == 480);
+    QVERIFY(frame->format == AV_PIX_FMT_YUV420P);
+    QVERIFY(frame->data[0]);
+
+    const qint64 bytes = pool.getStats().bytesInUse;
+    QVERIFY(bytes >= 640 * 480 * 3 / 2);
+    QVERIFY(pool.getStats().misses == 1);
+
+    pool.release(frame);
+    QVERIFY(pool.getStats().bytesInUse == 0);
+    QVERIFY(pool.getStats().bytesHeld == bytes);
+
+    AVFrame* recycled = pool.acquire(640, 480, AV_PIX_FMT_YUV420P, 32);
+    QVERIFY(recycled == frame);
+    QVERIFY(pool.getStats().hits == 1);
+    QVERIFY(pool.getStats().bytesHeld == 0);
+    QVERIFY(pool.getStats().bytesInUse == bytes);
+
+    pool.release(recycled);
+}
+
+void TestVideoFramePool::keyTest()
+{
+    VideoFramePool pool;
+
+    AVFrame* frame = pool.acquire(640, 480, AV_PIX_FMT_YUV420P, 32);
+    pool.release(frame);
+
+    // every property of the geometry has to match
+    std::vector<AVFrame*> others{pool.acquire(640, 480, AV_PIX_FMT_RGB24, 32),
+                                 pool.acquire(640, 480, AV_PIX_FMT_YUV420P, 1),
+                                 pool.acquire(320, 480, AV_PIX_FMT_YUV420P, 32),
+                                 pool.acquire(640, 240, AV_PIX_FMT_YUV420P, 32)};
+
+    for (AVFrame* other : others) {
+        QVERIFY(other);
+        QVERIFY(other != frame);
+    }
+
+    QVERIFY(pool.getStats().hits == 0);
+    QVERIFY(pool.getStats().misses == 5);
+
+    for (AVFrame* other : others) {
+        pool.release(other);
+    }
+}
+
+void TestVideoFramePool::limitTest()
+{
+    VideoFramePool pool;
+
+    std::vector<AVFrame*> frames;
+    for (int i = 0; i < 32; ++i) {
+        frames.push_back(pool.acquire(64, 64, AV_PIX_FMT_RGB24, 32));
+    }
+
+    for (AVFrame* frame : frames) {
+        pool.release(frame);
+    }
+
+    // excess frames are freed instead of kept
+    const qint64 frameBytes = av_image_get_buffer_size(AV_PIX_FMT_RGB24, 64, 64, 32);
+    QVERIFY(pool.getStats().bytesHeld > 0);
+    QVERIFY(pool.getStats().bytesHeld < 32 * frameBytes);
+    QVERIFY(pool.getStats().bytesInUse == 0);
+}
+
+void TestVideoFramePool::foreignFrameTest()
+{
+    VideoFramePool pool;
+
+    AVFrame* frame = av_frame_alloc();
+    QVERIFY(av_image_alloc(frame->data, frame->linesize, 64, 64, AV_PIX_FMT_RGB24, 32) >= 0);
+
+    // frames not from the pool are freed
+    pool.release(frame);
+    QVERIFY(pool.getStats().bytesHeld == 0);
+
+    pool.release(nullptr);
+}
+
+void TestVideoFramePool::clearTest()
+{
+    VideoFramePool pool;
+
+    AVFrame* idle = pool.acquire(64, 64, AV_PIX_FMT_RGB24, 32);
+    AVFrame* used = pool.acquire(64, 64, AV_PIX_FMT_RGB24, 32);
+    pool.release(idle);
+
+    pool.clear();
+    QVERIFY(pool.getStats().bytesHeld == 0);
+    QVERIFY(pool.getStats().bytesInUse > 0);
+
+    // frames in use can still be given back afterwards
+    pool.release(used);
+    QVERIFY(pool.getStats().bytesInUse == 0);
+    QVERIFY(pool.getStats().bytesHeld > 0);
+}
+
+void TestVideoFramePool::concurrentTest()
+{
+    VideoFramePool pool;
+
+    // streams of two geometries, two threads each
+    QVector<QFuture<void>> threads;
+    for (int i = 0; i < 4; ++i) {
+        const int width = i % 2 ? 64 : 32;
+        threads.append(QtConcurrent::run([&pool, width]() {
+            for (int j = 0; j < 1000; ++j) {
+                AVFrame* first = pool.acquire(width, 32, AV_PIX_FMT_RGB24, 32);
+                AVFrame* second = pool.acquire(width, 32, AV_PIX_FMT_RGB24, 32);
+                pool.release(first);
+                pool.release(second);
+            }
+        }));
+    }
+
+    for (QFuture<void>& thread : threads) {
+        thread.waitForFinished();
+    }
+
+    const VideoFramePool::Stats stats = pool.getStats();
+    QVERIFY(stats.hits + stats.misses == 8000);
+    // no more than the four frames in flight per geometry are ever allocated
+    QVERIFY(stats.misses <= 8);
+    QVERIFY(stats.bytesInUse == 0);
+    QVERIFY(stats.bytesHeld > 0);
+}
+
+QTEST_GUILESS_MAIN(TestVideoFramePool)
+#include "videoframepool_test.moc"
@@ -0,0 +1,113 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/video/videolatency.h"
+
+#include <QtTest/QtTest>
+
+static const qint64 MS = 1000000;
+
+class TestVideoLatency : public QObject
+{
+    Q_OBJECT
+private slots:
+    void emptyTest();
+    void percentileTest();
+    void meanMaxTest();
+    void unreachedStageTest();
+    void summaryTest();
+};
+
+void TestVideoLatency::emptyTest()
+{
+    VideoLatency latency;
+    QVERIFY(latency.isEmpty());
+    QVERIFY(latency.getSummary().isEmpty());
+
+    const VideoLatency::Histogram& histogram = latency.get(VideoLatency::Render);
+    QVERIFY(histogram.getCount() == 0);
+    QVERIFY(histogram.getMean() == 0.0);
+    QVERIFY(histogram.getPercentile(0.5) == 0.0);
+}
+
+void TestVideoLatency::percentileTest()
+{
+    VideoLatency::Histogram histogram;
+    for (int i = 0; i < 90; ++i) {
+        histogram.record(3 * MS);
+    }
+
+    for (int i = 0; i < 10; ++i) {
+        histogram.record(40 * MS);
+    }
+
+    QVERIFY(histogram.getCount() == 100);
+    QCOMPARE(histogram.getPercentile(0.5), 5.0);
+    QCOMPARE(histogram.getPercentile(0.9), 5.0);
+    QCOMPARE(histogram.getPercentile(0.95), 40.0);
+
+    // beyond the last bound the maximum is all we know
+    histogram.record(3000 * MS);
+    QCOMPARE(histogram.getPercentile(1.0), 3000.0);
+}
+
+void TestVideoLatency::meanMaxTest()
+{
+    VideoLatency::Histogram histogram;
+    histogram.record(10 * MS);
+    histogram.record(20 * MS);
+    histogram.record(30 * MS);
+
+    QCOMPARE(histogram.getMean(), 20.0);
+    QCOMPARE(histogram.getMax(), 30.0);
+
+    histogram.reset();
+    QVERIFY(histogram.getCount() == 0);
+    QCOMPARE(histogram.getMax(), 0.0);
+}
+
+void TestVideoLatency::unreachedStageTest()
+{
+    VideoLatency latency;
+    latency.record(VideoLatency::Encode, 0, 5 * MS);
+    latency.record(VideoLatency::Encode, 5 * MS, 0);
+    latency.record(VideoLatency::Encode, 5 * MS, 4 * MS);
+    QVERIFY(latency.isEmpty());
+
+    latency.record(VideoLatency::Encode, 5 * MS, 12 * MS);
+    QVERIFY(!latency.isEmpty());
+    QVERIFY(latency.get(VideoLatency::Encode).getCount() == 1);
+    QCOMPARE(latency.get(VideoLatency::Encode).getMax(), 7.0);
+    QVERIFY(latency.get(VideoLatency::Convert).getCount() == 0);
+}
+
+void TestVideoLatency::summaryTest()
+{
+    VideoLatency latency;
+    latency.record(VideoLatency::Render, MS, 9 * MS);
+    const QString summary = latency.getSummary();
+    QVERIFY(summary.startsWith("render 1 frames"));
+    QVERIFY(!summary.contains("encode"));
+
+    latency.reset();
+    QVERIFY(latency.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(TestVideoLatency)
+#include "videolatency_test.moc"
@@ -0,0 +1,305 @@
+/*
+    Copyright © 2017 by The qTox Project Contributors
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    qTox is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    qTox is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with qTox.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "src/video/testpatternsource.h"
+#include "src/video/videoframe.h"
+#include "src/video/videoframepool.h"
+
+extern "C" {
+#include <libavutil/pixfmt.h>
+}
+
+#include <vpx/vp8cx.h>
+#include <vpx/vpx_encoder.h>
+
+#include <QElapsedTimer>
+#include <QtTest/QtTest>
+
+#include <ctime>
+#include <memory>
+
+/*
+ * Frames come from a TestPatternSource, so no camera is needed. Every benchmark iteration
+ * generates a frame and takes it through the stages up to the measured one, since VideoFrame
+ * caches its conversions. The pipeline benchmark reports the stages separately.
+ *
+ * Preview measures the conversion VideoSurface does off the GUI thread, painting needs a display.
+ */
+
+Q_DECLARE_METATYPE(AVPixelFormat)
+
+/// Size previews are scaled to, about a call window
+static const QSize PREVIEW_SIZE{640, 360};
+/// Frames the pipeline benchmark runs
+static const int PIPELINE_FRAMES = 300;
+
+/**
+ * @brief Encodes frames with VP8 in realtime mode, about like toxav does.
+ */
+class Encoder
+{
+public:
+    Encoder(QSize size, int fps)
+        : size{size}
+        , pts{0}
+    {
+        vpx_codec_enc_cfg_t cfg;
+        vpx_codec_enc_config_default(vpx_codec_vp8_cx(), &cfg, 0);
+        cfg.g_w = static_cast<unsigned>(size.width());
+        cfg.g_h = static_cast<unsigned>(size.height());
+        cfg.g_timebase = {1, fps};
+        cfg.g_lag_in_frames = 0;
+        cfg.g_pass = VPX_RC_ONE_PASS;
+        cfg.rc_end_usage = VPX_CBR;
+        cfg.rc_target_bitrate = 5000;
+        cfg.g_error_resilient = VPX_ERROR_RESILIENT_DEFAULT;
+
+        valid = vpx_codec_enc_init(&codec, vpx_codec_vp8_cx(), &cfg, 0) == VPX_CODEC_OK;
+        if (valid) {
+            vpx_codec_control(&codec, VP8E_SET_CPUUSED, 8);
+        }
+    }
+
+    ~Encoder()
+    {
+        if (valid) {
+            vpx_codec_destroy(&codec);
+        }
+    }
+
+    bool isValid() const
+    {
+        return valid;
+    }
+
+    /**
+     * @brief Encodes a frame, returns the size of the encoded data in bytes.
+     */
+    size_t encode(const ToxYUVFrame& frame)
+    {
+        vpx_image_t img;
+        vpx_img_wrap(&img, VPX_IMG_FMT_I420, frame.width, frame.height, 1,
+                     const_cast<uint8_t*>(frame.y));
+        img.planes[VPX_PLANE_U] = const_cast<uint8_t*>(frame.u);
+        img.planes[VPX_PLANE_V] = const_cast<uint8_t*>(frame.v);
+
+        if (vpx_codec_encode(&codec, &img, pts++, 1, 0, VPX_DL_REALTIME) != VPX_CODEC_OK) {
+            return 0;
+        }
+
+        size_t bytes = 0;
+        vpx_codec_iter_t iter = nullptr;
+        const vpx_codec_cx_pkt_t* pkt;
+        while ((pkt = vpx_codec_get_cx_data(&codec, &iter))) {
+            if (pkt->kind == VPX_CODEC_CX_FRAME_PKT) {
+                bytes += pkt->data.frame.sz;
+            }
+        }
+
+        return bytes;
+    }
+
+private:
+    const QSize size;
+    vpx_codec_ctx_t codec;
+    vpx_codec_pts_t pts;
+    bool valid;
+};
+
+class BenchVideoPipeline : public QObject
+{
+    Q_OBJECT
+private slots:
+    void generate_data();
+    void generate();
+    void preview_data();
+    void preview();
+    void encode_data();
+    void encode();
+    void pipeline_data();
+    void pipeline();
+
+private:
+    void addFormatRows();
+};
+
+void BenchVideoPipeline::addFormatRows()
+{
+    QTest::addColumn<QSize>("size");
+    QTest::addColumn<AVPixelFormat>("pixFmt");
+
+    // webcams deliver YUV420P, or YUVJ422P when they send MJPEG
+    QTest::newRow("640x480 YUV420P") << QSize{640, 480} << AV_PIX_FMT_YUV420P;
+    QTest::newRow("1280x720 YUV420P") << QSize{1280, 720} << AV_PIX_FMT_YUV420P;
+    QTest::newRow("1280x720 YUVJ422P") << QSize{1280, 720} << AV_PIX_FMT_YUVJ422P;
+    QTest::newRow("1920x1080 YUVJ422P") << QSize{1920, 1080} << AV_PIX_FMT_YUVJ422P;
+}
+
+void BenchVideoPipeline::generate_data()
+{
+    addFormatRows();
+}
+
+void BenchVideoPipeline::generate()
+{
+    QFETCH(QSize, size);
+    QFETCH(AVPixelFormat, pixFmt);
+
+    TestPatternSource source{size, 30, pixFmt};
+    std::shared_ptr<VideoFrame> frame;
+    connect(&source, &VideoSource::frameAvailable,
+            [&frame](std::shared_ptr<VideoFrame> f) { frame = std::move(f); });
+
+    QBENCHMARK
+    {
+        source.generateFrame();
+    }
+
+    QVERIFY(frame);
+    QVERIFY(frame->getSourceDimensions().size() == size);
+}
+
+void BenchVideoPipeline::preview_data()
+{
+    addFormatRows();
+}
+
+void BenchVideoPipeline::preview()
+{
+    QFETCH(QSize, size);
+    QFETCH(AVPixelFormat, pixFmt);
+
+    TestPatternSource source{size, 30, pixFmt};
+    std::shared_ptr<VideoFrame> frame;
+    connect(&source, &VideoSource::frameAvailable,
+            [&frame](std::shared_ptr<VideoFrame> f) { frame = std::move(f); });
+
+    QImage image;
+    QBENCHMARK
+    {
+        source.generateFrame();
+        image = frame->toQImage(PREVIEW_SIZE).convertToFormat(QImage::Format_RGB32);
+    }
+
+    QVERIFY(image.size() == PREVIEW_SIZE);
+}
+
+void BenchVideoPipeline::encode_data()
+{
+    addFormatRows();
+}
+
+void BenchVideoPipeline::encode()
+{
+    QFETCH(QSize, size);
+    QFETCH(AVPixelFormat, pixFmt);
+
+    TestPatternSource source{size, 30, pixFmt};
+    std::shared_ptr<VideoFrame> frame;
+    connect(&source, &VideoSource::frameAvailable,
+            [&frame](std::shared_ptr<VideoFrame> f) { frame = std::move(f); });
+
+    Encoder encoder{size, source.getFps()};
+    QVERIFY(encoder.isValid());
+
+    size_t bytes = 0;
+    QBENCHMARK
+    {
+        source.generateFrame();
+        bytes += encoder.encode(frame->toToxYUVFrame());
+    }
+
+    QVERIFY(bytes > 0);
+}
+
+void BenchVideoPipeline::pipeline_data()
+{
+    addFormatRows();
+}
+
+/**
+ * @brief Runs frames through conversion, encode and preview like a call, reporting each stage.
+ *
+ * The result is the achieved frame rate. Stage times, buffer allocations and CPU load are logged.
+ */
+void BenchVideoPipeline::pipeline()
+{
+    QFETCH(QSize, size);
+    QFETCH(AVPixelFormat, pixFmt);
+
+    TestPatternSource source{size, 30, pixFmt};
+    std::shared_ptr<VideoFrame> frame;
+    connect(&source, &VideoSource::frameAvailable,
+            [&frame](std::shared_ptr<VideoFrame> f) { frame = std::move(f); });
+
+    Encoder encoder{size, source.getFps()};
+    QVERIFY(encoder.isValid());
+
+    VideoFramePool& pool = VideoFramePool::getInstance();
+    pool.clear();
+    const VideoFramePool::Stats before = pool.getStats();
+
+    qint64 generateTime = 0;
+    qint64 convertTime = 0;
+    qint64 encodeTime = 0;
+    qint64 previewTime = 0;
+
+    QElapsedTimer timer;
+    QElapsedTimer wall;
+    const std::clock_t cpuStart = std::clock();
+    wall.start();
+
+    for (int i = 0; i < PIPELINE_FRAMES; ++i) {
+        timer.start();
+        source.generateFrame();
+        generateTime += timer.nsecsElapsed();
+
+        timer.start();
+        const ToxYUVFrame yuv = frame->toToxYUVFrame();
+        convertTime += timer.nsecsElapsed();
+        QVERIFY(yuv);
+
+        timer.start();
+        encoder.encode(yuv);
+        encodeTime += timer.nsecsElapsed();
+
+        timer.start();
+        frame->toQImage(PREVIEW_SIZE).convertToFormat(QImage::Format_RGB32);
+        previewTime += timer.nsecsElapsed();
+    }
+
+    const qint64 elapsed = wall.nsecsElapsed();
+    const double cpu = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    frame.reset();
+
+    const VideoFramePool::Stats after = pool.getStats();
+    const double toMs = 1e-6 / PIPELINE_FRAMES;
+    const double fps = PIPELINE_FRAMES * 1e9 / elapsed;
+
+    qDebug().nospace() << fps << " fps, per frame: generate " << generateTime * toMs
+                       << "ms, convert " << convertTime * toMs << "ms, encode "
+                       << encodeTime * toMs << "ms, preview " << previewTime * toMs << "ms; "
+                       << static_cast<double>(after.misses - before.misses) / PIPELINE_FRAMES
+                       << " pool allocations per frame; CPU " << cpu * 1e11 / elapsed << "%";
+
+    QTest::setBenchmarkResult(fps, QTest::FramesPerSecond);
+}
+
+QTEST_GUILESS_MAIN(BenchVideoPipeline)
+#include "videopipeline_bench.moc"